@@ -0,0 +1,109 @@
+/**
+ * @file app_policy.c
+ * @brief Implementation of the frontmost-application policy and its cache.
+ */
+
+#include "app_policy.h"
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief Configures the policy from a mode and a comma-separated app list.
+ *
+ * Whitespace around entries is ignored; entries beyond
+ * KB_APP_POLICY_MAX_APPS or longer than KB_APP_POLICY_ID_MAX are dropped.
+ */
+void app_policy_configure(kb_app_policy_t *policy, kb_app_mode_t mode, const char *apps) {
+    policy->mode = mode;
+    policy->count = 0;
+
+    const char *p = apps;
+    while (p && *p && policy->count < KB_APP_POLICY_MAX_APPS) {
+        const char *end = strchr(p, ',');
+        if (!end) end = p + strlen(p);
+
+        const char *first = p;
+        const char *last = end;
+        while (first < last && (*first == ' ' || *first == '\t')) first++;
+        while (last > first && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r')) last--;
+
+        size_t len = (size_t)(last - first);
+        if (len > 0 && len < KB_APP_POLICY_ID_MAX) {
+            memcpy(policy->apps[policy->count], first, len);
+            policy->apps[policy->count][len] = '\0';
+            policy->count++;
+        }
+        p = *end ? end + 1 : end;
+    }
+
+    atomic_store_explicit(&policy->current, app_policy_resolve(policy, NULL), memory_order_relaxed);
+}
+
+/**
+ * @brief Resolves the verdict for an application without touching the cache.
+ */
+kb_app_verdict_t app_policy_resolve(const kb_app_policy_t *policy, const char *bundle_id) {
+    if (policy->mode == KB_APP_MODE_OFF) return KB_APP_POLICY_BLOCK;
+
+    bool listed = false;
+    for (int i = 0; bundle_id && i < policy->count; i++) {
+        if (strcmp(policy->apps[i], bundle_id) == 0) {
+            listed = true;
+            break;
+        }
+    }
+
+    if (policy->mode == KB_APP_MODE_ONLY) {
+        return listed ? KB_APP_POLICY_BLOCK : KB_APP_POLICY_EXEMPT;
+    }
+    return listed ? KB_APP_POLICY_EXEMPT : KB_APP_POLICY_BLOCK;
+}
+
+/**
+ * @brief Resolves and caches the verdict for a newly activated application.
+ */
+void app_policy_activate(kb_app_policy_t *policy, const char *bundle_id) {
+    atomic_store_explicit(&policy->current, app_policy_resolve(policy, bundle_id), memory_order_relaxed);
+}
+
+/**
+ * @brief Writes the application list back as a comma-separated string.
+ */
+void app_policy_format_apps(const kb_app_policy_t *policy, char *buffer, size_t size) {
+    if (!buffer || size == 0) return;
+    buffer[0] = '\0';
+    size_t used = 0;
+    for (int i = 0; i < policy->count; i++) {
+        int n = snprintf(buffer + used, size - used, "%s%s", i ? "," : "", policy->apps[i]);
+        if (n < 0 || (size_t)n >= size - used) break;
+        used += (size_t)n;
+    }
+}
+
+/**
+ * @brief Returns the settings name of a mode.
+ */
+const char *app_policy_mode_name(kb_app_mode_t mode) {
+    switch (mode) {
+        case KB_APP_MODE_ONLY: return "only";
+        case KB_APP_MODE_EXCEPT: return "except";
+        default: return "off";
+    }
+}
+
+/**
+ * @brief Parses a mode name as written in settings.conf.
+ */
+bool app_policy_parse_mode(const char *name, kb_app_mode_t *mode) {
+    if (!name || !mode) return false;
+    if (strcmp(name, "off") == 0) {
+        *mode = KB_APP_MODE_OFF;
+    } else if (strcmp(name, "only") == 0) {
+        *mode = KB_APP_MODE_ONLY;
+    } else if (strcmp(name, "except") == 0) {
+        *mode = KB_APP_MODE_EXCEPT;
+    } else {
+        return false;
+    }
+    return true;
+}
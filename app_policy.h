@@ -0,0 +1,114 @@
+/**
+ * @file app_policy.h
+ * @brief Frontmost-application blocking policy with an asynchronously
+ * updated cache.
+ *
+ * The list of applications is resolved against the frontmost application
+ * only when the system reports an activation. The result is cached in an
+ * atomic so the event tap performs a single load per event.
+ */
+
+#ifndef APP_POLICY_H
+#define APP_POLICY_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/** @brief Maximum number of applications in the policy list. */
+#define KB_APP_POLICY_MAX_APPS 32
+
+/** @brief Maximum length of a bundle identifier, including the terminator. */
+#define KB_APP_POLICY_ID_MAX 128
+
+/**
+ * @brief How the application list restricts blocking.
+ */
+typedef enum {
+    KB_APP_MODE_OFF = 0,    /**< Blocking applies regardless of the frontmost app */
+    KB_APP_MODE_ONLY,       /**< Blocking applies only while a listed app is frontmost */
+    KB_APP_MODE_EXCEPT      /**< Blocking applies unless a listed app is frontmost */
+} kb_app_mode_t;
+
+/**
+ * @brief Policy resolved for the current frontmost application.
+ */
+typedef enum {
+    KB_APP_POLICY_BLOCK = 0,    /**< Blocking applies */
+    KB_APP_POLICY_EXEMPT        /**< Events pass while this app is frontmost */
+} kb_app_verdict_t;
+
+/**
+ * @brief Application list and cached verdict for the frontmost app.
+ */
+typedef struct {
+    kb_app_mode_t mode;                                     /**< List semantics */
+    int count;                                              /**< Number of listed apps */
+    char apps[KB_APP_POLICY_MAX_APPS][KB_APP_POLICY_ID_MAX]; /**< Listed bundle identifiers */
+    atomic_int current;                                     /**< Cached kb_app_verdict_t */
+} kb_app_policy_t;
+
+/**
+ * @brief Configures the policy from a mode and a comma-separated app list.
+ *
+ * The cached verdict is reset as if no application were frontmost.
+ *
+ * @param policy Policy to configure.
+ * @param mode List semantics.
+ * @param apps Comma-separated bundle identifiers, or NULL for none.
+ */
+void app_policy_configure(kb_app_policy_t *policy, kb_app_mode_t mode, const char *apps);
+
+/**
+ * @brief Notification sink: resolves and caches the verdict for a newly
+ * activated application.
+ *
+ * Any activation source (NSWorkspace, a test driver) feeds this function.
+ *
+ * @param policy Policy to update.
+ * @param bundle_id Bundle identifier of the frontmost app, or NULL if unknown.
+ */
+void app_policy_activate(kb_app_policy_t *policy, const char *bundle_id);
+
+/**
+ * @brief Resolves the verdict for an application without touching the cache.
+ *
+ * @param policy Policy to consult.
+ * @param bundle_id Bundle identifier, or NULL if unknown.
+ * @return Verdict for the application.
+ */
+kb_app_verdict_t app_policy_resolve(const kb_app_policy_t *policy, const char *bundle_id);
+
+/**
+ * @brief Returns the cached verdict for the frontmost application.
+ *
+ * This is the only call made from the event tap.
+ */
+static inline kb_app_verdict_t app_policy_current(const kb_app_policy_t *policy) {
+    return (kb_app_verdict_t)atomic_load_explicit(&policy->current, memory_order_relaxed);
+}
+
+/**
+ * @brief Writes the application list back as a comma-separated string.
+ *
+ * @param policy Policy to format.
+ * @param buffer Output buffer.
+ * @param size Size of the buffer.
+ */
+void app_policy_format_apps(const kb_app_policy_t *policy, char *buffer, size_t size);
+
+/**
+ * @brief Returns the settings name of a mode.
+ */
+const char *app_policy_mode_name(kb_app_mode_t mode);
+
+/**
+ * @brief Parses a mode name as written in settings.conf.
+ *
+ * @param name Mode name ("off", "only" or "except").
+ * @param mode Output for the parsed mode.
+ * @return True if the name was recognized.
+ */
+bool app_policy_parse_mode(const char *name, kb_app_mode_t *mode);
+
+#endif
@@ -0,0 +1,62 @@
+/**
+ * @file arena.c
+ * @brief Implementation of the startup arena.
+ */
+
+#include "arena.h"
+#include <string.h>
+#include <sys/mman.h>
+
+/** @brief Offset of the first block, past the arena header. */
+#define ARENA_HEADER ((sizeof(kb_arena_t) + KB_ARENA_ALIGN - 1) & ~(size_t)(KB_ARENA_ALIGN - 1))
+
+/**
+ * @brief Maps an arena.
+ */
+kb_arena_t *arena_create(size_t size) {
+    size = (size + KB_ARENA_ALIGN - 1) & ~(size_t)(KB_ARENA_ALIGN - 1);
+    void *map = mmap(NULL, ARENA_HEADER + size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (map == MAP_FAILED) return NULL;
+
+    kb_arena_t *arena = (kb_arena_t *)map;
+    arena->size = size;
+    arena->used = 0;
+    return arena;
+}
+
+/**
+ * @brief Hands out a zeroed block.
+ *
+ * The mapping starts out zeroed; the memset is there to fault the pages in
+ * now rather than on first use.
+ */
+void *arena_alloc(kb_arena_t *arena, size_t size) {
+    size = (size + KB_ARENA_ALIGN - 1) & ~(size_t)(KB_ARENA_ALIGN - 1);
+    if (size > arena->size - arena->used) return NULL;
+
+    unsigned char *block = (unsigned char *)arena + ARENA_HEADER + arena->used;
+    arena->used += size;
+    memset(block, 0, size);
+    return block;
+}
+
+/**
+ * @brief Returns how much of the arena is in use.
+ */
+size_t arena_mark(const kb_arena_t *arena) {
+    return arena->used;
+}
+
+/**
+ * @brief Releases every block handed out since a mark was taken.
+ */
+void arena_rewind(kb_arena_t *arena, size_t mark) {
+    if (mark < arena->used) arena->used = mark;
+}
+
+/**
+ * @brief Unmaps an arena and every block taken from it.
+ */
+void arena_destroy(kb_arena_t *arena) {
+    if (arena) munmap(arena, ARENA_HEADER + arena->size);
+}
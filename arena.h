@@ -0,0 +1,69 @@
+/**
+ * @file arena.h
+ * @brief Fixed-size bump arena for memory acquired at startup.
+ *
+ * An instance takes everything it needs from one arena when it is created
+ * and gives it back all at once when it is destroyed, so nothing reaches
+ * the allocator while it captures. The arena is mapped up front; every
+ * block is zeroed when handed out, which also faults its pages in before
+ * the tap thread first touches them.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/** @brief Alignment of every block; one cache line. */
+#define KB_ARENA_ALIGN 64
+
+/**
+ * @brief Arena state, stored at the start of its own mapping.
+ */
+typedef struct {
+    size_t size;    /**< Bytes available for blocks */
+    size_t used;    /**< Bytes handed out, including padding */
+} kb_arena_t;
+
+/**
+ * @brief Maps an arena.
+ *
+ * @param size Bytes needed for blocks, before alignment padding.
+ * @return The arena, or NULL if it could not be mapped.
+ */
+kb_arena_t *arena_create(size_t size);
+
+/**
+ * @brief Hands out a zeroed block.
+ *
+ * @param arena Arena to take the block from.
+ * @param size Block size in bytes.
+ * @return The block, aligned to KB_ARENA_ALIGN, or NULL if the arena is full.
+ */
+void *arena_alloc(kb_arena_t *arena, size_t size);
+
+/**
+ * @brief Returns how much of the arena is in use, for arena_rewind().
+ *
+ * @param arena Arena to query.
+ * @return Bytes handed out so far.
+ */
+size_t arena_mark(const kb_arena_t *arena);
+
+/**
+ * @brief Releases every block handed out since a mark was taken. The
+ * blocks must no longer be in use.
+ *
+ * @param arena Arena to rewind.
+ * @param mark Value returned by arena_mark().
+ */
+void arena_rewind(kb_arena_t *arena, size_t mark);
+
+/**
+ * @brief Unmaps an arena and every block taken from it.
+ *
+ * @param arena Arena to release, may be NULL.
+ */
+void arena_destroy(kb_arena_t *arena);
+
+#endif
@@ -0,0 +1,249 @@
+/**
+ * @file batch.c
+ * @brief Implementation of batched decisions and the classification kernels.
+ */
+
+#include "batch.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BATCH_X86 1
+#endif
+
+static const char *const impl_names[KB_BATCH_IMPL_COUNT] = {
+    [KB_BATCH_SCALAR] = "scalar",
+    [KB_BATCH_SSE2] = "sse2",
+    [KB_BATCH_AVX2] = "avx2",
+};
+
+/**
+ * @brief Fills a batch from decoded events.
+ */
+void batch_from_events(kb_batch_t *batch, const kb_event_t *events, size_t count) {
+    if (count > KB_BATCH_MAX) count = KB_BATCH_MAX;
+    batch->count = count;
+    for (size_t i = 0; i < count; i++) {
+        batch->type[i] = (uint8_t)events[i].type;
+        batch->autorepeat[i] = events[i].autorepeat;
+        batch->key_code[i] = events[i].key_code;
+        batch->device[i] = events[i].device;
+        batch->flags[i] = events[i].flags;
+        batch->timestamp[i] = events[i].timestamp;
+    }
+}
+
+/**
+ * @brief Classifies events [first, batch->count) one at a time.
+ */
+static void classify_scalar(const kb_batch_t *batch, size_t first, unsigned long long shortcut_flags,
+                            unsigned short shortcut_key, kb_batch_masks_t *masks) {
+    for (size_t i = first; i < batch->count; i++) {
+        uint64_t bit = 1ULL << (i & 63);
+        bool down = batch->type[i] == KB_EVENT_KEY_DOWN;
+        if (down) masks->down[i >> 6] |= bit;
+        if (batch->type[i] == KB_EVENT_OTHER) masks->other[i >> 6] |= bit;
+        if (down && batch->key_code[i] == shortcut_key && batch->flags[i] == shortcut_flags) {
+            masks->shortcut[i >> 6] |= bit;
+        }
+    }
+}
+
+#ifdef BATCH_X86
+/**
+ * @brief Classifies 16 events per step.
+ *
+ * SSE2 has no 64-bit compare: flags compare as two 32-bit halves that must
+ * both match.
+ *
+ * @return Number of events classified; the rest is left to the scalar path.
+ */
+__attribute__((target("sse2"))) static size_t classify_sse2(const kb_batch_t *batch,
+                                                            unsigned long long shortcut_flags,
+                                                            unsigned short shortcut_key, kb_batch_masks_t *masks) {
+    const __m128i down_type = _mm_set1_epi8(KB_EVENT_KEY_DOWN);
+    const __m128i other_type = _mm_set1_epi8(KB_EVENT_OTHER);
+    const __m128i key = _mm_set1_epi16((short)shortcut_key);
+    const __m128i flags = _mm_set1_epi64x((long long)shortcut_flags);
+    size_t i = 0;
+
+    for (; i + 16 <= batch->count; i += 16) {
+        __m128i types = _mm_load_si128((const __m128i *)&batch->type[i]);
+        uint64_t down = (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(types, down_type));
+        uint64_t other = (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(types, other_type));
+
+        __m128i keys_lo = _mm_cmpeq_epi16(_mm_load_si128((const __m128i *)&batch->key_code[i]), key);
+        __m128i keys_hi = _mm_cmpeq_epi16(_mm_load_si128((const __m128i *)&batch->key_code[i + 8]), key);
+        uint64_t keys = (uint64_t)_mm_movemask_epi8(_mm_packs_epi16(keys_lo, keys_hi));
+
+        uint64_t flag_match = 0;
+        for (int p = 0; p < 8; p++) {
+            __m128i halves = _mm_cmpeq_epi32(_mm_load_si128((const __m128i *)&batch->flags[i + 2 * p]), flags);
+            __m128i both = _mm_and_si128(halves, _mm_shuffle_epi32(halves, _MM_SHUFFLE(2, 3, 0, 1)));
+            flag_match |= (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(both)) << (2 * p);
+        }
+
+        unsigned int shift = i & 63;
+        masks->down[i >> 6] |= down << shift;
+        masks->other[i >> 6] |= other << shift;
+        masks->shortcut[i >> 6] |= (down & keys & flag_match) << shift;
+    }
+    return i;
+}
+
+/**
+ * @brief Classifies 32 events per step.
+ *
+ * @return Number of events classified; the rest is left to the scalar path.
+ */
+__attribute__((target("avx2"))) static size_t classify_avx2(const kb_batch_t *batch,
+                                                            unsigned long long shortcut_flags,
+                                                            unsigned short shortcut_key, kb_batch_masks_t *masks) {
+    const __m256i down_type = _mm256_set1_epi8(KB_EVENT_KEY_DOWN);
+    const __m256i other_type = _mm256_set1_epi8(KB_EVENT_OTHER);
+    const __m256i key = _mm256_set1_epi16((short)shortcut_key);
+    const __m256i flags = _mm256_set1_epi64x((long long)shortcut_flags);
+    size_t i = 0;
+
+    for (; i + 32 <= batch->count; i += 32) {
+        __m256i types = _mm256_load_si256((const __m256i *)&batch->type[i]);
+        uint64_t down = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(types, down_type));
+        uint64_t other = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(types, other_type));
+
+        /* packs works within 128-bit lanes; the permute restores event order */
+        __m256i keys_lo = _mm256_cmpeq_epi16(_mm256_load_si256((const __m256i *)&batch->key_code[i]), key);
+        __m256i keys_hi = _mm256_cmpeq_epi16(_mm256_load_si256((const __m256i *)&batch->key_code[i + 16]), key);
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi16(keys_lo, keys_hi), _MM_SHUFFLE(3, 1, 2, 0));
+        uint64_t keys = (uint32_t)_mm256_movemask_epi8(packed);
+
+        uint64_t flag_match = 0;
+        for (int p = 0; p < 8; p++) {
+            __m256i equal = _mm256_cmpeq_epi64(_mm256_load_si256((const __m256i *)&batch->flags[i + 4 * p]), flags);
+            flag_match |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(equal)) << (4 * p);
+        }
+
+        unsigned int shift = i & 63;
+        masks->down[i >> 6] |= down << shift;
+        masks->other[i >> 6] |= other << shift;
+        masks->shortcut[i >> 6] |= (down & keys & flag_match) << shift;
+    }
+    return i;
+}
+#endif
+
+/**
+ * @brief Returns whether the CPU can run an implementation.
+ */
+bool batch_impl_available(kb_batch_impl_t impl) {
+    switch (impl) {
+        case KB_BATCH_SCALAR: return true;
+#ifdef BATCH_X86
+        case KB_BATCH_SSE2: return __builtin_cpu_supports("sse2");
+        case KB_BATCH_AVX2: return __builtin_cpu_supports("avx2");
+#endif
+        default: return false;
+    }
+}
+
+/**
+ * @brief Returns the fastest implementation the CPU can run.
+ */
+kb_batch_impl_t batch_best_impl(void) {
+    if (batch_impl_available(KB_BATCH_AVX2)) return KB_BATCH_AVX2;
+    if (batch_impl_available(KB_BATCH_SSE2)) return KB_BATCH_SSE2;
+    return KB_BATCH_SCALAR;
+}
+
+/**
+ * @brief Returns a short name for an implementation.
+ */
+const char *batch_impl_name(kb_batch_impl_t impl) {
+    return (unsigned int)impl < KB_BATCH_IMPL_COUNT ? impl_names[impl] : "unknown";
+}
+
+/**
+ * @brief Classifies every event of a batch.
+ */
+void batch_classify(kb_batch_impl_t impl, const kb_batch_t *batch, unsigned long long shortcut_flags,
+                    unsigned short shortcut_key, kb_batch_masks_t *masks) {
+    size_t done = 0;
+
+    memset(masks, 0, sizeof(*masks));
+#ifdef BATCH_X86
+    if (impl == KB_BATCH_AVX2) done = classify_avx2(batch, shortcut_flags, shortcut_key, masks);
+    if (impl == KB_BATCH_SSE2) done = classify_sse2(batch, shortcut_flags, shortcut_key, masks);
+#else
+    (void)impl;
+#endif
+    classify_scalar(batch, done, shortcut_flags, shortcut_key, masks);
+}
+
+/**
+ * @brief Decides every event of a batch.
+ *
+ * Per word of 64 events: shortcut hits and quarantined key downs come from
+ * the masks; with blocking off everything else passes in one fill, with
+ * blocking on non-key events pass and key events go through the policy.
+ */
+void batch_decide(const kb_engine_t *engine, kb_batch_impl_t impl, const kb_batch_t *batch, kb_verdict_t *verdicts,
+                  kb_reason_t *reasons) {
+    kb_event_t event;
+
+    if (engine->recording) {
+        for (size_t i = 0; i < batch->count; i++) {
+            batch_event(batch, i, &event);
+            verdicts[i] = engine_decide(engine, &event, &reasons[i]);
+        }
+        return;
+    }
+
+    kb_batch_masks_t masks;
+    batch_classify(impl, batch, engine->shortcut_flags, engine->shortcut_key_code, &masks);
+
+    bool any_quarantined = false;
+    for (size_t w = 0; w < KB_KEY_COUNT / 64; w++) any_quarantined |= engine->quarantined[w] != 0;
+
+    for (size_t base = 0; base < batch->count; base += 64) {
+        size_t w = base >> 6;
+        size_t n = batch->count - base < 64 ? batch->count - base : 64;
+        uint64_t unlock = engine->shortcut_enabled ? masks.shortcut[w] : 0;
+        uint64_t held = 0;
+
+        if (any_quarantined) {
+            for (uint64_t downs = masks.down[w] & ~unlock; downs; downs &= downs - 1) {
+                unsigned int j = (unsigned int)__builtin_ctzll(downs);
+                if (engine_key_quarantined(engine, batch->key_code[base + j])) held |= 1ULL << j;
+            }
+        }
+
+        if (!engine->enabled) {
+            for (size_t j = 0; j < n; j++) {
+                verdicts[base + j] = KB_VERDICT_PASS;
+                reasons[base + j] = KB_REASON_DISABLED;
+            }
+        } else {
+            for (size_t j = 0; j < n; j++) {
+                uint64_t bit = 1ULL << j;
+                if ((unlock | held) & bit) continue;
+                if (masks.other[w] & bit) {
+                    verdicts[base + j] = KB_VERDICT_PASS;
+                    reasons[base + j] = KB_REASON_NOT_A_KEY;
+                    continue;
+                }
+                batch_event(batch, base + j, &event);
+                verdicts[base + j] = engine_decide_policy(engine, engine->rules, &event, &reasons[base + j]);
+            }
+        }
+
+        for (; held; held &= held - 1) {
+            unsigned int j = (unsigned int)__builtin_ctzll(held);
+            verdicts[base + j] = KB_VERDICT_BLOCK;
+            reasons[base + j] = KB_REASON_QUARANTINED;
+        }
+        for (; unlock; unlock &= unlock - 1) {
+            unsigned int j = (unsigned int)__builtin_ctzll(unlock);
+            verdicts[base + j] = KB_VERDICT_UNLOCK;
+            reasons[base + j] = KB_REASON_SHORTCUT;
+        }
+    }
+}
@@ -0,0 +1,122 @@
+/**
+ * @file batch.h
+ * @brief Batched decisions over structure-of-arrays event batches.
+ *
+ * Sources that deliver many events at once (trace replay, offline analysis)
+ * can decide them as a batch. A classification kernel compares every event
+ * against the event type and emergency shortcut checks at the head of
+ * engine_decide and returns bit masks; the batch path then settles whole
+ * words of events from the masks and only runs the per-event policy
+ * (rules, allowed keys, device and application) for key events while
+ * blocking is active. Verdicts and reasons are identical to engine_decide.
+ *
+ * The kernel has a scalar version and, on x86, SSE2 and AVX2 versions; the
+ * best one the CPU supports is chosen at run time.
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "engine.h"
+
+/** @brief Maximum number of events in a batch; a multiple of 64. */
+#define KB_BATCH_MAX 4096
+
+/**
+ * @brief Classification kernel implementations.
+ */
+typedef enum {
+    KB_BATCH_SCALAR = 0,    /**< Portable C */
+    KB_BATCH_SSE2,          /**< 16 events per step, x86 */
+    KB_BATCH_AVX2,          /**< 32 events per step, x86 with AVX2 */
+    KB_BATCH_IMPL_COUNT
+} kb_batch_impl_t;
+
+/**
+ * @brief Events stored field by field so the kernel can load many at once.
+ */
+typedef struct {
+    size_t count;                                   /**< Number of events */
+    _Alignas(32) uint8_t type[KB_BATCH_MAX];        /**< kb_event_type_t */
+    _Alignas(32) uint8_t autorepeat[KB_BATCH_MAX];  /**< Auto-repeat flags */
+    _Alignas(32) uint16_t key_code[KB_BATCH_MAX];   /**< Key ids */
+    _Alignas(32) uint32_t device[KB_BATCH_MAX];     /**< Keyboard types */
+    _Alignas(32) uint64_t flags[KB_BATCH_MAX];      /**< Modifier flags */
+    _Alignas(32) uint64_t timestamp[KB_BATCH_MAX];  /**< Event times */
+} kb_batch_t;
+
+/**
+ * @brief Classification of a batch, one bit per event.
+ */
+typedef struct {
+    uint64_t down[KB_BATCH_MAX / 64];       /**< Key downs */
+    uint64_t other[KB_BATCH_MAX / 64];      /**< KB_EVENT_OTHER events */
+    uint64_t shortcut[KB_BATCH_MAX / 64];   /**< Key downs matching the shortcut key and flags */
+} kb_batch_masks_t;
+
+/**
+ * @brief Fills a batch from decoded events.
+ *
+ * @param batch Batch to fill.
+ * @param events Events.
+ * @param count Number of events (at most KB_BATCH_MAX are used).
+ */
+void batch_from_events(kb_batch_t *batch, const kb_event_t *events, size_t count);
+
+/**
+ * @brief Copies one event out of a batch.
+ */
+static inline void batch_event(const kb_batch_t *batch, size_t i, kb_event_t *event) {
+    event->type = (kb_event_type_t)batch->type[i];
+    event->key_code = batch->key_code[i];
+    event->flags = batch->flags[i];
+    event->device = batch->device[i];
+    event->timestamp = batch->timestamp[i];
+    event->autorepeat = batch->autorepeat[i] != 0;
+}
+
+/**
+ * @brief Returns whether the CPU can run an implementation.
+ */
+bool batch_impl_available(kb_batch_impl_t impl);
+
+/**
+ * @brief Returns the fastest implementation the CPU can run.
+ */
+kb_batch_impl_t batch_best_impl(void);
+
+/**
+ * @brief Returns a short name for an implementation.
+ */
+const char *batch_impl_name(kb_batch_impl_t impl);
+
+/**
+ * @brief Classifies every event of a batch.
+ *
+ * Mask bits beyond the batch count are cleared.
+ *
+ * @param impl Implementation to run; must be available.
+ * @param batch Events.
+ * @param shortcut_flags Shortcut modifier flags.
+ * @param shortcut_key Shortcut key id.
+ * @param masks Receives the masks.
+ */
+void batch_classify(kb_batch_impl_t impl, const kb_batch_t *batch, unsigned long long shortcut_flags,
+                    unsigned short shortcut_key, kb_batch_masks_t *masks);
+
+/**
+ * @brief Decides every event of a batch, as engine_decide would one by one.
+ *
+ * @param engine Engine state.
+ * @param impl Classification kernel to use; must be available.
+ * @param batch Events.
+ * @param verdicts Receives one verdict per event.
+ * @param reasons Receives one reason per event.
+ */
+void batch_decide(const kb_engine_t *engine, kb_batch_impl_t impl, const kb_batch_t *batch, kb_verdict_t *verdicts,
+                  kb_reason_t *reasons);
+
+#endif
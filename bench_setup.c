@@ -0,0 +1,68 @@
+/**
+ * @file bench_setup.c
+ * @brief Implementation of the engine configuration shared by the tools.
+ */
+
+#include "bench_setup.h"
+#include "logger.h"
+#include <stdio.h>
+#include <string.h>
+
+const char bench_default_rules[KB_BENCH_DEFAULT_RULES][KB_RULE_TEXT_MAX] = {
+    "pass if app == com.apple.Terminal and cmd and key == 48",
+    "block if since_unlock < 2000 and not (shift or alt)",
+    "pass if key >= 122 and key <= 126 and not repeat",
+    "block if device == 59 or (ctrl and up)",
+    "pass if key == volume_up or key == volume_down",
+};
+
+/**
+ * @brief Configures the engine and the reference model identically.
+ */
+size_t bench_setup_init(kb_bench_setup_t *setup, const char (*lines)[KB_RULE_TEXT_MAX], size_t count) {
+    kb_engine_t *engine = &setup->engine;
+
+    memset(engine, 0, sizeof(*engine));
+    engine->enabled = true;
+    engine->shortcut_enabled = true;
+    engine->shortcut_flags = 0x00160000ULL;
+    engine->shortcut_key_code = 40;
+    engine->device_default = KB_DEVICE_POLICY_BLOCK;
+    engine->device_policy[41] = KB_DEVICE_POLICY_ALLOW;
+    engine->device_policy[58] = KB_DEVICE_POLICY_BLOCK;
+    engine_quarantine_key(engine, 7);
+    engine_quarantine_key(engine, KB_KEY_MEDIA_BASE + 2);
+    engine->allowed[0] |= 1ULL << 53;
+    engine->allowed[1] |= 1ULL << (96 - 64);
+    /* An unlock early in every stream keeps since_unlock rules reachable */
+    engine->last_unlock = 1000000000ULL;
+    app_policy_configure(&engine->app_policy, KB_APP_MODE_EXCEPT, "com.apple.Safari,org.example.Editor");
+
+    size_t valid = 0;
+    for (size_t i = 0; i < count && valid < KB_RULES_MAX; i++) {
+        if (!engine_ref_rule_valid(lines[i])) {
+            log_message(KB_LOG_LEVEL_ERROR, "Skipping rule the reference model cannot parse: %s", lines[i]);
+            continue;
+        }
+        snprintf(setup->rule_lines[valid++], KB_RULE_TEXT_MAX, "%s", lines[i]);
+    }
+    if (rules_compile(&setup->rules, (const char (*)[KB_RULE_TEXT_MAX])setup->rule_lines, valid) != valid) {
+        log_message(KB_LOG_LEVEL_ERROR, "Some rules did not compile; verdicts will disagree.");
+    }
+    engine->rules = &setup->rules;
+
+    setup->model.engine = engine;
+    setup->model.rules = (const char (*)[KB_RULE_TEXT_MAX])setup->rule_lines;
+    setup->model.rule_count = valid;
+    setup->model.frontmost = NULL;
+    return valid;
+}
+
+/**
+ * @brief Makes an application frontmost for both the engine and the model.
+ */
+void bench_setup_activate(kb_bench_setup_t *setup, const char *bundle_id) {
+    app_policy_activate(&setup->engine.app_policy, bundle_id);
+    rules_activate(&setup->rules, bundle_id);
+    setup->model.frontmost = bundle_id;
+}
@@ -0,0 +1,57 @@
+/**
+ * @file bench_setup.h
+ * @brief Engine configuration shared by the offline tools.
+ *
+ * The tools decide events against a fixed, representative configuration:
+ * blocking on, an emergency shortcut, quarantined and allowed keys, device
+ * and application policies, and a rule set (the defaults below or rules
+ * given on the command line). The reference model is set up over the same
+ * state so its verdicts can be compared with the engine's.
+ */
+
+#ifndef BENCH_SETUP_H
+#define BENCH_SETUP_H
+
+#include <stddef.h>
+#include "engine.h"
+#include "engine_ref.h"
+#include "rules.h"
+
+/** @brief Number of rules in bench_default_rules. */
+#define KB_BENCH_DEFAULT_RULES 5
+
+/** @brief Rules used when none are given on the command line. */
+extern const char bench_default_rules[KB_BENCH_DEFAULT_RULES][KB_RULE_TEXT_MAX];
+
+/**
+ * @brief Engine, compiled rules and reference model over the same settings.
+ */
+typedef struct {
+    kb_engine_t engine;                             /**< Engine state, with engine.rules pointing at rules */
+    kb_rules_t rules;                               /**< Compiled rules */
+    char rule_lines[KB_RULES_MAX][KB_RULE_TEXT_MAX]; /**< Rule sources, shared with the model */
+    kb_ref_model_t model;                           /**< Reference model */
+} kb_bench_setup_t;
+
+/**
+ * @brief Configures the engine and the reference model identically.
+ *
+ * Rules the reference model cannot parse are logged and skipped.
+ *
+ * @param setup Setup to fill.
+ * @param lines Rule sources.
+ * @param count Number of rules.
+ * @return Number of rules in use.
+ */
+size_t bench_setup_init(kb_bench_setup_t *setup, const char (*lines)[KB_RULE_TEXT_MAX], size_t count);
+
+/**
+ * @brief Makes an application frontmost for both the engine and the model.
+ *
+ * @param setup Configured setup.
+ * @param bundle_id Bundle identifier, or NULL if unknown. Must outlive the
+ * setup.
+ */
+void bench_setup_activate(kb_bench_setup_t *setup, const char *bundle_id);
+
+#endif
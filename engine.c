@@ -0,0 +1,176 @@
+/**
+ * @file engine.c
+ * @brief Implementation of the platform-independent decision engine.
+ *
+ * The decision order mirrors the event tap: shortcut recording first, then
+ * the emergency shortcut, then quarantined keys, then blocking subject to
+ * the configured rules and the per-key, device and frontmost-application
+ * policies.
+ */
+
+#include "engine.h"
+#include "rules.h"
+#include <string.h>
+
+/**
+ * @brief Resolves the blocking policy for a keyboard device.
+ *
+ * A single table load; devices without an entry use the default policy.
+ *
+ * @param engine Engine state.
+ * @param device Keyboard type reported for the event.
+ * @return KB_DEVICE_POLICY_BLOCK or KB_DEVICE_POLICY_ALLOW.
+ */
+kb_device_policy_t engine_device_policy(const kb_engine_t *engine, unsigned int device) {
+    unsigned char policy = device < KB_DEVICE_TYPE_COUNT ? engine->device_policy[device]
+                                                         : KB_DEVICE_POLICY_INHERIT;
+    if (policy == KB_DEVICE_POLICY_INHERIT) policy = engine->device_default;
+    return policy == KB_DEVICE_POLICY_ALLOW ? KB_DEVICE_POLICY_ALLOW : KB_DEVICE_POLICY_BLOCK;
+}
+
+/**
+ * @brief Decides what to do with a keyboard event.
+ */
+kb_verdict_t engine_decide(const kb_engine_t *engine, const kb_event_t *event, kb_reason_t *reason) {
+    return engine_decide_with_rules(engine, engine->rules, event, reason);
+}
+
+/**
+ * @brief Decides what to do with a keyboard event under a given rule set.
+ */
+kb_verdict_t engine_decide_with_rules(const kb_engine_t *engine, const struct kb_rules *rules,
+                                      const kb_event_t *event, kb_reason_t *reason) {
+    kb_reason_t unused;
+    if (!reason) reason = &unused;
+
+    /* One-shot recording captures the next key press and never blocks */
+    if (engine->recording) {
+        *reason = KB_REASON_RECORDING;
+        return event->type == KB_EVENT_KEY_DOWN && event->key_code < KB_KEY_MEDIA_BASE ? KB_VERDICT_RECORD
+                                                                                     : KB_VERDICT_PASS;
+    }
+
+    /* Emergency shortcut */
+    if (engine->shortcut_enabled && event->type == KB_EVENT_KEY_DOWN &&
+        event->flags == engine->shortcut_flags && event->key_code == engine->shortcut_key_code) {
+        *reason = KB_REASON_SHORTCUT;
+        return KB_VERDICT_UNLOCK;
+    }
+
+    /* Releases always pass so a key quarantined mid-press is not left held down */
+    if (event->type == KB_EVENT_KEY_DOWN && engine_key_quarantined(engine, event->key_code)) {
+        *reason = KB_REASON_QUARANTINED;
+        return KB_VERDICT_BLOCK;
+    }
+
+    if (!engine->enabled) {
+        *reason = KB_REASON_DISABLED;
+        return KB_VERDICT_PASS;
+    }
+    if (event->type == KB_EVENT_OTHER) {
+        *reason = KB_REASON_NOT_A_KEY;
+        return KB_VERDICT_PASS;
+    }
+    return engine_decide_policy(engine, rules, event, reason);
+}
+
+/**
+ * @brief Decides a key event while blocking is active.
+ */
+kb_verdict_t engine_decide_policy(const kb_engine_t *engine, const struct kb_rules *rules, const kb_event_t *event,
+                                  kb_reason_t *reason) {
+    int ruled = rules_eval(rules, engine, event);
+    if (ruled != KB_RULES_NO_MATCH) {
+        *reason = KB_REASON_RULE;
+        return (kb_verdict_t)ruled;
+    }
+    if (engine_key_bit(engine->allowed, event->key_code)) {
+        *reason = KB_REASON_ALLOWED_KEY;
+        return KB_VERDICT_PASS;
+    }
+    if (engine_device_policy(engine, event->device) == KB_DEVICE_POLICY_ALLOW) {
+        *reason = KB_REASON_DEVICE;
+        return KB_VERDICT_PASS;
+    }
+    if (app_policy_current(&engine->app_policy) == KB_APP_POLICY_EXEMPT) {
+        *reason = KB_REASON_APP;
+        return KB_VERDICT_PASS;
+    }
+    *reason = KB_REASON_BLOCKING;
+    return KB_VERDICT_BLOCK;
+}
+
+/**
+ * @brief Returns a short name for an event type.
+ */
+const char *engine_event_type_name(kb_event_type_t type) {
+    switch (type) {
+        case KB_EVENT_KEY_DOWN: return "down";
+        case KB_EVENT_KEY_UP: return "up";
+        case KB_EVENT_FLAGS_CHANGED: return "flags";
+        case KB_EVENT_SYSTEM_DEFINED: return "system";
+        case KB_EVENT_OTHER: return "other";
+        default: return "unknown";
+    }
+}
+
+/**
+ * @brief Returns a short name for a verdict.
+ */
+const char *engine_verdict_name(kb_verdict_t verdict) {
+    switch (verdict) {
+        case KB_VERDICT_PASS: return "pass";
+        case KB_VERDICT_BLOCK: return "block";
+        case KB_VERDICT_UNLOCK: return "unlock";
+        case KB_VERDICT_RECORD: return "record";
+        default: return "unknown";
+    }
+}
+
+/**
+ * @brief Returns a short name for a reason.
+ */
+const char *engine_reason_name(kb_reason_t reason) {
+    static const char *const names[KB_REASON_COUNT] = {
+        [KB_REASON_RECORDING] = "recording",
+        [KB_REASON_SHORTCUT] = "shortcut",
+        [KB_REASON_QUARANTINED] = "quarantined",
+        [KB_REASON_DISABLED] = "disabled",
+        [KB_REASON_NOT_A_KEY] = "not_a_key",
+        [KB_REASON_RULE] = "rule",
+        [KB_REASON_ALLOWED_KEY] = "allowed_key",
+        [KB_REASON_DEVICE] = "device",
+        [KB_REASON_APP] = "app",
+        [KB_REASON_BLOCKING] = "blocking",
+        [KB_REASON_PLUGIN] = "plugin",
+    };
+    return (unsigned int)reason < KB_REASON_COUNT ? names[reason] : "unknown";
+}
+
+/**
+ * @brief Returns the settings name of a device policy.
+ */
+const char *engine_device_policy_name(kb_device_policy_t policy) {
+    switch (policy) {
+        case KB_DEVICE_POLICY_BLOCK: return "block";
+        case KB_DEVICE_POLICY_ALLOW: return "allow";
+        default: return "inherit";
+    }
+}
+
+/**
+ * @brief Parses a device policy name as written in settings.conf.
+ */
+bool engine_parse_device_policy(const char *name, kb_device_policy_t *policy) {
+    if (!name || !policy) return false;
+    if (strcmp(name, "inherit") == 0) {
+        *policy = KB_DEVICE_POLICY_INHERIT;
+    } else if (strcmp(name, "block") == 0) {
+        *policy = KB_DEVICE_POLICY_BLOCK;
+    } else if (strcmp(name, "allow") == 0) {
+        *policy = KB_DEVICE_POLICY_ALLOW;
+    } else {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,226 @@
+/**
+ * @file engine.h
+ * @brief Platform-independent decision engine for keyboard events.
+ *
+ * The event tap decodes every native event once into a kb_event_t and asks
+ * the engine for a verdict. The engine holds no CoreGraphics types, so the
+ * same decision logic can be driven by any capture backend.
+ */
+
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "app_policy.h"
+
+/**
+ * @brief Number of distinct keyboard types tracked by the device table.
+ *
+ * Keyboard types reported by the system outside this range fall back to the
+ * default device policy.
+ */
+#define KB_DEVICE_TYPE_COUNT 256
+
+/**
+ * @brief Size of the internal key id space.
+ *
+ * Hardware key codes occupy the low ids; per-key state (quarantine, policy)
+ * is indexed by key id.
+ */
+#define KB_KEY_COUNT 256
+
+/** @brief First key id used for media/system keys (volume, brightness, ...). */
+#define KB_KEY_MEDIA_BASE 0x80
+
+/** @brief Key id of events that carry no key. */
+#define KB_KEY_NONE 0xFFFF
+
+/**
+ * @brief Kinds of keyboard events understood by the engine.
+ */
+typedef enum {
+    KB_EVENT_KEY_DOWN = 0,      /**< Key pressed */
+    KB_EVENT_KEY_UP,            /**< Key released */
+    KB_EVENT_FLAGS_CHANGED,     /**< Modifier key pressed or released */
+    KB_EVENT_SYSTEM_DEFINED,    /**< Media/system key event */
+    KB_EVENT_OTHER,             /**< Anything else; never blocked */
+    KB_EVENT_TYPE_COUNT
+} kb_event_type_t;
+
+/**
+ * @brief A decoded keyboard event.
+ */
+typedef struct {
+    kb_event_type_t type;       /**< Event kind */
+    unsigned short key_code;    /**< Key id: hardware key code or media key, KB_KEY_NONE if none */
+    unsigned long long flags;   /**< Modifier flags (Command, Shift, Option, Control only) */
+    unsigned int device;        /**< Keyboard type of the originating device */
+    uint64_t timestamp;         /**< Event time in nanoseconds */
+    bool autorepeat;            /**< Key down generated by auto-repeat */
+} kb_event_t;
+
+/**
+ * @brief Decisions returned by the engine.
+ */
+typedef enum {
+    KB_VERDICT_PASS = 0,        /**< Deliver the event */
+    KB_VERDICT_BLOCK,           /**< Suppress the event */
+    KB_VERDICT_UNLOCK,          /**< Emergency shortcut hit: deliver and stop blocking */
+    KB_VERDICT_RECORD,          /**< Deliver and record the event as the new shortcut */
+    KB_VERDICT_COUNT
+} kb_verdict_t;
+
+/**
+ * @brief Why the engine reached its verdict.
+ */
+typedef enum {
+    KB_REASON_RECORDING = 0,    /**< Recording a shortcut */
+    KB_REASON_SHORTCUT,         /**< Emergency shortcut matched */
+    KB_REASON_QUARANTINED,      /**< Key is quarantined */
+    KB_REASON_DISABLED,         /**< Blocking is off */
+    KB_REASON_NOT_A_KEY,        /**< Event carries no key */
+    KB_REASON_RULE,             /**< A configured rule matched */
+    KB_REASON_ALLOWED_KEY,      /**< Key is in the allowed list */
+    KB_REASON_DEVICE,           /**< Device policy allows the keyboard */
+    KB_REASON_APP,              /**< Frontmost application is exempt */
+    KB_REASON_BLOCKING,         /**< Blocking applies */
+    KB_REASON_PLUGIN,           /**< A filter plugin overrode the verdict */
+    KB_REASON_COUNT
+} kb_reason_t;
+
+/**
+ * @brief Blocking policy for a keyboard device.
+ */
+typedef enum {
+    KB_DEVICE_POLICY_INHERIT = 0,   /**< Use the default device policy */
+    KB_DEVICE_POLICY_BLOCK,         /**< Block the device while blocking is active */
+    KB_DEVICE_POLICY_ALLOW          /**< Never block the device */
+} kb_device_policy_t;
+
+struct kb_rules;
+
+/**
+ * @brief Decision state consulted for every event.
+ */
+typedef struct {
+    bool enabled;                           /**< Whether blocking is active */
+    bool shortcut_enabled;                  /**< Whether the emergency shortcut is active */
+    bool recording;                         /**< Whether recording a new shortcut */
+    unsigned long long shortcut_flags;      /**< Modifier flags for shortcut */
+    unsigned short shortcut_key_code;       /**< Key code for shortcut */
+    unsigned char device_default;           /**< Policy for devices without an entry */
+    unsigned char device_policy[KB_DEVICE_TYPE_COUNT]; /**< Per-device policy, indexed by keyboard type */
+    kb_app_policy_t app_policy;             /**< Frontmost-application policy and cached verdict */
+    uint64_t quarantined[KB_KEY_COUNT / 64]; /**< Keys blocked regardless of the blocking state */
+    uint64_t allowed[KB_KEY_COUNT / 64];    /**< Keys that pass while blocking is active */
+    const struct kb_rules *rules;           /**< Compiled rules tried before the built-in policies, may be NULL */
+    uint64_t last_unlock;                   /**< Timestamp of the last emergency shortcut, 0 if none */
+} kb_engine_t;
+
+/**
+ * @brief Tests a key id in a per-key bitmap.
+ */
+static inline bool engine_key_bit(const uint64_t *bitmap, unsigned int key) {
+    return key < KB_KEY_COUNT && ((bitmap[key >> 6] >> (key & 63)) & 1);
+}
+
+/**
+ * @brief Returns whether a key is quarantined.
+ */
+static inline bool engine_key_quarantined(const kb_engine_t *engine, unsigned int key) {
+    return engine_key_bit(engine->quarantined, key);
+}
+
+/**
+ * @brief Quarantines a key: its presses are blocked until cleared.
+ */
+static inline void engine_quarantine_key(kb_engine_t *engine, unsigned int key) {
+    if (key < KB_KEY_COUNT) engine->quarantined[key >> 6] |= 1ULL << (key & 63);
+}
+
+/**
+ * @brief Resolves the blocking policy for a keyboard device.
+ *
+ * @param engine Engine state.
+ * @param device Keyboard type reported for the event.
+ * @return KB_DEVICE_POLICY_BLOCK or KB_DEVICE_POLICY_ALLOW.
+ */
+kb_device_policy_t engine_device_policy(const kb_engine_t *engine, unsigned int device);
+
+/**
+ * @brief Decides what to do with a keyboard event.
+ *
+ * @param engine Engine state.
+ * @param event Decoded event.
+ * @param reason Receives why the verdict was reached, may be NULL.
+ * @return Verdict for the event.
+ */
+kb_verdict_t engine_decide(const kb_engine_t *engine, const kb_event_t *event, kb_reason_t *reason);
+
+/**
+ * @brief Decides what to do with a keyboard event, trying another rule set
+ * in place of the engine's own.
+ *
+ * Used to evaluate a candidate policy against live state.
+ *
+ * @param engine Engine state.
+ * @param rules Rule set to try, may be NULL.
+ * @param event Decoded event.
+ * @param reason Receives why the verdict was reached, may be NULL.
+ * @return Verdict for the event.
+ */
+kb_verdict_t engine_decide_with_rules(const kb_engine_t *engine, const struct kb_rules *rules,
+                                      const kb_event_t *event, kb_reason_t *reason);
+
+/**
+ * @brief Decides a key event once the earlier checks have let it through:
+ * not recording, not the shortcut, not a quarantined key, blocking active
+ * and the event not KB_EVENT_OTHER.
+ *
+ * Tries the rules, then the allowed keys, device and application policies.
+ * Used by batch paths that settle the earlier checks for many events at
+ * once.
+ *
+ * @param engine Engine state.
+ * @param rules Rule set to try, may be NULL.
+ * @param event Decoded event.
+ * @param reason Receives why the verdict was reached.
+ * @return KB_VERDICT_PASS or KB_VERDICT_BLOCK.
+ */
+kb_verdict_t engine_decide_policy(const kb_engine_t *engine, const struct kb_rules *rules, const kb_event_t *event,
+                                  kb_reason_t *reason);
+
+/**
+ * @brief Returns a short name for an event type, for logs and dumps.
+ */
+const char *engine_event_type_name(kb_event_type_t type);
+
+/**
+ * @brief Returns a short name for a verdict, for logs and dumps.
+ */
+const char *engine_verdict_name(kb_verdict_t verdict);
+
+/**
+ * @brief Returns a short name for a reason, for logs and dumps.
+ */
+const char *engine_reason_name(kb_reason_t reason);
+
+/**
+ * @brief Returns the settings name of a device policy.
+ *
+ * @param policy Policy value.
+ * @return "inherit", "block" or "allow".
+ */
+const char *engine_device_policy_name(kb_device_policy_t policy);
+
+/**
+ * @brief Parses a device policy name as written in settings.conf.
+ *
+ * @param name Policy name ("inherit", "block" or "allow").
+ * @param policy Output for the parsed policy.
+ * @return True if the name was recognized.
+ */
+bool engine_parse_device_policy(const char *name, kb_device_policy_t *policy);
+
+#endif
@@ -0,0 +1,295 @@
+/**
+ * @file engine_ref.c
+ * @brief Implementation of the reference decision model.
+ *
+ * Rules are evaluated while parsing: every sub-condition is evaluated in
+ * full (no short-circuiting) and combined with plain C operators.
+ */
+
+#include "engine_ref.h"
+#include "media_keys.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Evaluation state for one rule line.
+ */
+typedef struct {
+    const char *p;                  /**< Cursor into the rule text */
+    const kb_ref_model_t *model;    /**< Model (for the engine and the frontmost app) */
+    const kb_event_t *event;        /**< Event being decided, NULL when only validating */
+    bool ok;                        /**< False once the text failed to parse */
+} ref_parser_t;
+
+/**
+ * @brief Reads the next token into buffer; returns false at the end of the
+ * text.
+ */
+static bool ref_token(ref_parser_t *r, char *buffer, size_t size) {
+    while (*r->p == ' ' || *r->p == '\t' || *r->p == '\r' || *r->p == '\n') r->p++;
+    if (!*r->p) return false;
+
+    size_t n = 0;
+    if (*r->p == '(' || *r->p == ')') {
+        buffer[n++] = *r->p++;
+    } else if (*r->p == '=' || *r->p == '!' || *r->p == '<' || *r->p == '>') {
+        buffer[n++] = *r->p++;
+        if (*r->p == '=') buffer[n++] = *r->p++;
+    } else if (*r->p == '"') {
+        r->p++;
+        while (*r->p && *r->p != '"') {
+            if (n + 1 < size) buffer[n++] = *r->p;
+            r->p++;
+        }
+        if (*r->p == '"') r->p++;
+    } else {
+        while (*r->p && !strchr(" \t\r\n()=!<>\"", *r->p)) {
+            if (n + 1 < size) buffer[n++] = *r->p;
+            r->p++;
+        }
+    }
+    buffer[n] = '\0';
+    return true;
+}
+
+/**
+ * @brief Returns the next token without consuming it.
+ */
+static bool ref_peek(ref_parser_t *r, char *buffer, size_t size) {
+    const char *saved = r->p;
+    bool found = ref_token(r, buffer, size);
+    r->p = saved;
+    return found;
+}
+
+/**
+ * @brief Modifier bit for a modifier word, 0 if the word is not one.
+ */
+static unsigned long long ref_modifier(const char *word) {
+    if (strcmp(word, "shift") == 0) return 0x00020000ULL;
+    if (strcmp(word, "ctrl") == 0) return 0x00040000ULL;
+    if (strcmp(word, "alt") == 0) return 0x00080000ULL;
+    if (strcmp(word, "cmd") == 0) return 0x00100000ULL;
+    return 0;
+}
+
+/**
+ * @brief Parses "<op> <value>" and compares a left-hand value with it.
+ */
+static bool ref_compare(ref_parser_t *r, int64_t left, bool key) {
+    char op[KB_RULE_TEXT_MAX], text[KB_RULE_TEXT_MAX];
+    if (!ref_token(r, op, sizeof(op)) || !ref_token(r, text, sizeof(text))) {
+        r->ok = false;
+        return false;
+    }
+
+    int64_t right;
+    if (key) {
+        unsigned int value;
+        if (!media_key_parse(text, &value)) r->ok = false;
+        right = r->ok ? value : 0;
+    } else {
+        char *end;
+        unsigned long value = strtoul(text, &end, 0);
+        if (end == text || *end || value > UINT32_MAX) r->ok = false;
+        right = (int64_t)value;
+    }
+
+    if (strcmp(op, "==") == 0) return left == right;
+    if (strcmp(op, "!=") == 0) return left != right;
+    if (strcmp(op, "<") == 0) return left < right;
+    if (strcmp(op, "<=") == 0) return left <= right;
+    if (strcmp(op, ">") == 0) return left > right;
+    if (strcmp(op, ">=") == 0) return left >= right;
+    r->ok = false;
+    return false;
+}
+
+static bool ref_or(ref_parser_t *r);
+
+/**
+ * @brief Evaluates an atom, a negation or a parenthesized condition.
+ */
+static bool ref_unary(ref_parser_t *r) {
+    static const kb_event_t none = {KB_EVENT_OTHER, KB_KEY_NONE, 0, 0, 0, false};
+    const kb_event_t *ev = r->event ? r->event : &none;
+    const kb_engine_t *engine = r->model ? r->model->engine : NULL;
+    char word[KB_RULE_TEXT_MAX];
+    if (!ref_token(r, word, sizeof(word))) {
+        r->ok = false;
+        return false;
+    }
+
+    if (strcmp(word, "not") == 0) return !ref_unary(r);
+    if (strcmp(word, "(") == 0) {
+        bool value = ref_or(r);
+        if (!ref_token(r, word, sizeof(word)) || strcmp(word, ")") != 0) r->ok = false;
+        return value;
+    }
+    if (strcmp(word, "key") == 0) return ref_compare(r, ev->key_code, true);
+    if (strcmp(word, "device") == 0) return ref_compare(r, ev->device, false);
+    if (strcmp(word, "since_unlock") == 0) {
+        int64_t since = UINT32_MAX;
+        if (engine && engine->last_unlock && ev->timestamp >= engine->last_unlock) {
+            since = (int64_t)((ev->timestamp - engine->last_unlock) / 1000000ULL);
+        }
+        return ref_compare(r, since, false);
+    }
+    if (strcmp(word, "app") == 0) {
+        char op[KB_RULE_TEXT_MAX], id[KB_RULE_TEXT_MAX];
+        if (!ref_token(r, op, sizeof(op)) || !ref_token(r, id, sizeof(id)) ||
+            (strcmp(op, "==") != 0 && strcmp(op, "!=") != 0)) {
+            r->ok = false;
+            return false;
+        }
+        const char *frontmost = r->model ? r->model->frontmost : NULL;
+        bool same = frontmost && strcmp(frontmost, id) == 0;
+        return strcmp(op, "==") == 0 ? same : !same;
+    }
+    if (ref_modifier(word)) return (ev->flags & ref_modifier(word)) != 0;
+    if (strcmp(word, "down") == 0) return ev->type == KB_EVENT_KEY_DOWN;
+    if (strcmp(word, "up") == 0) return ev->type == KB_EVENT_KEY_UP;
+    if (strcmp(word, "repeat") == 0) return ev->autorepeat;
+    r->ok = false;
+    return false;
+}
+
+/**
+ * @brief Evaluates conditions joined by "and".
+ */
+static bool ref_and(ref_parser_t *r) {
+    char word[KB_RULE_TEXT_MAX];
+    bool value = ref_unary(r);
+    while (r->ok && ref_peek(r, word, sizeof(word)) && strcmp(word, "and") == 0) {
+        ref_token(r, word, sizeof(word));
+        bool right = ref_unary(r);
+        value = value && right;
+    }
+    return value;
+}
+
+/**
+ * @brief Evaluates conditions joined by "or".
+ */
+static bool ref_or(ref_parser_t *r) {
+    char word[KB_RULE_TEXT_MAX];
+    bool value = ref_and(r);
+    while (r->ok && ref_peek(r, word, sizeof(word)) && strcmp(word, "or") == 0) {
+        ref_token(r, word, sizeof(word));
+        bool right = ref_and(r);
+        value = value || right;
+    }
+    return value;
+}
+
+/**
+ * @brief Evaluates one rule line.
+ *
+ * @param verdict Receives the rule's verdict.
+ * @param matched Receives whether the condition holds.
+ * @return false if the line does not parse.
+ */
+static bool ref_rule(const kb_ref_model_t *model, const kb_event_t *event, const char *line, kb_verdict_t *verdict,
+                     bool *matched) {
+    ref_parser_t r = {line, model, event, true};
+    char word[KB_RULE_TEXT_MAX];
+    if (!ref_token(&r, word, sizeof(word))) return false;
+    if (strcmp(word, "block") == 0) {
+        *verdict = KB_VERDICT_BLOCK;
+    } else if (strcmp(word, "pass") == 0) {
+        *verdict = KB_VERDICT_PASS;
+    } else {
+        return false;
+    }
+
+    *matched = true;
+    if (ref_peek(&r, word, sizeof(word))) {
+        ref_token(&r, word, sizeof(word));
+        if (strcmp(word, "if") != 0) return false;
+        *matched = ref_or(&r);
+    }
+    return r.ok && !ref_token(&r, word, sizeof(word));
+}
+
+/**
+ * @brief Checks whether a rule line is valid in the reference grammar.
+ */
+bool engine_ref_rule_valid(const char *line) {
+    kb_verdict_t verdict;
+    bool matched;
+    return ref_rule(NULL, NULL, line, &verdict, &matched);
+}
+
+/**
+ * @brief Tests a key in a per-key set, reading it one bit at a time.
+ */
+static bool ref_key_in(const uint64_t *set, unsigned int key) {
+    if (key >= KB_KEY_COUNT) return false;
+    uint64_t word = set[key / 64];
+    for (unsigned int bit = 0; bit < key % 64; bit++) word >>= 1;
+    return (word & 1) != 0;
+}
+
+/**
+ * @brief Decides an event the slow way, in the documented decision order.
+ */
+kb_verdict_t engine_ref_decide(const kb_ref_model_t *model, const kb_event_t *event, kb_reason_t *reason) {
+    const kb_engine_t *engine = model->engine;
+    kb_reason_t unused;
+    if (!reason) reason = &unused;
+
+    if (engine->recording) {
+        *reason = KB_REASON_RECORDING;
+        if (event->type == KB_EVENT_KEY_DOWN && event->key_code < KB_KEY_MEDIA_BASE) return KB_VERDICT_RECORD;
+        return KB_VERDICT_PASS;
+    }
+    if (engine->shortcut_enabled && event->type == KB_EVENT_KEY_DOWN && event->flags == engine->shortcut_flags &&
+        event->key_code == engine->shortcut_key_code) {
+        *reason = KB_REASON_SHORTCUT;
+        return KB_VERDICT_UNLOCK;
+    }
+    if (event->type == KB_EVENT_KEY_DOWN && ref_key_in(engine->quarantined, event->key_code)) {
+        *reason = KB_REASON_QUARANTINED;
+        return KB_VERDICT_BLOCK;
+    }
+    if (!engine->enabled) {
+        *reason = KB_REASON_DISABLED;
+        return KB_VERDICT_PASS;
+    }
+    if (event->type == KB_EVENT_OTHER) {
+        *reason = KB_REASON_NOT_A_KEY;
+        return KB_VERDICT_PASS;
+    }
+
+    size_t valid = 0;
+    for (size_t i = 0; i < model->rule_count && valid < KB_RULES_MAX; i++) {
+        kb_verdict_t verdict;
+        bool matched;
+        if (!ref_rule(model, event, model->rules[i], &verdict, &matched)) continue;
+        valid++;
+        if (matched) {
+            *reason = KB_REASON_RULE;
+            return verdict;
+        }
+    }
+
+    if (ref_key_in(engine->allowed, event->key_code)) {
+        *reason = KB_REASON_ALLOWED_KEY;
+        return KB_VERDICT_PASS;
+    }
+
+    unsigned char device = KB_DEVICE_POLICY_INHERIT;
+    if (event->device < KB_DEVICE_TYPE_COUNT) device = engine->device_policy[event->device];
+    if (device == KB_DEVICE_POLICY_INHERIT) device = engine->device_default;
+    if (device == KB_DEVICE_POLICY_ALLOW) {
+        *reason = KB_REASON_DEVICE;
+        return KB_VERDICT_PASS;
+    }
+
+    if (app_policy_resolve(&engine->app_policy, model->frontmost) == KB_APP_POLICY_EXEMPT) {
+        *reason = KB_REASON_APP;
+        return KB_VERDICT_PASS;
+    }
+    *reason = KB_REASON_BLOCKING;
+    return KB_VERDICT_BLOCK;
+}
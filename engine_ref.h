@@ -0,0 +1,51 @@
+/**
+ * @file engine_ref.h
+ * @brief Reference model of the decision engine.
+ *
+ * A deliberately slow, direct transcription of the decision order, used to
+ * check the optimized engine: rules are interpreted from their source text
+ * on every event instead of running compiled bytecode, per-key sets are
+ * read one bit at a time, and the application policy is resolved from the
+ * frontmost bundle identifier instead of the cached verdict.
+ *
+ * The model ignores the limits of the compiled form (instruction count,
+ * step budget, nesting depth), so it agrees with engine_decide only for
+ * rule sets within those limits.
+ */
+
+#ifndef ENGINE_REF_H
+#define ENGINE_REF_H
+
+#include <stddef.h>
+#include "engine.h"
+#include "rules.h"
+
+/**
+ * @brief Everything the reference model decides from.
+ */
+typedef struct {
+    const kb_engine_t *engine;                  /**< Shortcut, key sets, device and app policy (rules ignored) */
+    const char (*rules)[KB_RULE_TEXT_MAX];      /**< Rule source lines */
+    size_t rule_count;                          /**< Number of rule lines */
+    const char *frontmost;                      /**< Bundle identifier of the frontmost app, NULL if unknown */
+} kb_ref_model_t;
+
+/**
+ * @brief Decides an event the slow way.
+ *
+ * @param model Model to decide with.
+ * @param event Decoded event.
+ * @param reason Receives why the verdict was reached, may be NULL.
+ * @return Verdict for the event.
+ */
+kb_verdict_t engine_ref_decide(const kb_ref_model_t *model, const kb_event_t *event, kb_reason_t *reason);
+
+/**
+ * @brief Checks whether a rule line is valid in the reference grammar.
+ *
+ * @param line Rule source.
+ * @return true if the line parses.
+ */
+bool engine_ref_rule_valid(const char *line);
+
+#endif
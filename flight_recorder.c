@@ -0,0 +1,86 @@
+/**
+ * @file flight_recorder.c
+ * @brief Implementation of the flight recorder.
+ */
+
+#include "flight_recorder.h"
+#include <string.h>
+
+/**
+ * @brief Names of state change causes, indexed by kb_cause_t.
+ */
+static const char *const CAUSE_NAMES[KB_CAUSE_COUNT] = {
+    [KB_CAUSE_USER] = "user",
+    [KB_CAUSE_SHORTCUT] = "shortcut",
+    [KB_CAUSE_TIMED] = "timed",
+    [KB_CAUSE_WATCHDOG] = "watchdog",
+    [KB_CAUSE_IDLE] = "idle",
+    [KB_CAUSE_SCHEDULE] = "schedule",
+    [KB_CAUSE_QUARANTINE] = "quarantine",
+};
+
+/**
+ * @brief Initializes an empty recorder.
+ */
+void flight_recorder_init(kb_flight_recorder_t *recorder) {
+    memset(recorder->events, 0, sizeof(recorder->events));
+    atomic_store_explicit(&recorder->event_head, 0, memory_order_relaxed);
+    memset(recorder->transitions, 0, sizeof(recorder->transitions));
+    recorder->transition_head = 0;
+    pthread_mutex_init(&recorder->lock, NULL);
+}
+
+/**
+ * @brief Releases the recorder's lock.
+ */
+void flight_recorder_destroy(kb_flight_recorder_t *recorder) {
+    pthread_mutex_destroy(&recorder->lock);
+}
+
+/**
+ * @brief Records a state change.
+ */
+void flight_recorder_transition(kb_flight_recorder_t *recorder, uint64_t timestamp, bool enabled, kb_cause_t cause,
+                                unsigned short key_code) {
+    pthread_mutex_lock(&recorder->lock);
+    kb_flight_transition_t *slot = &recorder->transitions[recorder->transition_head & (KB_FLIGHT_TRANSITIONS - 1)];
+    slot->timestamp = timestamp;
+    slot->key_code = key_code;
+    slot->enabled = enabled;
+    slot->cause = (uint8_t)cause;
+    recorder->transition_head++;
+    pthread_mutex_unlock(&recorder->lock);
+}
+
+/**
+ * @brief Writes both rings as text, oldest entries first.
+ */
+void flight_recorder_dump(kb_flight_recorder_t *recorder, FILE *out) {
+    /* Copy the state changes so a slow stream never holds up set_block */
+    kb_flight_transition_t transitions[KB_FLIGHT_TRANSITIONS];
+    pthread_mutex_lock(&recorder->lock);
+    uint64_t head = recorder->transition_head;
+    memcpy(transitions, recorder->transitions, sizeof(transitions));
+    pthread_mutex_unlock(&recorder->lock);
+
+    uint64_t first = head > KB_FLIGHT_TRANSITIONS ? head - KB_FLIGHT_TRANSITIONS : 0;
+    fprintf(out, "# transitions: timestamp_ns,blocking,cause,key\n");
+    for (uint64_t i = first; i < head; i++) {
+        const kb_flight_transition_t *t = &transitions[i & (KB_FLIGHT_TRANSITIONS - 1)];
+        fprintf(out, "%llu,%s,%s,", (unsigned long long)t->timestamp, t->enabled ? "on" : "off",
+                t->cause < KB_CAUSE_COUNT ? CAUSE_NAMES[t->cause] : "unknown");
+        if (t->key_code != KB_KEY_NONE) fprintf(out, "%hu", t->key_code);
+        fprintf(out, "\n");
+    }
+
+    head = atomic_load_explicit(&recorder->event_head, memory_order_acquire);
+    first = head > KB_FLIGHT_EVENTS ? head - KB_FLIGHT_EVENTS : 0;
+    fprintf(out, "# events: timestamp_ns,type,key,flags,device,verdict,reason\n");
+    for (uint64_t i = first; i < head; i++) {
+        kb_flight_event_t e = recorder->events[i & (KB_FLIGHT_EVENTS - 1)];
+        fprintf(out, "%llu,%s,", (unsigned long long)e.timestamp, engine_event_type_name((kb_event_type_t)e.type));
+        if (e.key_code != KB_KEY_NONE) fprintf(out, "%hu", e.key_code);
+        fprintf(out, ",0x%llx,%u,%s,%s\n", (unsigned long long)e.flags, e.device,
+                engine_verdict_name((kb_verdict_t)e.verdict), engine_reason_name((kb_reason_t)e.reason));
+    }
+}
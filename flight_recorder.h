@@ -0,0 +1,135 @@
+/**
+ * @file flight_recorder.h
+ * @brief Always-on in-memory record of recent events, verdicts and state
+ * changes.
+ *
+ * Events go into a fixed ring written only by the tap thread with plain
+ * stores: one slot write and an index bump per event, no locks and no
+ * allocation. State changes come from any thread and are rare, so they use
+ * a second, mutex-protected ring. Both can be dumped at any time for
+ * diagnosing reports like "the keyboard got stuck blocked".
+ */
+
+#ifndef FLIGHT_RECORDER_H
+#define FLIGHT_RECORDER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "engine.h"
+
+/** @brief Number of events kept (power of two). */
+#define KB_FLIGHT_EVENTS 4096
+
+/** @brief Number of state changes kept (power of two). */
+#define KB_FLIGHT_TRANSITIONS 256
+
+/** @brief Flight recorder dump file name inside Application Support. */
+#define KB_FLIGHT_RECORDER_FILE "flight_recorder.txt"
+
+/**
+ * @brief Causes of a blocking state change.
+ */
+typedef enum {
+    KB_CAUSE_USER = 0,      /**< Changed through the API (tray, shortcut settings) */
+    KB_CAUSE_SHORTCUT,      /**< Emergency shortcut */
+    KB_CAUSE_TIMED,         /**< Timed block ended */
+    KB_CAUSE_WATCHDOG,      /**< Maximum block duration reached */
+    KB_CAUSE_IDLE,          /**< Idle period elapsed */
+    KB_CAUSE_SCHEDULE,      /**< Schedule window boundary */
+    KB_CAUSE_QUARANTINE,    /**< A key was quarantined (state is unchanged) */
+    KB_CAUSE_COUNT
+} kb_cause_t;
+
+/**
+ * @brief One recorded event and its verdict (32 bytes).
+ */
+typedef struct {
+    uint64_t timestamp;     /**< Event time in nanoseconds */
+    uint64_t flags;         /**< Modifier flags */
+    uint32_t device;        /**< Keyboard type */
+    uint16_t key_code;      /**< Key id */
+    uint8_t type;           /**< kb_event_type_t */
+    uint8_t verdict;        /**< kb_verdict_t */
+    uint8_t reason;         /**< kb_reason_t */
+    uint8_t reserved[7];    /**< Padding */
+} kb_flight_event_t;
+
+/**
+ * @brief One recorded state change.
+ */
+typedef struct {
+    uint64_t timestamp;     /**< Time in nanoseconds, same clock as events */
+    uint16_t key_code;      /**< Quarantined key, KB_KEY_NONE otherwise */
+    uint8_t enabled;        /**< Blocking state after the change */
+    uint8_t cause;          /**< kb_cause_t */
+} kb_flight_transition_t;
+
+/**
+ * @brief Event and state change rings.
+ */
+typedef struct {
+    kb_flight_event_t events[KB_FLIGHT_EVENTS];                 /**< Event ring */
+    atomic_uint_fast64_t event_head;                            /**< Events recorded so far */
+    kb_flight_transition_t transitions[KB_FLIGHT_TRANSITIONS];  /**< State change ring */
+    uint64_t transition_head;                                   /**< State changes recorded so far */
+    pthread_mutex_t lock;                                       /**< Protects the state change ring */
+} kb_flight_recorder_t;
+
+/**
+ * @brief Initializes an empty recorder.
+ */
+void flight_recorder_init(kb_flight_recorder_t *recorder);
+
+/**
+ * @brief Releases the recorder's lock.
+ */
+void flight_recorder_destroy(kb_flight_recorder_t *recorder);
+
+/**
+ * @brief Records an event and its verdict. Tap thread only.
+ *
+ * @param recorder Recorder to write.
+ * @param event Decoded event.
+ * @param verdict Final verdict.
+ * @param reason Why the verdict was reached.
+ */
+static inline void flight_recorder_event(kb_flight_recorder_t *recorder, const kb_event_t *event,
+                                         kb_verdict_t verdict, kb_reason_t reason) {
+    uint64_t head = atomic_load_explicit(&recorder->event_head, memory_order_relaxed);
+    kb_flight_event_t *slot = &recorder->events[head & (KB_FLIGHT_EVENTS - 1)];
+    slot->timestamp = event->timestamp;
+    slot->flags = event->flags;
+    slot->device = event->device;
+    slot->key_code = event->key_code;
+    slot->type = (uint8_t)event->type;
+    slot->verdict = (uint8_t)verdict;
+    slot->reason = (uint8_t)reason;
+    atomic_store_explicit(&recorder->event_head, head + 1, memory_order_release);
+}
+
+/**
+ * @brief Records a state change. Safe to call from any thread.
+ *
+ * @param recorder Recorder to write.
+ * @param timestamp Time in nanoseconds, on the event clock.
+ * @param enabled Blocking state after the change.
+ * @param cause What caused the change.
+ * @param key_code Quarantined key, or KB_KEY_NONE.
+ */
+void flight_recorder_transition(kb_flight_recorder_t *recorder, uint64_t timestamp, bool enabled, kb_cause_t cause,
+                                unsigned short key_code);
+
+/**
+ * @brief Writes both rings as text, oldest entries first.
+ *
+ * Events recorded while dumping may show up torn or be missed; the dump is
+ * a best-effort snapshot and never stalls the tap.
+ *
+ * @param recorder Recorder to dump.
+ * @param out Output stream.
+ */
+void flight_recorder_dump(kb_flight_recorder_t *recorder, FILE *out);
+
+#endif
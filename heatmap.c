@@ -0,0 +1,71 @@
+/**
+ * @file heatmap.c
+ * @brief Implementation of the memory-mapped keystroke heatmap.
+ */
+
+#include "heatmap.h"
+#include "logger.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Maps the heatmap file, creating or resetting it if needed.
+ */
+kb_heatmap_t *heatmap_open(const char *path) {
+    /* Per-key press counts are keystroke metadata; keep them private to the user */
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        log_message(KB_LOG_LEVEL_ERROR, "Failed to open heatmap file at %s.", path);
+        return NULL;
+    }
+    /* A heatmap created by an older version may still be readable by others */
+    fchmod(fd, 0600);
+
+    struct stat st;
+    bool fresh = fstat(fd, &st) != 0 || st.st_size != (off_t)sizeof(kb_heatmap_t);
+    if (fresh && ftruncate(fd, sizeof(kb_heatmap_t)) != 0) {
+        log_message(KB_LOG_LEVEL_ERROR, "Failed to size heatmap file at %s.", path);
+        close(fd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, sizeof(kb_heatmap_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        log_message(KB_LOG_LEVEL_ERROR, "Failed to map heatmap file at %s.", path);
+        return NULL;
+    }
+
+    kb_heatmap_t *heatmap = (kb_heatmap_t *)map;
+    if (fresh || heatmap->magic != KB_HEATMAP_MAGIC || heatmap->version != KB_HEATMAP_VERSION ||
+        heatmap->key_count != KB_KEY_COUNT) {
+        memset(heatmap, 0, sizeof(*heatmap));
+        heatmap->magic = KB_HEATMAP_MAGIC;
+        heatmap->version = KB_HEATMAP_VERSION;
+        heatmap->key_count = KB_KEY_COUNT;
+        log_message(KB_LOG_LEVEL_INFO, "Initialized heatmap at %s.", path);
+    }
+    return heatmap;
+}
+
+/**
+ * @brief Unmaps a heatmap.
+ */
+void heatmap_close(kb_heatmap_t *heatmap) {
+    if (heatmap) munmap(heatmap, sizeof(*heatmap));
+}
+
+/**
+ * @brief Writes the heatmap as CSV (key,seen,blocked), skipping unused keys.
+ */
+void heatmap_export(const kb_heatmap_t *heatmap, FILE *out) {
+    fprintf(out, "key,seen,blocked\n");
+    for (int key = 0; key < KB_KEY_COUNT; key++) {
+        if (heatmap->seen[key] == 0 && heatmap->blocked[key] == 0) continue;
+        fprintf(out, "%d,%llu,%llu\n", key, (unsigned long long)heatmap->seen[key],
+                (unsigned long long)heatmap->blocked[key]);
+    }
+}
@@ -0,0 +1,74 @@
+/**
+ * @file heatmap.h
+ * @brief Per-key press counters persisted through a memory-mapped file.
+ *
+ * The counters live directly in a shared file mapping, so they survive
+ * restarts without any explicit save. Only the event tap thread writes to
+ * the mapping; increments are plain stores.
+ */
+
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "engine.h"
+
+/** @brief Heatmap file name inside Application Support. */
+#define KB_HEATMAP_FILE "heatmap.bin"
+
+/** @brief Identifies a heatmap file ("KBHM"). */
+#define KB_HEATMAP_MAGIC 0x4D48424BU
+
+/** @brief Layout version of the heatmap file. */
+#define KB_HEATMAP_VERSION 1
+
+/**
+ * @brief On-disk (and in-memory) layout of the heatmap.
+ */
+typedef struct {
+    uint32_t magic;                 /**< KB_HEATMAP_MAGIC */
+    uint32_t version;               /**< KB_HEATMAP_VERSION */
+    uint32_t key_count;             /**< KB_KEY_COUNT when the file was created */
+    uint32_t reserved;              /**< Padding, always zero */
+    uint64_t seen[KB_KEY_COUNT];    /**< Presses seen per key */
+    uint64_t blocked[KB_KEY_COUNT]; /**< Presses blocked per key */
+} kb_heatmap_t;
+
+/**
+ * @brief Maps the heatmap file, creating or resetting it if it is missing
+ * or has an unexpected layout.
+ *
+ * @param path Path of the heatmap file.
+ * @return Mapped heatmap, or NULL on failure.
+ */
+kb_heatmap_t *heatmap_open(const char *path);
+
+/**
+ * @brief Unmaps a heatmap. Counters are written back by the kernel.
+ */
+void heatmap_close(kb_heatmap_t *heatmap);
+
+/**
+ * @brief Counts a key press.
+ *
+ * @param heatmap Mapped heatmap.
+ * @param key Key id.
+ * @param blocked Whether the press was blocked.
+ */
+static inline void heatmap_record(kb_heatmap_t *heatmap, unsigned int key, bool blocked) {
+    if (key >= KB_KEY_COUNT) return;
+    heatmap->seen[key]++;
+    if (blocked) heatmap->blocked[key]++;
+}
+
+/**
+ * @brief Writes the heatmap as CSV (key,seen,blocked), skipping unused keys.
+ *
+ * @param heatmap Heatmap to export.
+ * @param out Output stream.
+ */
+void heatmap_export(const kb_heatmap_t *heatmap, FILE *out);
+
+#endif
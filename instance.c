@@ -0,0 +1,450 @@
+/**
+ * @file instance.c
+ * @brief Implementation of keyboard event interception and blocking using CoreGraphics.
+ *
+ * Every instance installs its own low-level event tap to block keyboard
+ * input, manage an emergency unlock shortcut, record key combinations, and
+ * synchronize settings. The tap thread decodes each event and hands it to
+ * the instance's session (session.c), which holds everything portable.
+ */
+
+#include "instance.h"
+#include "arena.h"
+#include "engine.h"
+#include "session.h"
+#include <ApplicationServices/ApplicationServices.h>
+#include <Carbon/Carbon.h>
+#include "logger.h"
+#include "worker.h"
+#include "media_keys.h"
+#include "system_event.h"
+#include "thread_priority.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <mach/mach_time.h>
+
+#ifndef kCGEventSystemDefined
+#define kCGEventSystemDefined 14
+#endif
+
+/**
+ * @brief Longest slice the tap thread spends in its run loop before
+ * checking for a stop request.
+ *
+ * A stop normally interrupts the run loop at once; the slice only bounds
+ * shutdown latency when the request races the start of a slice.
+ */
+#define KB_TAP_RUN_SLICE_SECONDS 1.0
+
+/**
+ * @brief Startup memory of one instance: its context and what its session
+ * takes.
+ */
+#define KB_INSTANCE_ARENA_SIZE (sizeof(struct kb_context) + KB_SESSION_ARENA_SIZE + KB_ARENA_ALIGN)
+
+/**
+ * @brief Internal context for managing keyboard state (kb_instance_t).
+ */
+struct kb_context {
+    CFMachPortRef eventTap;                 /**< Event tap reference */
+    CFRunLoopSourceRef runLoopSource;      /**< Run loop source for the tap */
+    kb_session_t session;                   /**< Decision state, timers and background work */
+    pthread_t thread;                        /**< Background thread running the event tap */
+    CFRunLoopRef runLoop;                   /**< Run loop of the tap thread, valid while running */
+    bool running;                           /**< Whether the tap thread is running */
+    atomic_bool stopping;                   /**< Asks the tap thread to tear down and exit */
+    uint64_t latencyCount;                  /**< Events measured for callback-entry latency */
+    uint64_t latencySumNs;                  /**< Sum of callback-entry latencies */
+    uint64_t latencyMaxNs;                  /**< Worst callback-entry latency */
+    unsigned long tapTimeouts;              /**< Times macOS disabled the tap for being slow */
+    kb_arena_t *arena;                      /**< Startup memory, holding this context */
+};
+
+/** @brief Internal name of the instance structure. */
+typedef struct kb_context kb_context_t;
+
+/**
+ * @brief State of a tap thread that is starting up.
+ */
+typedef enum {
+    TAP_STARTING = 0,   /**< Creating the event tap */
+    TAP_RUNNING,        /**< Tap installed, run loop about to run */
+    TAP_FAILED          /**< Tap could not be created; the thread exits */
+} tap_state_t;
+
+/**
+ * @brief Handshake between kb_instance_start and a new tap thread.
+ *
+ * Lives on the starting thread's stack; the tap thread never touches it
+ * after reporting its state.
+ */
+typedef struct {
+    kb_context_t *ctx;          /**< Instance being started */
+    pthread_mutex_t lock;       /**< Protects state */
+    pthread_cond_t cond;        /**< Signaled when state leaves TAP_STARTING */
+    tap_state_t state;          /**< Startup outcome */
+} tap_startup_t;
+
+/** @brief Conversion from event timestamps (mach time units) to nanoseconds. */
+static mach_timebase_info_data_t g_timebase;
+/** @brief Initializes g_timebase once per process. */
+static pthread_once_t g_timebase_once = PTHREAD_ONCE_INIT;
+
+/**
+ * @brief Reads the mach timebase.
+ */
+static void init_timebase(void) {
+    mach_timebase_info(&g_timebase);
+}
+
+/**
+ * @brief Decodes a CoreGraphics event into the engine's event representation.
+ *
+ * @param type Type of the keyboard event.
+ * @param event The keyboard event.
+ * @param out Decoded event.
+ */
+static void decode_event(CGEventType type, CGEventRef event, kb_event_t *out) {
+    out->flags = (unsigned long long)(CGEventGetFlags(event) &
+                                      (kCGEventFlagMaskCommand | kCGEventFlagMaskShift |
+                                       kCGEventFlagMaskAlternate | kCGEventFlagMaskControl));
+    out->device = (unsigned int)CGEventGetIntegerValueField(event, kCGKeyboardEventKeyboardType);
+    out->timestamp = (uint64_t)CGEventGetTimestamp(event) * g_timebase.numer / g_timebase.denom;
+
+    switch (type) {
+        case kCGEventKeyDown: out->type = KB_EVENT_KEY_DOWN; break;
+        case kCGEventKeyUp: out->type = KB_EVENT_KEY_UP; break;
+        case kCGEventFlagsChanged: out->type = KB_EVENT_FLAGS_CHANGED; break;
+        case kCGEventSystemDefined: {
+            /* Media keys carry their key and state in subtype/data1 */
+            int subtype = 0;
+            long data1 = 0;
+            read_system_event_fields(event, &subtype, &data1);
+            media_key_decode(subtype, data1, out);
+            return;
+        }
+        default:
+            out->type = KB_EVENT_OTHER;
+            out->key_code = KB_KEY_NONE;
+            out->autorepeat = false;
+            return;
+    }
+    out->key_code = (unsigned short)CGEventGetIntegerValueField(event, kCGKeyboardEventKeycode);
+    out->autorepeat = CGEventGetIntegerValueField(event, kCGKeyboardEventAutorepeat) != 0;
+}
+
+/**
+ * @brief Keyboard event callback.
+ *
+ * Decodes the event once and hands it to the session, which applies the
+ * verdict of the engine and the filter plugins: blocking, shortcut
+ * detection, or one-shot recording. Events that pass are rewritten in
+ * place according to the remap table. Nothing here allocates or takes the
+ * worker lock: owner notifications, reports and saving are posted to the
+ * worker. Reading the fields of a media key event goes through NSEvent,
+ * which does allocate; see system_event.h.
+ *
+ * If macOS disables the tap anyway, it is re-enabled at once.
+ *
+ * @param proxy Unused event tap proxy.
+ * @param type Type of the keyboard event.
+ * @param event The keyboard event.
+ * @param refcon Pointer to kb_context_t.
+ * @return NULL to block the event, or the original event to allow.
+ */
+static CGEventRef keyboardCallback(CGEventTapProxy proxy, CGEventType type, CGEventRef event, void *refcon) {
+    uint64_t entry = trace_now_ns();
+    kb_context_t *ctx = (kb_context_t *)refcon;
+    if (!ctx) return event;
+
+    if (type == kCGEventTapDisabledByTimeout || type == kCGEventTapDisabledByUserInput) {
+        if (type == kCGEventTapDisabledByTimeout) {
+            ctx->tapTimeouts++;
+            metrics_bump(&ctx->session.metrics.tap_timeouts, 1);
+        } else {
+            metrics_bump(&ctx->session.metrics.tap_user_disables, 1);
+        }
+        log_message(KB_LOG_LEVEL_ERROR, "Event tap was disabled by %s. Re-enabling it.",
+                    type == kCGEventTapDisabledByTimeout ? "timeout" : "user input");
+        CGEventTapEnable(ctx->eventTap, true);
+        return event;
+    }
+
+    kb_event_t ev;
+    decode_event(type, event, &ev);
+
+    /* Time from the event's creation to this callback: the delay the tap thread adds */
+    if (entry > ev.timestamp) {
+        uint64_t latency = entry - ev.timestamp;
+        ctx->latencyCount++;
+        ctx->latencySumNs += latency;
+        if (latency > ctx->latencyMaxNs) ctx->latencyMaxNs = latency;
+    }
+
+    unsigned short keyCode;
+    if (!session_handle_event(&ctx->session, &ev, entry, &keyCode)) return NULL;
+    if (keyCode != ev.key_code) CGEventSetIntegerValueField(event, kCGKeyboardEventKeycode, keyCode);
+    return event;
+}
+
+/**
+ * @brief Thread function that runs the event tap.
+ *
+ * Installs the tap on its own run loop, reports the outcome through the
+ * startup handshake, and runs until kb_instance_stop asks it to exit. The
+ * tap is torn down on this thread, which owns the run loop it was added to.
+ *
+ * @param arg Pointer to tap_startup_t
+ * @return Always NULL
+ */
+static void *keyboard_thread_func(void *arg) {
+    tap_startup_t *startup = (tap_startup_t *)arg;
+    kb_context_t *ctx = startup->ctx;
+    thread_priority_apply_self(ctx->session.tap_priority);
+    CGEventMask eventMask = CGEventMaskBit(kCGEventKeyDown) | 
+                            CGEventMaskBit(kCGEventKeyUp) | 
+                            CGEventMaskBit(kCGEventFlagsChanged) | 
+                            CGEventMaskBit(kCGEventSystemDefined);
+    ctx->eventTap = CGEventTapCreate(kCGSessionEventTap, kCGHeadInsertEventTap, kCGEventTapOptionDefault, eventMask, keyboardCallback, ctx);
+    if (ctx->eventTap) {
+        ctx->runLoop = CFRunLoopGetCurrent();
+        ctx->runLoopSource = CFMachPortCreateRunLoopSource(kCFAllocatorDefault, ctx->eventTap, 0);
+        CFRunLoopAddSource(ctx->runLoop, ctx->runLoopSource, kCFRunLoopCommonModes);
+        CGEventTapEnable(ctx->eventTap, true);
+        log_message(KB_LOG_LEVEL_INFO, "Event tap created successfully in background thread.");
+    } else {
+        log_message(KB_LOG_LEVEL_ERROR, "Failed to create event tap. Check Accessibility permissions.");
+    }
+
+    bool started = ctx->eventTap != NULL;
+    pthread_mutex_lock(&startup->lock);
+    startup->state = started ? TAP_RUNNING : TAP_FAILED;
+    pthread_cond_signal(&startup->cond);
+    pthread_mutex_unlock(&startup->lock);
+    if (!started) return NULL;
+
+    while (!atomic_load_explicit(&ctx->stopping, memory_order_acquire)) {
+        if (CFRunLoopRunInMode(kCFRunLoopDefaultMode, KB_TAP_RUN_SLICE_SECONDS, false) == kCFRunLoopRunFinished) {
+            log_message(KB_LOG_LEVEL_ERROR, "Event tap run loop has no sources left. Stopping capture.");
+            break;
+        }
+    }
+
+    CGEventTapEnable(ctx->eventTap, false);
+    CFRunLoopRemoveSource(ctx->runLoop, ctx->runLoopSource, kCFRunLoopCommonModes);
+    CFRelease(ctx->runLoopSource);
+    ctx->runLoopSource = NULL;
+    CFMachPortInvalidate(ctx->eventTap);
+    CFRelease(ctx->eventTap);
+    ctx->eventTap = NULL;
+    return NULL;
+}
+
+/**
+ * @brief Creates an instance and starts capturing.
+ *
+ * Everything the instance keeps comes from its arena, so capturing never
+ * reaches the allocator.
+ */
+kb_result_t kb_instance_create(const app_settings_t *settings, const kb_instance_callbacks_t *callbacks, void *arg,
+                               kb_instance_t **out) {
+    kb_arena_t *arena = arena_create(KB_INSTANCE_ARENA_SIZE);
+    if (!arena) return KB_ERROR_EVENT_TAP_FAILED;
+    kb_context_t *ctx = (kb_context_t *)arena_alloc(arena, sizeof(kb_context_t));
+    ctx->arena = arena;
+    pthread_once(&g_timebase_once, init_timebase);
+
+    if (!session_start(&ctx->session, settings, callbacks, arg, arena)) {
+        arena_destroy(arena);
+        return KB_ERROR_EVENT_TAP_FAILED;
+    }
+    kb_result_t result = kb_instance_start(ctx);
+    if (result != KB_SUCCESS) {
+        session_stop(&ctx->session);
+        arena_destroy(arena);
+        return result;
+    }
+    *out = ctx;
+    return KB_SUCCESS;
+}
+
+/**
+ * @brief Starts the tap thread and waits until the tap is installed.
+ */
+kb_result_t kb_instance_start(kb_instance_t *instance) {
+    if (instance->running) return KB_ERROR_ALREADY_STARTED;
+
+    tap_startup_t startup;
+    startup.ctx = instance;
+    startup.state = TAP_STARTING;
+    pthread_mutex_init(&startup.lock, NULL);
+    pthread_cond_init(&startup.cond, NULL);
+    atomic_store_explicit(&instance->stopping, false, memory_order_relaxed);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    thread_priority_init_attr(&attr, instance->session.tap_priority);
+
+    kb_result_t result = KB_SUCCESS;
+    if (pthread_create(&instance->thread, &attr, keyboard_thread_func, &startup) != 0) {
+        log_message(KB_LOG_LEVEL_ERROR, "Failed to create keyboard thread.");
+        result = KB_ERROR_EVENT_TAP_FAILED;
+    } else {
+        pthread_mutex_lock(&startup.lock);
+        while (startup.state == TAP_STARTING) pthread_cond_wait(&startup.cond, &startup.lock);
+        pthread_mutex_unlock(&startup.lock);
+        if (startup.state == TAP_FAILED) {
+            pthread_join(instance->thread, NULL);
+            result = KB_ERROR_PERMISSION_DENIED;
+        } else {
+            instance->running = true;
+        }
+    }
+
+    pthread_attr_destroy(&attr);
+    pthread_cond_destroy(&startup.cond);
+    pthread_mutex_destroy(&startup.lock);
+    return result;
+}
+
+/**
+ * @brief Stops the tap thread and waits for it to exit.
+ *
+ * The stop flag is set before interrupting the run loop, so a request that
+ * lands between two slices is seen when the next one would start.
+ */
+void kb_instance_stop(kb_instance_t *instance) {
+    if (!instance->running) return;
+    uint64_t start = worker_now_ns();
+    atomic_store_explicit(&instance->stopping, true, memory_order_release);
+    CFRunLoopStop(instance->runLoop);
+    pthread_join(instance->thread, NULL);
+    instance->runLoop = NULL;
+    instance->running = false;
+    log_message(KB_LOG_LEVEL_DEBUG, "Event tap stopped in %llu us.",
+                (unsigned long long)((worker_now_ns() - start) / 1000ULL));
+    if (instance->latencyCount) {
+        log_message(KB_LOG_LEVEL_INFO, "Event tap latency (%s priority) over %llu events: mean %llu us, max %llu us.",
+                    thread_priority_name(instance->session.tap_priority), (unsigned long long)instance->latencyCount,
+                    (unsigned long long)(instance->latencySumNs / instance->latencyCount / 1000ULL),
+                    (unsigned long long)(instance->latencyMaxNs / 1000ULL));
+    }
+    if (instance->session.tap_watchdog.overruns || instance->tapTimeouts) {
+        log_message(KB_LOG_LEVEL_INFO,
+                    "Event tap callback overran its budget %llu times; disabled by timeout %lu times.",
+                    (unsigned long long)instance->session.tap_watchdog.overruns, instance->tapTimeouts);
+    }
+}
+
+/**
+ * @brief Reloads the settings of a stopped instance.
+ */
+kb_result_t kb_instance_reload(kb_instance_t *instance, const app_settings_t *settings) {
+    if (instance->running) return KB_ERROR_ALREADY_STARTED;
+    session_reload(&instance->session, settings);
+    return KB_SUCCESS;
+}
+
+/**
+ * @brief Enables or disables keyboard blocking.
+ *
+ * Turning blocking on arms the safety watchdog and cancels any pending
+ * timed unblock; turning it off cancels both.
+ *
+ * @param instance Instance to update.
+ * @param on True to block, false to pass events through.
+ */
+void kb_instance_enable_block(kb_instance_t *instance, bool on) {
+    session_set_block(&instance->session, on, KB_CAUSE_USER);
+}
+
+/**
+ * @brief Enables keyboard blocking for a limited time.
+ */
+void kb_instance_enable_block_for(kb_instance_t *instance, unsigned int minutes) {
+    session_block_for(&instance->session, minutes);
+}
+
+/**
+ * @brief Returns whether keyboard blocking is currently enabled.
+ */
+bool kb_instance_is_block_enabled(const kb_instance_t *instance) {
+    return instance->session.engine.enabled;
+}
+
+/**
+ * @brief Enables or disables the emergency shortcut.
+ */
+void kb_instance_set_shortcut_enabled(kb_instance_t *instance, bool enabled) {
+    instance->session.engine.shortcut_enabled = enabled;
+    session_request_save(&instance->session);
+}
+
+/**
+ * @brief Returns whether the emergency shortcut is enabled.
+ */
+bool kb_instance_is_shortcut_enabled(const kb_instance_t *instance) {
+    return instance->session.engine.shortcut_enabled;
+}
+
+/**
+ * @brief Sets the key combination for the emergency shortcut.
+ */
+void kb_instance_set_shortcut(kb_instance_t *instance, unsigned long long flags, unsigned short keyCode) {
+    instance->session.engine.shortcut_flags = flags;
+    instance->session.engine.shortcut_key_code = keyCode;
+    session_request_save(&instance->session);
+}
+
+/**
+ * @brief Retrieves the key combination for the emergency shortcut.
+ */
+void kb_instance_get_shortcut(const kb_instance_t *instance, unsigned long long *flags, unsigned short *keyCode) {
+    if (flags) *flags = instance->session.engine.shortcut_flags;
+    if (keyCode) *keyCode = instance->session.engine.shortcut_key_code;
+}
+
+/**
+ * @brief Starts recording a one-shot emergency shortcut.
+ */
+void kb_instance_start_recording(kb_instance_t *instance) {
+    instance->session.engine.recording = true;
+    log_message(KB_LOG_LEVEL_DEBUG, "Recording mode: ON (one-shot)");
+}
+
+/**
+ * @brief Releases every quarantined key.
+ */
+void kb_instance_clear_quarantined_keys(kb_instance_t *instance) {
+    memset(instance->session.engine.quarantined, 0, sizeof(instance->session.engine.quarantined));
+    log_message(KB_LOG_LEVEL_INFO, "Quarantined keys re-enabled.");
+}
+
+/**
+ * @brief Caches the blocking policy for the application that became frontmost.
+ */
+void kb_instance_set_frontmost_application(kb_instance_t *instance, const char *bundleId) {
+    session_set_frontmost_application(&instance->session, bundleId);
+}
+
+/**
+ * @brief Writes the flight recorder to a file.
+ */
+bool kb_instance_dump_flight_recorder(kb_instance_t *instance, const char *path) {
+    return session_dump_flight_recorder(&instance->session, path);
+}
+
+/**
+ * @brief Stops capturing and frees an instance.
+ */
+void kb_instance_destroy(kb_instance_t *instance) {
+    if (!instance) return;
+    kb_instance_stop(instance);
+    session_stop(&instance->session);
+    arena_destroy(instance->arena);
+    log_message(KB_LOG_LEVEL_INFO, "Keyboard blocker resources cleaned up.");
+}
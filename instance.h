@@ -0,0 +1,180 @@
+/**
+ * @file instance.h
+ * @brief Capture sessions as independent instances.
+ *
+ * Each instance owns its own event tap, tap thread, decision state, timers
+ * and callbacks, so several sessions can run side by side in one process.
+ * The keyboard.h API drives a single default instance on top of this one.
+ *
+ * All instances share the background worker thread; it runs while at least
+ * one instance exists.
+ */
+
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include <stdbool.h>
+#include "settings.h"
+
+/**
+ * @brief Result codes returned by keyboard operations.
+ */
+typedef enum {
+    KB_SUCCESS = 0,             /**< Operation successful */
+    KB_ERROR_PERMISSION_DENIED, /**< Accessibility permissions missing */
+    KB_ERROR_EVENT_TAP_FAILED,  /**< Failed to create event tap */
+    KB_ERROR_ALREADY_STARTED    /**< Session already initialized */
+} kb_result_t;
+
+/**
+ * @brief Opaque handle to a capture session.
+ */
+typedef struct kb_context kb_instance_t;
+
+/**
+ * @brief Notifications raised by an instance. Any member may be NULL.
+ *
+ * Callbacks run on the worker thread and must return quickly. The tap
+ * thread never calls them: it files the notification and posts a task.
+ */
+typedef struct {
+    /** @brief Blocking was turned on or off by the instance itself (shortcut, timers, schedule). */
+    void (*state_changed)(bool active, void *arg);
+    /** @brief A new emergency shortcut was recorded. */
+    void (*shortcut_recorded)(unsigned long long flags, unsigned short keyCode, void *arg);
+    /** @brief A stuck or chattering key was quarantined. */
+    void (*key_quarantined)(unsigned short keyCode, void *arg);
+} kb_instance_callbacks_t;
+
+/**
+ * @brief Creates an instance and starts capturing.
+ *
+ * @param settings Settings to run with, or NULL to load settings.conf. Only
+ * instances created from settings.conf save changes back and keep the
+ * keystroke heatmap.
+ * @param callbacks Notifications, or NULL for none. Copied.
+ * @param arg Argument passed to every callback.
+ * @param out Receives the instance on success.
+ * @return KB_SUCCESS once the event tap is installed,
+ * KB_ERROR_PERMISSION_DENIED if it could not be created, or
+ * KB_ERROR_EVENT_TAP_FAILED.
+ */
+kb_result_t kb_instance_create(const app_settings_t *settings, const kb_instance_callbacks_t *callbacks, void *arg,
+                               kb_instance_t **out);
+
+/**
+ * @brief Stops capturing and frees an instance.
+ *
+ * The tap thread is stopped and joined before anything it uses is freed.
+ *
+ * @param instance Instance to destroy, may be NULL.
+ */
+void kb_instance_destroy(kb_instance_t *instance);
+
+/**
+ * @brief Starts capturing on a stopped instance.
+ *
+ * Starts a new tap thread and waits until its event tap is installed. All
+ * other state (blocking, shortcut, timers) is kept across stop and start.
+ *
+ * @param instance Instance to start.
+ * @return KB_SUCCESS, KB_ERROR_ALREADY_STARTED if capturing,
+ * KB_ERROR_PERMISSION_DENIED if the tap could not be created, or
+ * KB_ERROR_EVENT_TAP_FAILED.
+ */
+kb_result_t kb_instance_start(kb_instance_t *instance);
+
+/**
+ * @brief Stops capturing: removes the event tap on its own thread and joins
+ * the thread. Does nothing if the instance is not capturing.
+ *
+ * @param instance Instance to stop.
+ */
+void kb_instance_stop(kb_instance_t *instance);
+
+/**
+ * @brief Reloads the settings of a stopped instance.
+ *
+ * The worker, metrics socket, counters, flight recorder and heatmap carry
+ * on. Blocking follows the new settings, so it is off after reloading
+ * settings.conf, as after a launch.
+ *
+ * @param instance Instance to reload.
+ * @param settings Settings to run with, or NULL to load settings.conf.
+ * @return KB_SUCCESS, or KB_ERROR_ALREADY_STARTED if capturing.
+ */
+kb_result_t kb_instance_reload(kb_instance_t *instance, const app_settings_t *settings);
+
+/**
+ * @brief Enables or disables blocking.
+ *
+ * Turning blocking on arms the safety watchdog and cancels any pending
+ * timed unblock; turning it off cancels both.
+ */
+void kb_instance_enable_block(kb_instance_t *instance, bool on);
+
+/**
+ * @brief Enables blocking for a limited time.
+ *
+ * @param instance Instance to block.
+ * @param minutes Duration of the block in minutes.
+ */
+void kb_instance_enable_block_for(kb_instance_t *instance, unsigned int minutes);
+
+/**
+ * @brief Returns whether blocking is active.
+ */
+bool kb_instance_is_block_enabled(const kb_instance_t *instance);
+
+/**
+ * @brief Enables or disables the emergency unlock shortcut.
+ */
+void kb_instance_set_shortcut_enabled(kb_instance_t *instance, bool enabled);
+
+/**
+ * @brief Returns whether the emergency shortcut is enabled.
+ */
+bool kb_instance_is_shortcut_enabled(const kb_instance_t *instance);
+
+/**
+ * @brief Sets the key combination for the emergency shortcut.
+ */
+void kb_instance_set_shortcut(kb_instance_t *instance, unsigned long long flags, unsigned short keyCode);
+
+/**
+ * @brief Retrieves the key combination for the emergency shortcut.
+ */
+void kb_instance_get_shortcut(const kb_instance_t *instance, unsigned long long *flags, unsigned short *keyCode);
+
+/**
+ * @brief Records the next key press as the emergency shortcut.
+ */
+void kb_instance_start_recording(kb_instance_t *instance);
+
+/**
+ * @brief Releases every quarantined key.
+ */
+void kb_instance_clear_quarantined_keys(kb_instance_t *instance);
+
+/**
+ * @brief Reports the application that became frontmost. Safe to call from
+ * any thread.
+ *
+ * @param instance Instance to update.
+ * @param bundleId Bundle identifier of the application, or NULL if unknown.
+ */
+void kb_instance_set_frontmost_application(kb_instance_t *instance, const char *bundleId);
+
+/**
+ * @brief Writes the instance's flight recorder (recent events, verdicts and
+ * blocking state changes) to a file.
+ *
+ * Safe to call while capturing; the tap is never paused.
+ *
+ * @param instance Instance to dump.
+ * @param path File to write, replaced if it exists.
+ * @return true on success.
+ */
+bool kb_instance_dump_flight_recorder(kb_instance_t *instance, const char *path);
+
+#endif
@@ -0,0 +1,447 @@
+/**
+ * @file kb_alloc_check.c
+ * @brief Checks that capturing never reaches the allocator.
+ *
+ * Interposes malloc and friends with counting versions, then feeds a
+ * generated event stream to session_handle_event(), the same function the
+ * event tap callback runs after decoding (stuck key detection, engine,
+ * shadow rules, plugins, flight recorder, heatmap, remap, metrics,
+ * callback watchdog, tracing and logging). The worker thread runs the
+ * reports and delivers owner notifications as it does in the app. Setup
+ * runs before counting starts and comes from an arena like an instance's;
+ * after a warm-up, any allocation or free on any thread fails the check.
+ *
+ * Decoding CoreGraphics events is not covered: reading the fields of a
+ * media key event goes through NSEvent and allocates (see system_event.h).
+ * Neither is what the owner's callbacks do on the worker; the app's post
+ * to the main queue allocates there, off the tap thread.
+ * Runs on Linux and macOS; see "make tools".
+ */
+
+#ifndef __APPLE__
+#define _GNU_SOURCE
+#endif
+
+#include <dlfcn.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "arena.h"
+#include "bench_setup.h"
+#include "logger.h"
+#include "session.h"
+#include "trace.h"
+#include "worker.h"
+#include "workload.h"
+
+/** @brief Events generated per batch. */
+#define KB_ALLOC_CHECK_BATCH 4096
+
+/** @brief Allocation call sites remembered for the report. */
+#define KB_ALLOC_CHECK_SITES 16
+
+/**
+ * @brief Generated batches between changes of the frontmost application;
+ * the first event of those batches is also turned into the shortcut.
+ */
+#define KB_ALLOC_CHECK_APP_PERIOD 64
+
+/**
+ * @brief Interposed allocator entry points.
+ */
+typedef enum {
+    ALLOC_MALLOC = 0,
+    ALLOC_CALLOC,
+    ALLOC_REALLOC,
+    ALLOC_FREE,
+    ALLOC_MEMALIGN,
+    ALLOC_KIND_COUNT
+} alloc_kind_t;
+
+static const char *const alloc_names[ALLOC_KIND_COUNT] = {
+    [ALLOC_MALLOC] = "malloc",
+    [ALLOC_CALLOC] = "calloc",
+    [ALLOC_REALLOC] = "realloc",
+    [ALLOC_FREE] = "free",
+    [ALLOC_MEMALIGN] = "posix_memalign/aligned_alloc",
+};
+
+/** @brief Whether calls are being counted. */
+static atomic_bool g_armed;
+
+/** @brief Calls counted per entry point. */
+static atomic_uint_fast64_t g_counts[ALLOC_KIND_COUNT];
+
+/** @brief Callers of the first counted calls. */
+static void *g_sites[KB_ALLOC_CHECK_SITES];
+static alloc_kind_t g_site_kinds[KB_ALLOC_CHECK_SITES];
+static atomic_uint g_site_count;
+
+/**
+ * @brief Counts one call if counting is on.
+ */
+static void count_call(alloc_kind_t kind, void *caller) {
+    if (!atomic_load_explicit(&g_armed, memory_order_relaxed)) return;
+    atomic_fetch_add_explicit(&g_counts[kind], 1, memory_order_relaxed);
+    unsigned int site = atomic_fetch_add_explicit(&g_site_count, 1, memory_order_relaxed);
+    if (site < KB_ALLOC_CHECK_SITES) {
+        g_sites[site] = caller;
+        g_site_kinds[site] = kind;
+    }
+}
+
+#ifdef __APPLE__
+/*
+ * dyld rebinds every image's calls to the replaced functions; calls made
+ * from this file still reach the originals.
+ */
+static void *counting_malloc(size_t size) {
+    count_call(ALLOC_MALLOC, __builtin_return_address(0));
+    return malloc(size);
+}
+
+static void *counting_calloc(size_t count, size_t size) {
+    count_call(ALLOC_CALLOC, __builtin_return_address(0));
+    return calloc(count, size);
+}
+
+static void *counting_realloc(void *ptr, size_t size) {
+    count_call(ALLOC_REALLOC, __builtin_return_address(0));
+    return realloc(ptr, size);
+}
+
+static void counting_free(void *ptr) {
+    if (ptr) count_call(ALLOC_FREE, __builtin_return_address(0));
+    free(ptr);
+}
+
+static int counting_posix_memalign(void **out, size_t alignment, size_t size) {
+    count_call(ALLOC_MEMALIGN, __builtin_return_address(0));
+    return posix_memalign(out, alignment, size);
+}
+
+static const struct {
+    const void *replacement;
+    const void *original;
+} interposers[] __attribute__((used, section("__DATA,__interpose"))) = {
+    {(const void *)counting_malloc, (const void *)malloc},
+    {(const void *)counting_calloc, (const void *)calloc},
+    {(const void *)counting_realloc, (const void *)realloc},
+    {(const void *)counting_free, (const void *)free},
+    {(const void *)counting_posix_memalign, (const void *)posix_memalign},
+};
+#else
+/*
+ * The executable's definitions take precedence over the C library's for
+ * every caller. The originals are looked up on first use; dlsym may itself
+ * allocate, which is served from a static buffer and never freed.
+ */
+static void *(*real_malloc)(size_t);
+static void *(*real_calloc)(size_t, size_t);
+static void *(*real_realloc)(void *, size_t);
+static void (*real_free)(void *);
+static int (*real_posix_memalign)(void **, size_t, size_t);
+static void *(*real_aligned_alloc)(size_t, size_t);
+
+static _Alignas(64) unsigned char g_bootstrap[8192];
+static size_t g_bootstrap_used;
+static bool g_resolving;
+
+static void *bootstrap_alloc(size_t size) {
+    size = (size + 15) & ~(size_t)15;
+    if (size > sizeof(g_bootstrap) - g_bootstrap_used) return NULL;
+    void *block = g_bootstrap + g_bootstrap_used;
+    g_bootstrap_used += size;
+    return block;
+}
+
+static bool is_bootstrap(const void *ptr) {
+    return (const unsigned char *)ptr >= g_bootstrap && (const unsigned char *)ptr < g_bootstrap + sizeof(g_bootstrap);
+}
+
+static void resolve(void) {
+    if (real_free || g_resolving) return;
+    g_resolving = true;
+    real_malloc = (void *(*)(size_t))dlsym(RTLD_NEXT, "malloc");
+    real_calloc = (void *(*)(size_t, size_t))dlsym(RTLD_NEXT, "calloc");
+    real_realloc = (void *(*)(void *, size_t))dlsym(RTLD_NEXT, "realloc");
+    real_posix_memalign = (int (*)(void **, size_t, size_t))dlsym(RTLD_NEXT, "posix_memalign");
+    real_aligned_alloc = (void *(*)(size_t, size_t))dlsym(RTLD_NEXT, "aligned_alloc");
+    real_free = (void (*)(void *))dlsym(RTLD_NEXT, "free");
+    g_resolving = false;
+}
+
+void *malloc(size_t size) {
+    resolve();
+    if (!real_malloc) return bootstrap_alloc(size);
+    count_call(ALLOC_MALLOC, __builtin_return_address(0));
+    return real_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    resolve();
+    if (!real_calloc) return bootstrap_alloc(count * size);  /* static storage is zeroed */
+    count_call(ALLOC_CALLOC, __builtin_return_address(0));
+    return real_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    resolve();
+    count_call(ALLOC_REALLOC, __builtin_return_address(0));
+    if (is_bootstrap(ptr)) {
+        void *moved = real_malloc(size);
+        if (moved) memcpy(moved, ptr, size);
+        return moved;
+    }
+    return real_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    if (!ptr || is_bootstrap(ptr)) return;
+    resolve();
+    count_call(ALLOC_FREE, __builtin_return_address(0));
+    real_free(ptr);
+}
+
+int posix_memalign(void **out, size_t alignment, size_t size) {
+    resolve();
+    count_call(ALLOC_MEMALIGN, __builtin_return_address(0));
+    return real_posix_memalign(out, alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    resolve();
+    count_call(ALLOC_MEMALIGN, __builtin_return_address(0));
+    return real_aligned_alloc(alignment, size);
+}
+#endif
+
+/**
+ * @brief A session and what the check counts of it.
+ */
+typedef struct {
+    kb_session_t session;               /**< Session under test */
+    unsigned long long unlocks;         /**< Shortcut unlocks seen */
+    atomic_ullong quarantines;          /**< Quarantine notifications delivered */
+    atomic_ullong state_changes;        /**< State notifications delivered */
+} kb_check_t;
+
+static void count_state_change(bool active, void *arg) {
+    (void)active;
+    atomic_fetch_add_explicit(&((kb_check_t *)arg)->state_changes, 1, memory_order_relaxed);
+}
+
+static void count_quarantine(unsigned short key_code, void *arg) {
+    (void)key_code;
+    atomic_fetch_add_explicit(&((kb_check_t *)arg)->quarantines, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Fills settings like the tools' engine configuration (see
+ * bench_setup.c). The candidate shadow rules drop the last default rule,
+ * so they disagree now and then.
+ */
+static void build_settings(app_settings_t *s) {
+    s->blocking_enabled = true;
+    s->shortcut_enabled = true;
+    s->shortcut_flags = 0x00160000ULL;
+    s->shortcut_keycode = 40;
+    s->device_default_policy = KB_DEVICE_POLICY_BLOCK;
+    s->device_policies[41] = KB_DEVICE_POLICY_ALLOW;
+    s->device_policies[58] = KB_DEVICE_POLICY_BLOCK;
+    s->allowed_keys[0] |= 1ULL << 53;
+    s->allowed_keys[1] |= 1ULL << (96 - 64);
+    s->app_policy_mode = KB_APP_MODE_EXCEPT;
+    snprintf(s->app_policy_apps, sizeof(s->app_policy_apps), "com.apple.Safari,org.example.Editor");
+    s->rule_count = KB_BENCH_DEFAULT_RULES;
+    memcpy(s->rules, bench_default_rules, sizeof(bench_default_rules));
+    s->shadow_rule_count = KB_BENCH_DEFAULT_RULES - 1;
+    memcpy(s->shadow_rules, bench_default_rules, s->shadow_rule_count * sizeof(s->shadow_rules[0]));
+    s->shadow_budget_us = 50;
+    s->stuck_key_seconds = 10;
+    s->chatter_ms = 5;
+    remap_init(&s->remap);
+    remap_set(&s->remap, 57, 53);
+}
+
+/**
+ * @brief Handles one event the way the tap callback does after decoding.
+ *
+ * The shortcut turns blocking off; the check turns it back on at once, as
+ * the owner would, with the quarantine cleared, so the stream keeps
+ * exercising the blocking paths.
+ */
+static void handle_event(kb_check_t *check, const kb_event_t *ev) {
+    kb_session_t *session = &check->session;
+    unsigned short key_code;
+
+    (void)session_handle_event(session, ev, trace_now_ns(), &key_code);
+    if (!session->engine.enabled) {
+        check->unlocks++;
+        memset(session->engine.quarantined, 0, sizeof(session->engine.quarantined));
+        session_set_block(session, true, KB_CAUSE_USER);
+    }
+}
+
+/**
+ * @brief Waits for the worker to run reports armed by the last events.
+ */
+static void drain_worker(void) {
+    struct timespec pause = {0, 50 * 1000000L};
+    nanosleep(&pause, NULL);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [-m model] [-n events] [-w events] [-s seed] [-B budget_ns] [-o log]\n"
+            "  -m model     uniform, typing, repeat, chords, mash, flood or mix (default mix)\n"
+            "  -n events    Events checked (default 5000000)\n"
+            "  -w events    Warm-up events before counting starts (default 100000)\n"
+            "  -s seed      Generator seed (default 1)\n"
+            "  -B budget_ns Callback budget; overruns go through the worker's report (default 1000)\n"
+            "  -o log       Where log messages go (default /dev/null); every level is enabled\n",
+            name);
+}
+
+int main(int argc, char *argv[]) {
+    static const char *const frontmost_apps[] = {"com.apple.Terminal", "com.example.game", NULL};
+    kb_workload_model_t model = KB_WORKLOAD_MIX;
+    unsigned long long total = 5000000ULL;
+    unsigned long long warmup = 100000ULL;
+    unsigned long long seed = 1;
+    unsigned long long budget_ns = 1000;
+    const char *log_path = "/dev/null";
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            if (!workload_parse_model(argv[++i], &model)) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            total = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            warmup = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-B") == 0 && i + 1 < argc) {
+            budget_ns = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            log_path = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (!freopen(log_path, "w", stdout)) {
+        fprintf(stderr, "Failed to open %s for writing.\n", log_path);
+        return 1;
+    }
+    init_kb_logger();
+    set_kb_log_level(KB_LOG_LEVEL_ALL);
+
+    kb_arena_t *arena = arena_create(sizeof(kb_check_t) + sizeof(app_settings_t) + sizeof(kb_workload_t) +
+                                     KB_ALLOC_CHECK_BATCH * sizeof(kb_event_t) + KB_SESSION_ARENA_SIZE +
+                                     4 * KB_ARENA_ALIGN);
+    if (!arena) {
+        fprintf(stderr, "Failed to map the arena.\n");
+        return 1;
+    }
+    kb_check_t *check = (kb_check_t *)arena_alloc(arena, sizeof(kb_check_t));
+    app_settings_t *settings = (app_settings_t *)arena_alloc(arena, sizeof(app_settings_t));
+    kb_workload_t *workload = (kb_workload_t *)arena_alloc(arena, sizeof(kb_workload_t));
+    kb_event_t *events = (kb_event_t *)arena_alloc(arena, KB_ALLOC_CHECK_BATCH * sizeof(kb_event_t));
+
+    static const kb_instance_callbacks_t callbacks = {
+        .state_changed = count_state_change,
+        .key_quarantined = count_quarantine,
+    };
+    build_settings(settings);
+    if (!session_start(&check->session, settings, &callbacks, check, arena)) {
+        fprintf(stderr, "Failed to start the worker.\n");
+        return 1;
+    }
+    kb_session_t *session = &check->session;
+    session->tap_watchdog.budget_ns = budget_ns;
+    engine_quarantine_key(&session->engine, 7);
+    engine_quarantine_key(&session->engine, KB_KEY_MEDIA_BASE + 2);
+    /* An unlock early in every stream keeps since_unlock rules reachable */
+    session->engine.last_unlock = 1000000000ULL;
+
+    char heatmap_path[] = "/tmp/kb_alloc_check.XXXXXX";
+    int fd = mkstemp(heatmap_path);
+    if (fd >= 0) {
+        close(fd);
+        session->heatmap = heatmap_open(heatmap_path);
+        unlink(heatmap_path);
+    }
+    workload_init(workload, model, seed, 40);
+
+    unsigned long long batches = 0;
+    for (unsigned long long done = 0, end = warmup; done < warmup + total; batches++) {
+        if (done == end) {
+            drain_worker();
+            atomic_store_explicit(&g_armed, true, memory_order_release);
+            end = warmup + total;
+        }
+        size_t count = KB_ALLOC_CHECK_BATCH;
+        if (count > end - done) count = (size_t)(end - done);
+        if (batches % KB_ALLOC_CHECK_APP_PERIOD == 0) {
+            session_set_frontmost_application(session, frontmost_apps[(batches / KB_ALLOC_CHECK_APP_PERIOD) % 3]);
+        }
+        workload_generate(workload, events, count);
+        if (batches % KB_ALLOC_CHECK_APP_PERIOD == 0) {
+            /* The generated streams never press the shortcut; unlocks notify the owner */
+            events[0].type = KB_EVENT_KEY_DOWN;
+            events[0].flags = settings->shortcut_flags;
+            events[0].key_code = settings->shortcut_keycode;
+            events[0].autorepeat = false;
+        }
+        for (size_t i = 0; i < count; i++) handle_event(check, &events[i]);
+        done += count;
+    }
+    drain_worker();
+    atomic_store_explicit(&g_armed, false, memory_order_release);
+
+    unsigned long long overruns = (unsigned long long)session->tap_watchdog.overruns;
+    unsigned long long disagreements = (unsigned long long)atomic_load(&session->shadow.head);
+    session_stop(session);
+    fflush(stdout);
+
+    uint64_t counted = 0;
+    for (int k = 0; k < ALLOC_KIND_COUNT; k++) counted += atomic_load(&g_counts[k]);
+    fprintf(stderr,
+            "%s: %llu events after %llu warm-up, %llu unlocks, %llu state notifications, %llu quarantines, "
+            "%llu slow callbacks, %llu shadow disagreements queued\n",
+            workload_model_name(model), total, warmup, check->unlocks, atomic_load(&check->state_changes),
+            atomic_load(&check->quarantines), overruns, disagreements);
+    if (counted == 0) {
+        fprintf(stderr, "No allocator calls while capturing.\n");
+        arena_destroy(arena);
+        return 0;
+    }
+
+    fprintf(stderr, "FAIL: %llu allocator calls while capturing:", (unsigned long long)counted);
+    for (int k = 0; k < ALLOC_KIND_COUNT; k++) {
+        uint64_t n = atomic_load(&g_counts[k]);
+        if (n) fprintf(stderr, " %s %llu", alloc_names[k], (unsigned long long)n);
+    }
+    fprintf(stderr, "\n");
+    unsigned int sites = atomic_load(&g_site_count);
+    for (unsigned int i = 0; i < sites && i < KB_ALLOC_CHECK_SITES; i++) {
+        Dl_info info;
+        if (dladdr(g_sites[i], &info) && info.dli_sname) {
+            fprintf(stderr, "  %s from %s+%#lx (%s)\n", alloc_names[g_site_kinds[i]], info.dli_sname,
+                    (unsigned long)((const char *)g_sites[i] - (const char *)info.dli_saddr), info.dli_fname);
+        } else {
+            fprintf(stderr, "  %s from %p\n", alloc_names[g_site_kinds[i]], g_sites[i]);
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,330 @@
+/**
+ * @file kb_analyze.c
+ * @brief Parallel offline evaluation of a policy over many traces.
+ *
+ * Binary replay traces are split into chunks of a fixed number of events;
+ * flight recorder dumps, which can only be read in order, are one chunk
+ * each. Chunks are decided across all cores by the work-stealing pool, each
+ * into its own statistics, which are merged per worker and then across
+ * workers.
+ *
+ * Every event is decided against the configured state (see bench_setup.h),
+ * as the shadow evaluation does: an unlock is counted, but does not turn
+ * blocking off for the events after it. That keeps chunks independent.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "bench_setup.h"
+#include "engine.h"
+#include "logger.h"
+#include "replay.h"
+#include "work_pool.h"
+
+/** @brief Default events per chunk. */
+#define KB_ANALYZE_CHUNK 1000000ULL
+
+/** @brief Events read per batch within a chunk. */
+#define KB_ANALYZE_BATCH 4096
+
+/** @brief Latency buckets: bucket b counts decisions under 2^b nanoseconds. */
+#define KB_ANALYZE_BUCKETS 24
+
+/**
+ * @brief A contiguous range of events in one trace.
+ */
+typedef struct {
+    const char *path;           /**< Trace file */
+    uint64_t first;             /**< Index of the first event */
+    uint64_t count;             /**< Number of events, UINT64_MAX for the whole dump */
+} kb_chunk_t;
+
+/**
+ * @brief Verdict and latency statistics; one per chunk, merged per worker.
+ */
+typedef struct {
+    _Alignas(64) uint64_t events;                   /**< Events decided */
+    uint64_t chunks;                                /**< Chunks merged in */
+    uint64_t outcomes[KB_VERDICT_COUNT][KB_REASON_COUNT]; /**< Events by verdict and reason */
+    uint64_t latency[KB_ANALYZE_BUCKETS];           /**< Decision time histogram */
+    uint64_t latency_sum_ns;                        /**< Total decision time */
+    uint64_t latency_max_ns;                        /**< Slowest decision */
+    uint64_t errors;                                /**< Chunks that could not be read */
+} kb_analysis_t;
+
+/**
+ * @brief Everything a run shares between workers.
+ */
+typedef struct {
+    const kb_bench_setup_t *setup;  /**< Policy to evaluate */
+    const kb_chunk_t *chunks;       /**< Chunks, indexed by task */
+    kb_analysis_t *workers;         /**< Per-worker totals */
+} kb_analyze_run_t;
+
+static kb_bench_setup_t setup;
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Returns the latency bucket for a duration.
+ */
+static unsigned int latency_bucket(uint64_t ns) {
+    unsigned int bucket = 0;
+    while (bucket + 1 < KB_ANALYZE_BUCKETS && (1ULL << bucket) <= ns) bucket++;
+    return bucket;
+}
+
+/**
+ * @brief Adds one set of statistics to another.
+ */
+static void analysis_merge(kb_analysis_t *into, const kb_analysis_t *from) {
+    into->events += from->events;
+    into->chunks += from->chunks;
+    for (int v = 0; v < KB_VERDICT_COUNT; v++) {
+        for (int r = 0; r < KB_REASON_COUNT; r++) into->outcomes[v][r] += from->outcomes[v][r];
+    }
+    for (int b = 0; b < KB_ANALYZE_BUCKETS; b++) into->latency[b] += from->latency[b];
+    into->latency_sum_ns += from->latency_sum_ns;
+    if (from->latency_max_ns > into->latency_max_ns) into->latency_max_ns = from->latency_max_ns;
+    into->errors += from->errors;
+}
+
+/**
+ * @brief Pool task: decides one chunk and merges its statistics into the
+ * worker's totals.
+ */
+static void analyze_chunk(void *arg, size_t task, unsigned int worker) {
+    kb_analyze_run_t *run = arg;
+    const kb_chunk_t *chunk = &run->chunks[task];
+    kb_analysis_t stats;
+    kb_replay_reader_t reader;
+    kb_event_t events[KB_ANALYZE_BATCH];
+
+    memset(&stats, 0, sizeof(stats));
+    stats.chunks = 1;
+    if (!replay_open(&reader, chunk->path)) {
+        stats.errors++;
+        analysis_merge(&run->workers[worker], &stats);
+        return;
+    }
+    if (chunk->first && !replay_seek(&reader, chunk->first)) stats.errors++;
+
+    uint64_t left = chunk->count;
+    while (left > 0 && !stats.errors) {
+        size_t want = left < KB_ANALYZE_BATCH ? (size_t)left : KB_ANALYZE_BATCH;
+        size_t count = replay_read(&reader, events, want);
+        if (count == 0) break;
+
+        uint64_t previous = now_ns();
+        for (size_t i = 0; i < count; i++) {
+            kb_reason_t reason;
+            kb_verdict_t verdict = engine_decide(&run->setup->engine, &events[i], &reason);
+            uint64_t now = now_ns();
+            uint64_t elapsed = now - previous;
+            previous = now;
+
+            stats.outcomes[verdict][reason]++;
+            stats.latency[latency_bucket(elapsed)]++;
+            stats.latency_sum_ns += elapsed;
+            if (elapsed > stats.latency_max_ns) stats.latency_max_ns = elapsed;
+        }
+        stats.events += count;
+        if (left != UINT64_MAX) left -= count;
+    }
+    replay_close(&reader);
+    analysis_merge(&run->workers[worker], &stats);
+}
+
+/**
+ * @brief Splits the traces into chunks.
+ *
+ * @return Number of chunks, written to a newly allocated array.
+ */
+static size_t split_traces(char **paths, int count, uint64_t chunk_events, kb_chunk_t **out) {
+    size_t used = 0, capacity = 64;
+    kb_chunk_t *chunks = malloc(capacity * sizeof(*chunks));
+
+    for (int i = 0; chunks && i < count; i++) {
+        kb_replay_reader_t reader;
+        uint64_t events;
+        if (!replay_open(&reader, paths[i])) continue;
+        bool binary = replay_count(&reader, &events);
+        replay_close(&reader);
+
+        uint64_t pieces = binary ? (events + chunk_events - 1) / chunk_events : 1;
+        for (uint64_t p = 0; p < pieces; p++) {
+            if (used == capacity) {
+                kb_chunk_t *grown = realloc(chunks, capacity * 2 * sizeof(*chunks));
+                if (!grown) {
+                    free(chunks);
+                    return 0;
+                }
+                chunks = grown;
+                capacity *= 2;
+            }
+            kb_chunk_t *chunk = &chunks[used++];
+            chunk->path = paths[i];
+            chunk->first = p * chunk_events;
+            chunk->count = binary ? (events - chunk->first < chunk_events ? events - chunk->first : chunk_events)
+                                  : UINT64_MAX;
+        }
+    }
+    *out = chunks;
+    return chunks ? used : 0;
+}
+
+/**
+ * @brief Decides every chunk with the given number of workers.
+ *
+ * @return Wall time in nanoseconds, or 0 on failure.
+ */
+static uint64_t analyze(const kb_chunk_t *chunks, size_t chunk_count, unsigned int threads, kb_analysis_t *total,
+                        kb_pool_stats_t *stats) {
+    kb_analysis_t *workers = aligned_alloc(64, sizeof(kb_analysis_t) * threads);
+    if (!workers) return 0;
+    memset(workers, 0, sizeof(kb_analysis_t) * threads);
+
+    kb_analyze_run_t run = {&setup, chunks, workers};
+    uint64_t start = now_ns();
+    bool ok = work_pool_run(threads, chunk_count, analyze_chunk, &run, stats);
+    uint64_t elapsed = now_ns() - start;
+
+    memset(total, 0, sizeof(*total));
+    for (unsigned int w = 0; w < threads; w++) analysis_merge(total, &workers[w]);
+    free(workers);
+    return ok ? (elapsed ? elapsed : 1) : 0;
+}
+
+/**
+ * @brief Returns the upper bound of the bucket holding the given quantile.
+ */
+static uint64_t latency_quantile(const kb_analysis_t *a, double quantile) {
+    uint64_t target = (uint64_t)((double)a->events * quantile), seen = 0;
+    for (int b = 0; b < KB_ANALYZE_BUCKETS; b++) {
+        seen += a->latency[b];
+        if (seen > target) return 1ULL << b;
+    }
+    return 1ULL << (KB_ANALYZE_BUCKETS - 1);
+}
+
+static void print_analysis(const kb_analysis_t *a) {
+    printf("%llu events in %llu chunks", (unsigned long long)a->events, (unsigned long long)a->chunks);
+    if (a->errors) printf(", %llu chunks unreadable", (unsigned long long)a->errors);
+    printf("\n\n%-8s %-12s %14s %8s\n", "verdict", "reason", "events", "share");
+    for (int v = 0; v < KB_VERDICT_COUNT; v++) {
+        for (int r = 0; r < KB_REASON_COUNT; r++) {
+            if (!a->outcomes[v][r]) continue;
+            printf("%-8s %-12s %14llu %7.2f%%\n", engine_verdict_name((kb_verdict_t)v),
+                   engine_reason_name((kb_reason_t)r), (unsigned long long)a->outcomes[v][r],
+                   100.0 * (double)a->outcomes[v][r] / (double)a->events);
+        }
+    }
+    if (a->events) {
+        printf("\ndecision latency: mean %.1f ns, p50 < %llu ns, p99 < %llu ns, p99.9 < %llu ns, max %llu ns\n",
+               (double)a->latency_sum_ns / (double)a->events, (unsigned long long)latency_quantile(a, 0.5),
+               (unsigned long long)latency_quantile(a, 0.99), (unsigned long long)latency_quantile(a, 0.999),
+               (unsigned long long)a->latency_max_ns);
+    }
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [-j threads] [-c events] [-S] [-r rule]... [-a bundle_id] trace...\n"
+            "  -j threads    Worker threads (default: online CPUs)\n"
+            "  -c events     Events per chunk of a binary trace (default 1000000)\n"
+            "  -S            Also run with 1, 2, 4, ... threads and report scaling efficiency\n"
+            "  -r rule       Candidate rule to evaluate instead of the defaults; may be repeated\n"
+            "  -a bundle_id  Frontmost application (default com.apple.Terminal)\n",
+            name);
+}
+
+int main(int argc, char *argv[]) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int threads = online > 0 ? (unsigned int)online : 1;
+    uint64_t chunk_events = KB_ANALYZE_CHUNK;
+    bool scaling = false;
+    const char *frontmost = "com.apple.Terminal";
+    size_t rule_count = 0;
+    static char rules_arg[KB_RULES_MAX][KB_RULE_TEXT_MAX];
+    int first_trace = argc;
+
+    set_kb_log_level(KB_LOG_LEVEL_ERROR);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            threads = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            chunk_events = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-S") == 0) {
+            scaling = true;
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            if (rule_count < KB_RULES_MAX) snprintf(rules_arg[rule_count++], KB_RULE_TEXT_MAX, "%s", argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            frontmost = argv[++i];
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 2;
+        } else {
+            first_trace = i;
+            break;
+        }
+    }
+    if (first_trace == argc || chunk_events == 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    if (threads < 1) threads = 1;
+    if (threads > KB_POOL_MAX_THREADS) threads = KB_POOL_MAX_THREADS;
+
+    if (rule_count) {
+        bench_setup_init(&setup, (const char (*)[KB_RULE_TEXT_MAX])rules_arg, rule_count);
+    } else {
+        bench_setup_init(&setup, bench_default_rules, KB_BENCH_DEFAULT_RULES);
+    }
+    bench_setup_activate(&setup, frontmost);
+
+    kb_chunk_t *chunks = NULL;
+    size_t chunk_count = split_traces(&argv[first_trace], argc - first_trace, chunk_events, &chunks);
+    if (chunk_count == 0) {
+        log_message(KB_LOG_LEVEL_ERROR, "No readable traces.");
+        free(chunks);
+        return 1;
+    }
+
+    kb_analysis_t total;
+    kb_pool_stats_t stats;
+    uint64_t elapsed = analyze(chunks, chunk_count, threads, &total, &stats);
+    if (!elapsed) {
+        log_message(KB_LOG_LEVEL_ERROR, "Failed to start the worker pool.");
+        free(chunks);
+        return 1;
+    }
+    print_analysis(&total);
+    printf("%u threads: %.3f s, %.1f M events/s, %llu steals\n", threads, (double)elapsed / 1e9,
+           (double)total.events / ((double)elapsed / 1e3), (unsigned long long)stats.steals);
+
+    if (scaling) {
+        uint64_t single = 0;
+        printf("\n%8s %10s %14s %9s %11s %8s\n", "threads", "seconds", "M events/s", "speedup", "efficiency",
+               "steals");
+        for (unsigned int n = 1; n <= threads; n = n * 2 > threads && n != threads ? threads : n * 2) {
+            kb_analysis_t run;
+            uint64_t ns = analyze(chunks, chunk_count, n, &run, &stats);
+            if (!ns) break;
+            if (n == 1) single = ns;
+            double speedup = (double)single / (double)ns;
+            printf("%8u %10.3f %14.1f %8.2fx %10.1f%% %8llu\n", n, (double)ns / 1e9,
+                   (double)run.events / ((double)ns / 1e3), speedup, 100.0 * speedup / n,
+                   (unsigned long long)stats.steals);
+        }
+    }
+    free(chunks);
+    return total.errors ? 1 : 0;
+}
@@ -0,0 +1,532 @@
+/**
+ * @file kb_bench.c
+ * @brief Differential benchmark of the decision engines.
+ *
+ * Feeds the same event stream to the reference model (engine_ref.h) and to
+ * every optimized engine, checks that each returns the reference verdict
+ * and reason for every event, and reports the time per event and the
+ * speedup over the reference. The engine also runs with the flight recorder
+ * on, to measure what recording costs per event. With the default rules, an engine whose rule
+ * stage is bench_default_rules written out in C shows what the rules
+ * bytecode costs. The same events are also remapped through a
+ * remap table and through the equivalent hand-written switch, to show what
+ * the table lookup costs.
+ *
+ * With -L it instead measures how long a thread at each tap_priority takes
+ * to wake for a timestamped write while every CPU is kept busy, which is the
+ * delay the tap thread adds before a keystroke under load.
+ *
+ * Streams are either generated in-process by a workload model (seeded, so a
+ * run can be repeated) or read from replay traces and flight recorder dumps
+ * given on the command line.
+ * Runs on any POSIX system; see "make tools".
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "batch.h"
+#include "bench_setup.h"
+#include "engine.h"
+#include "engine_ref.h"
+#include "flight_recorder.h"
+#include "logger.h"
+#include "remap.h"
+#include "replay.h"
+#include "rules.h"
+#include "thread_priority.h"
+#include "workload.h"
+
+/** @brief Maximum events decided per batch. */
+#define KB_BENCH_BATCH KB_BATCH_MAX
+
+/** @brief Mismatches printed before the rest are only counted. */
+#define KB_BENCH_MAX_REPORTED 10
+
+/** @brief Generated batches between changes of the frontmost application. */
+#define KB_BENCH_APP_PERIOD 64
+
+/** @brief Wakeups timed per row of the saturation run (-L). */
+#define KB_BENCH_WAKEUPS 2000
+
+/** @brief Time between the saturation run's wakeups, in nanoseconds. */
+#define KB_BENCH_WAKEUP_INTERVAL_NS 1000000ULL
+
+/** @brief Busy threads per CPU during the saturation run. */
+#define KB_BENCH_SPINNERS_PER_CPU 2
+
+/** @brief Modifier bits as they appear in kb_event_t flags (CGEventFlags). */
+#define FLAG_SHIFT   0x00020000ULL
+#define FLAG_CONTROL 0x00040000ULL
+#define FLAG_OPTION  0x00080000ULL
+#define FLAG_COMMAND 0x00100000ULL
+
+/**
+ * @brief Decides a batch of events.
+ */
+typedef void (*kb_bench_decide_t)(const kb_bench_setup_t *setup, const kb_event_t *events, const kb_batch_t *batch,
+                                  kb_verdict_t *verdicts, kb_reason_t *reasons);
+
+/**
+ * @brief An engine under test and its results.
+ */
+typedef struct {
+    const char *name;           /**< Name printed in the report */
+    kb_bench_decide_t decide;   /**< Batch entry point */
+    int batch_impl;             /**< Classification kernel a batch engine needs, -1 for none */
+    bool skipped;               /**< Not run: the CPU lacks the kernel */
+    uint64_t elapsed_ns;        /**< Time spent deciding */
+    uint64_t mismatches;        /**< Events that disagreed with the reference */
+} kb_bench_engine_t;
+
+static void decide_reference(const kb_bench_setup_t *setup, const kb_event_t *events, const kb_batch_t *batch,
+                             kb_verdict_t *verdicts, kb_reason_t *reasons) {
+    for (size_t i = 0; i < batch->count; i++) {
+        verdicts[i] = engine_ref_decide(&setup->model, &events[i], &reasons[i]);
+    }
+}
+
+static void decide_engine(const kb_bench_setup_t *setup, const kb_event_t *events, const kb_batch_t *batch,
+                          kb_verdict_t *verdicts, kb_reason_t *reasons) {
+    for (size_t i = 0; i < batch->count; i++) verdicts[i] = engine_decide(&setup->engine, &events[i], &reasons[i]);
+}
+
+/** @brief Recorder written by decide_engine_recorded(). */
+static kb_flight_recorder_t recorder;
+
+static void decide_engine_recorded(const kb_bench_setup_t *setup, const kb_event_t *events, const kb_batch_t *batch,
+                                   kb_verdict_t *verdicts, kb_reason_t *reasons) {
+    for (size_t i = 0; i < batch->count; i++) {
+        verdicts[i] = engine_decide(&setup->engine, &events[i], &reasons[i]);
+        flight_recorder_event(&recorder, &events[i], verdicts[i], reasons[i]);
+    }
+}
+
+static void decide_batch_scalar(const kb_bench_setup_t *setup, const kb_event_t *events, const kb_batch_t *batch,
+                                kb_verdict_t *verdicts, kb_reason_t *reasons) {
+    (void)events;
+    batch_decide(&setup->engine, KB_BATCH_SCALAR, batch, verdicts, reasons);
+}
+
+static void decide_batch_sse2(const kb_bench_setup_t *setup, const kb_event_t *events, const kb_batch_t *batch,
+                              kb_verdict_t *verdicts, kb_reason_t *reasons) {
+    (void)events;
+    batch_decide(&setup->engine, KB_BATCH_SSE2, batch, verdicts, reasons);
+}
+
+static void decide_batch_avx2(const kb_bench_setup_t *setup, const kb_event_t *events, const kb_batch_t *batch,
+                              kb_verdict_t *verdicts, kb_reason_t *reasons) {
+    (void)events;
+    batch_decide(&setup->engine, KB_BATCH_AVX2, batch, verdicts, reasons);
+}
+
+/** @brief Whether com.apple.Terminal is frontmost, for decide_hand_rules(). */
+static bool terminal_frontmost;
+
+/**
+ * @brief bench_default_rules written out by hand.
+ *
+ * @return The verdict of the first matching rule, or KB_RULES_NO_MATCH.
+ */
+static inline int hand_rules(const kb_engine_t *engine, const kb_event_t *ev) {
+    uint64_t since_unlock = engine->last_unlock && ev->timestamp >= engine->last_unlock
+                                ? (ev->timestamp - engine->last_unlock) / 1000000ULL
+                                : UINT32_MAX;
+
+    if (terminal_frontmost && (ev->flags & FLAG_COMMAND) && ev->key_code == 48) return KB_VERDICT_PASS;
+    if (since_unlock < 2000 && !(ev->flags & (FLAG_SHIFT | FLAG_OPTION))) return KB_VERDICT_BLOCK;
+    if (ev->key_code >= 122 && ev->key_code <= 126 && !ev->autorepeat) return KB_VERDICT_PASS;
+    if (ev->device == 59 || ((ev->flags & FLAG_CONTROL) && ev->type == KB_EVENT_KEY_UP)) return KB_VERDICT_BLOCK;
+    if (ev->key_code == KB_KEY_MEDIA_BASE || ev->key_code == KB_KEY_MEDIA_BASE + 1) return KB_VERDICT_PASS;
+    return KB_RULES_NO_MATCH;
+}
+
+/**
+ * @brief The engine with hand_rules() in place of the rules bytecode.
+ *
+ * The rules run first in the policy stage, so deciding without rules and
+ * applying hand_rules() to events that reached that stage is equivalent.
+ */
+static void decide_hand_rules(const kb_bench_setup_t *setup, const kb_event_t *events, const kb_batch_t *batch,
+                              kb_verdict_t *verdicts, kb_reason_t *reasons) {
+    for (size_t i = 0; i < batch->count; i++) {
+        verdicts[i] = engine_decide_with_rules(&setup->engine, NULL, &events[i], &reasons[i]);
+        switch (reasons[i]) {
+            case KB_REASON_ALLOWED_KEY:
+            case KB_REASON_DEVICE:
+            case KB_REASON_APP:
+            case KB_REASON_BLOCKING: {
+                int ruled = hand_rules(&setup->engine, &events[i]);
+                if (ruled == KB_RULES_NO_MATCH) break;
+                verdicts[i] = (kb_verdict_t)ruled;
+                reasons[i] = KB_REASON_RULE;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+/** @brief Engines under test; the reference must stay first. */
+static kb_bench_engine_t engines[] = {
+    {"reference", decide_reference, -1, false, 0, 0},
+    {"engine", decide_engine, -1, false, 0, 0},
+    {"engine+rec", decide_engine_recorded, -1, false, 0, 0},
+    {"batch-scalar", decide_batch_scalar, KB_BATCH_SCALAR, false, 0, 0},
+    {"batch-sse2", decide_batch_sse2, KB_BATCH_SSE2, false, 0, 0},
+    {"batch-avx2", decide_batch_avx2, KB_BATCH_AVX2, false, 0, 0},
+    {"hand-rules", decide_hand_rules, -1, false, 0, 0},
+};
+
+#define ENGINE_COUNT (sizeof(engines) / sizeof(engines[0]))
+
+/** @brief Remap table applied to every event: caps lock off, option and command swapped, right command to control. */
+static const char bench_remap[] = "57:none,0x3A:0x37,0x37:0x3A,0x36:0x3B";
+
+/**
+ * @brief bench_remap written out by hand.
+ */
+static inline unsigned short remap_switch(unsigned short key) {
+    switch (key) {
+        case 57: return KB_KEY_NONE;
+        case 0x3A: return 0x37;
+        case 0x37: return 0x3A;
+        case 0x36: return 0x3B;
+        default: return key;
+    }
+}
+
+/**
+ * @brief The remap table timed against remap_switch().
+ */
+static struct {
+    kb_remap_t table;       /**< bench_remap, parsed */
+    uint64_t table_ns;      /**< Time spent in remap_lookup() */
+    uint64_t switch_ns;     /**< Time spent in remap_switch() */
+    uint64_t mismatches;    /**< Events the two mapped differently */
+} remap;
+
+/** @brief Applications the generator cycles through as frontmost. */
+static const char *const frontmost_apps[] = {"com.apple.Terminal", "com.apple.Safari", "org.example.Editor", NULL};
+
+static kb_bench_setup_t setup;
+
+/**
+ * @brief Makes an application frontmost for every engine.
+ */
+static void activate(const char *bundle_id) {
+    bench_setup_activate(&setup, bundle_id);
+    terminal_frontmost = bundle_id && strcmp(bundle_id, "com.apple.Terminal") == 0;
+}
+
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Runs one batch through every engine and compares with the reference.
+ */
+static void run_batch(const kb_event_t *events, size_t count) {
+    static kb_verdict_t verdicts[ENGINE_COUNT][KB_BENCH_BATCH];
+    static kb_reason_t reasons[ENGINE_COUNT][KB_BENCH_BATCH];
+    static kb_batch_t batch;
+    static unsigned short table_keys[KB_BENCH_BATCH];
+    static unsigned short switch_keys[KB_BENCH_BATCH];
+    static uint64_t reported;
+
+    /* Batch sources deliver events field by field; building the batch is not timed */
+    batch_from_events(&batch, events, count);
+    for (size_t e = 0; e < ENGINE_COUNT; e++) {
+        if (engines[e].skipped) continue;
+        uint64_t start = now_ns();
+        engines[e].decide(&setup, events, &batch, verdicts[e], reasons[e]);
+        engines[e].elapsed_ns += now_ns() - start;
+    }
+
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < count; i++) table_keys[i] = remap_lookup(&remap.table, events[i].key_code);
+    remap.table_ns += now_ns() - start;
+    start = now_ns();
+    for (size_t i = 0; i < count; i++) switch_keys[i] = remap_switch(events[i].key_code);
+    remap.switch_ns += now_ns() - start;
+
+    for (size_t e = 1; e < ENGINE_COUNT; e++) {
+        if (engines[e].skipped) continue;
+        for (size_t i = 0; i < count; i++) {
+            if (verdicts[e][i] == verdicts[0][i] && reasons[e][i] == reasons[0][i]) continue;
+            engines[e].mismatches++;
+            if (reported++ >= KB_BENCH_MAX_REPORTED) continue;
+            const kb_event_t *ev = &events[i];
+            printf("MISMATCH %s: %llu,%s,%hu,0x%llx,%u%s frontmost=%s: reference %s/%s, got %s/%s\n",
+                   engines[e].name, (unsigned long long)ev->timestamp, engine_event_type_name(ev->type),
+                   ev->key_code, ev->flags, ev->device, ev->autorepeat ? ",repeat" : "",
+                   setup.model.frontmost ? setup.model.frontmost : "none", engine_verdict_name(verdicts[0][i]),
+                   engine_reason_name(reasons[0][i]), engine_verdict_name(verdicts[e][i]),
+                   engine_reason_name(reasons[e][i]));
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (table_keys[i] == switch_keys[i]) continue;
+        remap.mismatches++;
+        if (reported++ >= KB_BENCH_MAX_REPORTED) continue;
+        printf("MISMATCH remap: key %hu: switch %hu, table %hu\n", events[i].key_code, switch_keys[i], table_keys[i]);
+    }
+}
+
+/** @brief Keeps the spinner threads running during the saturation run. */
+static atomic_bool spinning;
+
+static void *spin(void *arg) {
+    (void)arg;
+    volatile uint64_t n = 0;
+    while (atomic_load_explicit(&spinning, memory_order_relaxed)) n++;
+    return NULL;
+}
+
+/**
+ * @brief A stand-in for the tap thread: wakes for each timestamp written to
+ * its pipe and records how late it woke.
+ */
+typedef struct {
+    int fd;                                 /**< Read end of the pipe */
+    kb_thread_priority_t priority;          /**< Priority it runs at */
+    bool applied;                           /**< The system accepted the priority */
+    uint64_t latency[KB_BENCH_WAKEUPS];     /**< Wakeup delays, in nanoseconds */
+} kb_bench_waker_t;
+
+static void *wake(void *arg) {
+    kb_bench_waker_t *waker = (kb_bench_waker_t *)arg;
+    waker->applied = thread_priority_apply_self(waker->priority);
+    for (size_t i = 0; i < KB_BENCH_WAKEUPS; i++) {
+        uint64_t sent;
+        if (read(waker->fd, &sent, sizeof(sent)) != (ssize_t)sizeof(sent)) break;
+        waker->latency[i] = now_ns() - sent;
+    }
+    return NULL;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/**
+ * @brief Times KB_BENCH_WAKEUPS wakeups of a thread at one priority and
+ * prints a row: mean, median, 99th percentile and worst delay.
+ *
+ * @return False if the thread could not be created.
+ */
+static bool run_wakeups(kb_thread_priority_t priority, const char *load) {
+    static kb_bench_waker_t waker;
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    memset(&waker, 0, sizeof(waker));
+    waker.fd = fds[0];
+    waker.priority = priority;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    thread_priority_init_attr(&attr, priority);
+    pthread_t thread;
+    int err = pthread_create(&thread, &attr, wake, &waker);
+    pthread_attr_destroy(&attr);
+    if (err != 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    for (size_t i = 0; i < KB_BENCH_WAKEUPS; i++) {
+        struct timespec interval = {0, (long)KB_BENCH_WAKEUP_INTERVAL_NS};
+        nanosleep(&interval, NULL);
+        uint64_t sent = now_ns();
+        if (write(fds[1], &sent, sizeof(sent)) != (ssize_t)sizeof(sent)) break;
+    }
+    pthread_join(thread, NULL);
+    close(fds[0]);
+    close(fds[1]);
+
+    uint64_t sum = 0;
+    for (size_t i = 0; i < KB_BENCH_WAKEUPS; i++) sum += waker.latency[i];
+    qsort(waker.latency, KB_BENCH_WAKEUPS, sizeof(waker.latency[0]), compare_u64);
+    printf("%-12s %-6s %10.1f %10.1f %10.1f %10.1f %8s\n", thread_priority_name(priority), load,
+           (double)sum / KB_BENCH_WAKEUPS / 1000.0, (double)waker.latency[KB_BENCH_WAKEUPS / 2] / 1000.0,
+           (double)waker.latency[KB_BENCH_WAKEUPS * 99 / 100] / 1000.0,
+           (double)waker.latency[KB_BENCH_WAKEUPS - 1] / 1000.0, waker.applied ? "yes" : "no");
+    return true;
+}
+
+/**
+ * @brief Saturation run: wakeup delay at the default priority on an idle
+ * machine, then at every priority with all CPUs busy.
+ *
+ * @return Exit status.
+ */
+static int run_saturation(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) cpus = 1;
+    size_t spinner_count = (size_t)cpus * KB_BENCH_SPINNERS_PER_CPU;
+    pthread_t *spinners = calloc(spinner_count, sizeof(*spinners));
+    if (!spinners) return 2;
+
+    printf("tap wakeup delay, %d wakeups per row, %zu busy threads on %ld CPUs\n", KB_BENCH_WAKEUPS, spinner_count,
+           cpus);
+    printf("%-12s %-6s %10s %10s %10s %10s %8s\n", "priority", "load", "mean us", "p50 us", "p99 us", "max us",
+           "applied");
+    bool ok = run_wakeups(KB_THREAD_PRIORITY_DEFAULT, "idle");
+
+    atomic_store(&spinning, true);
+    size_t started = 0;
+    while (started < spinner_count && pthread_create(&spinners[started], NULL, spin, NULL) == 0) started++;
+    static const kb_thread_priority_t priorities[] = {
+        KB_THREAD_PRIORITY_DEFAULT, KB_THREAD_PRIORITY_INTERACTIVE, KB_THREAD_PRIORITY_REALTIME};
+    for (size_t p = 0; p < sizeof(priorities) / sizeof(priorities[0]); p++) {
+        ok = run_wakeups(priorities[p], "busy") && ok;
+    }
+    atomic_store(&spinning, false);
+    for (size_t i = 0; i < started; i++) pthread_join(spinners[i], NULL);
+    free(spinners);
+    return ok && started == spinner_count ? 0 : 2;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [-m model] [-n events] [-s seed] [-b size] [-D] [-r rule]... [-a bundle_id] [trace...]\n"
+            "       %s -L\n"
+            "  -m model      Workload model, see kb_gen (default uniform)\n"
+            "  -n events     Number of generated events (default 10000000); ignored with traces\n"
+            "  -s seed       Generator seed (default 1)\n"
+            "  -b size       Events per batch, up to 4096 (default 4096)\n"
+            "  -D            Decide with blocking off, as between blocking sessions\n"
+            "  -r rule       Rule to use instead of the defaults; may be repeated\n"
+            "  -a bundle_id  Frontmost application (default: cycle through a fixed set)\n"
+            "  trace         Replay trace or flight recorder dump to decide instead\n"
+            "  -L            Time tap thread wakeups at each tap_priority with every CPU busy\n",
+            name, name);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned long long total = 10000000ULL;
+    uint64_t seed = 1;
+    kb_workload_model_t model = KB_WORKLOAD_UNIFORM;
+    size_t batch_size = KB_BENCH_BATCH;
+    bool disabled = false;
+    const char *frontmost = NULL;
+    size_t rule_count = 0;
+    static char rules_arg[KB_RULES_MAX][KB_RULE_TEXT_MAX];
+    int first_trace = argc;
+
+    set_kb_log_level(KB_LOG_LEVEL_ERROR);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            if (!workload_parse_model(argv[++i], &model)) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            total = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            batch_size = strtoul(argv[++i], NULL, 10);
+            if (batch_size < 1 || batch_size > KB_BENCH_BATCH) batch_size = KB_BENCH_BATCH;
+        } else if (strcmp(argv[i], "-D") == 0) {
+            disabled = true;
+        } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+            if (rule_count < KB_RULES_MAX) snprintf(rules_arg[rule_count++], KB_RULE_TEXT_MAX, "%s", argv[i + 1]);
+            i++;
+        } else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            frontmost = argv[++i];
+        } else if (strcmp(argv[i], "-L") == 0) {
+            return run_saturation();
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 2;
+        } else {
+            first_trace = i;
+            break;
+        }
+    }
+
+    if (rule_count) {
+        bench_setup_init(&setup, (const char (*)[KB_RULE_TEXT_MAX])rules_arg, rule_count);
+    } else {
+        bench_setup_init(&setup, bench_default_rules, KB_BENCH_DEFAULT_RULES);
+    }
+    activate(frontmost ? frontmost : frontmost_apps[0]);
+    setup.engine.enabled = !disabled;
+    flight_recorder_init(&recorder);
+    remap_parse(&remap.table, bench_remap);
+    for (size_t e = 0; e < ENGINE_COUNT; e++) {
+        if (engines[e].batch_impl >= 0) engines[e].skipped = !batch_impl_available((kb_batch_impl_t)engines[e].batch_impl);
+        /* hand_rules() only encodes the default rules */
+        if (engines[e].decide == decide_hand_rules) engines[e].skipped = rule_count > 0;
+    }
+
+    static kb_event_t events[KB_BENCH_BATCH];
+    unsigned long long decided = 0;
+
+    if (first_trace < argc) {
+        for (int i = first_trace; i < argc; i++) {
+            kb_replay_reader_t reader;
+            if (!replay_open(&reader, argv[i])) return 2;
+            size_t count;
+            while ((count = replay_read(&reader, events, batch_size)) > 0) {
+                run_batch(events, count);
+                decided += count;
+            }
+            replay_close(&reader);
+        }
+    } else {
+        static kb_workload_t workload;
+        workload_init(&workload, model, seed, 40);
+        for (unsigned long long batch = 0; decided < total; batch++) {
+            if (!frontmost && batch % KB_BENCH_APP_PERIOD == 0) {
+                activate(frontmost_apps[(batch / KB_BENCH_APP_PERIOD) % (sizeof(frontmost_apps) / sizeof(frontmost_apps[0]))]);
+            }
+            size_t count = total - decided < batch_size ? (size_t)(total - decided) : batch_size;
+            workload_generate(&workload, events, count);
+            run_batch(events, count);
+            decided += count;
+        }
+    }
+
+    printf("%llu events in batches of %zu, %zu rules, blocking %s\n", decided, batch_size, setup.model.rule_count,
+           disabled ? "off" : "on");
+    printf("%-12s %12s %10s %10s %12s\n", "engine", "ns/event", "speedup", "vs engine", "mismatches");
+    bool failed = false;
+    for (size_t e = 0; e < ENGINE_COUNT; e++) {
+        if (engines[e].skipped) {
+            printf("%-12s %12s\n", engines[e].name, "n/a");
+            continue;
+        }
+        double per_event = decided ? (double)engines[e].elapsed_ns / (double)decided : 0.0;
+        double speedup = engines[e].elapsed_ns ? (double)engines[0].elapsed_ns / (double)engines[e].elapsed_ns : 0.0;
+        double scalar = engines[e].elapsed_ns ? (double)engines[1].elapsed_ns / (double)engines[e].elapsed_ns : 0.0;
+        printf("%-12s %12.2f %9.1fx %9.2fx %12llu\n", engines[e].name, per_event, speedup, scalar,
+               (unsigned long long)engines[e].mismatches);
+        if (engines[e].mismatches) failed = true;
+    }
+    if (!engines[2].skipped) {
+        printf("flight recorder overhead: %.2f ns/event\n",
+               decided ? ((double)engines[2].elapsed_ns - (double)engines[1].elapsed_ns) / (double)decided : 0.0);
+    }
+    printf("%-12s %12s %10s %10s %12s\n", "remap", "ns/event", "", "vs switch", "mismatches");
+    printf("%-12s %12.2f %10s %9.2fx %12llu\n", "switch", decided ? (double)remap.switch_ns / (double)decided : 0.0,
+           "", 1.0, 0ULL);
+    printf("%-12s %12.2f %10s %9.2fx %12llu\n", "table", decided ? (double)remap.table_ns / (double)decided : 0.0, "",
+           remap.table_ns ? (double)remap.switch_ns / (double)remap.table_ns : 0.0,
+           (unsigned long long)remap.mismatches);
+    if (remap.mismatches) failed = true;
+    return failed ? 1 : 0;
+}
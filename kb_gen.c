@@ -0,0 +1,102 @@
+/**
+ * @file kb_gen.c
+ * @brief Writes synthetic keyboard event streams as replay traces.
+ *
+ * The traces replay through kb_bench like recorded ones. The same model,
+ * seed and device always produce the same file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "engine.h"
+#include "logger.h"
+#include "replay.h"
+#include "workload.h"
+
+/** @brief Events generated per write. */
+#define KB_GEN_BATCH 4096
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "Usage: %s [-m model] [-n events] [-s seed] [-d device] [-o file]\n"
+            "  -m model   uniform, typing, repeat, chords, mash, flood or mix (default mix)\n"
+            "  -n events  Number of events (default 1000000)\n"
+            "  -s seed    Generator seed (default 1)\n"
+            "  -d device  Keyboard type of the events (default 40)\n"
+            "  -o file    Output trace (default stdout)\n",
+            name);
+}
+
+int main(int argc, char *argv[]) {
+    kb_workload_model_t model = KB_WORKLOAD_MIX;
+    unsigned long long total = 1000000ULL;
+    unsigned long long seed = 1;
+    unsigned int device = 40;
+    const char *output = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+            if (!workload_parse_model(argv[++i], &model)) {
+                usage(argv[0]);
+                return 2;
+            }
+        } else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            total = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seed = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+            device = (unsigned int)strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    FILE *out = output ? fopen(output, "wb") : stdout;
+    if (!out) {
+        log_message(KB_LOG_LEVEL_ERROR, "Failed to open %s for writing.", output);
+        return 1;
+    }
+
+    static kb_workload_t workload;
+    static kb_event_t events[KB_GEN_BATCH];
+    unsigned long long types[KB_EVENT_TYPE_COUNT] = {0};
+    unsigned long long repeats = 0;
+    uint64_t first = 0, last = 0;
+    bool ok = replay_write_header(out);
+
+    workload_init(&workload, model, seed, device);
+    for (unsigned long long done = 0; ok && done < total;) {
+        size_t count = total - done < KB_GEN_BATCH ? (size_t)(total - done) : KB_GEN_BATCH;
+        workload_generate(&workload, events, count);
+        for (size_t i = 0; i < count; i++) {
+            types[events[i].type]++;
+            if (events[i].autorepeat) repeats++;
+        }
+        if (done == 0) first = events[0].timestamp;
+        last = events[count - 1].timestamp;
+        ok = replay_write(out, events, count);
+        done += count;
+    }
+    if (out != stdout) {
+        if (fclose(out) != 0) ok = false;
+    } else if (fflush(out) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        log_message(KB_LOG_LEVEL_ERROR, "Failed to write the trace.");
+        return 1;
+    }
+
+    double seconds = (double)(last - first) / 1e9;
+    fprintf(stderr, "%s: %llu events over %.1f s (%.0f events/s):", workload_model_name(model), total, seconds,
+            seconds > 0 ? (double)total / seconds : 0.0);
+    for (int t = 0; t < KB_EVENT_TYPE_COUNT; t++) {
+        if (types[t]) fprintf(stderr, " %s %llu", engine_event_type_name((kb_event_type_t)t), types[t]);
+    }
+    fprintf(stderr, ", auto-repeat %llu\n", repeats);
+    return 0;
+}
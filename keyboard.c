@@ -1,174 +1,87 @@
 /**
  * @file keyboard.c
- * @brief Implementation of keyboard event interception and blocking using CoreGraphics.
+ * @brief Default-instance wrappers for the keyboard API.
  *
- * Provides a low-level event tap to block keyboard input, manage an emergency
- * unlock shortcut, record key combinations, and synchronize settings.
+ * The application runs a single capture session created from settings.conf.
+ * These functions forward to that instance and do nothing before it exists
+ * or after it has been cleaned up.
  */
 
 #include "keyboard.h"
-#include "settings.h"
-#include <ApplicationServices/ApplicationServices.h>
-#include <Carbon/Carbon.h>
+#include "flight_recorder.h"
 #include "logger.h"
-#include <stdio.h>
-#include <stdlib.h>
-#include <pthread.h>
+#include "trace.h"
+#include <stddef.h>
 
-#ifndef kCGEventSystemDefined
-#define kCGEventSystemDefined 14
-#endif
-
-/**
- * @brief Internal context for managing keyboard state.
- */
-typedef struct {
-    CFMachPortRef eventTap;                 /**< Event tap reference */
-    CFRunLoopSourceRef runLoopSource;      /**< Run loop source for the tap */
-    bool enabled;                           /**< Whether blocking is active */
-    bool shortcutEnabled;                   /**< Whether the emergency shortcut is active */
-    bool recording;                         /**< Whether recording a new shortcut */
-    CGEventFlags shortcutFlags;             /**< Modifier flags for shortcut */
-    CGKeyCode shortcutKeyCode;              /**< Key code for shortcut */
-    void (*recordingCallback)(unsigned long long, unsigned short); /**< Callback when recording completes */
-    pthread_t thread;                        /**< Background thread running the event tap */
-} kb_context_t;
-
-/** @brief Global context instance. */
-static kb_context_t *g_context = NULL;
-/** @brief Global callback for recording shortcuts. */
+/** @brief The default instance, NULL until setupKeyboardEventTap succeeds. */
+static kb_instance_t *g_instance = NULL;
+/** @brief Global callback for recording. */
 static void (*g_recording_callback)(unsigned long long, unsigned short) = NULL;
+/** @brief Global callback for quarantined keys. */
+static void (*g_quarantine_callback)(unsigned short) = NULL;
 
 /** Forward declaration for tray update function */
 extern void update_tray_state(bool active);
 
 /**
- * @brief Synchronizes context settings to disk.
+ * @brief Forwards state changes of the default instance to the tray.
  */
-static void sync_and_save_settings(void) {
-    if (!g_context) return;
-    app_settings_t s;
-    s.shortcut_enabled = g_context->shortcutEnabled;
-    s.shortcut_flags = (unsigned long long)g_context->shortcutFlags;
-    s.shortcut_keycode = (unsigned short)g_context->shortcutKeyCode;
-    s.blocking_enabled = g_context->enabled;
-    save_settings(&s);
+static void default_state_changed(bool active, void *arg) {
+    (void)arg;
+    update_tray_state(active);
 }
 
 /**
- * @brief Keyboard event callback.
- *
- * Handles blocking, shortcut detection, and one-shot recording.
- *
- * @param proxy Unused event tap proxy.
- * @param type Type of the keyboard event.
- * @param event The keyboard event.
- * @param refcon Pointer to kb_context_t.
- * @return NULL to block the event, or the original event to allow.
+ * @brief Forwards a recorded shortcut to the registered callback.
  */
-CGEventRef keyboardCallback(CGEventTapProxy proxy, CGEventType type, CGEventRef event, void *refcon) {
-    kb_context_t *ctx = (kb_context_t *)refcon;
-    if (!ctx) return event;
-
-    /* Handle one-shot recording */
-    if (ctx->recording) {
-        if (type == kCGEventKeyDown) {
-            CGEventFlags flags = CGEventGetFlags(event);
-            CGKeyCode keyCode = (CGKeyCode)CGEventGetIntegerValueField(event, kCGKeyboardEventKeycode);
-            CGEventFlags cleanFlags = flags & (kCGEventFlagMaskCommand | kCGEventFlagMaskShift | 
-                                              kCGEventFlagMaskAlternate | kCGEventFlagMaskControl);
-            ctx->shortcutFlags = cleanFlags;
-            ctx->shortcutKeyCode = keyCode;
-            ctx->recording = false;
-            sync_and_save_settings();
-            log_message(KB_LOG_LEVEL_INFO, "Shortcut recorded and saved.");
-            if (ctx->recordingCallback) {
-                log_message(KB_LOG_LEVEL_INFO, "Shortcut flags: %llu, KeyCode: %hu", (unsigned long long)cleanFlags, (unsigned short)keyCode);
-                ctx->recordingCallback((unsigned long long)cleanFlags, (unsigned short)keyCode);
-            }
-        }
-        return event;
-    }
-
-    /* Handle emergency shortcut */
-    if (ctx->shortcutEnabled && type == kCGEventKeyDown) {
-        CGEventFlags flags = CGEventGetFlags(event);
-        CGKeyCode keyCode = (CGKeyCode)CGEventGetIntegerValueField(event, kCGKeyboardEventKeycode);
-        CGEventFlags cleanFlags = flags & (kCGEventFlagMaskCommand | kCGEventFlagMaskShift | 
-                                          kCGEventFlagMaskAlternate | kCGEventFlagMaskControl);
-        if (cleanFlags == ctx->shortcutFlags && keyCode == ctx->shortcutKeyCode) {
-            log_message(KB_LOG_LEVEL_INFO, "Emergency shortcut detected. Disabling block.");
-            ctx->enabled = false;
-            update_tray_state(false);
-            return event; 
-        }
-    }
-
-    /* Block events if enabled */
-    if (!ctx->enabled) return event;
-    if (type == kCGEventKeyDown || type == kCGEventKeyUp || type == kCGEventFlagsChanged || type == kCGEventSystemDefined) {
-        log_message(KB_LOG_LEVEL_DEBUG, "Keyboard event blocked");
-        return NULL;
-    }
-    return event;
+static void default_shortcut_recorded(unsigned long long flags, unsigned short keyCode, void *arg) {
+    (void)arg;
+    if (g_recording_callback) g_recording_callback(flags, keyCode);
 }
 
 /**
- * @brief Thread function that runs the event tap.
- *
- * @param arg Pointer to kb_context_t
- * @return Always NULL
+ * @brief Forwards a quarantined key to the registered callback.
  */
-static void *keyboard_thread_func(void *arg) {
-    kb_context_t *ctx = (kb_context_t *)arg;
-    CGEventMask eventMask = CGEventMaskBit(kCGEventKeyDown) | 
-                            CGEventMaskBit(kCGEventKeyUp) | 
-                            CGEventMaskBit(kCGEventFlagsChanged) | 
-                            CGEventMaskBit(kCGEventSystemDefined);
-    ctx->eventTap = CGEventTapCreate(kCGSessionEventTap, kCGHeadInsertEventTap, kCGEventTapOptionDefault, eventMask, keyboardCallback, ctx);
-    if (!ctx->eventTap) {
-        log_message(KB_LOG_LEVEL_ERROR, "Failed to create event tap. Check Accessibility permissions.");
-        return NULL;
-    }
-    ctx->runLoopSource = CFMachPortCreateRunLoopSource(kCFAllocatorDefault, ctx->eventTap, 0);
-    CFRunLoopAddSource(CFRunLoopGetCurrent(), ctx->runLoopSource, kCFRunLoopCommonModes);
-    CGEventTapEnable(ctx->eventTap, true);
-    log_message(KB_LOG_LEVEL_INFO, "Event tap created successfully in background thread.");    
-    CFRunLoopRun();
-    return NULL;
+static void default_key_quarantined(unsigned short keyCode, void *arg) {
+    (void)arg;
+    if (g_quarantine_callback) g_quarantine_callback(keyCode);
 }
 
 /**
- * @brief Loads default keyboard-related settings from persistence.
+ * @brief Initializes the keyboard event tap and background thread.
+ *
+ * @return KB_SUCCESS on success or an error code.
  */
-void loadDefaultKeyboardSettings(void) {
-    app_settings_t s;
-    load_settings(&s);
-    g_context->enabled = s.blocking_enabled;
-    g_context->shortcutEnabled = s.shortcut_enabled;
-    g_context->recording = false;
-    g_context->shortcutFlags = (CGEventFlags)s.shortcut_flags;
-    g_context->shortcutKeyCode = (CGKeyCode)s.shortcut_keycode;
+kb_result_t setupKeyboardEventTap(void) {
+    if (g_instance) return KB_ERROR_ALREADY_STARTED;
+    static const kb_instance_callbacks_t callbacks = {
+        default_state_changed,
+        default_shortcut_recorded,
+        default_key_quarantined,
+    };
+    return kb_instance_create(NULL, &callbacks, NULL, &g_instance);
 }
 
 /**
- * @brief Initializes the keyboard event tap and background thread.
+ * @brief Restarts keyboard capture with freshly loaded settings.
+ *
+ * The default instance is stopped and reloaded rather than recreated, so
+ * the worker and the metrics socket survive.
  *
  * @return KB_SUCCESS on success or an error code.
  */
-kb_result_t setupKeyboardEventTap(void) {
-    if (g_context) return KB_ERROR_ALREADY_STARTED; 
-    g_context = (kb_context_t *)calloc(1, sizeof(kb_context_t));
-    if (!g_context) return KB_ERROR_EVENT_TAP_FAILED;
-    loadDefaultKeyboardSettings();
-    if (pthread_create(&g_context->thread, NULL, keyboard_thread_func, g_context) != 0) {
-        log_message(KB_LOG_LEVEL_ERROR, "Failed to create keyboard thread.");
-        free(g_context);
-        g_context = NULL;
-        return KB_ERROR_EVENT_TAP_FAILED;
-    }
-    g_context->recordingCallback = g_recording_callback;
-    return KB_SUCCESS;
+kb_result_t restartKeyboardEventTap(void) {
+    if (!g_instance) return setupKeyboardEventTap();
+    kb_instance_stop(g_instance);
+    kb_instance_reload(g_instance, NULL);
+    return kb_instance_start(g_instance);
+}
+
+/**
+ * @brief Returns the default instance.
+ */
+kb_instance_t *getDefaultKeyboardInstance(void) {
+    return g_instance;
 }
 
 /**
@@ -177,11 +90,16 @@ kb_result_t setupKeyboardEventTap(void) {
  * @param on True to block, false to pass events through.
  */
 void enableKeyboardBlock(bool on) {
-    if (g_context) {
-        g_context->enabled = on;
-        sync_and_save_settings();
-        log_message(KB_LOG_LEVEL_INFO, "Keyboard block status updated: %s", on ? "ACTIVE" : "INACTIVE");
-    }
+    if (g_instance) kb_instance_enable_block(g_instance, on);
+}
+
+/**
+ * @brief Enables keyboard blocking for a limited time.
+ *
+ * @param minutes Duration of the block in minutes.
+ */
+void enableKeyboardBlockFor(unsigned int minutes) {
+    if (g_instance) kb_instance_enable_block_for(g_instance, minutes);
 }
 
 /**
@@ -190,45 +108,35 @@ void enableKeyboardBlock(bool on) {
  * @return True if blocking, false otherwise.
  */
 bool isKeyboardBlockEnabled(void) {
-    return g_context ? g_context->enabled : false;
+    return g_instance ? kb_instance_is_block_enabled(g_instance) : false;
 }
 
 /**
  * @brief Enables or disables the emergency shortcut.
  */
 void setShortcutEnabled(bool enabled) {
-    if (g_context) {
-        g_context->shortcutEnabled = enabled;
-        sync_and_save_settings();
-    }
+    if (g_instance) kb_instance_set_shortcut_enabled(g_instance, enabled);
 }
 
 /**
  * @brief Returns whether the emergency shortcut is enabled.
  */
 bool isShortcutEnabled(void) {
-    return g_context ? g_context->shortcutEnabled : false;
+    return g_instance ? kb_instance_is_shortcut_enabled(g_instance) : false;
 }
 
 /**
  * @brief Sets the key combination for the emergency shortcut.
  */
 void setShortcut(unsigned long long flags, unsigned short keyCode) {
-    if (g_context) {
-        g_context->shortcutFlags = (CGEventFlags)flags;
-        g_context->shortcutKeyCode = (CGKeyCode)keyCode;
-        sync_and_save_settings();
-    }
+    if (g_instance) kb_instance_set_shortcut(g_instance, flags, keyCode);
 }
 
 /**
  * @brief Retrieves the current key combination for the emergency shortcut.
  */
 void getShortcut(unsigned long long *flags, unsigned short *keyCode) {
-    if (g_context) {
-        if (flags) *flags = (unsigned long long)g_context->shortcutFlags;
-        if (keyCode) *keyCode = (unsigned short)g_context->shortcutKeyCode;
-    }
+    if (g_instance) kb_instance_get_shortcut(g_instance, flags, keyCode);
 }
 
 /**
@@ -236,37 +144,68 @@ void getShortcut(unsigned long long *flags, unsigned short *keyCode) {
  */
 void setRecordingCallback(void (*callback)(unsigned long long flags, unsigned short keyCode)) {
     g_recording_callback = callback;
-    if (g_context) {
-        g_context->recordingCallback = callback;
-    }
 }
 
 /**
  * @brief Starts recording a one-shot emergency shortcut.
  */
 void startRecording(void) {
-    if (g_context) {
-        g_context->recording = true;
-        log_message(KB_LOG_LEVEL_DEBUG, "Recording mode: ON (one-shot)");
+    if (g_instance) kb_instance_start_recording(g_instance);
+}
+
+/**
+ * @brief Sets the callback to be invoked when a key is quarantined.
+ */
+void setKeyQuarantineCallback(void (*callback)(unsigned short keyCode)) {
+    g_quarantine_callback = callback;
+}
+
+/**
+ * @brief Releases every quarantined key.
+ */
+void clearQuarantinedKeys(void) {
+    if (g_instance) kb_instance_clear_quarantined_keys(g_instance);
+}
+
+/**
+ * @brief Caches the blocking policy for the application that became frontmost.
+ */
+void setFrontmostApplication(const char *bundleId) {
+    if (g_instance) kb_instance_set_frontmost_application(g_instance, bundleId);
+}
+
+/**
+ * @brief Writes the default instance's flight recorder to Application Support.
+ */
+bool dumpFlightRecorder(void) {
+    if (!g_instance) return false;
+    char path[512];
+    get_app_support_path(path, sizeof(path), KB_FLIGHT_RECORDER_FILE);
+    return kb_instance_dump_flight_recorder(g_instance, path);
+}
+
+/**
+ * @brief Writes the toggle traces to Application Support.
+ */
+bool dumpTrace(void) {
+    char path[512];
+    get_app_support_path(path, sizeof(path), KB_TRACE_FILE);
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        log_message(KB_LOG_LEVEL_ERROR, "Failed to open %s for the trace.", path);
+        return false;
     }
+    trace_export(out);
+    fclose(out);
+    log_message(KB_LOG_LEVEL_INFO, "Trace written to %s.", path);
+    return true;
 }
 
 /**
  * @brief Cleans up keyboard resources, including event taps and threads.
  */
 void cleanup_keyboard(void) {
-    if (!g_context) return;
-    if (g_context->runLoopSource) {
-        CFRunLoopRemoveSource(CFRunLoopGetCurrent(), g_context->runLoopSource, kCFRunLoopCommonModes);
-        CFRelease(g_context->runLoopSource);
-        g_context->runLoopSource = NULL;
-    }
-    if (g_context->eventTap) {
-        CGEventTapEnable(g_context->eventTap, false);
-        CFRelease(g_context->eventTap);
-        g_context->eventTap = NULL;
-    }
-    free(g_context);
-    g_context = NULL;
-    log_message(KB_LOG_LEVEL_INFO, "Keyboard blocker resources cleaned up.");
-}
\ No newline at end of file
+    if (!g_instance) return;
+    kb_instance_destroy(g_instance);
+    g_instance = NULL;
+}
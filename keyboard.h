@@ -4,22 +4,16 @@
  *
  * Provides functions for installing a keyboard event tap, enabling/disabling
  * blocking, managing an emergency shortcut, and recording key combinations.
+ * These functions drive the application's default instance (see
+ * instance.h), which reads and saves settings.conf and reports state changes
+ * to the tray.
  */
 
 #ifndef KEYBOARD_H
 #define KEYBOARD_H
 
 #include <stdbool.h>
-
-/**
- * @brief Result codes returned by keyboard operations.
- */
-typedef enum {
-    KB_SUCCESS = 0,             /**< Operation successful */
-    KB_ERROR_PERMISSION_DENIED, /**< Accessibility permissions missing */
-    KB_ERROR_EVENT_TAP_FAILED,  /**< Failed to create event tap */
-    KB_ERROR_ALREADY_STARTED    /**< Session already initialized */
-} kb_result_t;
+#include "instance.h"
 
 /**
  * @brief Initializes the keyboard event tap.
@@ -30,6 +24,17 @@ typedef enum {
  */
 kb_result_t setupKeyboardEventTap(void);
 
+/**
+ * @brief Restarts keyboard capture in-process.
+ *
+ * Stops the event tap, reloads settings.conf into the default instance and
+ * starts the tap again. Background work, the metrics socket and the
+ * counters carry on. Blocking is off after a restart.
+ *
+ * @return KB_SUCCESS on success, or an appropriate error code.
+ */
+kb_result_t restartKeyboardEventTap(void);
+
 /**
  * @brief Enables or disables keyboard blocking.
  *
@@ -39,6 +44,16 @@ kb_result_t setupKeyboardEventTap(void);
  */
 void enableKeyboardBlock(bool on);
 
+/**
+ * @brief Enables keyboard blocking for a limited time.
+ *
+ * Blocking is lifted automatically once the duration elapses, even if the
+ * emergency shortcut is disabled.
+ *
+ * @param minutes Duration of the block in minutes.
+ */
+void enableKeyboardBlockFor(unsigned int minutes);
+
 /**
  * @brief Checks if keyboard blocking is currently active.
  *
@@ -97,4 +112,54 @@ void setRecordingCallback(void (*callback)(unsigned long long flags, unsigned sh
  */
 void startRecording(void);
 
+/**
+ * @brief Sets the callback to invoke when a key is quarantined.
+ *
+ * A key is quarantined when it auto-repeats for too long or chatters
+ * through impossibly fast press/release cycles. The callback runs on the
+ * background worker thread and must return quickly.
+ *
+ * @param callback Function pointer that receives the offending keyCode.
+ */
+void setKeyQuarantineCallback(void (*callback)(unsigned short keyCode));
+
+/**
+ * @brief Releases every quarantined key.
+ */
+void clearQuarantinedKeys(void);
+
+/**
+ * @brief Returns the default instance.
+ *
+ * @return The instance created by setupKeyboardEventTap, or NULL.
+ */
+kb_instance_t *getDefaultKeyboardInstance(void);
+
+/**
+ * @brief Reports the application that became frontmost.
+ *
+ * Resolves the per-application policy once and caches it, so the event tap
+ * never has to look up the frontmost application itself. Safe to call from
+ * any thread.
+ *
+ * @param bundleId Bundle identifier of the application, or NULL if unknown.
+ */
+void setFrontmostApplication(const char *bundleId);
+
+/**
+ * @brief Writes the flight recorder of the default instance to
+ * KB_FLIGHT_RECORDER_FILE in the Application Support directory.
+ *
+ * @return true on success.
+ */
+bool dumpFlightRecorder(void);
+
+/**
+ * @brief Writes the blocking toggle traces to KB_TRACE_FILE in the
+ * Application Support directory, in Chrome trace format.
+ *
+ * @return true on success.
+ */
+bool dumpTrace(void);
+
 #endif
\ No newline at end of file
@@ -13,6 +13,16 @@
 /** @brief Global variable storing the currently active log levels. */
 static int g_kb_log_level = KB_LOG_LEVEL_INFO | KB_LOG_LEVEL_ERROR;
 
+/** @brief Buffer for stdout, so logging never allocates. */
+static char g_kb_log_buffer[KB_LOG_BUFFER_SIZE];
+
+/**
+ * @brief Gives stdout a static, line-buffered buffer.
+ */
+void init_kb_logger(void) {
+    setvbuf(stdout, g_kb_log_buffer, _IOLBF, sizeof(g_kb_log_buffer));
+}
+
 /**
  * @brief Sets the global log level.
  *
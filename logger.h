@@ -27,6 +27,17 @@ enum KB_LOG_LEVEL_FLAGS {
     KB_LOG_LEVEL_ALL   = 0xFF       /**< All levels enabled */
 };
 
+/** @brief Size of the static stdout buffer installed by init_kb_logger(). */
+#define KB_LOG_BUFFER_SIZE 4096
+
+/**
+ * @brief Gives stdout a static, line-buffered buffer.
+ *
+ * stdio otherwise allocates the buffer on the first write, which may come
+ * from the event tap. Call before anything is written to stdout.
+ */
+void init_kb_logger(void);
+
 /**
  * @brief Sets the global log level for filtering messages.
  *
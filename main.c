@@ -12,6 +12,8 @@
 #include "tray.h"
 #include "logger.h"
 #include "version.h"
+#include "settings.h"
+#include "heatmap.h"
 
 /**
  * @brief Parses command-line arguments to determine the logging level.
@@ -48,6 +50,33 @@ static int parse_arguments(int argc, char *argv[]) {
     return log_level;
 }
 
+/**
+ * @brief Writes the keystroke heatmap as CSV.
+ *
+ * @param output Output file path, or NULL for stdout.
+ * @return Exit status code (0 on success)
+ */
+static int export_heatmap(const char *output) {
+    /* Logging shares stdout with the CSV; keep the export clean */
+    if (!output) set_kb_log_level(KB_LOG_LEVEL_NONE);
+
+    char path[512];
+    get_app_support_path(path, sizeof(path), KB_HEATMAP_FILE);
+    kb_heatmap_t *heatmap = heatmap_open(path);
+    if (!heatmap) return 1;
+
+    FILE *out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        log_message(KB_LOG_LEVEL_ERROR, "Failed to open %s for writing.", output);
+        heatmap_close(heatmap);
+        return 1;
+    }
+    heatmap_export(heatmap, out);
+    if (out != stdout) fclose(out);
+    heatmap_close(heatmap);
+    return 0;
+}
+
 /**
  * @brief Initializes the macOS system tray icon and menu.
  *
@@ -73,8 +102,9 @@ static void run() {
 /**
  * @brief Main entry point of the keyboard blocker application.
  *
- * - Parses command-line arguments
  * - Sets up logging
+ * - Parses command-line arguments
+ * - Handles one-shot commands (`--export-heatmap [file]`) and exits
  * - Initializes the tray icon
  * - Runs the main Cocoa event loop
  *
@@ -83,9 +113,16 @@ static void run() {
  * @return Exit status code (0 on success)
  */
 int main(int argc, char *argv[]) {
+    init_kb_logger();
     int log_level = parse_arguments(argc, argv);
     set_kb_log_level(log_level);
 
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--export-heatmap") == 0) {
+            return export_heatmap(i + 1 < argc && argv[i + 1][0] != '-' ? argv[i + 1] : NULL);
+        }
+    }
+
     log_message(KB_LOG_LEVEL_INFO, "Keyboard blocker starting (Cocoa Mode)...");
     log_message(KB_LOG_LEVEL_INFO, "Current version: %s", KB_VERSION);
 
@@ -0,0 +1,94 @@
+/**
+ * @file media_keys.c
+ * @brief Implementation of media key decoding.
+ *
+ * data1 of an auxiliary control button event packs the key type in its
+ * high 16 bits and the key flags in its low 16 bits: bits 8-15 hold the
+ * state (0x0A pressed, 0x0B released) and bit 0 the repeat flag.
+ */
+
+#include "media_keys.h"
+#include <stdlib.h>
+#include <string.h>
+
+/** @brief Key state value for a press. */
+#define MEDIA_KEY_STATE_DOWN 0x0A
+
+/** @brief Key state value for a release. */
+#define MEDIA_KEY_STATE_UP 0x0B
+
+/**
+ * @brief Media key names, indexed by key type (NX_KEYTYPE_* values).
+ */
+static const char *const MEDIA_KEY_NAMES[KB_MEDIA_KEY_COUNT] = {
+    [0] = "volume_up",
+    [1] = "volume_down",
+    [2] = "brightness_up",
+    [3] = "brightness_down",
+    [4] = "caps_lock",
+    [5] = "help",
+    [6] = "power",
+    [7] = "mute",
+    [10] = "num_lock",
+    [11] = "contrast_up",
+    [12] = "contrast_down",
+    [13] = "launch_panel",
+    [14] = "eject",
+    [15] = "video_mirror",
+    [16] = "play",
+    [17] = "next",
+    [18] = "previous",
+    [19] = "fast_forward",
+    [20] = "rewind",
+    [21] = "illumination_up",
+    [22] = "illumination_down",
+    [23] = "illumination_toggle",
+};
+
+/**
+ * @brief Decodes a system-defined event into a media key press or release.
+ */
+bool media_key_decode(int subtype, long data1, kb_event_t *event) {
+    event->type = KB_EVENT_SYSTEM_DEFINED;
+    event->key_code = KB_KEY_NONE;
+    event->autorepeat = false;
+    if (subtype != KB_SUBTYPE_AUX_CONTROL_BUTTONS) return false;
+
+    unsigned int key_type = (unsigned int)((data1 & 0xFFFF0000L) >> 16);
+    unsigned int state = (unsigned int)((data1 & 0xFF00) >> 8);
+    if (key_type >= KB_MEDIA_KEY_COUNT) return false;
+    if (state != MEDIA_KEY_STATE_DOWN && state != MEDIA_KEY_STATE_UP) return false;
+
+    event->type = state == MEDIA_KEY_STATE_DOWN ? KB_EVENT_KEY_DOWN : KB_EVENT_KEY_UP;
+    event->key_code = (unsigned short)(KB_KEY_MEDIA_BASE + key_type);
+    event->autorepeat = (data1 & 0x1) != 0;
+    return true;
+}
+
+/**
+ * @brief Returns the settings name of a media key id.
+ */
+const char *media_key_name(unsigned int key) {
+    if (key < KB_KEY_MEDIA_BASE || key >= KB_KEY_MEDIA_BASE + KB_MEDIA_KEY_COUNT) return NULL;
+    return MEDIA_KEY_NAMES[key - KB_KEY_MEDIA_BASE];
+}
+
+/**
+ * @brief Parses a key as written in settings.conf.
+ */
+bool media_key_parse(const char *name, unsigned int *key) {
+    if (!name || !*name || !key) return false;
+
+    for (unsigned int i = 0; i < KB_MEDIA_KEY_COUNT; i++) {
+        if (MEDIA_KEY_NAMES[i] && strcmp(MEDIA_KEY_NAMES[i], name) == 0) {
+            *key = KB_KEY_MEDIA_BASE + i;
+            return true;
+        }
+    }
+
+    char *end;
+    unsigned long value = strtoul(name, &end, 0);
+    if (*end != '\0' || value >= KB_KEY_COUNT) return false;
+    *key = (unsigned int)value;
+    return true;
+}
@@ -0,0 +1,57 @@
+/**
+ * @file media_keys.h
+ * @brief Decoding of media and system keys carried by system-defined events.
+ *
+ * Volume, brightness, playback and eject keys arrive as system-defined
+ * events (type 14) whose subtype and data1 fields encode the key and its
+ * state. Decoding maps them into the engine's key id space above the
+ * hardware key codes, so per-key policies treat them like ordinary keys.
+ */
+
+#ifndef MEDIA_KEYS_H
+#define MEDIA_KEYS_H
+
+#include <stdbool.h>
+#include "engine.h"
+
+/** @brief System-defined subtype carrying auxiliary control buttons. */
+#define KB_SUBTYPE_AUX_CONTROL_BUTTONS 8
+
+/** @brief Number of media key types reserved in the key id space. */
+#define KB_MEDIA_KEY_COUNT 32
+
+/**
+ * @brief Decodes a system-defined event into a media key press or release.
+ *
+ * On success the event's type becomes KB_EVENT_KEY_DOWN or KB_EVENT_KEY_UP,
+ * its key_code the media key id and its autorepeat flag the repeat bit.
+ * Otherwise the event is left as KB_EVENT_SYSTEM_DEFINED with key_code
+ * KB_KEY_NONE.
+ *
+ * @param subtype Event subtype.
+ * @param data1 Event data1 field.
+ * @param event Event to update.
+ * @return True if the event is a media key.
+ */
+bool media_key_decode(int subtype, long data1, kb_event_t *event);
+
+/**
+ * @brief Returns the settings name of a media key id.
+ *
+ * @param key Key id.
+ * @return Name (e.g. "volume_up"), or NULL if the id is not a named media key.
+ */
+const char *media_key_name(unsigned int key);
+
+/**
+ * @brief Parses a key as written in settings.conf.
+ *
+ * Accepts media key names and numeric key ids (decimal or 0x-prefixed).
+ *
+ * @param name Key name or number.
+ * @param key Output for the key id.
+ * @return True if the key was recognized.
+ */
+bool media_key_parse(const char *name, unsigned int *key);
+
+#endif
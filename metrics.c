@@ -0,0 +1,295 @@
+/**
+ * @file metrics.c
+ * @brief Implementation of the metrics counters and exposition server.
+ */
+
+#include "metrics.h"
+#include "logger.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/** @brief How long a connection may take to send its request. */
+#define KB_METRICS_READ_TIMEOUT_NS 1000000000ULL
+
+/** @brief How long a connection may stall reading the response. */
+#define KB_METRICS_WRITE_TIMEOUT_NS 5000000000ULL
+
+/** @brief Pause before accepting again while every slot is busy. */
+#define KB_METRICS_BUSY_RETRY_NS 10000000ULL
+
+/* A scraper that hangs up early must not kill the process with SIGPIPE */
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+/**
+ * @brief Upper bounds of the finite callback latency buckets, in nanoseconds.
+ */
+static const uint64_t BUCKET_BOUNDS_NS[KB_METRICS_BUCKETS] = {
+    5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 5000000, 25000000,
+};
+
+/**
+ * @brief Records the duration of one tap callback.
+ */
+void metrics_observe_callback(kb_metrics_t *metrics, uint64_t elapsed_ns) {
+    metrics_bump(&metrics->latency_sum_ns, elapsed_ns);
+    for (size_t i = 0; i < KB_METRICS_BUCKETS; i++) {
+        if (elapsed_ns <= BUCKET_BOUNDS_NS[i]) {
+            metrics_bump(&metrics->latency_buckets[i], 1);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Reads a counter.
+ */
+static uint64_t read_counter(const kb_counter_t *counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+/**
+ * @brief Writes a counter family with a single unlabeled sample.
+ */
+static void render_counter(FILE *out, const char *name, const char *help, uint64_t value) {
+    fprintf(out, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", name, help, name, name, (unsigned long long)value);
+}
+
+/**
+ * @brief Writes the counters in Prometheus text format.
+ *
+ * The histogram count is the total of the event counters, so every bucket
+ * read here is at most the count even while the tap keeps running.
+ */
+void metrics_render(const kb_metrics_t *metrics, FILE *out) {
+    uint64_t total = 0;
+    fprintf(out, "# HELP keyblocker_events_total Keyboard events by type and verdict.\n"
+                 "# TYPE keyblocker_events_total counter\n");
+    for (int type = 0; type < KB_EVENT_TYPE_COUNT; type++) {
+        for (int verdict = 0; verdict < KB_VERDICT_COUNT; verdict++) {
+            uint64_t value = read_counter(&metrics->events[type][verdict]);
+            total += value;
+            fprintf(out, "keyblocker_events_total{type=\"%s\",verdict=\"%s\"} %llu\n",
+                    engine_event_type_name((kb_event_type_t)type), engine_verdict_name((kb_verdict_t)verdict),
+                    (unsigned long long)value);
+        }
+    }
+
+    render_counter(out, "keyblocker_shortcut_unlocks_total", "Emergency shortcut hits.",
+                   read_counter(&metrics->shortcut_unlocks));
+    fprintf(out, "# HELP keyblocker_tap_reenables_total Event tap re-enabled after macOS disabled it.\n"
+                 "# TYPE keyblocker_tap_reenables_total counter\n"
+                 "keyblocker_tap_reenables_total{reason=\"timeout\"} %llu\n"
+                 "keyblocker_tap_reenables_total{reason=\"user_input\"} %llu\n",
+            (unsigned long long)read_counter(&metrics->tap_timeouts),
+            (unsigned long long)read_counter(&metrics->tap_user_disables));
+    render_counter(out, "keyblocker_slow_callbacks_total", "Event tap callbacks over the callback budget.",
+                   read_counter(&metrics->slow_callbacks));
+    render_counter(out, "keyblocker_settings_writes_total", "Writes of settings.conf.",
+                   read_counter(&metrics->settings_writes));
+
+    uint64_t buckets[KB_METRICS_BUCKETS];
+    for (size_t i = 0; i < KB_METRICS_BUCKETS; i++) buckets[i] = read_counter(&metrics->latency_buckets[i]);
+    uint64_t sum = read_counter(&metrics->latency_sum_ns);
+    fprintf(out, "# HELP keyblocker_callback_duration_seconds Time spent in the event tap callback.\n"
+                 "# TYPE keyblocker_callback_duration_seconds histogram\n");
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < KB_METRICS_BUCKETS; i++) {
+        cumulative += buckets[i];
+        if (cumulative > total) cumulative = total;
+        fprintf(out, "keyblocker_callback_duration_seconds_bucket{le=\"%g\"} %llu\n",
+                (double)BUCKET_BOUNDS_NS[i] / 1e9, (unsigned long long)cumulative);
+    }
+    fprintf(out, "keyblocker_callback_duration_seconds_bucket{le=\"+Inf\"} %llu\n"
+                 "keyblocker_callback_duration_seconds_sum %.9f\n"
+                 "keyblocker_callback_duration_seconds_count %llu\n",
+            (unsigned long long)total, (double)sum / 1e9, (unsigned long long)total);
+}
+
+/**
+ * @brief Makes a socket non-blocking, and on systems without MSG_NOSIGNAL
+ * keeps it from raising SIGPIPE.
+ */
+static void set_nonblocking(int fd) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+}
+
+/**
+ * @brief Renders the HTTP response of a connection into memory. The body
+ * is rendered first so the headers can give its length.
+ */
+static void render_response(kb_metrics_client_t *client) {
+    char *body = NULL;
+    size_t body_length = 0;
+    FILE *out = open_memstream(&body, &body_length);
+    if (!out) return;
+    client->server->render(out, client->server->arg);
+    if (fclose(out) != 0) {
+        free(body);
+        return;
+    }
+
+    out = open_memstream(&client->response, &client->length);
+    if (out) {
+        fprintf(out,
+                "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n"
+                "Connection: close\r\n\r\n",
+                body_length);
+        fwrite(body, 1, body_length, out);
+        if (fclose(out) != 0) {
+            free(client->response);
+            client->response = NULL;
+        }
+    }
+    free(body);
+}
+
+/**
+ * @brief Closes a connection and frees its slot.
+ */
+static void close_client(kb_metrics_client_t *client) {
+    if (client->fd >= 0) close(client->fd);
+    client->fd = -1;
+    free(client->response);
+    client->response = NULL;
+    client->length = 0;
+    client->sent = 0;
+}
+
+/**
+ * @brief Task answering one connection with the rendered metrics.
+ *
+ * The request is read and ignored; every path gets the same response. A
+ * client that sends nothing for a second still gets it; one that stops
+ * reading for KB_METRICS_WRITE_TIMEOUT_NS is dropped.
+ */
+static void serve_client(kb_task_t *task) {
+    kb_metrics_client_t *client = (kb_metrics_client_t *)task->arg;
+
+    KB_TASK_BEGIN(task);
+    KB_TASK_WAIT_FD(task, client->fd, KB_TASK_READ, KB_METRICS_READ_TIMEOUT_NS);
+    if (task->ready) {
+        char request[1024];
+        (void)read(client->fd, request, sizeof(request));
+    }
+    render_response(client);
+
+    while (client->response && client->sent < client->length) {
+        ssize_t n = send(client->fd, client->response + client->sent, client->length - client->sent, SEND_FLAGS);
+        if (n > 0) {
+            client->sent += (size_t)n;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            KB_TASK_WAIT_FD(task, client->fd, KB_TASK_WRITE, KB_METRICS_WRITE_TIMEOUT_NS);
+            if (!task->ready) break;
+        } else {
+            break;
+        }
+    }
+    close_client(client);
+    KB_TASK_END(task);
+}
+
+/**
+ * @brief Returns a free connection slot, or NULL if all are busy.
+ */
+static kb_metrics_client_t *free_client(kb_metrics_server_t *server) {
+    for (size_t i = 0; i < KB_METRICS_CLIENTS; i++) {
+        if (server->clients[i].fd < 0) return &server->clients[i];
+    }
+    return NULL;
+}
+
+/**
+ * @brief Task accepting connections while there are free slots.
+ */
+static void accept_clients(kb_task_t *task) {
+    kb_metrics_server_t *server = (kb_metrics_server_t *)task->arg;
+
+    KB_TASK_BEGIN(task);
+    for (;;) {
+        KB_TASK_WAIT_FD(task, server->listen_fd, KB_TASK_READ, 0);
+        for (kb_metrics_client_t *client = free_client(server); client; client = free_client(server)) {
+            int fd = accept(server->listen_fd, NULL, NULL);
+            if (fd < 0) break;
+            set_nonblocking(fd);
+            client->fd = fd;
+            worker_spawn(&client->task);
+        }
+        if (!free_client(server)) KB_TASK_SLEEP(task, KB_METRICS_BUSY_RETRY_NS);
+    }
+    KB_TASK_END(task);
+}
+
+/**
+ * @brief Starts serving metrics on a Unix socket.
+ */
+bool metrics_server_start(kb_metrics_server_t *server, const char *path, kb_metrics_render_fn render, void *arg) {
+    server->listen_fd = -1;
+    if (strlen(path) >= sizeof(server->path)) {
+        log_message(KB_LOG_LEVEL_ERROR, "Metrics socket path %s is too long.", path);
+        return false;
+    }
+    strcpy(server->path, path);
+    server->render = render;
+    server->arg = arg;
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        log_message(KB_LOG_LEVEL_ERROR, "Failed to create the metrics socket: %s", strerror(errno));
+        return false;
+    }
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+        log_message(KB_LOG_LEVEL_ERROR, "Failed to listen on %s: %s", path, strerror(errno));
+        close(fd);
+        return false;
+    }
+    set_nonblocking(fd);
+    server->listen_fd = fd;
+
+    for (size_t i = 0; i < KB_METRICS_CLIENTS; i++) {
+        kb_metrics_client_t *client = &server->clients[i];
+        client->server = server;
+        client->fd = -1;
+        client->response = NULL;
+        client->length = 0;
+        client->sent = 0;
+        worker_task_init(&client->task, serve_client, client);
+    }
+    worker_task_init(&server->accept_task, accept_clients, server);
+    worker_spawn(&server->accept_task);
+    log_message(KB_LOG_LEVEL_INFO, "Serving metrics on %s.", path);
+    return true;
+}
+
+/**
+ * @brief Stops the server and removes the socket file.
+ */
+void metrics_server_stop(kb_metrics_server_t *server) {
+    if (server->listen_fd < 0) return;
+    worker_task_cancel(&server->accept_task);
+    for (size_t i = 0; i < KB_METRICS_CLIENTS; i++) {
+        worker_task_cancel(&server->clients[i].task);
+        close_client(&server->clients[i]);
+    }
+    close(server->listen_fd);
+    unlink(server->path);
+    server->listen_fd = -1;
+}
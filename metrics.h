@@ -0,0 +1,132 @@
+/**
+ * @file metrics.h
+ * @brief Counters and a latency histogram exposed in Prometheus text format.
+ *
+ * Most counters have a single writer, the tap thread, which bumps them with
+ * a relaxed load and store: no locked instructions on the event path. The
+ * exposition server reads them with relaxed loads at any time, so scraping
+ * never stops or slows the tap. Counters written from several threads use
+ * atomic adds.
+ *
+ * The exposition server answers every connection on a Unix socket with one
+ * HTTP response, so "curl --unix-socket <path> http://localhost/metrics"
+ * works as a scraper. It runs as tasks on the worker: one accepts
+ * connections and one per connection reads the request and writes the
+ * response without blocking.
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "engine.h"
+#include "worker.h"
+
+/** @brief Number of finite callback latency buckets. */
+#define KB_METRICS_BUCKETS 10
+
+/** @brief Maximum length of the metrics socket path, including the terminator. */
+#define KB_METRICS_PATH_MAX 104
+
+/** @brief Connections served at once; later ones wait in the listen backlog. */
+#define KB_METRICS_CLIENTS 4
+
+/** @brief A counter. */
+typedef _Atomic uint64_t kb_counter_t;
+
+/**
+ * @brief Increments a counter that only the calling thread writes.
+ */
+static inline void metrics_bump(kb_counter_t *counter, uint64_t amount) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + amount,
+                          memory_order_relaxed);
+}
+
+/**
+ * @brief Counters of one instance.
+ */
+typedef struct {
+    kb_counter_t events[KB_EVENT_TYPE_COUNT][KB_VERDICT_COUNT]; /**< Events by type and verdict (tap thread) */
+    kb_counter_t shortcut_unlocks;                  /**< Emergency shortcut hits (tap thread) */
+    kb_counter_t tap_timeouts;                      /**< Tap re-enabled after a timeout (tap thread) */
+    kb_counter_t tap_user_disables;                 /**< Tap re-enabled after a user-input disable (tap thread) */
+    kb_counter_t slow_callbacks;                    /**< Callbacks over budget (tap thread) */
+    kb_counter_t latency_buckets[KB_METRICS_BUCKETS]; /**< Callback durations per bucket, not cumulative (tap thread) */
+    kb_counter_t latency_sum_ns;                    /**< Sum of callback durations (tap thread) */
+    kb_counter_t settings_writes;                   /**< settings.conf writes (any thread) */
+} kb_metrics_t;
+
+/**
+ * @brief Records the duration of one tap callback. Tap thread only.
+ *
+ * @param metrics Counters to update.
+ * @param elapsed_ns Callback duration in nanoseconds.
+ */
+void metrics_observe_callback(kb_metrics_t *metrics, uint64_t elapsed_ns);
+
+/**
+ * @brief Writes the counters in Prometheus text format.
+ *
+ * @param metrics Counters to render.
+ * @param out Output stream.
+ */
+void metrics_render(const kb_metrics_t *metrics, FILE *out);
+
+/**
+ * @brief Renders the full exposition into a stream.
+ */
+typedef void (*kb_metrics_render_fn)(FILE *out, void *arg);
+
+struct kb_metrics_server;
+
+/**
+ * @brief One connection being served.
+ */
+typedef struct {
+    kb_task_t task;                     /**< Reads the request and writes the response */
+    struct kb_metrics_server *server;   /**< Owning server */
+    int fd;                             /**< Connection, -1 when the slot is free */
+    char *response;                     /**< Rendered response, NULL until rendered */
+    size_t length;                      /**< Response length */
+    size_t sent;                        /**< Bytes of the response written */
+} kb_metrics_client_t;
+
+/**
+ * @brief A Unix socket exposition server.
+ */
+typedef struct kb_metrics_server {
+    int listen_fd;                      /**< Listening socket, -1 when stopped */
+    kb_task_t accept_task;              /**< Accepts connections */
+    kb_metrics_client_t clients[KB_METRICS_CLIENTS]; /**< Connection slots */
+    char path[KB_METRICS_PATH_MAX];     /**< Socket path */
+    kb_metrics_render_fn render;        /**< Renders a response body */
+    void *arg;                          /**< Argument for render */
+} kb_metrics_server_t;
+
+/**
+ * @brief Starts serving metrics on a Unix socket.
+ *
+ * A stale socket file at the path is replaced. The worker must be running
+ * (worker_start).
+ *
+ * @param server Server to start.
+ * @param path Socket path.
+ * @param render Renders a response body; runs on the worker thread.
+ * @param arg Argument for render.
+ * @return true if the server is running.
+ */
+bool metrics_server_start(kb_metrics_server_t *server, const char *path, kb_metrics_render_fn render, void *arg);
+
+/**
+ * @brief Stops the server, drops open connections and removes the socket file.
+ * Does nothing if the server is not running.
+ *
+ * @param server Server to stop.
+ */
+void metrics_server_stop(kb_metrics_server_t *server);
+
+#endif
@@ -0,0 +1,117 @@
+/**
+ * @file plugin.c
+ * @brief Implementation of plugin loading and the timed plugin chain.
+ */
+
+#include "plugin.h"
+#include "logger.h"
+#include <dlfcn.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * @brief Returns a monotonic timestamp in nanoseconds.
+ */
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Loads plugins into an empty chain.
+ */
+size_t plugins_load(kb_plugin_chain_t *chain, const char (*paths)[KB_PLUGIN_PATH_MAX], size_t count,
+                    unsigned int budget_us) {
+    memset(chain, 0, sizeof(*chain));
+    chain->budget_ns = (uint64_t)budget_us * 1000ULL;
+
+    for (size_t i = 0; i < count && chain->count < KB_PLUGIN_MAX; i++) {
+        void *handle = dlopen(paths[i], RTLD_NOW | RTLD_LOCAL);
+        if (!handle) {
+            log_message(KB_LOG_LEVEL_ERROR, "Failed to load plugin %s: %s", paths[i], dlerror());
+            continue;
+        }
+
+        kb_plugin_entry_t entry = (kb_plugin_entry_t)dlsym(handle, KB_PLUGIN_ENTRY);
+        const kb_plugin_t *plugin = entry ? entry() : NULL;
+        if (!plugin || plugin->abi_version != KB_PLUGIN_ABI_VERSION || !plugin->decide) {
+            log_message(KB_LOG_LEVEL_ERROR, "Plugin %s does not export a compatible " KB_PLUGIN_ENTRY ".",
+                        paths[i]);
+            dlclose(handle);
+            continue;
+        }
+
+        kb_plugin_slot_t *slot = &chain->slots[chain->count++];
+        slot->decide = plugin->decide;
+        slot->state = plugin->init ? plugin->init() : NULL;
+        slot->plugin = plugin;
+        slot->handle = handle;
+        log_message(KB_LOG_LEVEL_INFO, "Loaded plugin %s from %s.", plugin->name ? plugin->name : "unnamed",
+                    paths[i]);
+    }
+    return chain->count;
+}
+
+/**
+ * @brief Runs an event through the chain.
+ *
+ * Overruns are counted per plugin; the call that reaches
+ * KB_PLUGIN_MAX_OVERRUNS still takes effect, later events skip the plugin.
+ */
+kb_verdict_t plugins_decide(kb_plugin_chain_t *chain, const kb_event_t *event, kb_verdict_t verdict) {
+    for (size_t i = 0; i < chain->count; i++) {
+        kb_plugin_slot_t *slot = &chain->slots[i];
+        if (slot->bypassed) continue;
+
+        uint64_t start = now_ns();
+        kb_verdict_t result = slot->decide(slot->state, event, verdict);
+        uint64_t elapsed = now_ns() - start;
+
+        slot->calls++;
+        if (elapsed > slot->max_ns) slot->max_ns = elapsed;
+        if (chain->budget_ns && elapsed > chain->budget_ns && ++slot->overruns >= KB_PLUGIN_MAX_OVERRUNS) {
+            slot->bypassed = true;
+            log_message(KB_LOG_LEVEL_ERROR, "Plugin %s exceeded its time budget %u times (last %llu us). Bypassing it.",
+                        slot->plugin->name ? slot->plugin->name : "unnamed", slot->overruns,
+                        (unsigned long long)(elapsed / 1000ULL));
+        }
+        if (result == KB_VERDICT_PASS || result == KB_VERDICT_BLOCK) verdict = result;
+    }
+    return verdict;
+}
+
+/**
+ * @brief Runs a batch of events through the chain.
+ */
+void plugins_decide_batch(kb_plugin_chain_t *chain, const kb_event_t *events, kb_verdict_t *verdicts,
+                          size_t count) {
+    for (size_t i = 0; i < chain->count; i++) {
+        kb_plugin_slot_t *slot = &chain->slots[i];
+        if (slot->bypassed) continue;
+
+        if (slot->plugin->decide_batch) {
+            slot->plugin->decide_batch(slot->state, events, verdicts, count);
+            continue;
+        }
+        for (size_t j = 0; j < count; j++) {
+            kb_verdict_t result = slot->decide(slot->state, &events[j], verdicts[j]);
+            if (result == KB_VERDICT_PASS || result == KB_VERDICT_BLOCK) verdicts[j] = result;
+        }
+    }
+}
+
+/**
+ * @brief Finalizes and unloads every plugin.
+ */
+void plugins_unload(kb_plugin_chain_t *chain) {
+    for (size_t i = 0; i < chain->count; i++) {
+        kb_plugin_slot_t *slot = &chain->slots[i];
+        log_message(KB_LOG_LEVEL_DEBUG, "Plugin %s: %llu calls, slowest %llu ns%s.",
+                    slot->plugin->name ? slot->plugin->name : "unnamed", (unsigned long long)slot->calls,
+                    (unsigned long long)slot->max_ns, slot->bypassed ? ", bypassed" : "");
+        if (slot->plugin->fini) slot->plugin->fini(slot->state);
+        dlclose(slot->handle);
+    }
+    chain->count = 0;
+}
@@ -0,0 +1,152 @@
+/**
+ * @file plugin.h
+ * @brief Filter plugin ABI and the host-side plugin chain.
+ *
+ * A plugin is a shared object exporting KB_PLUGIN_ENTRY, which returns a
+ * static kb_plugin_t. After the engine has decided to pass or block an
+ * event, each loaded plugin in turn may override that verdict. The emergency
+ * shortcut and shortcut recording never reach plugins.
+ *
+ * Every call is timed against a per-event budget. A plugin that overruns
+ * the budget KB_PLUGIN_MAX_OVERRUNS times is bypassed for the rest of the
+ * session, so a slow plugin cannot stall system input.
+ */
+
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "engine.h"
+
+/** @brief ABI version a plugin must report in kb_plugin_t.abi_version. */
+#define KB_PLUGIN_ABI_VERSION 1
+
+/** @brief Name of the symbol every plugin exports. */
+#define KB_PLUGIN_ENTRY "kb_plugin_register"
+
+/** @brief Maximum number of plugins loaded at once. */
+#define KB_PLUGIN_MAX 8
+
+/** @brief Maximum length of a plugin path, including the terminator. */
+#define KB_PLUGIN_PATH_MAX 512
+
+/** @brief Budget overruns after which a plugin is bypassed. */
+#define KB_PLUGIN_MAX_OVERRUNS 3
+
+/**
+ * @brief Description of a plugin, returned by its entry point.
+ *
+ * Only abi_version, name and decide are required.
+ */
+typedef struct {
+    uint32_t abi_version;   /**< KB_PLUGIN_ABI_VERSION */
+    const char *name;       /**< Name used in logs */
+
+    /**
+     * @brief Creates the plugin state. Called once after loading.
+     * @return State passed to the other hooks (may be NULL).
+     */
+    void *(*init)(void);
+
+    /**
+     * @brief Decides one event.
+     * @param state Plugin state.
+     * @param event Decoded event.
+     * @param verdict Verdict so far (KB_VERDICT_PASS or KB_VERDICT_BLOCK).
+     * @return KB_VERDICT_PASS or KB_VERDICT_BLOCK.
+     */
+    kb_verdict_t (*decide)(void *state, const kb_event_t *event, kb_verdict_t verdict);
+
+    /**
+     * @brief Decides a batch of events in place, for offline replay.
+     * @param state Plugin state.
+     * @param events Decoded events.
+     * @param verdicts Verdicts so far, overwritten with the plugin's verdicts.
+     * @param count Number of events.
+     */
+    void (*decide_batch)(void *state, const kb_event_t *events, kb_verdict_t *verdicts, size_t count);
+
+    /**
+     * @brief Releases the plugin state. Called before unloading.
+     */
+    void (*fini)(void *state);
+} kb_plugin_t;
+
+/** @brief Signature of the KB_PLUGIN_ENTRY function. */
+typedef const kb_plugin_t *(*kb_plugin_entry_t)(void);
+
+/**
+ * @brief A loaded plugin in the chain.
+ *
+ * The decide hook is copied out of the plugin description so dispatch is
+ * a single indirect call.
+ */
+typedef struct {
+    kb_verdict_t (*decide)(void *state, const kb_event_t *event, kb_verdict_t verdict); /**< Decide hook */
+    void *state;                        /**< Plugin state */
+    const kb_plugin_t *plugin;          /**< Plugin description */
+    void *handle;                       /**< dlopen handle */
+    unsigned int overruns;              /**< Calls that exceeded the budget */
+    bool bypassed;                      /**< Whether the plugin is skipped */
+    uint64_t calls;                     /**< Number of decide calls */
+    uint64_t max_ns;                    /**< Slowest decide call */
+} kb_plugin_slot_t;
+
+/**
+ * @brief The ordered chain of loaded plugins.
+ */
+typedef struct {
+    size_t count;                       /**< Number of loaded plugins */
+    uint64_t budget_ns;                 /**< Time budget per plugin call, 0 for none */
+    kb_plugin_slot_t slots[KB_PLUGIN_MAX]; /**< Loaded plugins, in chain order */
+} kb_plugin_chain_t;
+
+/**
+ * @brief Loads plugins into an empty chain.
+ *
+ * Plugins that fail to load, lack the entry point or report another ABI
+ * version are logged and skipped.
+ *
+ * @param chain Chain to fill.
+ * @param paths Shared object paths.
+ * @param count Number of paths.
+ * @param budget_us Time budget per call, in microseconds; 0 for none.
+ * @return Number of plugins loaded.
+ */
+size_t plugins_load(kb_plugin_chain_t *chain, const char (*paths)[KB_PLUGIN_PATH_MAX], size_t count,
+                    unsigned int budget_us);
+
+/**
+ * @brief Runs an event through the chain.
+ *
+ * @param chain Loaded plugins.
+ * @param event Decoded event.
+ * @param verdict Engine verdict (KB_VERDICT_PASS or KB_VERDICT_BLOCK).
+ * @return Final verdict.
+ */
+kb_verdict_t plugins_decide(kb_plugin_chain_t *chain, const kb_event_t *event, kb_verdict_t verdict);
+
+/**
+ * @brief Runs a batch of events through the chain, for offline replay.
+ *
+ * Plugins without a batch hook are called once per event. Batches are not
+ * timed.
+ *
+ * @param chain Loaded plugins.
+ * @param events Decoded events.
+ * @param verdicts Engine verdicts, overwritten with the final verdicts.
+ * @param count Number of events.
+ */
+void plugins_decide_batch(kb_plugin_chain_t *chain, const kb_event_t *events, kb_verdict_t *verdicts,
+                          size_t count);
+
+/**
+ * @brief Finalizes and unloads every plugin.
+ *
+ * @param chain Chain to empty.
+ */
+void plugins_unload(kb_plugin_chain_t *chain);
+
+#endif
@@ -0,0 +1,87 @@
+/**
+ * @file remap.c
+ * @brief Implementation of the key remap table.
+ */
+
+#include "remap.h"
+#include "logger.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Resets a table to the identity mapping.
+ */
+void remap_init(kb_remap_t *remap) {
+    for (unsigned int key = 0; key < KB_KEY_MEDIA_BASE; key++) {
+        remap->to[key] = (unsigned short)key;
+    }
+    remap->count = 0;
+}
+
+/**
+ * @brief Maps one key to another.
+ */
+bool remap_set(kb_remap_t *remap, unsigned int from, unsigned int to) {
+    if (from >= KB_KEY_MEDIA_BASE) return false;
+    if (to >= KB_KEY_MEDIA_BASE && to != KB_KEY_NONE) return false;
+
+    bool was_mapped = remap->to[from] != from;
+    bool is_mapped = to != from;
+    remap->to[from] = (unsigned short)to;
+    remap->count += (unsigned int)is_mapped - (unsigned int)was_mapped;
+    return true;
+}
+
+/**
+ * @brief Parses one key code of a pair.
+ */
+static bool parse_code(const char *text, unsigned int *code) {
+    if (strcmp(text, "none") == 0) {
+        *code = KB_KEY_NONE;
+        return true;
+    }
+    char *end;
+    unsigned long value = strtoul(text, &end, 0);
+    if (end == text || *end != '\0' || value >= KB_KEY_MEDIA_BASE) return false;
+    *code = (unsigned int)value;
+    return true;
+}
+
+/**
+ * @brief Parses a comma-separated list of from:to pairs.
+ */
+void remap_parse(kb_remap_t *remap, const char *list) {
+    remap_init(remap);
+
+    char buf[1024];
+    strncpy(buf, list, sizeof(buf) - 1);
+    buf[sizeof(buf) - 1] = '\0';
+
+    char *save = NULL;
+    for (char *pair = strtok_r(buf, ", ", &save); pair; pair = strtok_r(NULL, ", ", &save)) {
+        char *sep = strchr(pair, ':');
+        unsigned int from, to;
+        if (sep) *sep = '\0';
+        if (!sep || !parse_code(pair, &from) || from == KB_KEY_NONE || !parse_code(sep + 1, &to) ||
+            !remap_set(remap, from, to)) {
+            log_message(KB_LOG_LEVEL_ERROR, "Ignoring invalid remap entry %s.", pair);
+        }
+    }
+}
+
+/**
+ * @brief Writes the table as a from:to list.
+ */
+void remap_format(const kb_remap_t *remap, FILE *out) {
+    bool first = true;
+    for (unsigned int key = 0; key < KB_KEY_MEDIA_BASE; key++) {
+        unsigned short to = remap->to[key];
+        if (to == key) continue;
+        if (to == KB_KEY_NONE) {
+            fprintf(out, "%s%u:none", first ? "" : ",", key);
+        } else {
+            fprintf(out, "%s%u:%hu", first ? "" : ",", key, to);
+        }
+        first = false;
+    }
+}
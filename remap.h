@@ -0,0 +1,73 @@
+/**
+ * @file remap.h
+ * @brief Key remapping applied in the event tap callback.
+ *
+ * The remap table is a flat array indexed by hardware key code holding the
+ * code each key is rewritten to, so applying it is a single lookup with no
+ * allocation. Events are rewritten in place before they leave the tap.
+ */
+
+#ifndef REMAP_H
+#define REMAP_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "engine.h"
+
+/**
+ * @brief Flat remap table covering the hardware key codes.
+ */
+typedef struct {
+    unsigned short to[KB_KEY_MEDIA_BASE]; /**< Target per key code; KB_KEY_NONE disables the key */
+    unsigned int count;                   /**< Number of keys not mapped to themselves */
+} kb_remap_t;
+
+/**
+ * @brief Resets a table to the identity mapping.
+ *
+ * @param remap Table to reset.
+ */
+void remap_init(kb_remap_t *remap);
+
+/**
+ * @brief Maps one key to another.
+ *
+ * @param remap Table to update.
+ * @param from Source key code.
+ * @param to Target key code, or KB_KEY_NONE to disable the key.
+ * @return False if either key code is out of range.
+ */
+bool remap_set(kb_remap_t *remap, unsigned int from, unsigned int to);
+
+/**
+ * @brief Parses a comma-separated list of from:to pairs.
+ *
+ * Key codes are decimal or 0x-prefixed; a target of "none" disables the
+ * key. Invalid pairs are logged and skipped.
+ *
+ * @param remap Table to fill; reset first.
+ * @param list List such as "57:none,0x3A:0x37".
+ */
+void remap_parse(kb_remap_t *remap, const char *list);
+
+/**
+ * @brief Writes the table as a from:to list, without a trailing newline.
+ *
+ * @param remap Table to format.
+ * @param out Output stream.
+ */
+void remap_format(const kb_remap_t *remap, FILE *out);
+
+/**
+ * @brief Looks up the code a key is rewritten to.
+ *
+ * @param remap Table to consult.
+ * @param key Key code.
+ * @return Target code, KB_KEY_NONE if the key is disabled, or key itself if
+ * it is not remapped.
+ */
+static inline unsigned short remap_lookup(const kb_remap_t *remap, unsigned short key) {
+    return key < KB_KEY_MEDIA_BASE ? remap->to[key] : key;
+}
+
+#endif
@@ -0,0 +1,173 @@
+/**
+ * @file replay.c
+ * @brief Implementation of replay trace reading and writing.
+ */
+
+#include "replay.h"
+#include "logger.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/**
+ * @brief Converts a binary record to an event.
+ */
+static void record_to_event(const kb_replay_record_t *record, kb_event_t *event) {
+    event->type = record->type < KB_EVENT_TYPE_COUNT ? (kb_event_type_t)record->type : KB_EVENT_OTHER;
+    event->key_code = record->key_code;
+    event->flags = record->flags;
+    event->device = record->device;
+    event->timestamp = record->timestamp;
+    event->autorepeat = record->autorepeat != 0;
+}
+
+/**
+ * @brief Parses an event type name written by engine_event_type_name.
+ */
+static bool parse_type(const char *name, kb_event_type_t *type) {
+    for (int i = 0; i < KB_EVENT_TYPE_COUNT; i++) {
+        if (strcmp(name, engine_event_type_name((kb_event_type_t)i)) == 0) {
+            *type = (kb_event_type_t)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Parses one "timestamp_ns,type,key,flags,device,..." dump line.
+ */
+static bool parse_dump_line(char *line, kb_event_t *event) {
+    char *fields[5];
+    char *cursor = line;
+    for (int i = 0; i < 5; i++) {
+        fields[i] = cursor;
+        char *comma = strchr(cursor, ',');
+        if (!comma && i < 4) return false;
+        if (comma) {
+            *comma = '\0';
+            cursor = comma + 1;
+        }
+    }
+
+    char *end;
+    event->timestamp = strtoull(fields[0], &end, 10);
+    if (end == fields[0] || !parse_type(fields[1], &event->type)) return false;
+    event->key_code = fields[2][0] ? (unsigned short)strtoul(fields[2], NULL, 10) : KB_KEY_NONE;
+    event->flags = strtoull(fields[3], NULL, 16);
+    event->device = (unsigned int)strtoul(fields[4], NULL, 10);
+    event->autorepeat = false;
+    return true;
+}
+
+/**
+ * @brief Opens an event stream and detects its format.
+ */
+bool replay_open(kb_replay_reader_t *reader, const char *path) {
+    memset(reader, 0, sizeof(*reader));
+    reader->file = fopen(path, "rb");
+    if (!reader->file) {
+        log_message(KB_LOG_LEVEL_ERROR, "Failed to open %s.", path);
+        return false;
+    }
+    char magic[KB_REPLAY_HEADER_SIZE];
+    if (fread(magic, 1, sizeof(magic), reader->file) == sizeof(magic) &&
+        memcmp(magic, KB_REPLAY_MAGIC, sizeof(magic)) == 0) {
+        reader->binary = true;
+    } else {
+        rewind(reader->file);
+    }
+    return true;
+}
+
+/**
+ * @brief Reads up to max events.
+ */
+size_t replay_read(kb_replay_reader_t *reader, kb_event_t *events, size_t max) {
+    size_t count = 0;
+    if (reader->binary) {
+        kb_replay_record_t records[256];
+        while (count < max) {
+            size_t want = max - count < 256 ? max - count : 256;
+            size_t got = fread(records, sizeof(records[0]), want, reader->file);
+            for (size_t i = 0; i < got; i++) record_to_event(&records[i], &events[count++]);
+            if (got < want) break;
+        }
+        return count;
+    }
+
+    char line[256];
+    while (count < max && fgets(line, sizeof(line), reader->file)) {
+        reader->line++;
+        line[strcspn(line, "\r\n")] = '\0';
+        if (line[0] == '#') {
+            reader->in_events = strncmp(line, "# events", 8) == 0;
+            continue;
+        }
+        if (!reader->in_events || !line[0]) continue;
+        if (parse_dump_line(line, &events[count])) {
+            count++;
+        } else {
+            log_message(KB_LOG_LEVEL_ERROR, "Skipping malformed event on line %zu.", reader->line);
+        }
+    }
+    return count;
+}
+
+/**
+ * @brief Returns the number of events in a binary trace.
+ */
+bool replay_count(kb_replay_reader_t *reader, uint64_t *count) {
+    struct stat st;
+    if (!reader->binary || fstat(fileno(reader->file), &st) != 0 || st.st_size < KB_REPLAY_HEADER_SIZE) return false;
+    *count = (uint64_t)(st.st_size - KB_REPLAY_HEADER_SIZE) / sizeof(kb_replay_record_t);
+    return true;
+}
+
+/**
+ * @brief Positions a binary trace at an event.
+ */
+bool replay_seek(kb_replay_reader_t *reader, uint64_t index) {
+    if (!reader->binary) return false;
+    off_t offset = (off_t)(KB_REPLAY_HEADER_SIZE + index * sizeof(kb_replay_record_t));
+    return fseeko(reader->file, offset, SEEK_SET) == 0;
+}
+
+/**
+ * @brief Closes an event stream.
+ */
+void replay_close(kb_replay_reader_t *reader) {
+    if (reader->file) fclose(reader->file);
+    reader->file = NULL;
+}
+
+/**
+ * @brief Writes the binary trace header.
+ */
+bool replay_write_header(FILE *out) {
+    return fwrite(KB_REPLAY_MAGIC, 1, KB_REPLAY_HEADER_SIZE, out) == KB_REPLAY_HEADER_SIZE;
+}
+
+/**
+ * @brief Appends events to a binary trace.
+ */
+bool replay_write(FILE *out, const kb_event_t *events, size_t count) {
+    kb_replay_record_t records[256];
+    for (size_t done = 0; done < count;) {
+        size_t n = count - done < 256 ? count - done : 256;
+        for (size_t i = 0; i < n; i++) {
+            const kb_event_t *event = &events[done + i];
+            memset(&records[i], 0, sizeof(records[i]));
+            records[i].timestamp = event->timestamp;
+            records[i].flags = event->flags;
+            records[i].device = event->device;
+            records[i].key_code = event->key_code;
+            records[i].type = (uint8_t)event->type;
+            records[i].autorepeat = event->autorepeat;
+        }
+        if (fwrite(records, sizeof(records[0]), n, out) != n) return false;
+        done += n;
+    }
+    return true;
+}
@@ -0,0 +1,114 @@
+/**
+ * @file replay.h
+ * @brief Reading and writing keyboard event streams for offline replay.
+ *
+ * Two formats are read:
+ * - binary replay traces: the KB_REPLAY_MAGIC header followed by fixed-size
+ *   records in host byte order, written by the tools;
+ * - flight recorder dumps (KB_FLIGHT_RECORDER_FILE), whose "events"
+ *   section is replayed and the rest skipped.
+ *
+ * The format of a file is detected from its first bytes.
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "engine.h"
+
+/** @brief First bytes of a binary replay trace. */
+#define KB_REPLAY_MAGIC "KBRPLAY1"
+
+/** @brief Size of the binary header. */
+#define KB_REPLAY_HEADER_SIZE 8
+
+/**
+ * @brief One event in a binary replay trace (24 bytes).
+ */
+typedef struct {
+    uint64_t timestamp;     /**< Event time in nanoseconds */
+    uint64_t flags;         /**< Modifier flags */
+    uint32_t device;        /**< Keyboard type */
+    uint16_t key_code;      /**< Key id */
+    uint8_t type;           /**< kb_event_type_t */
+    uint8_t autorepeat;     /**< Auto-repeat flag */
+} kb_replay_record_t;
+
+/**
+ * @brief An open event stream.
+ */
+typedef struct {
+    FILE *file;             /**< Underlying file */
+    bool binary;            /**< Binary trace rather than a flight recorder dump */
+    bool in_events;         /**< Inside the events section of a dump */
+    size_t line;            /**< Current line of a dump, for errors */
+} kb_replay_reader_t;
+
+/**
+ * @brief Opens an event stream and detects its format.
+ *
+ * @param reader Reader to initialize.
+ * @param path File to read.
+ * @return true on success.
+ */
+bool replay_open(kb_replay_reader_t *reader, const char *path);
+
+/**
+ * @brief Reads up to max events.
+ *
+ * Malformed dump lines are logged and skipped.
+ *
+ * @param reader Open reader.
+ * @param events Receives the events.
+ * @param max Capacity of events.
+ * @return Number of events read; 0 at the end of the stream.
+ */
+size_t replay_read(kb_replay_reader_t *reader, kb_event_t *events, size_t max);
+
+/**
+ * @brief Returns the number of events in a binary trace.
+ *
+ * @param reader Open reader.
+ * @param count Receives the number of events.
+ * @return false for flight recorder dumps, which can only be read in order.
+ */
+bool replay_count(kb_replay_reader_t *reader, uint64_t *count);
+
+/**
+ * @brief Positions a binary trace at an event, so traces can be split into
+ * chunks read independently.
+ *
+ * @param reader Open reader.
+ * @param index Index of the next event to read.
+ * @return false for flight recorder dumps or on error.
+ */
+bool replay_seek(kb_replay_reader_t *reader, uint64_t index);
+
+/**
+ * @brief Closes an event stream.
+ */
+void replay_close(kb_replay_reader_t *reader);
+
+/**
+ * @brief Writes the binary trace header.
+ *
+ * @param out Output stream, positioned at its start.
+ * @return true on success.
+ */
+bool replay_write_header(FILE *out);
+
+/**
+ * @brief Appends events to a binary trace.
+ *
+ * @param out Output stream.
+ * @param events Events to write.
+ * @param count Number of events.
+ * @return true on success.
+ */
+bool replay_write(FILE *out, const kb_event_t *events, size_t count);
+
+#endif
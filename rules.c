@@ -0,0 +1,493 @@
+/**
+ * @file rules.c
+ * @brief Rule compiler and direct-threaded bytecode interpreter.
+ *
+ * The compiler is a recursive-descent parser emitting code for a small
+ * stack machine. "and"/"or" compile to forward jumps, so every program
+ * runs straight through; comparisons against constants are fused into a
+ * single instruction. After compilation each instruction is linked to the
+ * interpreter label of its opcode, and dispatch is one indirect jump.
+ */
+
+#include "rules.h"
+#include "logger.h"
+#include "media_keys.h"
+#include <stdlib.h>
+#include <string.h>
+
+/** @brief Maximum operand stack depth of a compiled program. */
+#define RULES_STACK_MAX 32
+
+/** @brief Modifier bits as they appear in kb_event_t flags (CGEventFlags). */
+#define FLAG_SHIFT   0x00020000ULL
+#define FLAG_CONTROL 0x00040000ULL
+#define FLAG_OPTION  0x00080000ULL
+#define FLAG_COMMAND 0x00100000ULL
+
+/**
+ * @brief Opcodes of the rule machine.
+ */
+typedef enum {
+    OP_END = 0,     /**< No rule matched */
+    OP_CONST,       /**< Push imm */
+    OP_KEY,         /**< Push the key id */
+    OP_DEVICE,      /**< Push the keyboard type */
+    OP_SINCE_UNLOCK, /**< Push milliseconds since the last unlock */
+    OP_FLAGS,       /**< Push whether all modifier bits in imm are held */
+    OP_TYPE,        /**< Push whether the event type equals imm */
+    OP_REPEAT,      /**< Push the auto-repeat flag */
+    OP_APP,         /**< Push whether referenced app arg is frontmost */
+    OP_EQ,          /**< Replace top with top == imm */
+    OP_NE,          /**< Replace top with top != imm */
+    OP_LT,          /**< Replace top with top < imm */
+    OP_LE,          /**< Replace top with top <= imm */
+    OP_GT,          /**< Replace top with top > imm */
+    OP_GE,          /**< Replace top with top >= imm */
+    OP_NOT,         /**< Replace top with its negation */
+    OP_JFALSE,      /**< If top is false jump to imm, else pop */
+    OP_JTRUE,       /**< If top is true jump to imm, else pop */
+    OP_MATCH,       /**< Pop; if true the event's verdict is arg */
+    OP_COUNT
+} rule_op_t;
+
+/**
+ * @brief Parser state for one rule line.
+ */
+typedef struct {
+    const char *p;          /**< Cursor into the rule text */
+    kb_rules_t *rules;      /**< Rule set receiving the code */
+    int depth;              /**< Current operand stack depth */
+    const char *error;      /**< First error, NULL if none */
+} compiler_t;
+
+/**
+ * @brief Runs a program, or exports the label table when labels is non-NULL.
+ *
+ * Sharing one function keeps the labels used for linking and for dispatch
+ * identical.
+ */
+static int run(const kb_rules_t *rules, const kb_engine_t *engine, const kb_event_t *event,
+               const void *const **labels) {
+    static const void *const table[OP_COUNT] = {
+        [OP_END] = &&op_end,       [OP_CONST] = &&op_const,   [OP_KEY] = &&op_key,
+        [OP_DEVICE] = &&op_device, [OP_SINCE_UNLOCK] = &&op_since_unlock,
+        [OP_FLAGS] = &&op_flags,   [OP_TYPE] = &&op_type,     [OP_REPEAT] = &&op_repeat,
+        [OP_APP] = &&op_app,       [OP_EQ] = &&op_eq,         [OP_NE] = &&op_ne,
+        [OP_LT] = &&op_lt,         [OP_LE] = &&op_le,         [OP_GT] = &&op_gt,
+        [OP_GE] = &&op_ge,         [OP_NOT] = &&op_not,       [OP_JFALSE] = &&op_jfalse,
+        [OP_JTRUE] = &&op_jtrue,   [OP_MATCH] = &&op_match,
+    };
+    if (labels) {
+        *labels = table;
+        return KB_RULES_NO_MATCH;
+    }
+
+    int64_t stack[RULES_STACK_MAX];
+    int64_t *sp = stack;
+    const kb_rule_insn_t *code = rules->code;
+    const kb_rule_insn_t *ip = code;
+    unsigned int budget = KB_RULES_MAX_STEPS;
+    unsigned int app_mask = atomic_load_explicit(&rules->app_mask, memory_order_relaxed);
+
+#define DISPATCH()                         \
+    do {                                   \
+        if (budget-- == 0) goto exhausted; \
+        goto *ip->handler;                 \
+    } while (0)
+#define NEXT()      \
+    do {            \
+        ip++;       \
+        DISPATCH(); \
+    } while (0)
+#define COMPARE(op)                           \
+    do {                                      \
+        sp[-1] = sp[-1] op (int64_t)ip->imm;  \
+        NEXT();                               \
+    } while (0)
+
+    DISPATCH();
+
+op_const:
+    *sp++ = ip->imm;
+    NEXT();
+op_key:
+    *sp++ = event->key_code;
+    NEXT();
+op_device:
+    *sp++ = event->device;
+    NEXT();
+op_since_unlock:
+    *sp++ = engine->last_unlock && event->timestamp >= engine->last_unlock
+                ? (int64_t)((event->timestamp - engine->last_unlock) / 1000000ULL)
+                : (int64_t)UINT32_MAX;
+    NEXT();
+op_flags:
+    *sp++ = (event->flags & ip->imm) == ip->imm;
+    NEXT();
+op_type:
+    *sp++ = (uint32_t)event->type == ip->imm;
+    NEXT();
+op_repeat:
+    *sp++ = event->autorepeat;
+    NEXT();
+op_app:
+    *sp++ = (app_mask >> ip->arg) & 1;
+    NEXT();
+op_eq:
+    COMPARE(==);
+op_ne:
+    COMPARE(!=);
+op_lt:
+    COMPARE(<);
+op_le:
+    COMPARE(<=);
+op_gt:
+    COMPARE(>);
+op_ge:
+    COMPARE(>=);
+op_not:
+    sp[-1] = !sp[-1];
+    NEXT();
+op_jfalse:
+    if (!sp[-1]) {
+        ip = code + ip->imm;
+        DISPATCH();
+    }
+    sp--;
+    NEXT();
+op_jtrue:
+    if (sp[-1]) {
+        ip = code + ip->imm;
+        DISPATCH();
+    }
+    sp--;
+    NEXT();
+op_match:
+    if (*--sp) return ip->arg;
+    NEXT();
+op_end:
+exhausted:
+    return KB_RULES_NO_MATCH;
+
+#undef COMPARE
+#undef NEXT
+#undef DISPATCH
+}
+
+/**
+ * @brief Runs the rule set against an event.
+ */
+int rules_eval(const kb_rules_t *rules, const kb_engine_t *engine, const kb_event_t *event) {
+    if (!rules || rules->count == 0) return KB_RULES_NO_MATCH;
+    return run(rules, engine, event, NULL);
+}
+
+/**
+ * @brief Skips whitespace.
+ */
+static void skip_space(compiler_t *c) {
+    while (*c->p == ' ' || *c->p == '\t' || *c->p == '\r' || *c->p == '\n') c->p++;
+}
+
+/**
+ * @brief Reads the next token: an operator, a parenthesis, a quoted string
+ * or a word. Returns false at the end of the text.
+ */
+static bool next_token(compiler_t *c, char *token, size_t size) {
+    skip_space(c);
+    const char *start = c->p;
+    size_t len;
+    if (*start == '\0') return false;
+
+    if (*start == '(' || *start == ')') {
+        len = 1;
+    } else if (strchr("=!<>", *start)) {
+        len = start[1] == '=' ? 2 : 1;
+    } else if (*start == '"') {
+        const char *end = strchr(start + 1, '"');
+        if (!end) end = start + strlen(start);
+        start++;
+        len = (size_t)(end - start);
+        c->p = *end ? end + 1 : end;
+        goto copy;
+    } else {
+        len = 0;
+        while (start[len] && !strchr(" \t\r\n()=!<>\"", start[len])) len++;
+    }
+    c->p = start + len;
+
+copy:
+    if (len >= size) len = size - 1;
+    memcpy(token, start, len);
+    token[len] = '\0';
+    return true;
+}
+
+/**
+ * @brief Consumes the next token if it equals the expected one.
+ */
+static bool accept(compiler_t *c, const char *expected) {
+    const char *saved = c->p;
+    char token[KB_RULE_TEXT_MAX];
+    if (next_token(c, token, sizeof(token)) && strcmp(token, expected) == 0) return true;
+    c->p = saved;
+    return false;
+}
+
+/**
+ * @brief Records the first compile error.
+ */
+static void fail(compiler_t *c, const char *error) {
+    if (!c->error) c->error = error;
+}
+
+/**
+ * @brief Appends an instruction, tracking the stack depth change.
+ *
+ * @return Index of the instruction, or 0 if the code is full; callers must
+ * not use it once c->error is set.
+ */
+static size_t emit(compiler_t *c, rule_op_t op, uint16_t arg, uint32_t imm, int stack_effect) {
+    kb_rules_t *rules = c->rules;
+    /* The last slot is reserved for the final OP_END */
+    if (rules->code_size >= KB_RULES_MAX_CODE - 1) {
+        fail(c, "rule set is too long");
+        return 0;
+    }
+    c->depth += stack_effect;
+    if (c->depth > RULES_STACK_MAX) fail(c, "condition is nested too deeply");
+
+    kb_rule_insn_t *insn = &rules->code[rules->code_size];
+    insn->handler = NULL;
+    insn->op = (uint16_t)op;
+    insn->arg = arg;
+    insn->imm = imm;
+    return rules->code_size++;
+}
+
+/**
+ * @brief Returns the index of a referenced application, interning it.
+ */
+static int intern_app(compiler_t *c, const char *bundle_id) {
+    kb_rules_t *rules = c->rules;
+    for (int i = 0; i < rules->app_count; i++) {
+        if (strcmp(rules->apps[i], bundle_id) == 0) return i;
+    }
+    if (rules->app_count >= KB_RULES_MAX_APPS || strlen(bundle_id) >= KB_APP_POLICY_ID_MAX) {
+        fail(c, "too many applications");
+        return 0;
+    }
+    strcpy(rules->apps[rules->app_count], bundle_id);
+    return rules->app_count++;
+}
+
+static void parse_or(compiler_t *c);
+
+/**
+ * @brief Parses a comparison against a constant: "<op> <value>".
+ */
+static void parse_comparison(compiler_t *c, bool key) {
+    static const struct {
+        const char *text;
+        rule_op_t op;
+    } ops[] = {
+        {"==", OP_EQ}, {"!=", OP_NE}, {"<", OP_LT}, {"<=", OP_LE}, {">", OP_GT}, {">=", OP_GE},
+    };
+
+    char token[KB_RULE_TEXT_MAX];
+    rule_op_t op = OP_COUNT;
+    if (next_token(c, token, sizeof(token))) {
+        for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); i++) {
+            if (strcmp(token, ops[i].text) == 0) op = ops[i].op;
+        }
+    }
+    if (op == OP_COUNT) {
+        fail(c, "expected a comparison operator");
+        return;
+    }
+
+    unsigned int value = 0;
+    if (!next_token(c, token, sizeof(token))) {
+        fail(c, "expected a value");
+        return;
+    }
+    if (key) {
+        if (!media_key_parse(token, &value)) fail(c, "unknown key");
+    } else {
+        char *end;
+        unsigned long number = strtoul(token, &end, 0);
+        if (end == token || *end != '\0' || number > UINT32_MAX) fail(c, "expected a number");
+        value = (unsigned int)number;
+    }
+    emit(c, op, 0, value, 0);
+}
+
+/**
+ * @brief Parses an atom, a negation or a parenthesized condition.
+ */
+static void parse_unary(compiler_t *c) {
+    char token[KB_RULE_TEXT_MAX];
+    if (!next_token(c, token, sizeof(token))) {
+        fail(c, "expected a condition");
+        return;
+    }
+
+    if (strcmp(token, "not") == 0) {
+        parse_unary(c);
+        emit(c, OP_NOT, 0, 0, 0);
+    } else if (strcmp(token, "(") == 0) {
+        parse_or(c);
+        if (!accept(c, ")")) fail(c, "expected )");
+    } else if (strcmp(token, "key") == 0) {
+        emit(c, OP_KEY, 0, 0, 1);
+        parse_comparison(c, true);
+    } else if (strcmp(token, "device") == 0) {
+        emit(c, OP_DEVICE, 0, 0, 1);
+        parse_comparison(c, false);
+    } else if (strcmp(token, "since_unlock") == 0) {
+        emit(c, OP_SINCE_UNLOCK, 0, 0, 1);
+        parse_comparison(c, false);
+    } else if (strcmp(token, "app") == 0) {
+        bool negate = accept(c, "!=");
+        if (!negate && !accept(c, "==")) fail(c, "expected == or != after app");
+        if (!next_token(c, token, sizeof(token))) {
+            fail(c, "expected a bundle identifier");
+            return;
+        }
+        emit(c, OP_APP, (uint16_t)intern_app(c, token), 0, 1);
+        if (negate) emit(c, OP_NOT, 0, 0, 0);
+    } else if (strcmp(token, "cmd") == 0) {
+        emit(c, OP_FLAGS, 0, (uint32_t)FLAG_COMMAND, 1);
+    } else if (strcmp(token, "shift") == 0) {
+        emit(c, OP_FLAGS, 0, (uint32_t)FLAG_SHIFT, 1);
+    } else if (strcmp(token, "alt") == 0) {
+        emit(c, OP_FLAGS, 0, (uint32_t)FLAG_OPTION, 1);
+    } else if (strcmp(token, "ctrl") == 0) {
+        emit(c, OP_FLAGS, 0, (uint32_t)FLAG_CONTROL, 1);
+    } else if (strcmp(token, "down") == 0) {
+        emit(c, OP_TYPE, 0, KB_EVENT_KEY_DOWN, 1);
+    } else if (strcmp(token, "up") == 0) {
+        emit(c, OP_TYPE, 0, KB_EVENT_KEY_UP, 1);
+    } else if (strcmp(token, "repeat") == 0) {
+        emit(c, OP_REPEAT, 0, 0, 1);
+    } else {
+        fail(c, "unknown condition");
+    }
+}
+
+/**
+ * @brief Parses a chain of conditions joined by "and" or "or".
+ *
+ * Each operator but the last emits a short-circuit jump to the end of the
+ * chain; the jumps are patched once the end is known.
+ */
+static void parse_chain(compiler_t *c, const char *word, rule_op_t jump, void (*operand)(compiler_t *)) {
+    size_t jumps[KB_RULE_TEXT_MAX / 4];
+    size_t count = 0;
+
+    operand(c);
+    while (!c->error && accept(c, word)) {
+        if (count == sizeof(jumps) / sizeof(jumps[0])) {
+            fail(c, "condition is too long");
+            return;
+        }
+        jumps[count++] = emit(c, jump, 0, 0, -1);
+        operand(c);
+    }
+    /* After an error the jumps may hold emit()'s 0, which is another rule's code */
+    if (c->error) return;
+    for (size_t i = 0; i < count; i++) {
+        c->rules->code[jumps[i]].imm = (uint32_t)c->rules->code_size;
+    }
+}
+
+/**
+ * @brief Parses conditions joined by "and".
+ */
+static void parse_and(compiler_t *c) {
+    parse_chain(c, "and", OP_JFALSE, parse_unary);
+}
+
+/**
+ * @brief Parses conditions joined by "or".
+ */
+static void parse_or(compiler_t *c) {
+    parse_chain(c, "or", OP_JTRUE, parse_and);
+}
+
+/**
+ * @brief Compiles one rule line, appending its code.
+ *
+ * @return NULL on success, or a description of the error.
+ */
+static const char *compile_rule(kb_rules_t *rules, const char *line) {
+    compiler_t c = {line, rules, 0, NULL};
+    char token[KB_RULE_TEXT_MAX];
+    uint16_t verdict;
+
+    if (!next_token(&c, token, sizeof(token))) return "empty rule";
+    if (strcmp(token, "block") == 0) {
+        verdict = KB_VERDICT_BLOCK;
+    } else if (strcmp(token, "pass") == 0) {
+        verdict = KB_VERDICT_PASS;
+    } else {
+        return "expected block or pass";
+    }
+
+    if (accept(&c, "if")) {
+        parse_or(&c);
+    } else {
+        emit(&c, OP_CONST, 0, 1, 1);
+    }
+    skip_space(&c);
+    if (*c.p) fail(&c, "unexpected text after condition");
+    emit(&c, OP_MATCH, verdict, 0, -1);
+    return c.error;
+}
+
+/**
+ * @brief Compiles rule lines into a rule set.
+ */
+size_t rules_compile(kb_rules_t *rules, const char (*lines)[KB_RULE_TEXT_MAX], size_t count) {
+    rules->count = 0;
+    rules->code_size = 0;
+    rules->app_count = 0;
+    atomic_store_explicit(&rules->app_mask, 0, memory_order_relaxed);
+
+    for (size_t i = 0; i < count && rules->count < KB_RULES_MAX; i++) {
+        size_t code_size = rules->code_size;
+        int app_count = rules->app_count;
+        const char *error = compile_rule(rules, lines[i]);
+        if (error) {
+            log_message(KB_LOG_LEVEL_ERROR, "Ignoring rule \"%s\": %s.", lines[i], error);
+            rules->code_size = code_size;
+            rules->app_count = app_count;
+            continue;
+        }
+        strcpy(rules->source[rules->count++], lines[i]);
+    }
+
+    rules->code[rules->code_size++] = (kb_rule_insn_t){NULL, OP_END, 0, 0};
+    if (rules->code_size > KB_RULES_MAX_STEPS) {
+        log_message(KB_LOG_LEVEL_ERROR, "Rules compile to %zu instructions; later rules may exceed the budget of %d.",
+                    rules->code_size, KB_RULES_MAX_STEPS);
+    }
+
+    const void *const *table;
+    run(NULL, NULL, NULL, &table);
+    for (size_t i = 0; i < rules->code_size; i++) {
+        rules->code[i].handler = table[rules->code[i].op];
+    }
+    return rules->count;
+}
+
+/**
+ * @brief Records which referenced applications match the newly activated one.
+ */
+void rules_activate(kb_rules_t *rules, const char *bundle_id) {
+    unsigned int mask = 0;
+    for (int i = 0; bundle_id && i < rules->app_count; i++) {
+        if (strcmp(rules->apps[i], bundle_id) == 0) mask |= 1U << i;
+    }
+    atomic_store_explicit(&rules->app_mask, mask, memory_order_relaxed);
+}
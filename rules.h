@@ -0,0 +1,110 @@
+/**
+ * @file rules.h
+ * @brief Blocking rules written in settings.conf, compiled to bytecode.
+ *
+ * Each "rule=" line reads "<block|pass> [if <condition>]". While blocking is
+ * active the rules are tried in order and the first one whose condition
+ * holds decides the event; events no rule matches fall through to the
+ * built-in per-key, device and application policies.
+ *
+ * Conditions combine the atoms below with "and", "or", "not" and
+ * parentheses:
+ * - key, device, since_unlock (milliseconds since the emergency shortcut)
+ *   compared with ==, !=, <, <=, >, >= against a number or media key name
+ * - app == <bundle id> / app != <bundle id>
+ * - cmd, shift, alt, ctrl (modifier held), down, up, repeat
+ *
+ * Example: "pass if app == com.apple.Terminal and cmd and key == 48".
+ *
+ * Rules compile into a flat instruction array executed by a direct-threaded
+ * interpreter. Evaluation allocates nothing and stops after
+ * KB_RULES_MAX_STEPS instructions, so a rule set can never stall the tap.
+ */
+
+#ifndef RULES_H
+#define RULES_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "engine.h"
+
+/** @brief Maximum number of rules read from settings. */
+#define KB_RULES_MAX 32
+
+/** @brief Maximum length of a rule's source text, including the terminator. */
+#define KB_RULE_TEXT_MAX 256
+
+/** @brief Maximum number of instructions in a compiled rule set. */
+#define KB_RULES_MAX_CODE 1024
+
+/** @brief Maximum number of distinct applications referenced by rules. */
+#define KB_RULES_MAX_APPS 32
+
+/**
+ * @brief Instruction budget for evaluating one event.
+ *
+ * An evaluation that runs out of budget is treated as "no match".
+ */
+#define KB_RULES_MAX_STEPS 512
+
+/** @brief Returned by rules_eval when no rule matched. */
+#define KB_RULES_NO_MATCH (-1)
+
+/**
+ * @brief One bytecode instruction.
+ */
+typedef struct {
+    const void *handler;    /**< Interpreter label for the opcode (direct threading) */
+    uint16_t op;            /**< Opcode */
+    uint16_t arg;           /**< Small operand (verdict, app index) */
+    uint32_t imm;           /**< Immediate operand (constant, jump target, flag mask) */
+} kb_rule_insn_t;
+
+/**
+ * @brief A compiled rule set and the application state it depends on.
+ */
+typedef struct kb_rules {
+    size_t count;                                       /**< Number of rules */
+    char source[KB_RULES_MAX][KB_RULE_TEXT_MAX];         /**< Rule text, kept for saving */
+    size_t code_size;                                   /**< Number of instructions */
+    kb_rule_insn_t code[KB_RULES_MAX_CODE];             /**< Compiled program */
+    int app_count;                                      /**< Number of referenced applications */
+    char apps[KB_RULES_MAX_APPS][KB_APP_POLICY_ID_MAX]; /**< Referenced bundle identifiers */
+    atomic_uint app_mask;                               /**< Bit per referenced app that is frontmost */
+} kb_rules_t;
+
+/**
+ * @brief Compiles rule lines into a rule set.
+ *
+ * Lines that fail to parse are logged and skipped.
+ *
+ * @param rules Rule set to fill.
+ * @param lines Rule texts.
+ * @param count Number of lines (at most KB_RULES_MAX are used).
+ * @return Number of rules compiled.
+ */
+size_t rules_compile(kb_rules_t *rules, const char (*lines)[KB_RULE_TEXT_MAX], size_t count);
+
+/**
+ * @brief Notification sink: records which referenced applications match the
+ * newly activated one.
+ *
+ * @param rules Rule set to update.
+ * @param bundle_id Bundle identifier of the frontmost app, or NULL if unknown.
+ */
+void rules_activate(kb_rules_t *rules, const char *bundle_id);
+
+/**
+ * @brief Runs the rule set against an event.
+ *
+ * @param rules Compiled rule set.
+ * @param engine Engine state (for the time of the last unlock).
+ * @param event Decoded event.
+ * @return KB_VERDICT_PASS or KB_VERDICT_BLOCK from the first matching rule,
+ * or KB_RULES_NO_MATCH.
+ */
+int rules_eval(const kb_rules_t *rules, const kb_engine_t *engine, const kb_event_t *event);
+
+#endif
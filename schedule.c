@@ -0,0 +1,239 @@
+/**
+ * @file schedule.c
+ * @brief Implementation of recurring blocking windows.
+ *
+ * Window state is only ever touched on the worker thread: starting a
+ * schedule arms every window's timer for immediate expiry, and each expiry
+ * re-evaluates that window against the local wall clock before re-arming it
+ * at the next boundary. Re-evaluating on every expiry keeps the schedule
+ * correct across daylight saving changes and wall-clock adjustments.
+ */
+
+#include "schedule.h"
+#include "worker.h"
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+/** @brief Minutes in a day. */
+#define MINUTES_PER_DAY 1440
+
+/** @brief Day mask for Monday to Friday. */
+#define WEEKDAYS 0x3E
+
+/** @brief Day mask for Saturday and Sunday. */
+#define WEEKENDS 0x41
+
+/** @brief Short weekday names, indexed like tm_wday. */
+static const char *const DAY_NAMES[7] = { "sun", "mon", "tue", "wed", "thu", "fri", "sat" };
+
+/**
+ * @brief Returns whether a window covers the given local time.
+ */
+bool schedule_window_active(const kb_schedule_window_t *window, const struct tm *tm) {
+    int minute = tm->tm_hour * 60 + tm->tm_min;
+    bool today = (window->days >> tm->tm_wday) & 1;
+    bool yesterday = (window->days >> ((tm->tm_wday + 6) % 7)) & 1;
+
+    if (window->start < window->end) {
+        return today && minute >= window->start && minute < window->end;
+    }
+    /* Runs past midnight: the tail belongs to the previous day's window */
+    return (today && minute >= window->start) || (yesterday && minute < window->end);
+}
+
+/**
+ * @brief Returns the local time at a minute of the day a number of days
+ * after a base date. mktime normalizes overflowing fields and DST.
+ */
+static time_t at_minute(const struct tm *base, int day_offset, int minute) {
+    struct tm t = *base;
+    t.tm_mday += day_offset;
+    t.tm_hour = 0;
+    t.tm_min = minute;
+    t.tm_sec = 0;
+    t.tm_isdst = -1;
+    return mktime(&t);
+}
+
+/**
+ * @brief Returns the next time after now at which the window starts or ends.
+ */
+time_t schedule_window_next_boundary(const kb_schedule_window_t *window, time_t now) {
+    struct tm base;
+    localtime_r(&now, &base);
+
+    time_t best = (time_t)-1;
+    int end_offset = window->start < window->end ? 0 : 1;
+    /* Yesterday's window may still be running; a week later the pattern repeats */
+    for (int k = -1; k <= 7; k++) {
+        if (!((window->days >> ((base.tm_wday + k + 7) % 7)) & 1)) continue;
+        time_t start = at_minute(&base, k, window->start);
+        time_t end = at_minute(&base, k + end_offset, window->end);
+        if (start > now && (best == (time_t)-1 || start < best)) best = start;
+        if (end > now && (best == (time_t)-1 || end < best)) best = end;
+    }
+    return best;
+}
+
+/**
+ * @brief Parses a comma-separated list of day names into a day mask.
+ */
+static bool parse_days(char *text, unsigned char *days) {
+    *days = 0;
+    for (char *save = NULL, *name = strtok_r(text, ",", &save); name; name = strtok_r(NULL, ",", &save)) {
+        if (strcasecmp(name, "daily") == 0) {
+            *days |= KB_SCHEDULE_EVERY_DAY;
+        } else if (strcasecmp(name, "weekdays") == 0) {
+            *days |= WEEKDAYS;
+        } else if (strcasecmp(name, "weekends") == 0) {
+            *days |= WEEKENDS;
+        } else {
+            int i = 0;
+            while (i < 7 && strcasecmp(name, DAY_NAMES[i]) != 0) i++;
+            if (i == 7) return false;
+            *days |= (unsigned char)(1 << i);
+        }
+    }
+    return *days != 0;
+}
+
+/**
+ * @brief Parses "HH:MM-HH:MM" into start and end minutes.
+ */
+static bool parse_times(const char *text, unsigned short *start, unsigned short *end) {
+    int sh, sm, eh, em;
+    char extra;
+    if (sscanf(text, "%d:%d-%d:%d%c", &sh, &sm, &eh, &em, &extra) != 4) return false;
+    if (sh < 0 || sh > 23 || sm < 0 || sm > 59) return false;
+    if (eh < 0 || eh > 24 || em < 0 || em > 59 || (eh == 24 && em != 0)) return false;
+    *start = (unsigned short)(sh * 60 + sm);
+    *end = (unsigned short)(eh * 60 + em);
+    return true;
+}
+
+/**
+ * @brief Parses a window as written in settings.conf.
+ */
+bool schedule_parse_window(const char *text, kb_schedule_window_t *window) {
+    if (!text || !window) return false;
+
+    char buffer[128];
+    while (*text == ' ' || *text == '\t') text++;
+    snprintf(buffer, sizeof(buffer), "%s", text);
+    buffer[strcspn(buffer, "\r\n")] = '\0';
+
+    char *days = buffer;
+    char *times = NULL;
+    char *space = strchr(buffer, ' ');
+    if (space) {
+        *space = '\0';
+        times = space + 1;
+        while (*times == ' ') times++;
+    } else if (strchr(buffer, ':')) {
+        days = NULL;
+        times = buffer;
+    }
+
+    window->days = KB_SCHEDULE_EVERY_DAY;
+    window->start = 0;
+    window->end = MINUTES_PER_DAY;
+    if (days && !parse_days(days, &window->days)) return false;
+    if (times && !parse_times(times, &window->start, &window->end)) return false;
+    return true;
+}
+
+/**
+ * @brief Formats a window in the settings.conf syntax.
+ */
+void schedule_format_window(const kb_schedule_window_t *window, char *buffer, size_t size) {
+    char days[32] = "";
+    if (window->days == KB_SCHEDULE_EVERY_DAY) {
+        snprintf(days, sizeof(days), "daily");
+    } else if (window->days == WEEKDAYS) {
+        snprintf(days, sizeof(days), "weekdays");
+    } else if (window->days == WEEKENDS) {
+        snprintf(days, sizeof(days), "weekends");
+    } else {
+        size_t used = 0;
+        for (int i = 0; i < 7; i++) {
+            if (!((window->days >> i) & 1)) continue;
+            used += (size_t)snprintf(days + used, sizeof(days) - used, "%s%s", used ? "," : "", DAY_NAMES[i]);
+        }
+    }
+
+    if (window->start == 0 && window->end == MINUTES_PER_DAY) {
+        snprintf(buffer, size, "%s", days);
+    } else {
+        snprintf(buffer, size, "%s %02d:%02d-%02d:%02d", days, window->start / 60, window->start % 60,
+                 window->end / 60, window->end % 60);
+    }
+}
+
+/**
+ * @brief Re-evaluates one window and re-arms it at its next boundary.
+ * Runs on the worker thread.
+ */
+static void entry_expired(kb_timer_t *timer, void *arg) {
+    kb_schedule_entry_t *entry = (kb_schedule_entry_t *)arg;
+    kb_schedule_t *schedule = entry->owner;
+
+    struct timespec wall;
+    worker_wall_time(&wall);
+    struct tm local;
+    localtime_r(&wall.tv_sec, &local);
+
+    bool active = schedule_window_active(&entry->window, &local);
+    if (active != entry->active) {
+        entry->active = active;
+        if (active) {
+            if (schedule->active++ == 0 && schedule->on_change) schedule->on_change(true, schedule->arg);
+        } else {
+            if (--schedule->active == 0 && schedule->on_change) schedule->on_change(false, schedule->arg);
+        }
+    }
+
+    time_t next = schedule_window_next_boundary(&entry->window, wall.tv_sec);
+    if (next != (time_t)-1) {
+        uint64_t delay = (uint64_t)(next - wall.tv_sec) * 1000000000ULL - (uint64_t)wall.tv_nsec;
+        worker_arm(timer, worker_now_ns() + delay);
+    }
+}
+
+/**
+ * @brief Starts evaluating windows on the worker thread.
+ *
+ * Every window is armed to expire immediately so its initial state is
+ * computed on the worker thread like any later boundary.
+ */
+bool schedule_start(kb_schedule_t *schedule, const kb_schedule_window_t *windows, size_t count,
+                    void (*on_change)(bool active, void *arg), void *arg, kb_arena_t *arena) {
+    memset(schedule, 0, sizeof(*schedule));
+    schedule->on_change = on_change;
+    schedule->arg = arg;
+    if (count == 0) return true;
+
+    schedule->entries = (kb_schedule_entry_t *)arena_alloc(arena, count * sizeof(kb_schedule_entry_t));
+    if (!schedule->entries) return false;
+    schedule->count = count;
+
+    uint64_t now = worker_now_ns();
+    for (size_t i = 0; i < count; i++) {
+        kb_schedule_entry_t *entry = &schedule->entries[i];
+        entry->window = windows[i];
+        entry->owner = schedule;
+        timer_init(&entry->timer, entry_expired, entry);
+        worker_arm(&entry->timer, now);
+    }
+    return true;
+}
+
+/**
+ * @brief Cancels all window timers.
+ */
+void schedule_stop(kb_schedule_t *schedule) {
+    for (size_t i = 0; i < schedule->count; i++) {
+        worker_cancel(&schedule->entries[i].timer);
+    }
+    memset(schedule, 0, sizeof(*schedule));
+}
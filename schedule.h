@@ -0,0 +1,124 @@
+/**
+ * @file schedule.h
+ * @brief Recurring blocking windows (e.g. "22:00-07:00", "sat,sun").
+ *
+ * Every window owns one timer on the worker's wheel, armed at its next
+ * start or end boundary. Expiry re-evaluates only that window, so the
+ * worker wakes when a boundary is due and the cost per boundary does not
+ * depend on the number of windows.
+ */
+
+#ifndef SCHEDULE_H
+#define SCHEDULE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include "arena.h"
+#include "timer_wheel.h"
+
+/** @brief Maximum number of schedule windows read from settings. */
+#define KB_SCHEDULE_MAX_WINDOWS 4096
+
+/** @brief Day mask covering every day of the week. */
+#define KB_SCHEDULE_EVERY_DAY 0x7F
+
+/**
+ * @brief A recurring blocking window.
+ *
+ * A window whose end is not after its start runs past midnight into the
+ * following day. It is active on a day only if it starts on a listed day.
+ */
+typedef struct {
+    unsigned char days;     /**< Bit per weekday, bit 0 = Sunday */
+    unsigned short start;   /**< Start, in minutes after midnight */
+    unsigned short end;     /**< End, in minutes after midnight (1440 for 24:00) */
+} kb_schedule_window_t;
+
+struct kb_schedule;
+
+/**
+ * @brief Runtime state of one window.
+ */
+typedef struct {
+    kb_timer_t timer;               /**< Fires at the next boundary */
+    kb_schedule_window_t window;    /**< Window definition */
+    bool active;                    /**< Whether the window currently covers now */
+    struct kb_schedule *owner;      /**< Owning schedule */
+} kb_schedule_entry_t;
+
+/**
+ * @brief A set of windows and the aggregate blocking state.
+ */
+typedef struct kb_schedule {
+    kb_schedule_entry_t *entries;   /**< Window states */
+    size_t count;                   /**< Number of windows */
+    size_t active;                  /**< Number of windows covering now */
+    void (*on_change)(bool active, void *arg); /**< Called when the aggregate state flips */
+    void *arg;                      /**< Argument for on_change */
+} kb_schedule_t;
+
+/**
+ * @brief Returns whether a window covers the given local time.
+ *
+ * @param window Window to test.
+ * @param tm Local broken-down time.
+ */
+bool schedule_window_active(const kb_schedule_window_t *window, const struct tm *tm);
+
+/**
+ * @brief Returns the next time after now at which the window starts or ends.
+ *
+ * @param window Window to inspect.
+ * @param now Current time.
+ * @return Time of the next boundary, or (time_t)-1 if the window is empty.
+ */
+time_t schedule_window_next_boundary(const kb_schedule_window_t *window, time_t now);
+
+/**
+ * @brief Parses a window as written in settings.conf.
+ *
+ * Format: "[days ]HH:MM-HH:MM" where days is a comma-separated list of
+ * sun..sat, "weekdays", "weekends" or "daily" (the default), or a days
+ * list alone for all-day windows.
+ *
+ * @param text Text to parse.
+ * @param window Output window.
+ * @return True if the text is a valid window.
+ */
+bool schedule_parse_window(const char *text, kb_schedule_window_t *window);
+
+/**
+ * @brief Formats a window in the settings.conf syntax.
+ *
+ * @param window Window to format.
+ * @param buffer Output buffer.
+ * @param size Size of the buffer.
+ */
+void schedule_format_window(const kb_schedule_window_t *window, char *buffer, size_t size);
+
+/**
+ * @brief Starts evaluating windows on the worker thread.
+ *
+ * on_change is invoked from the worker thread: shortly after start if a
+ * window already covers now, and afterwards whenever the aggregate state
+ * flips.
+ *
+ * @param schedule Schedule to start.
+ * @param windows Window definitions (copied).
+ * @param count Number of windows.
+ * @param on_change Callback for state flips.
+ * @param arg Argument for on_change.
+ * @param arena Arena the window table is taken from; it stays there until
+ *              the arena is destroyed.
+ * @return False if the arena has no room for the window table.
+ */
+bool schedule_start(kb_schedule_t *schedule, const kb_schedule_window_t *windows, size_t count,
+                    void (*on_change)(bool active, void *arg), void *arg, kb_arena_t *arena);
+
+/**
+ * @brief Cancels all window timers.
+ */
+void schedule_stop(kb_schedule_t *schedule);
+
+#endif
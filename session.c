@@ -0,0 +1,619 @@
+/**
+ * @file session.c
+ * @brief Implementation of the portable part of a capture instance.
+ *
+ * Runs on three kinds of threads: the tap thread calls
+ * session_handle_event(), the worker runs the timers and tasks, and the
+ * owner calls everything else. The tap only files work for the worker
+ * (notifications, reports, saving) and posts the task that does it.
+ */
+
+#include "session.h"
+#include "logger.h"
+#include "trace.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * @brief Delay between a settings change and the write of settings.conf;
+ * changes made meanwhile go into the same write.
+ */
+#define KB_SETTINGS_SAVE_DELAY_NS 100000000ULL
+
+/**
+ * @brief Notifies the owner that the session changed the blocking state.
+ */
+static void notify_state(kb_session_t *session, bool active) {
+    if (!session->callbacks.state_changed) return;
+    kb_trace_span_t span;
+    trace_begin(&span, "state_changed");
+    session->callbacks.state_changed(active, session->callback_arg);
+    trace_end(&span);
+}
+
+/**
+ * @brief Synchronizes session settings to disk.
+ *
+ * Does nothing for sessions not loaded from settings.conf.
+ *
+ * @param session Session to save.
+ */
+static void sync_and_save_settings(kb_session_t *session) {
+    if (!session->persistent) return;
+    kb_trace_span_t span;
+    trace_begin(&span, "save_settings");
+    atomic_fetch_add_explicit(&session->metrics.settings_writes, 1, memory_order_relaxed);
+    app_settings_t s;
+    s.shortcut_enabled = session->engine.shortcut_enabled;
+    s.shortcut_flags = session->engine.shortcut_flags;
+    s.shortcut_keycode = session->engine.shortcut_key_code;
+    s.blocking_enabled = session->engine.enabled;
+    s.device_default_policy = session->engine.device_default;
+    memcpy(s.device_policies, session->engine.device_policy, sizeof(s.device_policies));
+    s.max_block_minutes = session->max_block_minutes;
+    s.idle_block_minutes = session->idle_block_minutes;
+    memcpy(s.allowed_keys, session->engine.allowed, sizeof(s.allowed_keys));
+    s.remap = session->remap;
+    s.stuck_key_seconds = session->stuck_keys.repeat_limit_ms / 1000;
+    s.chatter_ms = session->stuck_keys.chatter_ms;
+    s.app_policy_mode = (unsigned char)session->engine.app_policy.mode;
+    app_policy_format_apps(&session->engine.app_policy, s.app_policy_apps, sizeof(s.app_policy_apps));
+    s.schedule_count = session->schedule.count;
+    for (size_t i = 0; i < s.schedule_count; i++) {
+        s.schedule[i] = session->schedule.entries[i].window;
+    }
+    s.rule_count = session->rules.count;
+    memcpy(s.rules, session->rules.source, s.rule_count * sizeof(s.rules[0]));
+    s.shadow_rule_count = session->shadow.rules.count;
+    memcpy(s.shadow_rules, session->shadow.rules.source, s.shadow_rule_count * sizeof(s.shadow_rules[0]));
+    s.shadow_budget_us = (unsigned int)(session->shadow.budget_ns / 1000ULL);
+    s.plugin_count = session->plugin_path_count;
+    memcpy(s.plugins, session->plugin_paths, s.plugin_count * sizeof(s.plugins[0]));
+    s.plugin_budget_us = (unsigned int)(session->plugins.budget_ns / 1000ULL);
+    s.tap_priority = (unsigned char)session->tap_priority;
+    s.callback_budget_us = (unsigned int)(session->tap_watchdog.budget_ns / 1000ULL);
+    strcpy(s.metrics_socket, session->metrics_server.listen_fd >= 0 ? session->metrics_server.path : "");
+    save_settings(&s);
+    trace_end(&span);
+}
+
+/**
+ * @brief Task that writes settings.conf KB_SETTINGS_SAVE_DELAY_NS after a
+ * change, so a burst of changes costs one write.
+ *
+ * @param task The session's save_task.
+ */
+static void persist_settings(kb_task_t *task) {
+    kb_session_t *session = (kb_session_t *)task->arg;
+
+    KB_TASK_BEGIN(task);
+    KB_TASK_SLEEP(task, KB_SETTINGS_SAVE_DELAY_NS);
+    if (atomic_exchange_explicit(&session->save_pending, false, memory_order_acq_rel)) {
+        /* The write belongs to the change that asked for it, not to the worker */
+        trace_set_current(atomic_load_explicit(&session->save_trace, memory_order_relaxed));
+        sync_and_save_settings(session);
+        trace_set_current(0);
+    }
+    KB_TASK_END(task);
+}
+
+/**
+ * @brief Asks the worker to save the settings.
+ */
+void session_request_save(kb_session_t *session) {
+    if (!session->persistent) return;
+    atomic_store_explicit(&session->save_trace, trace_current(), memory_order_relaxed);
+    atomic_store_explicit(&session->save_pending, true, memory_order_release);
+    worker_post(&session->save_task);
+}
+
+/**
+ * @brief Enables or disables blocking and records what caused the change.
+ */
+void session_set_block(kb_session_t *session, bool on, kb_cause_t cause) {
+    bool owns_trace = trace_current() == 0;
+    if (owns_trace) trace_set_current(trace_new_id());
+    kb_trace_span_t span;
+    trace_begin(&span, "set_block_state");
+
+    bool scheduled = on && cause == KB_CAUSE_SCHEDULE;
+    bool was_enabled = session->engine.enabled;
+    bool was_scheduled = atomic_exchange_explicit(&session->schedule_owns_block, scheduled, memory_order_relaxed);
+    session->engine.enabled = on;
+    flight_recorder_transition(&session->recorder, trace_now_ns(), on, cause, KB_KEY_NONE);
+    worker_cancel(&session->unblock_timer);
+    if (!on || scheduled) {
+        worker_cancel(&session->watchdog_timer);
+    } else if ((!was_enabled || was_scheduled) && session->max_block_minutes > 0) {
+        worker_arm(&session->watchdog_timer,
+                   worker_now_ns() + (uint64_t)session->max_block_minutes * 60ULL * 1000000000ULL);
+    }
+    session_request_save(session);
+    log_message(KB_LOG_LEVEL_INFO, "Keyboard block status updated: %s", on ? "ACTIVE" : "INACTIVE");
+
+    trace_end(&span);
+    if (owns_trace) trace_set_current(0);
+}
+
+/**
+ * @brief Enables blocking for a limited time.
+ */
+void session_block_for(kb_session_t *session, unsigned int minutes) {
+    session_set_block(session, true, KB_CAUSE_USER);
+    worker_arm(&session->unblock_timer, worker_now_ns() + (uint64_t)minutes * 60ULL * 1000000000ULL);
+    log_message(KB_LOG_LEVEL_INFO, "Keyboard blocked for %u minutes.", minutes);
+}
+
+/**
+ * @brief Timer callback that lifts the block when a timed block ends or the
+ * safety ceiling is reached. Runs on the worker thread.
+ *
+ * Inside a scheduled window the block is handed to the schedule instead,
+ * which lifts it when the window ends.
+ *
+ * @param timer The expired timer.
+ * @param arg Pointer to kb_session_t.
+ */
+static void auto_unblock(kb_timer_t *timer, void *arg) {
+    kb_session_t *session = (kb_session_t *)arg;
+    if (!session->engine.enabled) return;
+    bool watchdog = timer == &session->watchdog_timer;
+    if (session->schedule.active) {
+        worker_cancel(&session->unblock_timer);
+        worker_cancel(&session->watchdog_timer);
+        atomic_store_explicit(&session->schedule_owns_block, true, memory_order_relaxed);
+        log_message(KB_LOG_LEVEL_INFO, "%s Keeping the block until the scheduled window ends.",
+                    watchdog ? "Maximum block duration reached." : "Timed block finished.");
+        return;
+    }
+    log_message(KB_LOG_LEVEL_INFO, "%s Disabling block.",
+                watchdog ? "Maximum block duration reached." : "Timed block finished.");
+    trace_set_current(trace_new_id());
+    session_set_block(session, false, watchdog ? KB_CAUSE_WATCHDOG : KB_CAUSE_TIMED);
+    notify_state(session, false);
+    trace_set_current(0);
+}
+
+/**
+ * @brief Timer callback that blocks the keyboard after a period without
+ * input. Runs on the worker thread.
+ *
+ * The event tap only records the time of the last event; this timer is
+ * armed for when the idle period would end if no further input arrived, so
+ * it fires at most once per idle period regardless of typing activity.
+ *
+ * @param timer The expired timer.
+ * @param arg Pointer to kb_session_t.
+ */
+static void idle_check(kb_timer_t *timer, void *arg) {
+    kb_session_t *session = (kb_session_t *)arg;
+    uint64_t timeout = (uint64_t)session->idle_block_minutes * 60ULL * 1000000000ULL;
+    /* Read before the clock: an event stored in between must not look older than now */
+    uint64_t last = atomic_load_explicit(&session->last_event_ns, memory_order_relaxed);
+    uint64_t now = worker_now_ns();
+
+    session->idle_wakeups++;
+    log_message(KB_LOG_LEVEL_DEBUG, "Idle timer wakeup #%lu.", session->idle_wakeups);
+
+    if (last <= now && now - last >= timeout && !session->engine.enabled) {
+        log_message(KB_LOG_LEVEL_INFO, "No keyboard input for %u minutes. Enabling block.",
+                    session->idle_block_minutes);
+        trace_set_current(trace_new_id());
+        session_set_block(session, true, KB_CAUSE_IDLE);
+        notify_state(session, true);
+        trace_set_current(0);
+    }
+    worker_arm(timer, last + timeout > now ? last + timeout : now + timeout);
+}
+
+/**
+ * @brief Task that logs the slow tap callbacks filed since the last report.
+ * Posted by the tap thread.
+ *
+ * @param task The session's slow_report_task.
+ */
+static void report_slow_callbacks(kb_task_t *task) {
+    kb_session_t *session = (kb_session_t *)task->arg;
+
+    KB_TASK_BEGIN(task);
+    tap_watchdog_report(&session->tap_watchdog);
+    KB_TASK_END(task);
+}
+
+/**
+ * @brief Task that logs the shadow disagreements queued since the last
+ * report. Posted by the tap thread.
+ *
+ * @param task The session's shadow_report_task.
+ */
+static void report_shadow(kb_task_t *task) {
+    kb_session_t *session = (kb_session_t *)task->arg;
+
+    KB_TASK_BEGIN(task);
+    shadow_report(&session->shadow);
+    KB_TASK_END(task);
+}
+
+/**
+ * @brief Task that hands the owner the notifications the tap filed:
+ * quarantined keys, a recorded shortcut and a shortcut unlock. Posted by
+ * the tap thread, so owner callbacks (and whatever they allocate) never
+ * run on it.
+ *
+ * @param task The session's notice_task.
+ */
+static void deliver_notices(kb_task_t *task) {
+    kb_session_t *session = (kb_session_t *)task->arg;
+
+    KB_TASK_BEGIN(task);
+    for (size_t i = 0; i < KB_KEY_COUNT / 64; i++) {
+        uint64_t keys = atomic_exchange_explicit(&session->quarantine_notices[i], 0, memory_order_acq_rel);
+        for (; keys; keys &= keys - 1) {
+            unsigned short key = (unsigned short)(i * 64 + (size_t)__builtin_ctzll(keys));
+            if (session->callbacks.key_quarantined) {
+                session->callbacks.key_quarantined(key, session->callback_arg);
+            }
+        }
+    }
+    if (atomic_exchange_explicit(&session->shortcut_notice, false, memory_order_acq_rel) &&
+        session->callbacks.shortcut_recorded) {
+        log_message(KB_LOG_LEVEL_INFO, "Shortcut flags: %llu, KeyCode: %hu", session->engine.shortcut_flags,
+                    session->engine.shortcut_key_code);
+        session->callbacks.shortcut_recorded(session->engine.shortcut_flags, session->engine.shortcut_key_code,
+                                             session->callback_arg);
+    }
+    if (atomic_exchange_explicit(&session->state_notice, false, memory_order_acq_rel)) {
+        /* Continue the unlock's trace from key press to the UI */
+        trace_set_current(atomic_load_explicit(&session->state_notice_trace, memory_order_relaxed));
+        notify_state(session, session->engine.enabled);
+        trace_set_current(0);
+    }
+    KB_TASK_END(task);
+}
+
+/**
+ * @brief Renders the session's metrics for the exposition server. Runs on
+ * the worker thread.
+ *
+ * @param out Response body.
+ * @param arg Pointer to kb_session_t.
+ */
+static void render_metrics(FILE *out, void *arg) {
+    kb_session_t *session = (kb_session_t *)arg;
+    metrics_render(&session->metrics, out);
+    if (session->shadow.rules.count) shadow_render_metrics(&session->shadow, out);
+    fprintf(out, "# HELP keyblocker_slow_reports_dropped_total Slow callback reports lost to a full queue.\n"
+                 "# TYPE keyblocker_slow_reports_dropped_total counter\n"
+                 "keyblocker_slow_reports_dropped_total %llu\n"
+                 "# HELP keyblocker_blocking Whether blocking is active.\n"
+                 "# TYPE keyblocker_blocking gauge\n"
+                 "keyblocker_blocking %d\n",
+            (unsigned long long)atomic_load_explicit(&session->tap_watchdog.dropped, memory_order_relaxed),
+            session->engine.enabled ? 1 : 0);
+}
+
+/**
+ * @brief Schedule callback that follows window boundaries. Runs on the
+ * worker thread.
+ *
+ * A window only lifts the block it started (or was handed by a timer): a
+ * block the user already had, or turned back on during the window, stays.
+ *
+ * @param active True when a window begins, false when the last one ends.
+ * @param arg Pointer to kb_session_t.
+ */
+static void schedule_changed(bool active, void *arg) {
+    kb_session_t *session = (kb_session_t *)arg;
+    bool owned = atomic_load_explicit(&session->schedule_owns_block, memory_order_relaxed);
+    if (active && session->engine.enabled) {
+        log_message(KB_LOG_LEVEL_INFO, "Scheduled block started; blocking is already on.");
+        return;
+    }
+    if (!active && !owned) {
+        log_message(KB_LOG_LEVEL_INFO, "Scheduled block ended%s.",
+                    session->engine.enabled ? "; keeping the block turned on by hand" : "");
+        return;
+    }
+    log_message(KB_LOG_LEVEL_INFO, "Scheduled block %s.", active ? "started" : "ended");
+    trace_set_current(trace_new_id());
+    session_set_block(session, active, KB_CAUSE_SCHEDULE);
+    notify_state(session, active);
+    trace_set_current(0);
+}
+
+/**
+ * @brief Decides one decoded event.
+ *
+ * Every call is timed against the callback budget; overruns are filed with
+ * the branch taken and the slow work done, and reported by the worker.
+ */
+bool session_handle_event(kb_session_t *session, const kb_event_t *ev, uint64_t entry_ns,
+                          unsigned short *key_code) {
+    unsigned int work = 0;
+    bool pass = true;
+    *key_code = ev->key_code;
+
+    if (session->idle_block_minutes) {
+        atomic_store_explicit(&session->last_event_ns, worker_now_ns(), memory_order_relaxed);
+    }
+
+    if ((session->stuck_keys.repeat_limit_ms || session->stuck_keys.chatter_ms) &&
+        stuck_keys_observe(&session->stuck_keys, ev) && !engine_key_quarantined(&session->engine, ev->key_code)) {
+        engine_quarantine_key(&session->engine, ev->key_code);
+        flight_recorder_transition(&session->recorder, ev->timestamp, session->engine.enabled, KB_CAUSE_QUARANTINE,
+                                   ev->key_code);
+        log_message(KB_LOG_LEVEL_ERROR, "Key %hu is stuck or chattering. Blocking it until re-enabled.", ev->key_code);
+        work |= KB_SLOW_WORK_LOG;
+        if (session->callbacks.key_quarantined) {
+            atomic_fetch_or_explicit(&session->quarantine_notices[ev->key_code / 64], 1ULL << (ev->key_code % 64),
+                                     memory_order_release);
+            worker_post(&session->notice_task);
+        }
+    }
+
+    kb_reason_t reason;
+    kb_verdict_t verdict = engine_decide(&session->engine, ev, &reason);
+    if (session->shadow.active && shadow_evaluate(&session->shadow, &session->engine, ev, verdict, reason)) {
+        worker_post(&session->shadow_report_task);
+    }
+    if (session->plugins.count && (verdict == KB_VERDICT_PASS || verdict == KB_VERDICT_BLOCK)) {
+        kb_verdict_t filtered = plugins_decide(&session->plugins, ev, verdict);
+        if (filtered != verdict) reason = KB_REASON_PLUGIN;
+        verdict = filtered;
+        work |= KB_SLOW_WORK_PLUGINS;
+    }
+    flight_recorder_event(&session->recorder, ev, verdict, reason);
+    if (session->heatmap && ev->type == KB_EVENT_KEY_DOWN) {
+        heatmap_record(session->heatmap, ev->key_code, verdict == KB_VERDICT_BLOCK);
+        work |= KB_SLOW_WORK_HEATMAP;
+    }
+
+    switch (verdict) {
+        case KB_VERDICT_RECORD:
+            session->engine.shortcut_flags = ev->flags;
+            session->engine.shortcut_key_code = ev->key_code;
+            session->engine.recording = false;
+            session_request_save(session);
+            log_message(KB_LOG_LEVEL_INFO, "Shortcut recorded (keyboard type %u).", ev->device);
+            work |= KB_SLOW_WORK_LOG;
+            if (session->callbacks.shortcut_recorded) {
+                atomic_store_explicit(&session->shortcut_notice, true, memory_order_release);
+                worker_post(&session->notice_task);
+            }
+            break;
+        case KB_VERDICT_UNLOCK: {
+            /* Key press to input flowing again; the worker carries the trace on to the owner and the UI */
+            uint64_t trace_id = trace_new_id();
+            trace_set_current(trace_id);
+            session->engine.last_unlock = ev->timestamp;
+            session->engine.enabled = false;
+            atomic_store_explicit(&session->schedule_owns_block, false, memory_order_relaxed);
+            trace_record("shortcut", trace_id, ev->timestamp, trace_now_ns());
+            metrics_bump(&session->metrics.shortcut_unlocks, 1);
+            log_message(KB_LOG_LEVEL_INFO, "Emergency shortcut detected. Disabling block.");
+            flight_recorder_transition(&session->recorder, ev->timestamp, false, KB_CAUSE_SHORTCUT, KB_KEY_NONE);
+            if (session->callbacks.state_changed) {
+                atomic_store_explicit(&session->state_notice_trace, trace_id, memory_order_relaxed);
+                atomic_store_explicit(&session->state_notice, true, memory_order_release);
+                worker_post(&session->notice_task);
+            }
+            trace_set_current(0);
+            work |= KB_SLOW_WORK_LOG;
+            break;
+        }
+        case KB_VERDICT_BLOCK:
+            log_message(KB_LOG_LEVEL_DEBUG, "Keyboard event blocked (keyboard type %u)", ev->device);
+            if (get_kb_log_level() & KB_LOG_LEVEL_DEBUG) work |= KB_SLOW_WORK_LOG;
+            pass = false;
+            break;
+        default:
+            if (session->remap.count) {
+                unsigned short to = remap_lookup(&session->remap, ev->key_code);
+                if (to == KB_KEY_NONE) {
+                    pass = false;
+                } else {
+                    *key_code = to;
+                }
+            }
+            break;
+    }
+
+    uint64_t elapsed = trace_now_ns() - entry_ns;
+    metrics_bump(&session->metrics.events[ev->type][verdict], 1);
+    metrics_observe_callback(&session->metrics, elapsed);
+    if (session->tap_watchdog.budget_ns && elapsed > session->tap_watchdog.budget_ns) {
+        kb_slow_event_t slow = {ev->timestamp, elapsed, ev->key_code, (uint8_t)verdict, (uint8_t)work};
+        metrics_bump(&session->metrics.slow_callbacks, 1);
+        if (tap_watchdog_file(&session->tap_watchdog, &slow)) worker_post(&session->slow_report_task);
+    }
+    return pass;
+}
+
+/**
+ * @brief Applies settings to a new or reloading session.
+ *
+ * Also arms the schedule windows; they are evaluated once the worker runs.
+ * A running metrics server is kept if its path did not change.
+ *
+ * @param session Session to configure.
+ * @param s Settings to apply.
+ */
+static void apply_settings(kb_session_t *session, const app_settings_t *s) {
+    session->engine.enabled = s->blocking_enabled;
+    session->engine.shortcut_enabled = s->shortcut_enabled;
+    session->engine.recording = false;
+    session->engine.shortcut_flags = s->shortcut_flags;
+    session->engine.shortcut_key_code = s->shortcut_keycode;
+    session->engine.device_default = s->device_default_policy;
+    memcpy(session->engine.device_policy, s->device_policies, sizeof(session->engine.device_policy));
+    app_policy_configure(&session->engine.app_policy, (kb_app_mode_t)s->app_policy_mode, s->app_policy_apps);
+    session->max_block_minutes = s->max_block_minutes;
+    session->idle_block_minutes = s->idle_block_minutes;
+    memcpy(session->engine.allowed, s->allowed_keys, sizeof(session->engine.allowed));
+    session->remap = s->remap;
+    rules_compile(&session->rules, s->rules, s->rule_count);
+    session->engine.rules = session->rules.count ? &session->rules : NULL;
+    shadow_configure(&session->shadow, s->shadow_rules, s->shadow_rule_count, s->shadow_budget_us);
+    session->plugin_path_count = s->plugin_count;
+    memcpy(session->plugin_paths, s->plugins, s->plugin_count * sizeof(s->plugins[0]));
+    plugins_load(&session->plugins, s->plugins, s->plugin_count, s->plugin_budget_us);
+    stuck_keys_configure(&session->stuck_keys, s->stuck_key_seconds * 1000, s->chatter_ms);
+    session->tap_priority = (kb_thread_priority_t)s->tap_priority;
+    tap_watchdog_init(&session->tap_watchdog, s->callback_budget_us);
+    if (session->metrics_server.listen_fd >= 0 && strcmp(session->metrics_server.path, s->metrics_socket) != 0) {
+        metrics_server_stop(&session->metrics_server);
+    }
+    if (s->metrics_socket[0] && session->metrics_server.listen_fd < 0) {
+        metrics_server_start(&session->metrics_server, s->metrics_socket, render_metrics, session);
+    }
+    if (!schedule_start(&session->schedule, s->schedule, s->schedule_count, schedule_changed, session,
+                        session->arena)) {
+        log_message(KB_LOG_LEVEL_ERROR, "No room for %zu schedule windows.", s->schedule_count);
+    }
+}
+
+/**
+ * @brief Applies the given settings, or settings.conf, and arms the idle
+ * timer.
+ */
+static void configure(kb_session_t *session, const app_settings_t *settings) {
+    if (settings) {
+        apply_settings(session, settings);
+    } else {
+        /* The scratch copy stays in the arena; KB_SESSION_ARENA_SIZE accounts for it */
+        app_settings_t *s = (app_settings_t *)arena_alloc(session->arena, sizeof(app_settings_t));
+        load_settings(s);
+        apply_settings(session, s);
+    }
+
+    if (session->idle_block_minutes) {
+        uint64_t now = worker_now_ns();
+        atomic_store_explicit(&session->last_event_ns, now, memory_order_relaxed);
+        worker_arm(&session->idle_timer, now + (uint64_t)session->idle_block_minutes * 60ULL * 1000000000ULL);
+    }
+}
+
+/**
+ * @brief Configures a session and acquires the worker.
+ */
+bool session_start(kb_session_t *session, const app_settings_t *settings, const kb_instance_callbacks_t *callbacks,
+                   void *arg, kb_arena_t *arena) {
+    session->arena = arena;
+    if (callbacks) session->callbacks = *callbacks;
+    session->callback_arg = arg;
+    session->persistent = settings == NULL;
+    flight_recorder_init(&session->recorder);
+    session->metrics_server.listen_fd = -1;
+
+    timer_init(&session->unblock_timer, auto_unblock, session);
+    timer_init(&session->watchdog_timer, auto_unblock, session);
+    timer_init(&session->idle_timer, idle_check, session);
+    worker_task_init(&session->slow_report_task, report_slow_callbacks, session);
+    worker_task_init(&session->shadow_report_task, report_shadow, session);
+    worker_task_init(&session->notice_task, deliver_notices, session);
+    worker_task_init(&session->save_task, persist_settings, session);
+
+    if (!worker_start()) {
+        flight_recorder_destroy(&session->recorder);
+        return false;
+    }
+
+    session->arena_mark = arena_mark(arena);
+    configure(session, settings);
+    if (!settings) {
+        char heatmap_path[512];
+        get_app_support_path(heatmap_path, sizeof(heatmap_path), KB_HEATMAP_FILE);
+        session->heatmap = heatmap_open(heatmap_path);
+    }
+    return true;
+}
+
+/**
+ * @brief Replaces the settings of a session whose events are stopped.
+ */
+void session_reload(kb_session_t *session, const app_settings_t *settings) {
+    if (session->engine.enabled) session_set_block(session, false, KB_CAUSE_USER);
+    worker_task_cancel(&session->save_task);
+    if (atomic_exchange_explicit(&session->save_pending, false, memory_order_acq_rel)) {
+        sync_and_save_settings(session);
+    }
+    shadow_summary(&session->shadow);
+
+    /* Nothing may read the old configuration while it is replaced */
+    schedule_stop(&session->schedule);
+    worker_cancel(&session->unblock_timer);
+    worker_cancel(&session->watchdog_timer);
+    worker_cancel(&session->idle_timer);
+    worker_task_cancel(&session->slow_report_task);
+    worker_task_cancel(&session->shadow_report_task);
+    plugins_unload(&session->plugins);
+    atomic_store_explicit(&session->schedule_owns_block, false, memory_order_relaxed);
+
+    arena_rewind(session->arena, session->arena_mark);
+    configure(session, settings);
+    log_message(KB_LOG_LEVEL_INFO, "Settings reloaded.");
+}
+
+/**
+ * @brief Writes any pending settings change, logs the summaries and
+ * releases everything session_start() acquired.
+ */
+void session_stop(kb_session_t *session) {
+    worker_task_cancel(&session->save_task);
+    if (atomic_exchange_explicit(&session->save_pending, false, memory_order_acq_rel)) {
+        sync_and_save_settings(session);
+    }
+    if (session->idle_block_minutes) {
+        log_message(KB_LOG_LEVEL_INFO, "Idle timer woke %lu times.", session->idle_wakeups);
+    }
+    shadow_summary(&session->shadow);
+
+    metrics_server_stop(&session->metrics_server);
+    schedule_stop(&session->schedule);
+    worker_cancel(&session->unblock_timer);
+    worker_cancel(&session->watchdog_timer);
+    worker_cancel(&session->idle_timer);
+    worker_task_cancel(&session->slow_report_task);
+    worker_task_cancel(&session->shadow_report_task);
+    worker_task_cancel(&session->notice_task);
+    plugins_unload(&session->plugins);
+    heatmap_close(session->heatmap);
+    session->heatmap = NULL;
+    flight_recorder_destroy(&session->recorder);
+    worker_stop();
+}
+
+/**
+ * @brief Caches the blocking policy and rules for the application that
+ * became frontmost.
+ */
+void session_set_frontmost_application(kb_session_t *session, const char *bundle_id) {
+    app_policy_activate(&session->engine.app_policy, bundle_id);
+    rules_activate(&session->rules, bundle_id);
+    rules_activate(&session->shadow.rules, bundle_id);
+    log_message(KB_LOG_LEVEL_DEBUG, "Frontmost application: %s (%s)", bundle_id ? bundle_id : "unknown",
+                app_policy_current(&session->engine.app_policy) == KB_APP_POLICY_EXEMPT ? "exempt" : "blocked");
+}
+
+/**
+ * @brief Writes the flight recorder to a file.
+ */
+bool session_dump_flight_recorder(kb_session_t *session, const char *path) {
+    /* The dump holds recent keystrokes; keep it private to the user */
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    /* A dump left by an older version may still be readable by others */
+    if (fd >= 0) fchmod(fd, 0600);
+    FILE *out = fd >= 0 ? fdopen(fd, "w") : NULL;
+    if (!out) {
+        if (fd >= 0) close(fd);
+        log_message(KB_LOG_LEVEL_ERROR, "Failed to open %s for the flight recorder.", path);
+        return false;
+    }
+    flight_recorder_dump(&session->recorder, out);
+    fclose(out);
+    log_message(KB_LOG_LEVEL_INFO, "Flight recorder written to %s.", path);
+    return true;
+}
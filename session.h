@@ -0,0 +1,203 @@
+/**
+ * @file session.h
+ * @brief The portable part of a capture instance.
+ *
+ * A session holds everything an instance decides and keeps that does not
+ * depend on CoreGraphics: the engine, rules, shadow rules, plugins, stuck
+ * key detection, remap table, heatmap, flight recorder, metrics, timers,
+ * schedule and settings persistence. instance.c wraps a session with the
+ * event tap and its thread; kb_alloc_check drives one directly, so both
+ * run the same event path.
+ *
+ * session_handle_event() is the body of the tap callback after decoding.
+ * It never allocates or takes the worker lock; everything slow (owner
+ * notifications, reports, saving) is posted to the worker.
+ */
+
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "arena.h"
+#include "engine.h"
+#include "flight_recorder.h"
+#include "heatmap.h"
+#include "instance.h"
+#include "metrics.h"
+#include "plugin.h"
+#include "remap.h"
+#include "rules.h"
+#include "schedule.h"
+#include "settings.h"
+#include "shadow.h"
+#include "stuck_keys.h"
+#include "tap_watchdog.h"
+#include "thread_priority.h"
+#include "worker.h"
+
+/**
+ * @brief Arena space session_start() may take: a settings.conf scratch copy
+ * and the largest schedule window table.
+ */
+#define KB_SESSION_ARENA_SIZE (sizeof(app_settings_t) + KB_SCHEDULE_MAX_WINDOWS * sizeof(kb_schedule_entry_t) + \
+                               2 * KB_ARENA_ALIGN)
+
+/**
+ * @brief Decision state, timers and background work of one capture session.
+ */
+typedef struct {
+    kb_engine_t engine;                     /**< Decision state (blocking, shortcut, devices) */
+    kb_rules_t rules;                       /**< Compiled blocking rules */
+    kb_shadow_t shadow;                     /**< Candidate rules evaluated without enforcing */
+    kb_plugin_chain_t plugins;              /**< Filter plugins run after the engine */
+    size_t plugin_path_count;               /**< Number of configured plugin paths */
+    char plugin_paths[KB_PLUGIN_MAX][KB_PLUGIN_PATH_MAX]; /**< Configured plugin paths, kept for saving */
+    kb_stuck_detector_t stuck_keys;         /**< Stuck and chattering key detector */
+    kb_remap_t remap;                       /**< Key code rewrites for passing events */
+    kb_heatmap_t *heatmap;                  /**< Persistent per-key press counters, may be NULL */
+    kb_flight_recorder_t recorder;          /**< Recent events, verdicts and state changes */
+    kb_metrics_t metrics;                   /**< Counters exposed to monitoring */
+    kb_metrics_server_t metrics_server;     /**< Metrics exposition socket */
+    kb_tap_watchdog_t tap_watchdog;         /**< Callbacks that overran their budget */
+    kb_thread_priority_t tap_priority;      /**< Scheduling class of the tap thread */
+    kb_timer_t unblock_timer;               /**< Ends a timed block */
+    kb_timer_t watchdog_timer;              /**< Enforces the maximum block duration */
+    unsigned int max_block_minutes;         /**< Safety ceiling for non-scheduled blocks, 0 to disable */
+    kb_schedule_t schedule;                 /**< Recurring blocking windows */
+    atomic_bool schedule_owns_block;        /**< The current block is the schedule's, not the user's */
+    kb_timer_t idle_timer;                  /**< Checks for input inactivity */
+    unsigned int idle_block_minutes;        /**< Inactivity before blocking, 0 to disable */
+    _Atomic uint64_t last_event_ns;         /**< Time of the last keyboard event (worker clock) */
+    unsigned long idle_wakeups;             /**< Number of idle timer expiries */
+    kb_task_t slow_report_task;             /**< Reports slow callbacks off the tap thread */
+    kb_task_t shadow_report_task;           /**< Logs shadow disagreements off the tap thread */
+    kb_task_t notice_task;                  /**< Delivers owner notifications filed by the tap */
+    atomic_bool state_notice;               /**< The tap changed the blocking state */
+    _Atomic uint64_t state_notice_trace;    /**< Correlation id of that change */
+    atomic_bool shortcut_notice;            /**< The tap recorded a shortcut */
+    _Atomic uint64_t quarantine_notices[KB_KEY_COUNT / 64]; /**< Keys the tap quarantined */
+    kb_task_t save_task;                    /**< Writes settings.conf on the worker */
+    atomic_bool save_pending;               /**< Settings changed since the last write */
+    _Atomic uint64_t save_trace;            /**< Correlation id of the last change asking for a write */
+    bool persistent;                        /**< Whether changes are saved to settings.conf */
+    kb_instance_callbacks_t callbacks;      /**< Notifications to the owner */
+    void *callback_arg;                     /**< Argument for the notifications */
+    kb_arena_t *arena;                      /**< Startup memory for settings and the schedule */
+    size_t arena_mark;                      /**< Arena use before the settings blocks, for reloads */
+} kb_session_t;
+
+/**
+ * @brief Configures a session and acquires the worker.
+ *
+ * @param session Zeroed session.
+ * @param settings Settings to run with, or NULL to load settings.conf; only
+ * sessions loaded from settings.conf save changes back and keep the
+ * keystroke heatmap.
+ * @param callbacks Notifications, or NULL for none. Copied.
+ * @param arg Argument passed to every callback.
+ * @param arena Arena with KB_SESSION_ARENA_SIZE bytes to spare.
+ * @return False if the worker could not be started; nothing is kept.
+ */
+bool session_start(kb_session_t *session, const app_settings_t *settings, const kb_instance_callbacks_t *callbacks,
+                   void *arg, kb_arena_t *arena);
+
+/**
+ * @brief Writes any pending settings change, logs the session's summaries
+ * and releases everything session_start() acquired. Nothing may call
+ * session_handle_event() any more.
+ *
+ * @param session Started session.
+ */
+void session_stop(kb_session_t *session);
+
+/**
+ * @brief Replaces the settings of a session whose events are stopped.
+ *
+ * Writes any pending change first, then reconfigures the engine, rules,
+ * plugins, timers and schedule from the new settings. The worker, the
+ * metrics socket (unless its path changed), the notification tasks, the
+ * counters, the flight recorder and the heatmap carry on. Blocking then
+ * follows the new settings; settings.conf never restores it, so reloading
+ * from it leaves blocking off, as after a launch.
+ *
+ * @param session Started session; session_handle_event() must not run
+ * until this returns.
+ * @param settings Settings to run with, or NULL to load settings.conf.
+ * Whether changes are saved back stays as session_start() decided.
+ */
+void session_reload(kb_session_t *session, const app_settings_t *settings);
+
+/**
+ * @brief Decides one decoded event: stuck key detection, the engine,
+ * shadow rules, plugins, the flight recorder, the heatmap, the shortcut,
+ * recording and the remap table, then times the call against the
+ * callback budget.
+ *
+ * Runs on the tap thread. Never allocates, blocks or takes the worker
+ * lock; owner notifications and reports are posted to the worker.
+ *
+ * @param session Started session.
+ * @param ev Decoded event.
+ * @param entry_ns When the callback was entered, on the trace_now_ns() clock.
+ * @param key_code Receives the key code the event should carry if it
+ * passes.
+ * @return True to let the event through, false to drop it.
+ */
+bool session_handle_event(kb_session_t *session, const kb_event_t *ev, uint64_t entry_ns,
+                          unsigned short *key_code);
+
+/**
+ * @brief Enables or disables blocking and records what caused the change.
+ *
+ * Turning blocking on arms the safety watchdog and cancels any pending
+ * timed unblock; turning it off cancels both. Blocks turned on by the
+ * schedule belong to it: they have no ceiling and end with the window.
+ * Any other change takes the block back from the schedule. Traced under
+ * the current correlation id, or a new one if the thread has none. The
+ * owner is not notified.
+ *
+ * @param session Session to update.
+ * @param on True to block, false to pass events through.
+ * @param cause What asked for the change, for the flight recorder.
+ */
+void session_set_block(kb_session_t *session, bool on, kb_cause_t cause);
+
+/**
+ * @brief Enables blocking for a limited time.
+ *
+ * @param session Session to block.
+ * @param minutes Duration of the block in minutes.
+ */
+void session_block_for(kb_session_t *session, unsigned int minutes);
+
+/**
+ * @brief Asks the worker to save the settings. Safe from any thread,
+ * including the tap; does not allocate, lock or touch the disk. Does
+ * nothing for sessions not loaded from settings.conf.
+ *
+ * @param session Session to save.
+ */
+void session_request_save(kb_session_t *session);
+
+/**
+ * @brief Caches the blocking policy and rules for the application that
+ * became frontmost.
+ *
+ * @param session Session to update.
+ * @param bundle_id Bundle identifier, or NULL if unknown.
+ */
+void session_set_frontmost_application(kb_session_t *session, const char *bundle_id);
+
+/**
+ * @brief Writes the flight recorder to a file.
+ *
+ * @param session Session to dump.
+ * @param path File to write, replaced if it exists; readable by the user
+ * only.
+ * @return true on success.
+ */
+bool session_dump_flight_recorder(kb_session_t *session, const char *path);
+
+#endif
@@ -9,6 +9,7 @@
 
 #include "settings.h"
 #include "logger.h"
+#include "media_keys.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -52,12 +53,76 @@
 #define DEFAULT_BLOCKING_ENABLED false
 
 /**
- * @brief Constructs the full path to the settings file inside Application Support.
+ * @brief Default safety ceiling for any block, in minutes.
+ *
+ * Guarantees the keyboard comes back even if the shortcut is disabled and
+ * the tray is unreachable.
+ */
+#define DEFAULT_MAX_BLOCK_MINUTES 60
+
+/**
+ * @brief Default inactivity, in minutes, before blocking automatically.
+ *
+ * Disabled by default; blocking never starts on its own unless configured.
+ */
+#define DEFAULT_IDLE_BLOCK_MINUTES 0
+
+/**
+ * @brief Default auto-repeat duration, in seconds, that marks a key stuck.
+ *
+ * Disabled by default: holding a key (e.g. in games) looks the same.
+ */
+#define DEFAULT_STUCK_KEY_SECONDS 0
+
+/**
+ * @brief Default release-to-press gap, in milliseconds, below which a press
+ * counts as chattering. Disabled by default.
+ */
+#define DEFAULT_CHATTER_MS 0
+
+/**
+ * @brief Default time budget per plugin call, in microseconds. 0 means no
+ * budget: plugins are timed but never bypassed.
+ */
+#define DEFAULT_PLUGIN_BUDGET_US 250
+
+/**
+ * @brief Default scheduling class of the event tap thread. "kb_bench -L"
+ * shows a higher class mainly trimming the worst wakeup delay under full
+ * load, not the typical one, so the tap keeps the system default.
+ */
+#define DEFAULT_TAP_PRIORITY KB_THREAD_PRIORITY_DEFAULT
+
+/**
+ * @brief Default event tap callback budget, in microseconds.
+ */
+#define DEFAULT_CALLBACK_BUDGET_US 50
+
+/**
+ * @brief Default time budget per shadow evaluation, in microseconds.
+ */
+#define DEFAULT_SHADOW_BUDGET_US 20
+
+/**
+ * @brief Default blocking policy for keyboards without a device entry.
+ */
+#define DEFAULT_DEVICE_POLICY KB_DEVICE_POLICY_BLOCK
+
+/**
+ * @brief Key prefix for per-device policy entries (e.g. device_policy.58=allow).
+ */
+#define DEVICE_POLICY_PREFIX "device_policy."
+
+/**
+ * @brief Constructs the full path to a file inside Application Support.
+ *
+ * The KeyBlocker folder is created if it does not exist yet.
  *
  * @param buffer Buffer to store the full path.
  * @param size Size of the buffer.
+ * @param file File name inside the application folder.
  */
-static void get_settings_path(char *buffer, size_t size) {
+void get_app_support_path(char *buffer, size_t size, const char *file) {
     const char *home = getenv("HOME");
     if (!home) {
         struct passwd *pw = getpwuid(getuid());
@@ -72,7 +137,17 @@ static void get_settings_path(char *buffer, size_t size) {
         mkdir(folder, 0755);
     }
 
-    snprintf(buffer, size, "%s/%s", folder, SETTINGS_FILE);
+    snprintf(buffer, size, "%s/%s", folder, file);
+}
+
+/**
+ * @brief Constructs the full path to the settings file inside Application Support.
+ *
+ * @param buffer Buffer to store the full path.
+ * @param size Size of the buffer.
+ */
+static void get_settings_path(char *buffer, size_t size) {
+    get_app_support_path(buffer, size, SETTINGS_FILE);
 }
 
 /**
@@ -95,6 +170,25 @@ void load_settings(app_settings_t *s) {
     s->shortcut_flags = DEFAULT_SHORTCUT_FLAGS;
     s->shortcut_keycode = DEFAULT_SHORTCUT_KEYCODE;
     s->blocking_enabled = DEFAULT_BLOCKING_ENABLED;
+    s->max_block_minutes = DEFAULT_MAX_BLOCK_MINUTES;
+    s->idle_block_minutes = DEFAULT_IDLE_BLOCK_MINUTES;
+    s->stuck_key_seconds = DEFAULT_STUCK_KEY_SECONDS;
+    s->chatter_ms = DEFAULT_CHATTER_MS;
+    memset(s->allowed_keys, 0, sizeof(s->allowed_keys));
+    remap_init(&s->remap);
+    s->device_default_policy = DEFAULT_DEVICE_POLICY;
+    memset(s->device_policies, KB_DEVICE_POLICY_INHERIT, sizeof(s->device_policies));
+    s->app_policy_mode = KB_APP_MODE_OFF;
+    s->app_policy_apps[0] = '\0';
+    s->schedule_count = 0;
+    s->rule_count = 0;
+    s->shadow_rule_count = 0;
+    s->shadow_budget_us = DEFAULT_SHADOW_BUDGET_US;
+    s->plugin_count = 0;
+    s->plugin_budget_us = DEFAULT_PLUGIN_BUDGET_US;
+    s->tap_priority = DEFAULT_TAP_PRIORITY;
+    s->callback_budget_us = DEFAULT_CALLBACK_BUDGET_US;
+    s->metrics_socket[0] = '\0';
 
     char path[512];
     get_settings_path(path, sizeof(path));
@@ -105,7 +199,7 @@ void load_settings(app_settings_t *s) {
         return;
     }
 
-    char line[256];
+    char line[1280];
     while (fgets(line, sizeof(line), f)) {
         char *key = strtok(line, "=");
         char *val = strtok(NULL, "\n");
@@ -122,6 +216,90 @@ void load_settings(app_settings_t *s) {
                  * Always force the default value.
                  */
                 s->blocking_enabled = DEFAULT_BLOCKING_ENABLED;
+            } else if (strcmp(key, "max_block_minutes") == 0) {
+                s->max_block_minutes = (unsigned int)strtoul(val, NULL, 10);
+            } else if (strcmp(key, "idle_block_minutes") == 0) {
+                s->idle_block_minutes = (unsigned int)strtoul(val, NULL, 10);
+            } else if (strcmp(key, "stuck_key_seconds") == 0) {
+                s->stuck_key_seconds = (unsigned int)strtoul(val, NULL, 10);
+            } else if (strcmp(key, "chatter_ms") == 0) {
+                s->chatter_ms = (unsigned int)strtoul(val, NULL, 10);
+            } else if (strcmp(key, "allowed_keys") == 0) {
+                for (char *save = NULL, *name = strtok_r(val, ", ", &save); name; name = strtok_r(NULL, ", ", &save)) {
+                    unsigned int id;
+                    if (media_key_parse(name, &id)) {
+                        s->allowed_keys[id >> 6] |= 1ULL << (id & 63);
+                    } else {
+                        log_message(KB_LOG_LEVEL_ERROR, "Ignoring unknown key %s in allowed_keys.", name);
+                    }
+                }
+            } else if (strcmp(key, "remap") == 0) {
+                remap_parse(&s->remap, val);
+            } else if (strcmp(key, "device_policy_default") == 0) {
+                kb_device_policy_t policy;
+                if (engine_parse_device_policy(val, &policy) && policy != KB_DEVICE_POLICY_INHERIT) {
+                    s->device_default_policy = (unsigned char)policy;
+                }
+            } else if (strncmp(key, DEVICE_POLICY_PREFIX, strlen(DEVICE_POLICY_PREFIX)) == 0) {
+                char *end;
+                unsigned long device = strtoul(key + strlen(DEVICE_POLICY_PREFIX), &end, 10);
+                kb_device_policy_t policy;
+                if (*end == '\0' && device < KB_DEVICE_TYPE_COUNT && engine_parse_device_policy(val, &policy)) {
+                    s->device_policies[device] = (unsigned char)policy;
+                } else {
+                    log_message(KB_LOG_LEVEL_ERROR, "Ignoring invalid device policy entry %s=%s.", key, val);
+                }
+            } else if (strcmp(key, "app_policy_mode") == 0) {
+                kb_app_mode_t mode;
+                if (app_policy_parse_mode(val, &mode)) {
+                    s->app_policy_mode = (unsigned char)mode;
+                }
+            } else if (strcmp(key, "app_policy_apps") == 0) {
+                snprintf(s->app_policy_apps, sizeof(s->app_policy_apps), "%s", val);
+            } else if (strcmp(key, "schedule") == 0) {
+                if (s->schedule_count < KB_SCHEDULE_MAX_WINDOWS &&
+                    schedule_parse_window(val, &s->schedule[s->schedule_count])) {
+                    s->schedule_count++;
+                } else {
+                    log_message(KB_LOG_LEVEL_ERROR, "Ignoring invalid schedule entry %s.", val);
+                }
+            } else if (strcmp(key, "rule") == 0) {
+                if (s->rule_count < KB_RULES_MAX && strlen(val) < KB_RULE_TEXT_MAX) {
+                    strcpy(s->rules[s->rule_count++], val);
+                } else {
+                    log_message(KB_LOG_LEVEL_ERROR, "Ignoring rule %s: too many rules or rule too long.", val);
+                }
+            } else if (strcmp(key, "shadow_rule") == 0) {
+                if (s->shadow_rule_count < KB_RULES_MAX && strlen(val) < KB_RULE_TEXT_MAX) {
+                    strcpy(s->shadow_rules[s->shadow_rule_count++], val);
+                } else {
+                    log_message(KB_LOG_LEVEL_ERROR, "Ignoring shadow_rule %s: too many rules or rule too long.", val);
+                }
+            } else if (strcmp(key, "shadow_budget_us") == 0) {
+                s->shadow_budget_us = (unsigned int)strtoul(val, NULL, 10);
+            } else if (strcmp(key, "plugin") == 0) {
+                if (s->plugin_count < KB_PLUGIN_MAX && strlen(val) < KB_PLUGIN_PATH_MAX) {
+                    strcpy(s->plugins[s->plugin_count++], val);
+                } else {
+                    log_message(KB_LOG_LEVEL_ERROR, "Ignoring plugin %s: too many plugins or path too long.", val);
+                }
+            } else if (strcmp(key, "plugin_budget_us") == 0) {
+                s->plugin_budget_us = (unsigned int)strtoul(val, NULL, 10);
+            } else if (strcmp(key, "tap_priority") == 0) {
+                kb_thread_priority_t priority;
+                if (thread_priority_parse(val, &priority)) {
+                    s->tap_priority = (unsigned char)priority;
+                } else {
+                    log_message(KB_LOG_LEVEL_ERROR, "Ignoring invalid tap_priority %s.", val);
+                }
+            } else if (strcmp(key, "callback_budget_us") == 0) {
+                s->callback_budget_us = (unsigned int)strtoul(val, NULL, 10);
+            } else if (strcmp(key, "metrics_socket") == 0) {
+                if (strlen(val) < sizeof(s->metrics_socket)) {
+                    strcpy(s->metrics_socket, val);
+                } else {
+                    log_message(KB_LOG_LEVEL_ERROR, "Ignoring metrics_socket %s: path too long.", val);
+                }
             }
         }
     }
@@ -157,6 +335,54 @@ void save_settings(const app_settings_t *s) {
     fprintf(f, "shortcut_flags=%llu\n", (unsigned long long)s->shortcut_flags);
     fprintf(f, "shortcut_keycode=%hu\n", s->shortcut_keycode);
     fprintf(f, "blocking_enabled=%d\n", s->blocking_enabled ? 1 : 0);
+    fprintf(f, "max_block_minutes=%u\n", s->max_block_minutes);
+    fprintf(f, "idle_block_minutes=%u\n", s->idle_block_minutes);
+    fprintf(f, "stuck_key_seconds=%u\n", s->stuck_key_seconds);
+    fprintf(f, "chatter_ms=%u\n", s->chatter_ms);
+    fprintf(f, "allowed_keys=");
+    for (unsigned int id = 0, first = 1; id < KB_KEY_COUNT; id++) {
+        if (!engine_key_bit(s->allowed_keys, id)) continue;
+        const char *name = media_key_name(id);
+        if (name) {
+            fprintf(f, "%s%s", first ? "" : ",", name);
+        } else {
+            fprintf(f, "%s%u", first ? "" : ",", id);
+        }
+        first = 0;
+    }
+    fprintf(f, "\n");
+    fprintf(f, "remap=");
+    remap_format(&s->remap, f);
+    fprintf(f, "\n");
+    fprintf(f, "device_policy_default=%s\n", engine_device_policy_name(s->device_default_policy));
+    for (int i = 0; i < KB_DEVICE_TYPE_COUNT; i++) {
+        if (s->device_policies[i] != KB_DEVICE_POLICY_INHERIT) {
+            fprintf(f, DEVICE_POLICY_PREFIX "%d=%s\n", i, engine_device_policy_name(s->device_policies[i]));
+        }
+    }
+    fprintf(f, "app_policy_mode=%s\n", app_policy_mode_name(s->app_policy_mode));
+    if (s->app_policy_apps[0]) {
+        fprintf(f, "app_policy_apps=%s\n", s->app_policy_apps);
+    }
+    for (size_t i = 0; i < s->schedule_count; i++) {
+        char window[64];
+        schedule_format_window(&s->schedule[i], window, sizeof(window));
+        fprintf(f, "schedule=%s\n", window);
+    }
+    for (size_t i = 0; i < s->rule_count; i++) {
+        fprintf(f, "rule=%s\n", s->rules[i]);
+    }
+    for (size_t i = 0; i < s->shadow_rule_count; i++) {
+        fprintf(f, "shadow_rule=%s\n", s->shadow_rules[i]);
+    }
+    fprintf(f, "shadow_budget_us=%u\n", s->shadow_budget_us);
+    fprintf(f, "plugin_budget_us=%u\n", s->plugin_budget_us);
+    fprintf(f, "tap_priority=%s\n", thread_priority_name((kb_thread_priority_t)s->tap_priority));
+    fprintf(f, "callback_budget_us=%u\n", s->callback_budget_us);
+    if (s->metrics_socket[0]) fprintf(f, "metrics_socket=%s\n", s->metrics_socket);
+    for (size_t i = 0; i < s->plugin_count; i++) {
+        fprintf(f, "plugin=%s\n", s->plugins[i]);
+    }
 
     fclose(f);
     log_message(KB_LOG_LEVEL_DEBUG, "Settings saved to %s.", path);
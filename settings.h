@@ -9,6 +9,16 @@
 #define SETTINGS_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "engine.h"
+#include "remap.h"
+#include "plugin.h"
+#include "rules.h"
+#include "schedule.h"
+#include "metrics.h"
+#include "thread_priority.h"
+
 /**
  * @brief Structure holding all configurable application settings.
  *
@@ -18,14 +28,76 @@
  * - shortcut_keycode: hardware key code for the shortcut
  * - blocking_enabled: whether keyboard blocking is currently enabled (not
  *   persisted for safety)
+ * - max_block_minutes: safety ceiling after which a block not started by the
+ *   schedule is lifted (0 disables it)
+ * - idle_block_minutes: inactivity after which blocking is enabled
+ *   automatically (0 disables it)
+ * - stuck_key_seconds: auto-repeat duration after which a key is
+ *   quarantined (0 disables it)
+ * - chatter_ms: release-to-press gap below which presses count as
+ *   chattering (0 disables it)
+ * - allowed_keys: bitmap of key ids (including media keys) that pass while
+ *   blocking is active
+ * - remap: key code rewrites applied to events that pass
+ * - device_default_policy: blocking policy for keyboards without an entry
+ * - device_policies: per-keyboard-type policy (kb_device_policy_t values)
+ * - app_policy_mode: how app_policy_apps restricts blocking (kb_app_mode_t)
+ * - app_policy_apps: comma-separated bundle identifiers
+ * - schedule/schedule_count: recurring blocking windows
+ * - rules/rule_count: rule lines tried before the built-in policies
+ * - shadow_rules/shadow_rule_count: candidate rule lines evaluated in shadow
+ *   mode, never enforced
+ * - shadow_budget_us: time budget per shadow evaluation, in microseconds
+ * - plugins/plugin_count: filter plugin paths, in chain order
+ * - plugin_budget_us: time budget per plugin call, in microseconds (0 for
+ *   no budget)
+ * - tap_priority: scheduling class of the event tap thread
+ *   (kb_thread_priority_t)
+ * - callback_budget_us: time after which an event tap callback is reported
+ *   as slow, in microseconds (0 disables it)
+ * - metrics_socket: Unix socket path serving Prometheus metrics (empty
+ *   disables it)
  */
 typedef struct {
     bool shortcut_enabled;
     unsigned long long shortcut_flags;
     unsigned short shortcut_keycode;
     bool blocking_enabled;
+    unsigned int max_block_minutes;
+    unsigned int idle_block_minutes;
+    unsigned int stuck_key_seconds;
+    unsigned int chatter_ms;
+    uint64_t allowed_keys[KB_KEY_COUNT / 64];
+    kb_remap_t remap;
+    unsigned char device_default_policy;
+    unsigned char device_policies[KB_DEVICE_TYPE_COUNT];
+    unsigned char app_policy_mode;
+    char app_policy_apps[1024];
+    size_t schedule_count;
+    kb_schedule_window_t schedule[KB_SCHEDULE_MAX_WINDOWS];
+    size_t rule_count;
+    char rules[KB_RULES_MAX][KB_RULE_TEXT_MAX];
+    size_t shadow_rule_count;
+    char shadow_rules[KB_RULES_MAX][KB_RULE_TEXT_MAX];
+    unsigned int shadow_budget_us;
+    size_t plugin_count;
+    char plugins[KB_PLUGIN_MAX][KB_PLUGIN_PATH_MAX];
+    unsigned int plugin_budget_us;
+    unsigned char tap_priority;
+    unsigned int callback_budget_us;
+    char metrics_socket[KB_METRICS_PATH_MAX];
 } app_settings_t;
 
+/**
+ * @brief Builds the path of a file in the application's support folder
+ * (~/Library/Application Support/KeyBlocker), creating the folder if needed.
+ *
+ * @param buffer Buffer to store the full path.
+ * @param size Size of the buffer.
+ * @param file File name inside the application folder.
+ */
+void get_app_support_path(char *buffer, size_t size, const char *file);
+
 /**
  * @brief Load settings from persistent storage.
  *
@@ -0,0 +1,157 @@
+/**
+ * @file shadow.c
+ * @brief Implementation of shadow policy evaluation.
+ */
+
+#include "shadow.h"
+#include "logger.h"
+#include <string.h>
+#include <time.h>
+
+/**
+ * @brief Returns a monotonic timestamp in nanoseconds.
+ */
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Compiles a candidate rule set.
+ */
+size_t shadow_configure(kb_shadow_t *shadow, const char (*lines)[KB_RULE_TEXT_MAX], size_t count,
+                        unsigned int budget_us) {
+    memset(shadow, 0, sizeof(*shadow));
+    shadow->budget_ns = (uint64_t)budget_us * 1000ULL;
+    size_t compiled = count ? rules_compile(&shadow->rules, lines, count) : 0;
+    shadow->active = compiled > 0;
+    if (shadow->active) {
+        log_message(KB_LOG_LEVEL_INFO, "Evaluating %zu candidate rules in shadow mode.", compiled);
+    }
+    return compiled;
+}
+
+/**
+ * @brief Evaluates the candidate on an event.
+ *
+ * The overrun that reaches KB_SHADOW_MAX_OVERRUNS still counts its result;
+ * later events skip the candidate. Logging would block the tap, so the
+ * switch-off is left for the report.
+ */
+bool shadow_evaluate(kb_shadow_t *shadow, const kb_engine_t *engine, const kb_event_t *event, kb_verdict_t live,
+                     kb_reason_t live_reason) {
+    uint64_t start = now_ns();
+    kb_reason_t reason;
+    kb_verdict_t candidate = engine_decide_with_rules(engine, &shadow->rules, event, &reason);
+    uint64_t elapsed = now_ns() - start;
+
+    metrics_bump(&shadow->evaluated, 1);
+    bool stopped = false;
+    if (elapsed > shadow->budget_ns && ++shadow->overruns >= KB_SHADOW_MAX_OVERRUNS) {
+        shadow->active = false;
+        atomic_store_explicit(&shadow->stopped_ns, elapsed, memory_order_release);
+        stopped = true;
+    }
+    if (candidate == live) return stopped && !atomic_exchange_explicit(&shadow->pending, true, memory_order_acq_rel);
+
+    metrics_bump(&shadow->disagreements[live][candidate], 1);
+    uint64_t head = atomic_load_explicit(&shadow->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&shadow->tail, memory_order_acquire);
+    if (head - tail >= KB_SHADOW_SLOTS) {
+        atomic_fetch_add_explicit(&shadow->dropped, 1, memory_order_relaxed);
+    } else {
+        kb_shadow_diff_t *slot = &shadow->slots[head & (KB_SHADOW_SLOTS - 1)];
+        slot->event = *event;
+        slot->blocking = engine->enabled;
+        slot->live = (uint8_t)live;
+        slot->live_reason = (uint8_t)live_reason;
+        slot->candidate = (uint8_t)candidate;
+        slot->candidate_reason = (uint8_t)reason;
+        atomic_store_explicit(&shadow->head, head + 1, memory_order_release);
+    }
+    return !atomic_exchange_explicit(&shadow->pending, true, memory_order_acq_rel);
+}
+
+/**
+ * @brief Logs and removes every queued disagreement.
+ *
+ * Clears the pending flag before draining, so a disagreement queued while
+ * the report runs is either drained by it or schedules the next one.
+ */
+size_t shadow_report(kb_shadow_t *shadow) {
+    atomic_store_explicit(&shadow->pending, false, memory_order_seq_cst);
+
+    size_t count = 0;
+    uint64_t tail = atomic_load_explicit(&shadow->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&shadow->head, memory_order_acquire);
+    for (; tail != head; tail++, count++) {
+        const kb_shadow_diff_t *d = &shadow->slots[tail & (KB_SHADOW_SLOTS - 1)];
+        log_message(KB_LOG_LEVEL_INFO,
+                    "Shadow disagreement: %s key %hu flags 0x%llx keyboard type %u%s at %llu ns, blocking %s: "
+                    "live %s (%s), candidate %s (%s).",
+                    engine_event_type_name(d->event.type), d->event.key_code, d->event.flags, d->event.device,
+                    d->event.autorepeat ? " (repeat)" : "", (unsigned long long)d->event.timestamp,
+                    d->blocking ? "on" : "off", engine_verdict_name((kb_verdict_t)d->live),
+                    engine_reason_name((kb_reason_t)d->live_reason), engine_verdict_name((kb_verdict_t)d->candidate),
+                    engine_reason_name((kb_reason_t)d->candidate_reason));
+    }
+    atomic_store_explicit(&shadow->tail, tail, memory_order_release);
+
+    uint64_t dropped = atomic_load_explicit(&shadow->dropped, memory_order_relaxed);
+    if (dropped != shadow->reported_dropped) {
+        log_message(KB_LOG_LEVEL_INFO, "%llu more shadow disagreements were counted but not logged.",
+                    (unsigned long long)(dropped - shadow->reported_dropped));
+        shadow->reported_dropped = dropped;
+    }
+
+    uint64_t stopped = atomic_load_explicit(&shadow->stopped_ns, memory_order_acquire);
+    if (stopped && !shadow->reported_stop) {
+        log_message(KB_LOG_LEVEL_ERROR, "Candidate rules exceeded their time budget %u times (last %llu us). "
+                    "Stopped shadow evaluation.", KB_SHADOW_MAX_OVERRUNS, (unsigned long long)(stopped / 1000ULL));
+        shadow->reported_stop = true;
+    }
+    return count;
+}
+
+/**
+ * @brief Logs the aggregate counts.
+ */
+void shadow_summary(const kb_shadow_t *shadow) {
+    uint64_t evaluated = atomic_load_explicit(&shadow->evaluated, memory_order_relaxed);
+    if (!evaluated) return;
+    uint64_t total = 0;
+    for (int live = 0; live < KB_VERDICT_COUNT; live++) {
+        for (int candidate = 0; candidate < KB_VERDICT_COUNT; candidate++) {
+            uint64_t n = atomic_load_explicit(&shadow->disagreements[live][candidate], memory_order_relaxed);
+            if (!n) continue;
+            total += n;
+            log_message(KB_LOG_LEVEL_INFO, "Shadow: live %s, candidate %s on %llu events.",
+                        engine_verdict_name((kb_verdict_t)live), engine_verdict_name((kb_verdict_t)candidate),
+                        (unsigned long long)n);
+        }
+    }
+    log_message(KB_LOG_LEVEL_INFO, "Shadow: candidate disagreed on %llu of %llu events.", (unsigned long long)total,
+                (unsigned long long)evaluated);
+}
+
+/**
+ * @brief Writes the aggregate counts in Prometheus text format.
+ */
+void shadow_render_metrics(const kb_shadow_t *shadow, FILE *out) {
+    fprintf(out, "# HELP keyblocker_shadow_evaluated_total Events evaluated by the candidate rules.\n"
+                 "# TYPE keyblocker_shadow_evaluated_total counter\n"
+                 "keyblocker_shadow_evaluated_total %llu\n"
+                 "# HELP keyblocker_shadow_disagreements_total Events the candidate rules decided differently.\n"
+                 "# TYPE keyblocker_shadow_disagreements_total counter\n",
+            (unsigned long long)atomic_load_explicit(&shadow->evaluated, memory_order_relaxed));
+    for (int live = 0; live < KB_VERDICT_COUNT; live++) {
+        for (int candidate = 0; candidate < KB_VERDICT_COUNT; candidate++) {
+            if (live == candidate) continue;
+            fprintf(out, "keyblocker_shadow_disagreements_total{live=\"%s\",candidate=\"%s\"} %llu\n",
+                    engine_verdict_name((kb_verdict_t)live), engine_verdict_name((kb_verdict_t)candidate),
+                    (unsigned long long)atomic_load_explicit(&shadow->disagreements[live][candidate],
+                                                             memory_order_relaxed));
+        }
+    }
+}
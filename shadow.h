@@ -0,0 +1,116 @@
+/**
+ * @file shadow.h
+ * @brief Shadow evaluation of a candidate rule set on live events.
+ *
+ * The live policy keeps enforcing. For every event, the engine's decision is
+ * repeated with the candidate rules ("shadow_rule=" lines) in place of the
+ * live ones; the candidate's verdict is never applied. Agreements are only
+ * counted. Disagreements are counted by verdict pair and queued with the
+ * full event, without allocating, for the worker to log.
+ *
+ * Each candidate evaluation is timed; a candidate that overruns its budget
+ * KB_SHADOW_MAX_OVERRUNS times is switched off for the session, and the
+ * next report says so.
+ */
+
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "engine.h"
+#include "metrics.h"
+#include "rules.h"
+
+/** @brief Number of unreported disagreements kept (power of two). */
+#define KB_SHADOW_SLOTS 64
+
+/** @brief Budget overruns after which the candidate is switched off. */
+#define KB_SHADOW_MAX_OVERRUNS 3
+
+/**
+ * @brief One event on which the candidate disagreed with the live policy.
+ */
+typedef struct {
+    kb_event_t event;       /**< The event */
+    bool blocking;          /**< Whether blocking was active */
+    uint8_t live;           /**< Live verdict (kb_verdict_t) */
+    uint8_t live_reason;    /**< Live reason (kb_reason_t) */
+    uint8_t candidate;      /**< Candidate verdict (kb_verdict_t) */
+    uint8_t candidate_reason; /**< Candidate reason (kb_reason_t) */
+} kb_shadow_diff_t;
+
+/**
+ * @brief A candidate policy and its disagreement log.
+ */
+typedef struct {
+    kb_rules_t rules;                       /**< Candidate rule set */
+    bool active;                            /**< Whether the candidate is evaluated */
+    uint64_t budget_ns;                     /**< Time budget per evaluation */
+    unsigned int overruns;                  /**< Evaluations that exceeded the budget */
+    kb_counter_t evaluated;                 /**< Events evaluated (tap thread) */
+    kb_counter_t disagreements[KB_VERDICT_COUNT][KB_VERDICT_COUNT]; /**< By live, then candidate verdict (tap thread) */
+    kb_shadow_diff_t slots[KB_SHADOW_SLOTS];  /**< Unreported disagreements */
+    atomic_uint_fast64_t head;              /**< Disagreements queued (tap thread) */
+    atomic_uint_fast64_t tail;              /**< Disagreements reported (worker) */
+    atomic_bool pending;                    /**< A report is scheduled */
+    atomic_uint_fast64_t dropped;           /**< Disagreements lost to a full queue, in total */
+    uint64_t reported_dropped;              /**< Lost disagreements already reported (worker) */
+    atomic_uint_fast64_t stopped_ns;        /**< Last evaluation time once switched off, 0 while active */
+    bool reported_stop;                     /**< Switch-off already reported (worker) */
+} kb_shadow_t;
+
+/**
+ * @brief Compiles a candidate rule set. The candidate is active if at least
+ * one rule compiled.
+ *
+ * @param shadow Shadow state to initialize.
+ * @param lines Candidate rule texts.
+ * @param count Number of lines.
+ * @param budget_us Time budget per evaluation, in microseconds.
+ * @return Number of candidate rules compiled.
+ */
+size_t shadow_configure(kb_shadow_t *shadow, const char (*lines)[KB_RULE_TEXT_MAX], size_t count,
+                        unsigned int budget_us);
+
+/**
+ * @brief Evaluates the candidate on an event. Tap thread only.
+ *
+ * @param shadow Shadow state.
+ * @param engine Live engine state.
+ * @param event Decoded event.
+ * @param live Live engine verdict.
+ * @param live_reason Live engine reason.
+ * @return true if the caller must schedule a report, false otherwise.
+ */
+bool shadow_evaluate(kb_shadow_t *shadow, const kb_engine_t *engine, const kb_event_t *event, kb_verdict_t live,
+                     kb_reason_t live_reason);
+
+/**
+ * @brief Logs and removes every queued disagreement, and reports a
+ * switch-off. Run by the report.
+ *
+ * @param shadow Shadow state.
+ * @return Number of disagreements logged.
+ */
+size_t shadow_report(kb_shadow_t *shadow);
+
+/**
+ * @brief Logs the aggregate counts.
+ *
+ * @param shadow Shadow state.
+ */
+void shadow_summary(const kb_shadow_t *shadow);
+
+/**
+ * @brief Writes the aggregate counts in Prometheus text format.
+ *
+ * @param shadow Shadow state.
+ * @param out Output stream.
+ */
+void shadow_render_metrics(const kb_shadow_t *shadow, FILE *out);
+
+#endif
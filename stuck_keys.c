@@ -0,0 +1,56 @@
+/**
+ * @file stuck_keys.c
+ * @brief Implementation of the stuck and chattering key detector.
+ */
+
+#include "stuck_keys.h"
+#include <string.h>
+
+/**
+ * @brief Resets the detector with new thresholds.
+ */
+void stuck_keys_configure(kb_stuck_detector_t *detector, uint32_t repeat_limit_ms, uint32_t chatter_ms) {
+    memset(detector, 0, sizeof(*detector));
+    detector->repeat_limit_ms = repeat_limit_ms;
+    detector->chatter_ms = chatter_ms;
+}
+
+/**
+ * @brief Feeds one event to the detector.
+ *
+ * A stuck key shows up as an uninterrupted run of auto-repeat key downs; a
+ * chattering key as repeated presses arriving within chatter_ms of the
+ * previous release. A tripped key's record is reset so it can trip again
+ * after being released from quarantine.
+ */
+bool stuck_keys_observe(kb_stuck_detector_t *detector, const kb_event_t *event) {
+    if (event->key_code >= KB_KEY_COUNT) return false;
+    kb_key_record_t *key = &detector->keys[event->key_code];
+    uint32_t now_ms = (uint32_t)(event->timestamp / 1000000ULL);
+    bool tripped = false;
+
+    if (event->type == KB_EVENT_KEY_DOWN) {
+        if (event->autorepeat) {
+            if (!key->repeating) {
+                key->repeating = 1;
+                key->repeat_start_ms = now_ms;
+            } else if (detector->repeat_limit_ms && now_ms - key->repeat_start_ms >= detector->repeat_limit_ms) {
+                tripped = true;
+            }
+        } else {
+            key->repeating = 0;
+            if (detector->chatter_ms && key->released && now_ms - key->last_up_ms < detector->chatter_ms) {
+                tripped = ++key->chatter >= KB_CHATTER_COUNT;
+            } else {
+                key->chatter = 0;
+            }
+        }
+    } else if (event->type == KB_EVENT_KEY_UP) {
+        key->repeating = 0;
+        key->last_up_ms = now_ms;
+        key->released = 1;
+    }
+
+    if (tripped) memset(key, 0, sizeof(*key));
+    return tripped;
+}
@@ -0,0 +1,62 @@
+/**
+ * @file stuck_keys.h
+ * @brief Detector for stuck (endlessly auto-repeating) and chattering keys.
+ *
+ * Liquid spills and worn switches make a single key repeat forever or bounce
+ * through press/release cycles faster than a finger can. The detector keeps
+ * a fixed array of small per-key records updated in O(1) per event and
+ * reports when a key should be quarantined.
+ */
+
+#ifndef STUCK_KEYS_H
+#define STUCK_KEYS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "engine.h"
+
+/** @brief Consecutive too-fast press cycles that mark a key as chattering. */
+#define KB_CHATTER_COUNT 5
+
+/**
+ * @brief Per-key detector record.
+ *
+ * Times are truncated to 32-bit milliseconds; differences are computed with
+ * unsigned arithmetic, so wrap-around is harmless.
+ */
+typedef struct {
+    uint32_t last_up_ms;        /**< Time of the last release */
+    uint32_t repeat_start_ms;   /**< Time of the first auto-repeat in the current run */
+    uint8_t chatter;            /**< Consecutive too-fast press cycles */
+    uint8_t repeating;          /**< Whether an auto-repeat run is in progress */
+    uint8_t released;           /**< Whether last_up_ms is valid */
+} kb_key_record_t;
+
+/**
+ * @brief Detector thresholds and per-key state.
+ */
+typedef struct {
+    uint32_t repeat_limit_ms;           /**< Auto-repeat run length that marks a key stuck, 0 to disable */
+    uint32_t chatter_ms;                /**< Release-to-press gap below which a press is too fast, 0 to disable */
+    kb_key_record_t keys[KB_KEY_COUNT]; /**< Per-key records */
+} kb_stuck_detector_t;
+
+/**
+ * @brief Resets the detector with new thresholds.
+ *
+ * @param detector Detector to configure.
+ * @param repeat_limit_ms Auto-repeat run length that marks a key stuck, 0 to disable.
+ * @param chatter_ms Release-to-press gap below which a press is too fast, 0 to disable.
+ */
+void stuck_keys_configure(kb_stuck_detector_t *detector, uint32_t repeat_limit_ms, uint32_t chatter_ms);
+
+/**
+ * @brief Feeds one event to the detector.
+ *
+ * @param detector Detector state.
+ * @param event Decoded event.
+ * @return True if the event's key has just been found stuck or chattering.
+ */
+bool stuck_keys_observe(kb_stuck_detector_t *detector, const kb_event_t *event);
+
+#endif
@@ -0,0 +1,26 @@
+/**
+ * @file system_event.h
+ * @brief Access to fields of system-defined events not exposed by CoreGraphics.
+ */
+
+#ifndef SYSTEM_EVENT_H
+#define SYSTEM_EVENT_H
+
+#include <stdbool.h>
+#include <ApplicationServices/ApplicationServices.h>
+
+/**
+ * @brief Reads the subtype and data1 fields of a system-defined event.
+ *
+ * Allocates: the fields are only reachable through an NSEvent wrapper.
+ * This is the one allocation left on the event tap thread, taken only for
+ * media key events, which are rare.
+ *
+ * @param event The event to inspect.
+ * @param subtype Output for the event subtype.
+ * @param data1 Output for the event's data1 field.
+ * @return False if the event is not a system-defined event.
+ */
+bool read_system_event_fields(CGEventRef event, int *subtype, long *data1);
+
+#endif
@@ -0,0 +1,29 @@
+/**
+ * @file system_event.m
+ * @brief Implementation of system-defined event field access.
+ *
+ * CoreGraphics offers no public field for the subtype and data1 of a
+ * system-defined event, so they are read through NSEvent. The wrapper
+ * object lives only for the duration of the call, but creating it
+ * allocates on the tap thread; kb_alloc_check does not cover this path.
+ */
+#import <Cocoa/Cocoa.h>
+#include "system_event.h"
+
+/**
+ * @brief Reads the subtype and data1 fields of a system-defined event.
+ *
+ * @param event The event to inspect.
+ * @param subtype Output for the event subtype.
+ * @param data1 Output for the event's data1 field.
+ * @return False if the event is not a system-defined event.
+ */
+bool read_system_event_fields(CGEventRef event, int *subtype, long *data1) {
+    @autoreleasepool {
+        NSEvent *nsEvent = [NSEvent eventWithCGEvent:event];
+        if (!nsEvent || nsEvent.type != NSEventTypeSystemDefined) return false;
+        *subtype = (int)nsEvent.subtype;
+        *data1 = (long)nsEvent.data1;
+        return true;
+    }
+}
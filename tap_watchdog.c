@@ -0,0 +1,91 @@
+/**
+ * @file tap_watchdog.c
+ * @brief Implementation of event tap deadline tracking.
+ */
+
+#include "tap_watchdog.h"
+#include "logger.h"
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * @brief Names of kb_slow_work_t flags, in bit order.
+ */
+static const char *const WORK_NAMES[] = {"settings", "log", "callback", "plugins", "heatmap"};
+
+/**
+ * @brief Initializes an empty watchdog.
+ */
+void tap_watchdog_init(kb_tap_watchdog_t *watchdog, unsigned int budget_us) {
+    memset(watchdog->slots, 0, sizeof(watchdog->slots));
+    watchdog->budget_ns = (uint64_t)budget_us * 1000ULL;
+    atomic_store_explicit(&watchdog->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&watchdog->tail, 0, memory_order_relaxed);
+    atomic_store_explicit(&watchdog->pending, false, memory_order_relaxed);
+    atomic_store_explicit(&watchdog->dropped, 0, memory_order_relaxed);
+    watchdog->reported_dropped = 0;
+    watchdog->overruns = 0;
+}
+
+/**
+ * @brief Files a slow event.
+ *
+ * The report clears the pending flag before draining, so an event filed
+ * while a report runs either gets drained by it or schedules the next one.
+ */
+bool tap_watchdog_file(kb_tap_watchdog_t *watchdog, const kb_slow_event_t *slow) {
+    watchdog->overruns++;
+    uint64_t head = atomic_load_explicit(&watchdog->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&watchdog->tail, memory_order_acquire);
+    if (head - tail >= KB_TAP_WATCHDOG_SLOTS) {
+        atomic_fetch_add_explicit(&watchdog->dropped, 1, memory_order_relaxed);
+    } else {
+        watchdog->slots[head & (KB_TAP_WATCHDOG_SLOTS - 1)] = *slow;
+        atomic_store_explicit(&watchdog->head, head + 1, memory_order_release);
+    }
+    return !atomic_exchange_explicit(&watchdog->pending, true, memory_order_acq_rel);
+}
+
+/**
+ * @brief Formats kb_slow_work_t flags.
+ */
+void tap_watchdog_format_work(unsigned int work, char *buffer, size_t size) {
+    size_t used = 0;
+    buffer[0] = '\0';
+    for (size_t i = 0; i < sizeof(WORK_NAMES) / sizeof(WORK_NAMES[0]); i++) {
+        if (!(work & (1u << i)) || used >= size) continue;
+        int n = snprintf(buffer + used, size - used, "%s%s", used ? "+" : "", WORK_NAMES[i]);
+        if (n > 0) used += (size_t)n;
+    }
+    if (!used) snprintf(buffer, size, "none");
+}
+
+/**
+ * @brief Logs and removes every filed slow event.
+ */
+size_t tap_watchdog_report(kb_tap_watchdog_t *watchdog) {
+    atomic_store_explicit(&watchdog->pending, false, memory_order_seq_cst);
+
+    size_t count = 0;
+    uint64_t tail = atomic_load_explicit(&watchdog->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&watchdog->head, memory_order_acquire);
+    for (; tail != head; tail++, count++) {
+        kb_slow_event_t slow = watchdog->slots[tail & (KB_TAP_WATCHDOG_SLOTS - 1)];
+        char work[64];
+        tap_watchdog_format_work(slow.work, work, sizeof(work));
+        log_message(KB_LOG_LEVEL_ERROR,
+                    "Event tap callback took %llu us (budget %llu us): %s branch, key %hu, slow work: %s.",
+                    (unsigned long long)(slow.elapsed_ns / 1000ULL),
+                    (unsigned long long)(watchdog->budget_ns / 1000ULL),
+                    engine_verdict_name((kb_verdict_t)slow.verdict), slow.key_code, work);
+    }
+    atomic_store_explicit(&watchdog->tail, tail, memory_order_release);
+
+    uint64_t dropped = atomic_load_explicit(&watchdog->dropped, memory_order_relaxed);
+    if (dropped != watchdog->reported_dropped) {
+        log_message(KB_LOG_LEVEL_ERROR, "%llu more slow event tap callbacks were not recorded.",
+                    (unsigned long long)(dropped - watchdog->reported_dropped));
+        watchdog->reported_dropped = dropped;
+    }
+    return count;
+}
@@ -0,0 +1,95 @@
+/**
+ * @file tap_watchdog.h
+ * @brief Deadline tracking for the event tap callback.
+ *
+ * macOS disables an event tap whose callback is too slow. To notice
+ * regressions well before that happens, the tap thread times every callback
+ * against a budget and files each overrun as a slow event: which branch ran
+ * and which slow work it touched. Slow events go into a single-producer,
+ * single-consumer ring without allocating; the worker drains and logs them.
+ */
+
+#ifndef TAP_WATCHDOG_H
+#define TAP_WATCHDOG_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "engine.h"
+
+/** @brief Number of unreported slow events kept (power of two). */
+#define KB_TAP_WATCHDOG_SLOTS 64
+
+/**
+ * @brief Slow work a callback may do, as bit flags.
+ */
+typedef enum {
+    KB_SLOW_WORK_SETTINGS = 1 << 0,     /**< Wrote settings.conf */
+    KB_SLOW_WORK_LOG = 1 << 1,          /**< Logged a message */
+    KB_SLOW_WORK_CALLBACK = 1 << 2,     /**< Called an owner callback */
+    KB_SLOW_WORK_PLUGINS = 1 << 3,      /**< Ran filter plugins */
+    KB_SLOW_WORK_HEATMAP = 1 << 4       /**< Updated the keystroke heatmap */
+} kb_slow_work_t;
+
+/**
+ * @brief One callback that exceeded its budget.
+ */
+typedef struct {
+    uint64_t timestamp;     /**< Event time in nanoseconds */
+    uint64_t elapsed_ns;    /**< Time spent in the callback */
+    uint16_t key_code;      /**< Key id */
+    uint8_t verdict;        /**< Branch taken (kb_verdict_t) */
+    uint8_t work;           /**< kb_slow_work_t flags */
+} kb_slow_event_t;
+
+/**
+ * @brief Budget and slow event ring of one event tap.
+ */
+typedef struct {
+    uint64_t budget_ns;                             /**< Callback budget, 0 to disable */
+    kb_slow_event_t slots[KB_TAP_WATCHDOG_SLOTS];   /**< Unreported slow events */
+    atomic_uint_fast64_t head;                      /**< Slow events filed (tap thread) */
+    atomic_uint_fast64_t tail;                      /**< Slow events reported (worker) */
+    atomic_bool pending;                            /**< A report is scheduled */
+    atomic_uint_fast64_t dropped;                   /**< Slow events lost to a full ring, in total */
+    uint64_t reported_dropped;                      /**< Lost slow events already reported (worker) */
+    uint64_t overruns;                              /**< Slow events filed in total */
+} kb_tap_watchdog_t;
+
+/**
+ * @brief Initializes an empty watchdog.
+ *
+ * @param watchdog Watchdog to initialize.
+ * @param budget_us Callback budget in microseconds, 0 to disable.
+ */
+void tap_watchdog_init(kb_tap_watchdog_t *watchdog, unsigned int budget_us);
+
+/**
+ * @brief Files a slow event. Tap thread only.
+ *
+ * @param watchdog Watchdog to update.
+ * @param slow Slow event to file.
+ * @return true if the caller must schedule a report, false if one is
+ * already scheduled.
+ */
+bool tap_watchdog_file(kb_tap_watchdog_t *watchdog, const kb_slow_event_t *slow);
+
+/**
+ * @brief Logs and removes every filed slow event. Run by the report.
+ *
+ * @param watchdog Watchdog to drain.
+ * @return Number of slow events logged.
+ */
+size_t tap_watchdog_report(kb_tap_watchdog_t *watchdog);
+
+/**
+ * @brief Formats kb_slow_work_t flags as "settings+log", or "none".
+ *
+ * @param work Flags to format.
+ * @param buffer Output buffer.
+ * @param size Size of the output buffer.
+ */
+void tap_watchdog_format_work(unsigned int work, char *buffer, size_t size);
+
+#endif
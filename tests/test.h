@@ -0,0 +1,45 @@
+/**
+ * @file test.h
+ * @brief Minimal checks for the unit tests under tests/.
+ *
+ * Each test program runs its cases in main() and exits non-zero if any
+ * CHECK failed; "make test" builds and runs every tests/test_*.c.
+ */
+
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+/** @brief Failed checks so far. */
+static int g_test_failures;
+
+/**
+ * @brief Records a failure, with its location, if the condition is false.
+ * The test goes on either way.
+ */
+#define CHECK(cond)                                                                         \
+    do {                                                                                    \
+        if (!(cond)) {                                                                      \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond);        \
+            g_test_failures++;                                                              \
+        }                                                                                   \
+    } while (0)
+
+/**
+ * @brief Runs one test case and reports its name if it failed.
+ */
+#define RUN_TEST(fn)                                                                        \
+    do {                                                                                    \
+        int before = g_test_failures;                                                       \
+        fn();                                                                               \
+        fprintf(stderr, "%s %s\n", g_test_failures == before ? "ok  " : "FAIL", #fn);       \
+    } while (0)
+
+/** @brief Exit status of a test program. */
+#define TEST_RESULT() (g_test_failures ? 1 : 0)
+
+/** @brief Minutes in nanoseconds, for worker_advance(). */
+#define TEST_MINUTES(n) ((uint64_t)(n) * 60ULL * 1000000000ULL)
+
+#endif
@@ -0,0 +1,145 @@
+/**
+ * @file test_app_policy.c
+ * @brief The frontmost-application policy and the rules' app conditions,
+ * driven by a fake activation source.
+ */
+
+#include <string.h>
+#include "app_policy.h"
+#include "engine.h"
+#include "logger.h"
+#include "rules.h"
+#include "test.h"
+
+/** @brief Listed application. */
+#define TEST_LISTED "com.apple.Terminal"
+
+/** @brief Application not on the list. */
+#define TEST_UNLISTED "com.example.Other"
+
+static kb_engine_t g_engine;
+static kb_rules_t g_rules;
+
+/**
+ * @brief Fake activation source: delivers an activation to both sinks, as
+ * the workspace observer does.
+ */
+static void activate(const char *bundle_id) {
+    app_policy_activate(&g_engine.app_policy, bundle_id);
+    rules_activate(&g_rules, bundle_id);
+}
+
+/**
+ * @brief Returns the engine's verdict for a key press, with its reason.
+ */
+static kb_verdict_t decide(kb_reason_t *reason) {
+    kb_event_t ev = {0};
+    ev.type = KB_EVENT_KEY_DOWN;
+    ev.key_code = 4;
+    return engine_decide(&g_engine, &ev, reason);
+}
+
+/**
+ * @brief Resets the engine to blocking with the given application list and
+ * no rules.
+ */
+static void setup(kb_app_mode_t mode) {
+    memset(&g_engine, 0, sizeof(g_engine));
+    g_engine.enabled = true;
+    g_engine.device_default = KB_DEVICE_POLICY_BLOCK;
+    app_policy_configure(&g_engine.app_policy, mode, " " TEST_LISTED ", com.example.Editor ");
+    rules_compile(&g_rules, NULL, 0);
+}
+
+static void test_listed_app_hits(void) {
+    setup(KB_APP_MODE_EXCEPT);
+    CHECK(g_engine.app_policy.count == 2);
+    activate(TEST_LISTED);
+    CHECK(app_policy_current(&g_engine.app_policy) == KB_APP_POLICY_EXEMPT);
+    kb_reason_t reason;
+    CHECK(decide(&reason) == KB_VERDICT_PASS && reason == KB_REASON_APP);
+
+    setup(KB_APP_MODE_ONLY);
+    activate(TEST_LISTED);
+    CHECK(app_policy_current(&g_engine.app_policy) == KB_APP_POLICY_BLOCK);
+    CHECK(decide(&reason) == KB_VERDICT_BLOCK && reason == KB_REASON_BLOCKING);
+}
+
+static void test_unlisted_app_misses(void) {
+    setup(KB_APP_MODE_EXCEPT);
+    activate(TEST_LISTED);
+    activate(TEST_UNLISTED);
+    CHECK(app_policy_current(&g_engine.app_policy) == KB_APP_POLICY_BLOCK);
+    kb_reason_t reason;
+    CHECK(decide(&reason) == KB_VERDICT_BLOCK && reason == KB_REASON_BLOCKING);
+
+    setup(KB_APP_MODE_ONLY);
+    activate(TEST_UNLISTED);
+    CHECK(app_policy_current(&g_engine.app_policy) == KB_APP_POLICY_EXEMPT);
+    CHECK(decide(&reason) == KB_VERDICT_PASS && reason == KB_REASON_APP);
+}
+
+static void test_unknown_app_gets_default(void) {
+    /* The cache starts out as if no application were frontmost */
+    setup(KB_APP_MODE_EXCEPT);
+    CHECK(app_policy_current(&g_engine.app_policy) == KB_APP_POLICY_BLOCK);
+    activate(TEST_LISTED);
+    activate(NULL);
+    CHECK(app_policy_current(&g_engine.app_policy) == KB_APP_POLICY_BLOCK);
+
+    setup(KB_APP_MODE_ONLY);
+    CHECK(app_policy_current(&g_engine.app_policy) == KB_APP_POLICY_EXEMPT);
+    activate(NULL);
+    CHECK(app_policy_current(&g_engine.app_policy) == KB_APP_POLICY_EXEMPT);
+
+    /* With the list off every application blocks */
+    setup(KB_APP_MODE_OFF);
+    activate(TEST_LISTED);
+    CHECK(app_policy_current(&g_engine.app_policy) == KB_APP_POLICY_BLOCK);
+}
+
+static void test_resolve_leaves_cache(void) {
+    setup(KB_APP_MODE_EXCEPT);
+    activate(TEST_UNLISTED);
+    CHECK(app_policy_resolve(&g_engine.app_policy, TEST_LISTED) == KB_APP_POLICY_EXEMPT);
+    CHECK(app_policy_current(&g_engine.app_policy) == KB_APP_POLICY_BLOCK);
+}
+
+static void test_rules_follow_activations(void) {
+    static const char lines[][KB_RULE_TEXT_MAX] = {
+        "pass if app == " TEST_LISTED,
+        "block if app != com.example.Editor and key == 5",
+    };
+    setup(KB_APP_MODE_OFF);
+    CHECK(rules_compile(&g_rules, lines, 2) == 2);
+    g_engine.rules = &g_rules;
+    kb_event_t ev = {0};
+    ev.type = KB_EVENT_KEY_DOWN;
+    ev.key_code = 5;
+
+    activate(TEST_LISTED);
+    CHECK(rules_eval(&g_rules, &g_engine, &ev) == KB_VERDICT_PASS);
+    kb_reason_t reason;
+    CHECK(decide(&reason) == KB_VERDICT_PASS && reason == KB_REASON_RULE);
+
+    activate(TEST_UNLISTED);
+    CHECK(rules_eval(&g_rules, &g_engine, &ev) == KB_VERDICT_BLOCK);
+    activate("com.example.Editor");
+    CHECK(rules_eval(&g_rules, &g_engine, &ev) == KB_RULES_NO_MATCH);
+
+    /* An unknown application matches no "app ==" and every "app !=" */
+    activate(NULL);
+    CHECK(rules_eval(&g_rules, &g_engine, &ev) == KB_VERDICT_BLOCK);
+    ev.key_code = 4;
+    CHECK(rules_eval(&g_rules, &g_engine, &ev) == KB_RULES_NO_MATCH);
+}
+
+int main(void) {
+    set_kb_log_level(KB_LOG_LEVEL_NONE);
+    RUN_TEST(test_listed_app_hits);
+    RUN_TEST(test_unlisted_app_misses);
+    RUN_TEST(test_unknown_app_gets_default);
+    RUN_TEST(test_resolve_leaves_cache);
+    RUN_TEST(test_rules_follow_activations);
+    return TEST_RESULT();
+}
@@ -0,0 +1,170 @@
+/**
+ * @file test_block.c
+ * @brief Timed blocking, the safety watchdog and idle blocking, on the
+ * worker's virtual clock.
+ */
+
+#include <stdlib.h>
+#include "arena.h"
+#include "logger.h"
+#include "session.h"
+#include "worker.h"
+#include "test.h"
+
+/** @brief State notifications seen by the owner. */
+static int g_changes;
+static bool g_last_state;
+
+static void on_state_changed(bool active, void *arg) {
+    (void)arg;
+    g_changes++;
+    g_last_state = active;
+}
+
+/**
+ * @brief Starts a session with blocking off, the given safety ceiling and
+ * idle period.
+ */
+static kb_session_t *start_session(unsigned int max_block_minutes, unsigned int idle_block_minutes) {
+    static const kb_instance_callbacks_t callbacks = {.state_changed = on_state_changed};
+    app_settings_t *settings = calloc(1, sizeof(*settings));
+    kb_session_t *session = calloc(1, sizeof(*session));
+    settings->max_block_minutes = max_block_minutes;
+    settings->idle_block_minutes = idle_block_minutes;
+    CHECK(session_start(session, settings, &callbacks, NULL, arena_create(KB_SESSION_ARENA_SIZE)));
+    free(settings);
+    g_changes = 0;
+    return session;
+}
+
+static void stop_session(kb_session_t *session) {
+    kb_arena_t *arena = session->arena;
+    session_stop(session);
+    arena_destroy(arena);
+    free(session);
+}
+
+/**
+ * @brief Returns the cause of the last recorded state change.
+ */
+static kb_cause_t last_cause(const kb_session_t *session) {
+    uint64_t head = session->recorder.transition_head;
+    return head ? (kb_cause_t)session->recorder.transitions[(head - 1) % KB_FLIGHT_TRANSITIONS].cause
+                : KB_CAUSE_COUNT;
+}
+
+static void test_timed_block_ends(void) {
+    kb_session_t *session = start_session(0, 0);
+    session_block_for(session, 30);
+    CHECK(session->engine.enabled);
+    worker_advance(TEST_MINUTES(29));
+    CHECK(session->engine.enabled);
+    CHECK(g_changes == 0);
+    worker_advance(TEST_MINUTES(2));
+    CHECK(!session->engine.enabled);
+    CHECK(g_changes == 1 && !g_last_state);
+    CHECK(last_cause(session) == KB_CAUSE_TIMED);
+    stop_session(session);
+}
+
+static void test_watchdog_lifts_block(void) {
+    kb_session_t *session = start_session(60, 0);
+    session_set_block(session, true, KB_CAUSE_USER);
+    worker_advance(TEST_MINUTES(59));
+    CHECK(session->engine.enabled);
+    worker_advance(TEST_MINUTES(2));
+    CHECK(!session->engine.enabled);
+    CHECK(g_changes == 1 && !g_last_state);
+    CHECK(last_cause(session) == KB_CAUSE_WATCHDOG);
+    stop_session(session);
+}
+
+static void test_watchdog_caps_timed_block(void) {
+    kb_session_t *session = start_session(60, 0);
+    session_block_for(session, 120);
+    worker_advance(TEST_MINUTES(61));
+    CHECK(!session->engine.enabled);
+    CHECK(last_cause(session) == KB_CAUSE_WATCHDOG);
+    worker_advance(TEST_MINUTES(120));
+    CHECK(g_changes == 1);
+    stop_session(session);
+}
+
+static void test_unblock_cancels_timers(void) {
+    kb_session_t *session = start_session(60, 0);
+    session_block_for(session, 30);
+    worker_advance(TEST_MINUTES(10));
+    session_set_block(session, false, KB_CAUSE_USER);
+    session_set_block(session, true, KB_CAUSE_USER);
+    /* The timed unblock is gone and the ceiling counts from the new block */
+    worker_advance(TEST_MINUTES(45));
+    CHECK(session->engine.enabled);
+    worker_advance(TEST_MINUTES(20));
+    CHECK(!session->engine.enabled);
+    CHECK(last_cause(session) == KB_CAUSE_WATCHDOG);
+    CHECK(g_changes == 1);
+    stop_session(session);
+}
+
+static void test_long_block_runs_fast(void) {
+    kb_session_t *session = start_session(0, 0);
+    session_block_for(session, 600);
+    worker_advance(TEST_MINUTES(24 * 60));
+    CHECK(!session->engine.enabled);
+    CHECK(g_changes == 1);
+    stop_session(session);
+}
+
+/**
+ * @brief Decides a key press, which restarts the idle period.
+ */
+static void press(kb_session_t *session) {
+    kb_event_t ev = {0};
+    ev.type = KB_EVENT_KEY_DOWN;
+    ev.key_code = 4;
+    unsigned short key_code = ev.key_code;
+    session_handle_event(session, &ev, worker_now_ns(), &key_code);
+}
+
+static void test_idle_blocks_after_quiet_period(void) {
+    kb_session_t *session = start_session(0, 5);
+    worker_advance(TEST_MINUTES(4));
+    press(session);
+    worker_advance(TEST_MINUTES(4));
+    CHECK(!session->engine.enabled);
+    worker_advance(TEST_MINUTES(2));
+    CHECK(session->engine.enabled);
+    CHECK(g_changes == 1 && g_last_state);
+    CHECK(last_cause(session) == KB_CAUSE_IDLE);
+    stop_session(session);
+}
+
+static void test_idle_ignores_event_newer_than_clock(void) {
+    kb_session_t *session = start_session(0, 5);
+    worker_advance(TEST_MINUTES(4));
+    /* The tap stored an event time past the worker's reading of the clock */
+    atomic_store(&session->last_event_ns, worker_now_ns() + TEST_MINUTES(2));
+    worker_advance(TEST_MINUTES(2));
+    CHECK(!session->engine.enabled);
+    /* The period counts from that event */
+    worker_advance(TEST_MINUTES(4));
+    CHECK(!session->engine.enabled);
+    worker_advance(TEST_MINUTES(2));
+    CHECK(session->engine.enabled);
+    stop_session(session);
+}
+
+int main(void) {
+    init_kb_logger();
+    set_kb_log_level(KB_LOG_LEVEL_ERROR);
+    worker_use_virtual_clock(0);
+
+    RUN_TEST(test_timed_block_ends);
+    RUN_TEST(test_watchdog_lifts_block);
+    RUN_TEST(test_watchdog_caps_timed_block);
+    RUN_TEST(test_unblock_cancels_timers);
+    RUN_TEST(test_long_block_runs_fast);
+    RUN_TEST(test_idle_blocks_after_quiet_period);
+    RUN_TEST(test_idle_ignores_event_newer_than_clock);
+    return TEST_RESULT();
+}
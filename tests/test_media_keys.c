@@ -0,0 +1,149 @@
+/**
+ * @file test_media_keys.c
+ * @brief Table-driven tests of media key decoding and naming.
+ */
+
+#include <string.h>
+#include "media_keys.h"
+#include "test.h"
+
+/** @brief data1 of an auxiliary control button event. */
+#define DATA1(key_type, state, repeat) (((long)(key_type) << 16) | ((long)(state) << 8) | (long)(repeat))
+
+/**
+ * @brief One decode case: the event fields in, the decoded event out.
+ */
+typedef struct {
+    int subtype;
+    long data1;
+    bool media;                 /**< Expected return value */
+    kb_event_type_t type;
+    unsigned short key_code;
+    bool autorepeat;
+} decode_case_t;
+
+static const decode_case_t DECODE_CASES[] = {
+    {8, DATA1(0, 0x0A, 0), true, KB_EVENT_KEY_DOWN, KB_KEY_MEDIA_BASE + 0, false},
+    {8, DATA1(0, 0x0B, 0), true, KB_EVENT_KEY_UP, KB_KEY_MEDIA_BASE + 0, false},
+    {8, DATA1(1, 0x0A, 1), true, KB_EVENT_KEY_DOWN, KB_KEY_MEDIA_BASE + 1, true},
+    {8, DATA1(7, 0x0A, 0), true, KB_EVENT_KEY_DOWN, KB_KEY_MEDIA_BASE + 7, false},
+    {8, DATA1(16, 0x0B, 1), true, KB_EVENT_KEY_UP, KB_KEY_MEDIA_BASE + 16, true},
+    {8, DATA1(23, 0x0A, 0), true, KB_EVENT_KEY_DOWN, KB_KEY_MEDIA_BASE + 23, false},
+    /* Unnamed key types inside the reserved range still decode */
+    {8, DATA1(31, 0x0A, 0), true, KB_EVENT_KEY_DOWN, KB_KEY_MEDIA_BASE + 31, false},
+    /* Other flag bits than the repeat bit are ignored */
+    {8, DATA1(2, 0x0A, 0xFE), true, KB_EVENT_KEY_DOWN, KB_KEY_MEDIA_BASE + 2, false},
+    /* Rejected: other subtypes, key types past the range, unknown states */
+    {7, DATA1(0, 0x0A, 0), false, KB_EVENT_SYSTEM_DEFINED, KB_KEY_NONE, false},
+    {0, 0, false, KB_EVENT_SYSTEM_DEFINED, KB_KEY_NONE, false},
+    {8, DATA1(32, 0x0A, 0), false, KB_EVENT_SYSTEM_DEFINED, KB_KEY_NONE, false},
+    {8, DATA1(0x8000, 0x0A, 0), false, KB_EVENT_SYSTEM_DEFINED, KB_KEY_NONE, false},
+    {8, DATA1(0, 0x0C, 0), false, KB_EVENT_SYSTEM_DEFINED, KB_KEY_NONE, false},
+    {8, DATA1(0, 0x00, 1), false, KB_EVENT_SYSTEM_DEFINED, KB_KEY_NONE, false},
+    {8, -1L, false, KB_EVENT_SYSTEM_DEFINED, KB_KEY_NONE, false},
+};
+
+static void test_decode_table(void) {
+    for (size_t i = 0; i < sizeof(DECODE_CASES) / sizeof(DECODE_CASES[0]); i++) {
+        const decode_case_t *c = &DECODE_CASES[i];
+        kb_event_t event = {.type = KB_EVENT_OTHER, .key_code = 5, .autorepeat = true, .flags = 0x100000ULL,
+                            .device = 40, .timestamp = 123456789ULL};
+        bool media = media_key_decode(c->subtype, c->data1, &event);
+        if (media != c->media || event.type != c->type || event.key_code != c->key_code ||
+            event.autorepeat != c->autorepeat) {
+            fprintf(stderr, "decode case %zu: subtype %d data1 %#lx\n", i, c->subtype, (unsigned long)c->data1);
+        }
+        CHECK(media == c->media);
+        CHECK(event.type == c->type);
+        CHECK(event.key_code == c->key_code);
+        CHECK(event.autorepeat == c->autorepeat);
+        /* Fields decoded elsewhere are left alone */
+        CHECK(event.flags == 0x100000ULL && event.device == 40 && event.timestamp == 123456789ULL);
+    }
+}
+
+/**
+ * @brief One naming case: a key id and its settings name.
+ */
+typedef struct {
+    unsigned int key;
+    const char *name;           /**< NULL if the id has no name */
+} name_case_t;
+
+static const name_case_t NAME_CASES[] = {
+    {KB_KEY_MEDIA_BASE + 0, "volume_up"},
+    {KB_KEY_MEDIA_BASE + 1, "volume_down"},
+    {KB_KEY_MEDIA_BASE + 7, "mute"},
+    {KB_KEY_MEDIA_BASE + 14, "eject"},
+    {KB_KEY_MEDIA_BASE + 16, "play"},
+    {KB_KEY_MEDIA_BASE + 23, "illumination_toggle"},
+    {KB_KEY_MEDIA_BASE + 8, NULL},
+    {KB_KEY_MEDIA_BASE + 31, NULL},
+    {KB_KEY_MEDIA_BASE + KB_MEDIA_KEY_COUNT, NULL},
+    {KB_KEY_MEDIA_BASE - 1, NULL},
+    {0, NULL},
+};
+
+static void test_names_round_trip(void) {
+    for (size_t i = 0; i < sizeof(NAME_CASES) / sizeof(NAME_CASES[0]); i++) {
+        const name_case_t *c = &NAME_CASES[i];
+        const char *name = media_key_name(c->key);
+        CHECK(c->name ? name && strcmp(name, c->name) == 0 : name == NULL);
+        if (!c->name) continue;
+        unsigned int key = 0;
+        CHECK(media_key_parse(c->name, &key) && key == c->key);
+    }
+    /* Every named key parses back to itself */
+    for (unsigned int key = KB_KEY_MEDIA_BASE; key < KB_KEY_MEDIA_BASE + KB_MEDIA_KEY_COUNT; key++) {
+        const char *name = media_key_name(key);
+        unsigned int parsed = 0;
+        if (name) CHECK(media_key_parse(name, &parsed) && parsed == key);
+    }
+}
+
+/**
+ * @brief One parsing case: settings text and the key id it yields.
+ */
+typedef struct {
+    const char *text;
+    bool ok;
+    unsigned int key;
+} parse_case_t;
+
+static const parse_case_t PARSE_CASES[] = {
+    {"53", true, 53},
+    {"0x35", true, 53},
+    {"0", true, 0},
+    {"volume_down", true, KB_KEY_MEDIA_BASE + 1},
+    {"", false, 0},
+    {"volume", false, 0},
+    {"Volume_Up", false, 0},
+    {"53x", false, 0},
+    {"-1", false, 0},
+};
+
+static void test_parse_table(void) {
+    for (size_t i = 0; i < sizeof(PARSE_CASES) / sizeof(PARSE_CASES[0]); i++) {
+        const parse_case_t *c = &PARSE_CASES[i];
+        unsigned int key = 0;
+        bool ok = media_key_parse(c->text, &key);
+        if (ok != c->ok) fprintf(stderr, "parse case \"%s\"\n", c->text);
+        CHECK(ok == c->ok);
+        if (c->ok) CHECK(key == c->key);
+    }
+    char text[16];
+    unsigned int key;
+    snprintf(text, sizeof(text), "%u", KB_KEY_COUNT);
+    CHECK(!media_key_parse(text, &key));
+    snprintf(text, sizeof(text), "%u", KB_KEY_COUNT - 1);
+    CHECK(media_key_parse(text, &key) && key == KB_KEY_COUNT - 1);
+    CHECK(!media_key_parse(NULL, &key));
+    CHECK(!media_key_parse("53", NULL));
+}
+
+int main(void) {
+    RUN_TEST(test_decode_table);
+    RUN_TEST(test_names_round_trip);
+    RUN_TEST(test_parse_table);
+    return TEST_RESULT();
+}
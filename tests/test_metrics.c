@@ -0,0 +1,215 @@
+/**
+ * @file test_metrics.c
+ * @brief Scrapes of the metrics socket served by a session's worker, by
+ * hand and with curl where it is installed.
+ */
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "arena.h"
+#include "logger.h"
+#include "session.h"
+#include "trace.h"
+#include "test.h"
+
+/** @brief Largest response the tests read. */
+#define TEST_RESPONSE_MAX 16384
+
+/** @brief How long a scrape may take, in milliseconds. */
+#define TEST_SCRAPE_TIMEOUT_MS 3000
+
+/** @brief Connections opened at once; more than the server has slots. */
+#define TEST_CLIENTS (KB_METRICS_CLIENTS + 4)
+
+static kb_session_t *g_session;
+static char g_path[KB_METRICS_PATH_MAX];
+
+/**
+ * @brief Starts a blocking session that serves metrics on g_path.
+ */
+static void start_session(void) {
+    app_settings_t *settings = calloc(1, sizeof(*settings));
+    settings->blocking_enabled = true;
+    settings->allowed_keys[0] |= 1ULL << 3;
+    snprintf(g_path, sizeof(g_path), "/tmp/kb_test_metrics_%d.sock", (int)getpid());
+    snprintf(settings->metrics_socket, sizeof(settings->metrics_socket), "%s", g_path);
+    g_session = calloc(1, sizeof(*g_session));
+    CHECK(session_start(g_session, settings, NULL, NULL, arena_create(KB_SESSION_ARENA_SIZE)));
+    free(settings);
+}
+
+static void stop_session(void) {
+    kb_arena_t *arena = g_session->arena;
+    session_stop(g_session);
+    arena_destroy(arena);
+    free(g_session);
+}
+
+static void press(unsigned short key) {
+    kb_event_t ev = {0};
+    ev.type = KB_EVENT_KEY_DOWN;
+    ev.key_code = key;
+    ev.timestamp = trace_now_ns();
+    unsigned short key_code = key;
+    session_handle_event(g_session, &ev, trace_now_ns(), &key_code);
+}
+
+/**
+ * @brief Connects to the metrics socket, optionally sending a request.
+ */
+static int connect_client(bool send_request) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", g_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    static const char request[] = "GET /metrics HTTP/1.0\r\n\r\n";
+    if (send_request && write(fd, request, sizeof(request) - 1) != (ssize_t)sizeof(request) - 1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Reads a response until the server closes the connection.
+ *
+ * @return Bytes read, or -1 on error or timeout.
+ */
+static ssize_t read_response(int fd, char *buffer, size_t size) {
+    size_t length = 0;
+    for (;;) {
+        struct pollfd pfd = {fd, POLLIN, 0};
+        if (poll(&pfd, 1, TEST_SCRAPE_TIMEOUT_MS) != 1) return -1;
+        ssize_t n = read(fd, buffer + length, size - 1 - length);
+        if (n < 0) return -1;
+        if (n == 0) break;
+        length += (size_t)n;
+        if (length == size - 1) break;
+    }
+    buffer[length] = '\0';
+    return (ssize_t)length;
+}
+
+/**
+ * @brief Scrapes once and returns the response, or NULL on failure.
+ */
+static const char *scrape(bool send_request) {
+    static char response[TEST_RESPONSE_MAX];
+    int fd = connect_client(send_request);
+    if (fd < 0) return NULL;
+    ssize_t length = read_response(fd, response, sizeof(response));
+    close(fd);
+    return length > 0 ? response : NULL;
+}
+
+/**
+ * @brief Checks the headers a HTTP client relies on: the status line, the
+ * content type, a Content-Length matching the body, and connection close.
+ */
+static void check_headers(const char *response) {
+    CHECK(strncmp(response, "HTTP/1.0 200 OK\r\n", 17) == 0);
+    const char *end = strstr(response, "\r\n\r\n");
+    CHECK(end != NULL);
+    if (!end) return;
+    size_t header_length = (size_t)(end - response) + 4;
+    char headers[1024];
+    CHECK(header_length < sizeof(headers));
+    if (header_length >= sizeof(headers)) return;
+    memcpy(headers, response, header_length);
+    headers[header_length] = '\0';
+    CHECK(strstr(headers, "\r\nContent-Type: text/plain; version=0.0.4\r\n") != NULL);
+    CHECK(strstr(headers, "\r\nConnection: close\r\n") != NULL);
+    const char *length = strstr(headers, "\r\nContent-Length: ");
+    CHECK(length != NULL);
+    if (length) CHECK(strtoul(length + 18, NULL, 10) == strlen(end + 4));
+}
+
+static void test_scrape_reports_counters(void) {
+    start_session();
+    for (int i = 0; i < 10; i++) press(3);
+    for (int i = 0; i < 7; i++) press(4);
+    const char *response = scrape(true);
+    CHECK(response != NULL);
+    if (response) {
+        check_headers(response);
+        CHECK(strstr(response, "keyblocker_events_total{type=\"down\",verdict=\"pass\"} 10\n") != NULL);
+        CHECK(strstr(response, "keyblocker_events_total{type=\"down\",verdict=\"block\"} 7\n") != NULL);
+        CHECK(strstr(response, "keyblocker_blocking 1\n") != NULL);
+    }
+    session_set_block(g_session, false, KB_CAUSE_USER);
+    response = scrape(true);
+    CHECK(response && strstr(response, "keyblocker_blocking 0\n") != NULL);
+    stop_session();
+    CHECK(access(g_path, F_OK) != 0);
+}
+
+static void test_silent_client_gets_response(void) {
+    start_session();
+    const char *response = scrape(false);
+    CHECK(response != NULL);
+    if (response) check_headers(response);
+    stop_session();
+}
+
+static void test_curl_scrape(void) {
+    if (system("command -v curl >/dev/null 2>&1") != 0) {
+        fprintf(stderr, "     curl not found, skipped\n");
+        return;
+    }
+    start_session();
+    for (int i = 0; i < 3; i++) press(3);
+    char command[KB_METRICS_PATH_MAX + 128];
+    snprintf(command, sizeof(command), "curl -sSf --max-time 3 --unix-socket '%s' http://localhost/metrics", g_path);
+    FILE *curl = popen(command, "r");
+    CHECK(curl != NULL);
+    if (curl) {
+        static char output[TEST_RESPONSE_MAX];
+        size_t length = fread(output, 1, sizeof(output) - 1, curl);
+        output[length] = '\0';
+        /* curl fails on a bad status and on a body shorter than Content-Length */
+        int status = pclose(curl);
+        CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+        CHECK(strstr(output, "keyblocker_events_total{type=\"down\",verdict=\"pass\"} 3\n") != NULL);
+        CHECK(strstr(output, "keyblocker_blocking 1\n") != NULL);
+    }
+    stop_session();
+}
+
+static void test_more_clients_than_slots(void) {
+    start_session();
+    int fds[TEST_CLIENTS];
+    for (int i = 0; i < TEST_CLIENTS; i++) {
+        fds[i] = connect_client(true);
+        CHECK(fds[i] >= 0);
+    }
+    for (int i = 0; i < TEST_CLIENTS; i++) {
+        if (fds[i] < 0) continue;
+        char response[TEST_RESPONSE_MAX];
+        CHECK(read_response(fds[i], response, sizeof(response)) > 0);
+        CHECK(strncmp(response, "HTTP/1.0 200 OK\r\n", 17) == 0);
+        close(fds[i]);
+    }
+    stop_session();
+}
+
+int main(void) {
+    set_kb_log_level(KB_LOG_LEVEL_ERROR);
+    RUN_TEST(test_scrape_reports_counters);
+    RUN_TEST(test_silent_client_gets_response);
+    RUN_TEST(test_curl_scrape);
+    RUN_TEST(test_more_clients_than_slots);
+    return TEST_RESULT();
+}
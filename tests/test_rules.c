@@ -0,0 +1,71 @@
+/**
+ * @file test_rules.c
+ * @brief Rule compilation, and rule sets that outgrow the code array.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "logger.h"
+#include "rules.h"
+#include "test.h"
+
+/** @brief Command modifier flag, as carried in kb_event_t.flags. */
+#define TEST_FLAG_COMMAND 0x00100000ULL
+
+/** @brief Shift modifier flag, as carried in kb_event_t.flags. */
+#define TEST_FLAG_SHIFT 0x00020000ULL
+
+static kb_rules_t g_rules;
+static char g_lines[KB_RULES_MAX][KB_RULE_TEXT_MAX];
+
+/**
+ * @brief Returns the verdict of the rules for a key down with the given flags.
+ */
+static int eval(unsigned long long flags) {
+    kb_engine_t engine;
+    memset(&engine, 0, sizeof(engine));
+    kb_event_t ev = {0};
+    ev.type = KB_EVENT_KEY_DOWN;
+    ev.key_code = 4;
+    ev.flags = flags;
+    return rules_eval(&g_rules, &engine, &ev);
+}
+
+/**
+ * @brief Writes the longest "pass if shift or shift ..." rule that fits.
+ */
+static void long_rule(char *line) {
+    size_t length = (size_t)snprintf(line, KB_RULE_TEXT_MAX, "pass if shift");
+    while (length + sizeof(" or shift") <= KB_RULE_TEXT_MAX) {
+        length += (size_t)snprintf(line + length, KB_RULE_TEXT_MAX - length, " or shift");
+    }
+}
+
+static void test_first_rule_decides(void) {
+    snprintf(g_lines[0], KB_RULE_TEXT_MAX, "block if cmd");
+    snprintf(g_lines[1], KB_RULE_TEXT_MAX, "pass if shift or (down and key == 4)");
+    CHECK(rules_compile(&g_rules, (const char(*)[KB_RULE_TEXT_MAX])g_lines, 2) == 2);
+    CHECK(eval(TEST_FLAG_COMMAND) == KB_VERDICT_BLOCK);
+    CHECK(eval(TEST_FLAG_COMMAND | TEST_FLAG_SHIFT) == KB_VERDICT_BLOCK);
+    CHECK(eval(0) == KB_VERDICT_PASS);
+}
+
+static void test_overflow_keeps_earlier_rules(void) {
+    snprintf(g_lines[0], KB_RULE_TEXT_MAX, "block if cmd");
+    for (int i = 1; i < KB_RULES_MAX; i++) long_rule(g_lines[i]);
+    size_t count = rules_compile(&g_rules, (const char(*)[KB_RULE_TEXT_MAX])g_lines, KB_RULES_MAX);
+    /* Some long rules did not fit; the ones that did are all whole */
+    CHECK(count > 1 && count < KB_RULES_MAX);
+    CHECK(g_rules.code_size <= KB_RULES_MAX_CODE);
+    CHECK(strcmp(g_rules.source[0], "block if cmd") == 0);
+    CHECK(eval(TEST_FLAG_COMMAND) == KB_VERDICT_BLOCK);
+    CHECK(eval(TEST_FLAG_SHIFT) == KB_VERDICT_PASS);
+    CHECK(eval(0) == KB_RULES_NO_MATCH);
+}
+
+int main(void) {
+    set_kb_log_level(KB_LOG_LEVEL_NONE);
+    RUN_TEST(test_first_rule_decides);
+    RUN_TEST(test_overflow_keeps_earlier_rules);
+    return TEST_RESULT();
+}
@@ -0,0 +1,162 @@
+/**
+ * @file test_schedule.c
+ * @brief Scheduled blocking windows against timed blocks, the safety
+ * watchdog and manual blocks, on the worker's virtual clock in UTC.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include "arena.h"
+#include "logger.h"
+#include "session.h"
+#include "worker.h"
+#include "test.h"
+
+/** @brief Monday 2024-01-01 21:00 UTC, where the virtual clock starts. */
+#define TEST_WALL_START 1704142800
+
+/** @brief State notifications seen by the owner. */
+static int g_changes;
+
+static void on_state_changed(bool active, void *arg) {
+    (void)active;
+    (void)arg;
+    g_changes++;
+}
+
+/**
+ * @brief Starts a session with blocking off, a safety ceiling and one
+ * schedule window, and lets the schedule evaluate it.
+ */
+static kb_session_t *start_session(unsigned int max_block_minutes, const char *window) {
+    static const kb_instance_callbacks_t callbacks = {.state_changed = on_state_changed};
+    app_settings_t *settings = calloc(1, sizeof(*settings));
+    kb_session_t *session = calloc(1, sizeof(*session));
+    settings->max_block_minutes = max_block_minutes;
+    CHECK(schedule_parse_window(window, &settings->schedule[0]));
+    settings->schedule_count = 1;
+    CHECK(session_start(session, settings, &callbacks, NULL, arena_create(KB_SESSION_ARENA_SIZE)));
+    free(settings);
+    worker_advance(1000000000ULL);
+    g_changes = 0;
+    return session;
+}
+
+static void stop_session(kb_session_t *session) {
+    kb_arena_t *arena = session->arena;
+    session_stop(session);
+    arena_destroy(arena);
+    free(session);
+}
+
+/**
+ * @brief Advances the virtual clock to the next hh:mm, plus 30 seconds.
+ */
+static void advance_to(int hour, int minute) {
+    struct timespec wall;
+    worker_wall_time(&wall);
+    struct tm tm;
+    gmtime_r(&wall.tv_sec, &tm);
+    long now = tm.tm_hour * 3600L + tm.tm_min * 60L + tm.tm_sec;
+    long target = hour * 3600L + minute * 60L + 30;
+    long delta = target > now ? target - now : target + 86400L - now;
+    worker_advance((uint64_t)delta * 1000000000ULL - (uint64_t)wall.tv_nsec);
+}
+
+/**
+ * @brief Returns the cause of the last recorded state change.
+ */
+static kb_cause_t last_cause(const kb_session_t *session) {
+    uint64_t head = session->recorder.transition_head;
+    return head ? (kb_cause_t)session->recorder.transitions[(head - 1) % KB_FLIGHT_TRANSITIONS].cause
+                : KB_CAUSE_COUNT;
+}
+
+static void test_window_outlasts_watchdog(void) {
+    kb_session_t *session = start_session(60, "22:00-07:00");
+    advance_to(21, 30);
+    CHECK(!session->engine.enabled);
+    advance_to(22, 0);
+    CHECK(session->engine.enabled);
+    CHECK(last_cause(session) == KB_CAUSE_SCHEDULE);
+    /* The ceiling does not apply to the schedule's own block */
+    advance_to(23, 30);
+    CHECK(session->engine.enabled);
+    advance_to(6, 59);
+    CHECK(session->engine.enabled);
+    advance_to(7, 0);
+    CHECK(!session->engine.enabled);
+    CHECK(last_cause(session) == KB_CAUSE_SCHEDULE);
+    CHECK(g_changes == 2);
+    stop_session(session);
+}
+
+static void test_window_end_keeps_manual_block(void) {
+    kb_session_t *session = start_session(600, "22:00-07:00");
+    advance_to(23, 0);
+    CHECK(session->engine.enabled);
+    session_set_block(session, false, KB_CAUSE_USER);
+    advance_to(23, 30);
+    session_set_block(session, true, KB_CAUSE_USER);
+    advance_to(7, 0);
+    CHECK(session->engine.enabled);
+    CHECK(last_cause(session) == KB_CAUSE_USER);
+    /* The manual block still has its ceiling: ten hours from 23:30 */
+    advance_to(9, 29);
+    CHECK(session->engine.enabled);
+    advance_to(9, 31);
+    CHECK(!session->engine.enabled);
+    CHECK(last_cause(session) == KB_CAUSE_WATCHDOG);
+    stop_session(session);
+}
+
+static void test_window_keeps_earlier_manual_block(void) {
+    kb_session_t *session = start_session(0, "22:00-07:00");
+    advance_to(21, 0);
+    session_set_block(session, true, KB_CAUSE_USER);
+    advance_to(22, 0);
+    advance_to(7, 0);
+    CHECK(session->engine.enabled);
+    CHECK(last_cause(session) == KB_CAUSE_USER);
+    CHECK(g_changes == 0);
+    stop_session(session);
+}
+
+static void test_watchdog_hands_block_to_window(void) {
+    kb_session_t *session = start_session(60, "22:00-07:00");
+    advance_to(21, 30);
+    session_set_block(session, true, KB_CAUSE_USER);
+    advance_to(22, 45);
+    CHECK(session->engine.enabled);
+    advance_to(7, 0);
+    CHECK(!session->engine.enabled);
+    CHECK(last_cause(session) == KB_CAUSE_SCHEDULE);
+    CHECK(g_changes == 1);
+    stop_session(session);
+}
+
+static void test_timed_block_ends_into_window(void) {
+    kb_session_t *session = start_session(0, "22:00-07:00");
+    advance_to(21, 30);
+    session_block_for(session, 60);
+    advance_to(22, 45);
+    CHECK(session->engine.enabled);
+    advance_to(7, 0);
+    CHECK(!session->engine.enabled);
+    stop_session(session);
+}
+
+int main(void) {
+    setenv("TZ", "UTC", 1);
+    tzset();
+    init_kb_logger();
+    set_kb_log_level(KB_LOG_LEVEL_ERROR);
+    worker_use_virtual_clock(TEST_WALL_START);
+
+    RUN_TEST(test_window_outlasts_watchdog);
+    RUN_TEST(test_window_end_keeps_manual_block);
+    RUN_TEST(test_window_keeps_earlier_manual_block);
+    RUN_TEST(test_watchdog_hands_block_to_window);
+    RUN_TEST(test_timed_block_ends_into_window);
+    return TEST_RESULT();
+}
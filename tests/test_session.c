@@ -0,0 +1,189 @@
+/**
+ * @file test_session.c
+ * @brief Sessions side by side, start/stop and reload storms, on the real
+ * worker thread.
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "arena.h"
+#include "logger.h"
+#include "session.h"
+#include "trace.h"
+#include "worker.h"
+#include "test.h"
+
+/** @brief Sessions run side by side. */
+#define TEST_SESSIONS 8
+
+/** @brief Events each concurrent session decides. */
+#define TEST_EVENTS 200000
+
+/** @brief Start/stop and reload cycles of the storms. */
+#define TEST_CYCLES 200
+
+/** @brief Slowest acceptable session_stop(), in nanoseconds. */
+#define TEST_MAX_STOP_NS 200000000ULL
+
+/**
+ * @brief Lets only one key through while blocking.
+ */
+static void allow_only(app_settings_t *settings, unsigned short key) {
+    memset(settings->allowed_keys, 0, sizeof(settings->allowed_keys));
+    settings->allowed_keys[key / 64] |= 1ULL << (key % 64);
+}
+
+static kb_session_t *start_session(const app_settings_t *settings) {
+    kb_session_t *session = calloc(1, sizeof(*session));
+    if (!session_start(session, settings, NULL, NULL, arena_create(KB_SESSION_ARENA_SIZE))) {
+        free(session);
+        return NULL;
+    }
+    return session;
+}
+
+static void stop_session(kb_session_t *session) {
+    kb_arena_t *arena = session->arena;
+    session_stop(session);
+    arena_destroy(arena);
+    free(session);
+}
+
+/**
+ * @brief Decides a key press and returns whether it passed.
+ */
+static bool press(kb_session_t *session, unsigned short key) {
+    kb_event_t ev = {0};
+    ev.type = KB_EVENT_KEY_DOWN;
+    ev.key_code = key;
+    ev.timestamp = trace_now_ns();
+    unsigned short key_code = key;
+    return session_handle_event(session, &ev, trace_now_ns(), &key_code);
+}
+
+/**
+ * @brief Returns the lowest free descriptor; it grows if anything leaked one.
+ */
+static int lowest_free_fd(void) {
+    int fd = open("/dev/null", O_RDONLY);
+    close(fd);
+    return fd;
+}
+
+/** @brief Work of one concurrent session. */
+typedef struct {
+    pthread_t thread;
+    unsigned short key;         /**< The one key its settings allow */
+    unsigned long passed;       /**< Presses of that key that passed */
+    unsigned long leaked;       /**< Presses of other keys that passed */
+    bool started;
+} session_run_t;
+
+static void *run_session(void *arg) {
+    session_run_t *run = (session_run_t *)arg;
+    app_settings_t settings = {0};
+    settings.blocking_enabled = true;
+    allow_only(&settings, run->key);
+    kb_session_t *session = start_session(&settings);
+    run->started = session != NULL;
+    if (!session) return NULL;
+    for (unsigned long i = 0; i < TEST_EVENTS; i++) {
+        unsigned short key = (unsigned short)(i % TEST_SESSIONS);
+        bool passed = press(session, key);
+        if (key == run->key) {
+            run->passed += passed;
+        } else {
+            run->leaked += passed;
+        }
+    }
+    stop_session(session);
+    return NULL;
+}
+
+static void test_concurrent_sessions(void) {
+    session_run_t runs[TEST_SESSIONS] = {0};
+    for (unsigned short i = 0; i < TEST_SESSIONS; i++) {
+        runs[i].key = i;
+        CHECK(pthread_create(&runs[i].thread, NULL, run_session, &runs[i]) == 0);
+    }
+    for (int i = 0; i < TEST_SESSIONS; i++) {
+        pthread_join(runs[i].thread, NULL);
+        CHECK(runs[i].started);
+        CHECK(runs[i].passed == TEST_EVENTS / TEST_SESSIONS);
+        CHECK(runs[i].leaked == 0);
+    }
+}
+
+static void test_restart_storm(void) {
+    app_settings_t settings = {0};
+    settings.blocking_enabled = true;
+    allow_only(&settings, 3);
+    snprintf(settings.metrics_socket, sizeof(settings.metrics_socket), "/tmp/kb_test_session_%d.sock", (int)getpid());
+    int fd = lowest_free_fd();
+    uint64_t slowest = 0;
+
+    for (int i = 0; i < TEST_CYCLES; i++) {
+        kb_session_t *session = start_session(&settings);
+        CHECK(session != NULL);
+        if (!session) return;
+        CHECK(session->metrics_server.listen_fd >= 0);
+        CHECK(press(session, 3) && !press(session, 4));
+        uint64_t start = trace_now_ns();
+        stop_session(session);
+        uint64_t elapsed = trace_now_ns() - start;
+        if (elapsed > slowest) slowest = elapsed;
+    }
+    CHECK(lowest_free_fd() == fd);
+    CHECK(access(settings.metrics_socket, F_OK) != 0);
+    CHECK(slowest < TEST_MAX_STOP_NS);
+    fprintf(stderr, "     slowest stop of %d: %llu us\n", TEST_CYCLES, (unsigned long long)(slowest / 1000ULL));
+}
+
+static void test_reload_keeps_worker_and_socket(void) {
+    app_settings_t settings = {0};
+    allow_only(&settings, 3);
+    snprintf(settings.metrics_socket, sizeof(settings.metrics_socket), "/tmp/kb_test_reload_%d.sock", (int)getpid());
+    settings.schedule_count = KB_SCHEDULE_MAX_WINDOWS;
+    kb_session_t *session = start_session(&settings);
+    CHECK(session != NULL);
+    if (!session) return;
+    int listen_fd = session->metrics_server.listen_fd;
+    size_t arena_used = arena_mark(session->arena);
+    int fd = lowest_free_fd();
+
+    for (int i = 0; i < TEST_CYCLES; i++) {
+        unsigned short key = (unsigned short)(3 + i % 2);
+        allow_only(&settings, key);
+        session_set_block(session, true, KB_CAUSE_USER);
+        session_reload(session, &settings);
+        CHECK(!session->engine.enabled);
+        session_set_block(session, true, KB_CAUSE_USER);
+        CHECK(press(session, key) && !press(session, key ^ 7));
+    }
+    CHECK(session->metrics_server.listen_fd == listen_fd);
+    CHECK(arena_mark(session->arena) == arena_used);
+    CHECK(lowest_free_fd() == fd);
+
+    /* A new socket path replaces the server */
+    snprintf(settings.metrics_socket, sizeof(settings.metrics_socket), "/tmp/kb_test_reload_%d.new.sock",
+             (int)getpid());
+    char old_path[KB_METRICS_PATH_MAX];
+    snprintf(old_path, sizeof(old_path), "%s", session->metrics_server.path);
+    session_reload(session, &settings);
+    CHECK(session->metrics_server.listen_fd >= 0);
+    CHECK(strcmp(session->metrics_server.path, settings.metrics_socket) == 0);
+    CHECK(access(old_path, F_OK) != 0);
+    stop_session(session);
+    CHECK(access(settings.metrics_socket, F_OK) != 0);
+}
+
+int main(void) {
+    set_kb_log_level(KB_LOG_LEVEL_ERROR);
+    RUN_TEST(test_concurrent_sessions);
+    RUN_TEST(test_restart_storm);
+    RUN_TEST(test_reload_keeps_worker_and_socket);
+    return TEST_RESULT();
+}
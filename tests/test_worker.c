@@ -0,0 +1,211 @@
+/**
+ * @file test_worker.c
+ * @brief Worker timers, task sleeps and descriptor waits, cancellation and
+ * stopping with tasks in flight, on the virtual clock.
+ */
+
+#include <unistd.h>
+#include "logger.h"
+#include "worker.h"
+#include "test.h"
+
+/** @brief Seconds in nanoseconds, for worker_advance(). */
+#define TEST_SECONDS(n) ((uint64_t)(n) * 1000000000ULL)
+
+/** @brief Resolution of the worker's deadlines. */
+#define TEST_TICK_NS 10000000ULL
+
+/** @brief State of one test task. */
+typedef struct {
+    int fd;                 /**< Descriptor the task waits on */
+    int starts;             /**< Times the body started */
+    int wakes;              /**< Waits that ended */
+    unsigned int ready;     /**< Events that ended the last wait */
+    uint64_t woke_at[4];    /**< Worker time of each sleep's end */
+    int finished;           /**< Times the body ended */
+    int cancels;            /**< Calls of the cancel function */
+} test_task_t;
+
+/**
+ * @brief Sleeps for a second three times.
+ */
+static void sleeper(kb_task_t *task) {
+    test_task_t *t = (test_task_t *)task->arg;
+    KB_TASK_BEGIN(task);
+    t->starts++;
+    t->woke_at[0] = worker_now_ns();
+    KB_TASK_SLEEP(task, TEST_SECONDS(1));
+    t->woke_at[1] = worker_now_ns();
+    KB_TASK_SLEEP(task, TEST_SECONDS(1));
+    t->woke_at[2] = worker_now_ns();
+    KB_TASK_SLEEP(task, TEST_SECONDS(1));
+    t->woke_at[3] = worker_now_ns();
+    t->finished++;
+    KB_TASK_END(task);
+}
+
+/**
+ * @brief Waits twice for its descriptor, for up to ten seconds each.
+ */
+static void waiter(kb_task_t *task) {
+    test_task_t *t = (test_task_t *)task->arg;
+    KB_TASK_BEGIN(task);
+    t->starts++;
+    KB_TASK_WAIT_FD(task, t->fd, KB_TASK_READ, TEST_SECONDS(10));
+    t->wakes++;
+    t->ready = task->ready;
+    if (task->ready) {
+        char byte;
+        (void)read(t->fd, &byte, 1);
+    }
+    KB_TASK_WAIT_FD(task, t->fd, KB_TASK_READ, TEST_SECONDS(10));
+    t->wakes++;
+    t->ready = task->ready;
+    t->finished++;
+    KB_TASK_END(task);
+}
+
+static void count_cancel(kb_task_t *task) {
+    ((test_task_t *)task->arg)->cancels++;
+}
+
+static int g_fired;
+
+static void count_fire(kb_timer_t *timer, void *arg) {
+    (void)timer;
+    (void)arg;
+    g_fired++;
+}
+
+static void test_sleeps_resume_on_time(void) {
+    test_task_t t = {0};
+    kb_task_t task;
+    worker_task_init(&task, sleeper, &t);
+    worker_spawn(&task);
+    worker_advance(TEST_SECONDS(5));
+    CHECK(t.starts == 1 && t.finished == 1);
+    for (int i = 1; i < 4; i++) {
+        uint64_t slept = t.woke_at[i] - t.woke_at[i - 1];
+        CHECK(slept >= TEST_SECONDS(1) && slept <= TEST_SECONDS(1) + 2 * TEST_TICK_NS);
+    }
+    CHECK(!task.active);
+}
+
+static void test_timer_fires_once(void) {
+    kb_timer_t timer;
+    timer_init(&timer, count_fire, NULL);
+    g_fired = 0;
+    worker_arm(&timer, worker_now_ns() + TEST_SECONDS(5));
+    worker_advance(TEST_SECONDS(5) - 2 * TEST_TICK_NS);
+    CHECK(g_fired == 0);
+    worker_advance(4 * TEST_TICK_NS);
+    CHECK(g_fired == 1);
+    worker_advance(TEST_SECONDS(60));
+    CHECK(g_fired == 1);
+}
+
+static void test_wait_fd_ready_and_timeout(void) {
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    test_task_t t = {.fd = fds[0]};
+    kb_task_t task;
+    worker_task_init(&task, waiter, &t);
+    worker_spawn(&task);
+    worker_advance(TEST_SECONDS(1));
+    CHECK(t.starts == 1 && t.wakes == 0);
+
+    CHECK(write(fds[1], "x", 1) == 1);
+    worker_advance(0);
+    CHECK(t.wakes == 1 && t.ready == KB_TASK_READ);
+
+    worker_advance(TEST_SECONDS(9));
+    CHECK(t.wakes == 1);
+    worker_advance(TEST_SECONDS(2));
+    CHECK(t.wakes == 2 && t.ready == 0 && t.finished == 1);
+    CHECK(!task.active);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void test_cancel_runs_cancel_function(void) {
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    test_task_t t = {.fd = fds[0]};
+    kb_task_t task;
+    worker_task_init(&task, waiter, &t);
+    worker_task_on_cancel(&task, count_cancel);
+    worker_spawn(&task);
+    worker_advance(TEST_SECONDS(1));
+    CHECK(t.starts == 1);
+
+    worker_task_cancel(&task);
+    CHECK(t.cancels == 1 && !task.active);
+    /* Readiness after the cancel reaches nobody */
+    CHECK(write(fds[1], "x", 1) == 1);
+    worker_advance(TEST_SECONDS(20));
+    CHECK(t.wakes == 0);
+    worker_task_cancel(&task);
+    CHECK(t.cancels == 1);
+
+    /* A cancelled task starts from the top when spawned again */
+    worker_spawn(&task);
+    worker_advance(0);
+    CHECK(t.starts == 2 && t.wakes == 1 && t.ready == KB_TASK_READ);
+    worker_advance(TEST_SECONDS(11));
+    CHECK(t.finished == 1 && t.cancels == 1 && !task.active);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+static void test_stop_cancels_unfinished_tasks(void) {
+    int fds[2];
+    CHECK(pipe(fds) == 0);
+    test_task_t waiting = {.fd = fds[0]};
+    test_task_t sleeping = {0};
+    test_task_t posted = {0};
+    kb_task_t wait_task, sleep_task, post_task;
+    worker_task_init(&wait_task, waiter, &waiting);
+    worker_task_on_cancel(&wait_task, count_cancel);
+    worker_task_init(&sleep_task, sleeper, &sleeping);
+    worker_task_on_cancel(&sleep_task, count_cancel);
+    worker_task_init(&post_task, sleeper, &posted);
+    worker_spawn(&wait_task);
+    worker_spawn(&sleep_task);
+    worker_advance(TEST_SECONDS(1) + TEST_TICK_NS);
+    worker_post(&post_task);
+
+    worker_stop();
+    CHECK(waiting.cancels == 1 && sleeping.cancels == 1);
+    CHECK(!wait_task.active && !sleep_task.active && !post_task.active);
+    CHECK(posted.starts == 0);
+
+    /* Everything can be spawned again once the worker is back */
+    CHECK(worker_start());
+    CHECK(write(fds[1], "x", 1) == 1);
+    worker_spawn(&wait_task);
+    worker_spawn(&sleep_task);
+    worker_post(&post_task);
+    worker_advance(TEST_SECONDS(15));
+    CHECK(waiting.starts == 2 && waiting.finished == 1);
+    CHECK(sleeping.starts == 2 && sleeping.finished == 1);
+    CHECK(posted.starts == 1 && posted.finished == 1);
+    CHECK(waiting.cancels == 1 && sleeping.cancels == 1);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+int main(void) {
+    init_kb_logger();
+    set_kb_log_level(KB_LOG_LEVEL_ERROR);
+    worker_use_virtual_clock(0);
+    CHECK(worker_start());
+
+    RUN_TEST(test_sleeps_resume_on_time);
+    RUN_TEST(test_timer_fires_once);
+    RUN_TEST(test_wait_fd_ready_and_timeout);
+    RUN_TEST(test_cancel_runs_cancel_function);
+    RUN_TEST(test_stop_cancels_unfinished_tasks);
+
+    worker_stop();
+    return TEST_RESULT();
+}
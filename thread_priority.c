@@ -0,0 +1,126 @@
+/**
+ * @file thread_priority.c
+ * @brief Implementation of tap thread scheduling priorities.
+ *
+ * The real-time policy asks for a small slice of CPU within a short
+ * constraint and stays preemptible, which is what the scheduler expects of
+ * short, bursty work such as an event tap callback. macOS has no hard CPU
+ * affinity, so the thread is not pinned to a core.
+ *
+ * Elsewhere (the portable tools) there is no QoS class, so "interactive"
+ * runs as "default", and the real-time policy falls back to SCHED_FIFO at
+ * its lowest priority, which usually needs privileges. Neither sets CPU
+ * affinity.
+ */
+
+#include "thread_priority.h"
+#include "logger.h"
+#include <string.h>
+#ifdef __APPLE__
+#include <mach/mach.h>
+#include <mach/mach_time.h>
+#include <mach/thread_policy.h>
+#include <pthread/qos.h>
+#else
+#include <sched.h>
+#endif
+
+#ifdef __APPLE__
+
+/** @brief CPU time the tap thread may need per wakeup, in nanoseconds. */
+#define REALTIME_COMPUTATION_NS 200000ULL
+
+/** @brief Deadline within which that CPU time must be granted, in nanoseconds. */
+#define REALTIME_CONSTRAINT_NS 1000000ULL
+
+/**
+ * @brief Converts nanoseconds to mach absolute time units.
+ */
+static uint32_t ns_to_abs(uint64_t ns) {
+    mach_timebase_info_data_t timebase;
+    mach_timebase_info(&timebase);
+    return (uint32_t)(ns * timebase.denom / timebase.numer);
+}
+
+/**
+ * @brief Prepares thread attributes for a new thread of the given priority.
+ */
+void thread_priority_init_attr(pthread_attr_t *attr, kb_thread_priority_t priority) {
+    if (priority != KB_THREAD_PRIORITY_DEFAULT) {
+        pthread_attr_set_qos_class_np(attr, QOS_CLASS_USER_INTERACTIVE, 0);
+    }
+}
+
+/**
+ * @brief Applies the parts of a priority that must be set from the thread itself.
+ */
+bool thread_priority_apply_self(kb_thread_priority_t priority) {
+    if (priority != KB_THREAD_PRIORITY_REALTIME) return true;
+
+    thread_time_constraint_policy_data_t policy;
+    policy.period = 0;
+    policy.computation = ns_to_abs(REALTIME_COMPUTATION_NS);
+    policy.constraint = ns_to_abs(REALTIME_CONSTRAINT_NS);
+    policy.preemptible = 1;
+
+    kern_return_t kr = thread_policy_set(pthread_mach_thread_np(pthread_self()), THREAD_TIME_CONSTRAINT_POLICY,
+                                         (thread_policy_t)&policy, THREAD_TIME_CONSTRAINT_POLICY_COUNT);
+    if (kr != KERN_SUCCESS) {
+        log_message(KB_LOG_LEVEL_ERROR, "Failed to set real-time policy on the tap thread (error %d).", kr);
+        return false;
+    }
+    return true;
+}
+
+#else
+/**
+ * @brief Prepares thread attributes for a new thread of the given priority.
+ */
+void thread_priority_init_attr(pthread_attr_t *attr, kb_thread_priority_t priority) {
+    (void)attr;
+    (void)priority;
+}
+
+/**
+ * @brief Applies the parts of a priority that must be set from the thread itself.
+ */
+bool thread_priority_apply_self(kb_thread_priority_t priority) {
+    if (priority != KB_THREAD_PRIORITY_REALTIME) return true;
+
+    struct sched_param param = {.sched_priority = sched_get_priority_min(SCHED_FIFO)};
+    int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (err != 0) {
+        log_message(KB_LOG_LEVEL_ERROR, "Failed to set real-time policy on the tap thread (error %d).", err);
+        return false;
+    }
+    return true;
+}
+#endif
+
+/**
+ * @brief Returns the settings name of a priority.
+ */
+const char *thread_priority_name(kb_thread_priority_t priority) {
+    switch (priority) {
+        case KB_THREAD_PRIORITY_INTERACTIVE: return "interactive";
+        case KB_THREAD_PRIORITY_REALTIME: return "realtime";
+        default: return "default";
+    }
+}
+
+/**
+ * @brief Parses a priority name as written in settings.conf.
+ */
+bool thread_priority_parse(const char *name, kb_thread_priority_t *priority) {
+    if (!name || !priority) return false;
+    if (strcmp(name, "default") == 0) {
+        *priority = KB_THREAD_PRIORITY_DEFAULT;
+    } else if (strcmp(name, "interactive") == 0) {
+        *priority = KB_THREAD_PRIORITY_INTERACTIVE;
+    } else if (strcmp(name, "realtime") == 0) {
+        *priority = KB_THREAD_PRIORITY_REALTIME;
+    } else {
+        return false;
+    }
+    return true;
+}
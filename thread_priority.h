@@ -0,0 +1,60 @@
+/**
+ * @file thread_priority.h
+ * @brief Scheduling priority for the event tap thread.
+ *
+ * Every keystroke waits for the tap callback, so under CPU load a
+ * default-priority tap thread adds input latency. The tap thread can run
+ * at the user-interactive QoS class or under a real-time (time constraint)
+ * policy instead.
+ */
+
+#ifndef THREAD_PRIORITY_H
+#define THREAD_PRIORITY_H
+
+#include <stdbool.h>
+#include <pthread.h>
+
+/**
+ * @brief Scheduling classes for the tap thread.
+ */
+typedef enum {
+    KB_THREAD_PRIORITY_DEFAULT = 0,     /**< Inherit the default scheduling of new threads */
+    KB_THREAD_PRIORITY_INTERACTIVE,     /**< User-interactive QoS class */
+    KB_THREAD_PRIORITY_REALTIME         /**< Mach time constraint policy */
+} kb_thread_priority_t;
+
+/**
+ * @brief Prepares thread attributes for a new thread of the given priority.
+ *
+ * @param attr Initialized thread attributes.
+ * @param priority Requested priority.
+ */
+void thread_priority_init_attr(pthread_attr_t *attr, kb_thread_priority_t priority);
+
+/**
+ * @brief Applies the parts of a priority that must be set from the thread
+ * itself. Call first thing on the new thread.
+ *
+ * @param priority Requested priority.
+ * @return False if the system refused the policy; the thread keeps running
+ * at its previous priority.
+ */
+bool thread_priority_apply_self(kb_thread_priority_t priority);
+
+/**
+ * @brief Returns the settings name of a priority.
+ *
+ * @return "default", "interactive" or "realtime".
+ */
+const char *thread_priority_name(kb_thread_priority_t priority);
+
+/**
+ * @brief Parses a priority name as written in settings.conf.
+ *
+ * @param name Priority name.
+ * @param priority Output for the parsed priority.
+ * @return True if the name was recognized.
+ */
+bool thread_priority_parse(const char *name, kb_thread_priority_t *priority);
+
+#endif
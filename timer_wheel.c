@@ -0,0 +1,210 @@
+/**
+ * @file timer_wheel.c
+ * @brief Implementation of the hierarchical timer wheel.
+ *
+ * A timer is linked at the highest level where its deadline and the current
+ * tick differ, in the slot given by the deadline's bits at that level. When
+ * the current tick reaches the start of a coarse slot, its timers cascade
+ * into finer levels; level 0 slots hold only timers due on that exact tick.
+ */
+
+#include "timer_wheel.h"
+#include <string.h>
+
+#define SLOT_MASK ((uint64_t)KB_TIMER_WHEEL_SLOTS - 1)
+#define LEVEL_SHIFT(level) ((level) * KB_TIMER_WHEEL_BITS)
+#define SPAN_BITS LEVEL_SHIFT(KB_TIMER_WHEEL_LEVELS)
+
+/**
+ * @brief Initializes a timer.
+ */
+void timer_init(kb_timer_t *timer, kb_timer_callback_t callback, void *arg) {
+    memset(timer, 0, sizeof(*timer));
+    timer->callback = callback;
+    timer->arg = arg;
+}
+
+/**
+ * @brief Initializes an empty wheel.
+ */
+void timer_wheel_init(kb_timer_wheel_t *wheel, uint64_t tick_ns, uint64_t now_ns) {
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->tick_ns = tick_ns ? tick_ns : 1;
+    wheel->current = now_ns / wheel->tick_ns;
+}
+
+/**
+ * @brief Returns the list head a timer is (or would be) linked into.
+ */
+static kb_timer_t **list_head(kb_timer_wheel_t *wheel, const kb_timer_t *timer) {
+    if (timer->level >= KB_TIMER_WHEEL_LEVELS) return &wheel->overflow;
+    return &wheel->slots[timer->level][timer->slot];
+}
+
+/**
+ * @brief Links a timer at the level and slot matching its deadline.
+ */
+static void link_timer(kb_timer_wheel_t *wheel, kb_timer_t *timer) {
+    uint64_t diff = timer->deadline ^ wheel->current;
+    unsigned int level = 0;
+    while (level < KB_TIMER_WHEEL_LEVELS && (diff >> LEVEL_SHIFT(level + 1)) != 0) level++;
+
+    timer->level = (unsigned char)level;
+    timer->slot = 0;
+    if (level < KB_TIMER_WHEEL_LEVELS) {
+        timer->slot = (unsigned char)((timer->deadline >> LEVEL_SHIFT(level)) & SLOT_MASK);
+        wheel->occupied[level] |= 1ULL << timer->slot;
+    }
+
+    kb_timer_t **head = list_head(wheel, timer);
+    timer->prev = NULL;
+    timer->next = *head;
+    if (*head) (*head)->prev = timer;
+    *head = timer;
+}
+
+/**
+ * @brief Unlinks a timer from its slot, keeping the occupancy bitmap exact.
+ */
+static void unlink_timer(kb_timer_wheel_t *wheel, kb_timer_t *timer) {
+    kb_timer_t **head = list_head(wheel, timer);
+    if (timer->prev) {
+        timer->prev->next = timer->next;
+    } else {
+        *head = timer->next;
+    }
+    if (timer->next) timer->next->prev = timer->prev;
+    timer->next = timer->prev = NULL;
+
+    if (!*head && timer->level < KB_TIMER_WHEEL_LEVELS) {
+        wheel->occupied[timer->level] &= ~(1ULL << timer->slot);
+    }
+}
+
+/**
+ * @brief Arms (or re-arms) a timer to expire at an absolute time.
+ */
+void timer_wheel_arm(kb_timer_wheel_t *wheel, kb_timer_t *timer, uint64_t deadline_ns) {
+    if (timer->armed) {
+        unlink_timer(wheel, timer);
+    } else {
+        timer->armed = true;
+        wheel->armed++;
+    }
+
+    /* Round up so a timer never fires before its deadline */
+    uint64_t tick = (deadline_ns + wheel->tick_ns - 1) / wheel->tick_ns;
+    if (tick <= wheel->current) tick = wheel->current + 1;
+    timer->deadline = tick;
+    link_timer(wheel, timer);
+}
+
+/**
+ * @brief Disarms a timer. Does nothing if the timer is not armed.
+ */
+void timer_wheel_cancel(kb_timer_wheel_t *wheel, kb_timer_t *timer) {
+    if (!timer->armed) return;
+    unlink_timer(wheel, timer);
+    timer->armed = false;
+    wheel->armed--;
+}
+
+/**
+ * @brief Disarms every timer without firing it.
+ */
+void timer_wheel_clear(kb_timer_wheel_t *wheel) {
+    for (int level = 0; level < KB_TIMER_WHEEL_LEVELS; level++) {
+        for (int slot = 0; slot < KB_TIMER_WHEEL_SLOTS; slot++) {
+            while (wheel->slots[level][slot]) timer_wheel_cancel(wheel, wheel->slots[level][slot]);
+        }
+    }
+    while (wheel->overflow) timer_wheel_cancel(wheel, wheel->overflow);
+}
+
+/**
+ * @brief Returns the next tick at which a slot becomes due.
+ *
+ * Only slots after the current one can be occupied at each level, and a
+ * finer level's next slot always precedes a coarser one's.
+ */
+static bool next_event_tick(const kb_timer_wheel_t *wheel, uint64_t *tick) {
+    if (wheel->armed == 0) return false;
+
+    for (int level = 0; level < KB_TIMER_WHEEL_LEVELS; level++) {
+        uint64_t index = (wheel->current >> LEVEL_SHIFT(level)) & SLOT_MASK;
+        uint64_t later = index == SLOT_MASK ? 0 : wheel->occupied[level] & (~0ULL << (index + 1));
+        if (later) {
+            uint64_t base = (wheel->current >> LEVEL_SHIFT(level + 1)) << LEVEL_SHIFT(level + 1);
+            *tick = base | ((uint64_t)__builtin_ctzll(later) << LEVEL_SHIFT(level));
+            return true;
+        }
+    }
+
+    /* Only overflow timers remain: they are re-examined when the top level wraps */
+    *tick = ((wheel->current >> SPAN_BITS) + 1) << SPAN_BITS;
+    return true;
+}
+
+/**
+ * @brief Moves every timer of a list back into the wheel relative to the
+ * current tick.
+ */
+static void relink_list(kb_timer_wheel_t *wheel, kb_timer_t **head) {
+    kb_timer_t *timer = *head;
+    *head = NULL;
+    while (timer) {
+        kb_timer_t *next = timer->next;
+        link_timer(wheel, timer);
+        timer = next;
+    }
+}
+
+/**
+ * @brief Advances the wheel to the given time, firing every expired timer.
+ *
+ * The wheel jumps straight from one occupied slot to the next, so advancing
+ * a virtual clock by hours costs no more than the timers it touches.
+ */
+size_t timer_wheel_advance(kb_timer_wheel_t *wheel, uint64_t now_ns) {
+    uint64_t target = now_ns / wheel->tick_ns;
+    size_t fired = 0;
+
+    while (wheel->current < target) {
+        uint64_t next;
+        if (!next_event_tick(wheel, &next) || next > target) {
+            wheel->current = target;
+            break;
+        }
+        wheel->current = next;
+
+        if ((next & ((1ULL << SPAN_BITS) - 1)) == 0) {
+            relink_list(wheel, &wheel->overflow);
+        }
+        for (int level = KB_TIMER_WHEEL_LEVELS - 1; level > 0; level--) {
+            if ((next & ((1ULL << LEVEL_SHIFT(level)) - 1)) != 0) continue;
+            unsigned int slot = (unsigned int)((next >> LEVEL_SHIFT(level)) & SLOT_MASK);
+            wheel->occupied[level] &= ~(1ULL << slot);
+            relink_list(wheel, &wheel->slots[level][slot]);
+        }
+
+        /* Callbacks may arm timers; those always land on a later tick */
+        kb_timer_t **due = &wheel->slots[0][next & SLOT_MASK];
+        while (*due) {
+            kb_timer_t *timer = *due;
+            timer_wheel_cancel(wheel, timer);
+            timer->callback(timer, timer->arg);
+            fired++;
+        }
+    }
+    return fired;
+}
+
+/**
+ * @brief Returns when the wheel next needs to be advanced.
+ */
+bool timer_wheel_next_deadline(const kb_timer_wheel_t *wheel, uint64_t *deadline_ns) {
+    uint64_t tick;
+    if (!next_event_tick(wheel, &tick)) return false;
+    *deadline_ns = tick * wheel->tick_ns;
+    return true;
+}
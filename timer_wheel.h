@@ -0,0 +1,134 @@
+/**
+ * @file timer_wheel.h
+ * @brief Hierarchical timer wheel driven by an explicit clock.
+ *
+ * The wheel never reads a clock itself: callers pass the current time in
+ * nanoseconds to every operation. The worker thread drives it from the
+ * monotonic clock, while a virtual clock can advance hours of schedule in
+ * a single call.
+ *
+ * Timers live in one of KB_TIMER_WHEEL_LEVELS levels of
+ * KB_TIMER_WHEEL_SLOTS slots each; every level is 64 times coarser than
+ * the one below. Arming, cancelling and expiring a timer are O(1), and
+ * per-level occupancy bitmaps find the next due slot without scanning.
+ */
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief Bits of the tick counter covered by one level. */
+#define KB_TIMER_WHEEL_BITS 6
+
+/** @brief Number of slots per level. */
+#define KB_TIMER_WHEEL_SLOTS (1 << KB_TIMER_WHEEL_BITS)
+
+/**
+ * @brief Number of levels.
+ *
+ * With a 10 ms tick the top level spans about 124 days; timers further out
+ * wait on an overflow list.
+ */
+#define KB_TIMER_WHEEL_LEVELS 5
+
+struct kb_timer;
+
+/**
+ * @brief Callback invoked when a timer expires.
+ *
+ * @param timer The expired timer (already disarmed; may be re-armed).
+ * @param arg User argument given to timer_init().
+ */
+typedef void (*kb_timer_callback_t)(struct kb_timer *timer, void *arg);
+
+/**
+ * @brief Intrusive timer node. Owned by the caller, never allocated by the wheel.
+ */
+typedef struct kb_timer {
+    struct kb_timer *next;          /**< Next timer in the slot */
+    struct kb_timer *prev;          /**< Previous timer in the slot */
+    uint64_t deadline;              /**< Expiry, in wheel ticks */
+    kb_timer_callback_t callback;   /**< Expiry callback */
+    void *arg;                      /**< Callback argument */
+    unsigned char level;            /**< Level holding the timer (KB_TIMER_WHEEL_LEVELS for overflow) */
+    unsigned char slot;             /**< Slot holding the timer within its level */
+    bool armed;                     /**< Whether the timer is linked into the wheel */
+} kb_timer_t;
+
+/**
+ * @brief Wheel state.
+ */
+typedef struct {
+    uint64_t tick_ns;                                           /**< Duration of one tick */
+    uint64_t current;                                           /**< Last processed tick */
+    size_t armed;                                               /**< Number of armed timers */
+    uint64_t occupied[KB_TIMER_WHEEL_LEVELS];                   /**< Non-empty slot bitmap per level */
+    kb_timer_t *slots[KB_TIMER_WHEEL_LEVELS][KB_TIMER_WHEEL_SLOTS]; /**< Slot lists */
+    kb_timer_t *overflow;                                       /**< Timers beyond the top level */
+} kb_timer_wheel_t;
+
+/**
+ * @brief Initializes a timer.
+ *
+ * @param timer Timer to initialize.
+ * @param callback Expiry callback.
+ * @param arg Callback argument.
+ */
+void timer_init(kb_timer_t *timer, kb_timer_callback_t callback, void *arg);
+
+/**
+ * @brief Initializes an empty wheel.
+ *
+ * @param wheel Wheel to initialize.
+ * @param tick_ns Resolution of the wheel in nanoseconds.
+ * @param now_ns Current time in nanoseconds.
+ */
+void timer_wheel_init(kb_timer_wheel_t *wheel, uint64_t tick_ns, uint64_t now_ns);
+
+/**
+ * @brief Arms (or re-arms) a timer to expire at an absolute time.
+ *
+ * Deadlines in the past expire on the next advance.
+ *
+ * @param wheel Wheel to arm the timer in.
+ * @param timer Timer to arm.
+ * @param deadline_ns Absolute expiry time in nanoseconds.
+ */
+void timer_wheel_arm(kb_timer_wheel_t *wheel, kb_timer_t *timer, uint64_t deadline_ns);
+
+/**
+ * @brief Disarms a timer. Does nothing if the timer is not armed.
+ */
+void timer_wheel_cancel(kb_timer_wheel_t *wheel, kb_timer_t *timer);
+
+/**
+ * @brief Disarms every timer without firing it.
+ */
+void timer_wheel_clear(kb_timer_wheel_t *wheel);
+
+/**
+ * @brief Advances the wheel to the given time, firing every expired timer.
+ *
+ * @param wheel Wheel to advance.
+ * @param now_ns Current time in nanoseconds.
+ * @return Number of timers fired.
+ */
+size_t timer_wheel_advance(kb_timer_wheel_t *wheel, uint64_t now_ns);
+
+/**
+ * @brief Returns when the wheel next needs to be advanced.
+ *
+ * This is the earliest deadline when it lies on the finest level, and
+ * otherwise the point at which the coarser slot holding it cascades down,
+ * which is never later than the deadline itself.
+ *
+ * @param wheel Wheel to inspect.
+ * @param deadline_ns Output for the time in nanoseconds.
+ * @return False if no timer is armed.
+ */
+bool timer_wheel_next_deadline(const kb_timer_wheel_t *wheel, uint64_t *deadline_ns);
+
+#endif
@@ -0,0 +1,146 @@
+/**
+ * @file trace.c
+ * @brief Implementation of the cross-thread span recorder.
+ */
+
+#include "trace.h"
+#include <stdatomic.h>
+#include <time.h>
+
+/**
+ * @brief One recorded span.
+ */
+typedef struct {
+    const char *name;       /**< Static span name */
+    uint64_t id;            /**< Correlation id */
+    uint64_t start_ns;      /**< Start time */
+    uint64_t end_ns;        /**< End time */
+    uint32_t tid;           /**< Small per-thread number */
+} trace_span_t;
+
+/**
+ * @brief A ring slot. The name is published last, so a slot with a name has
+ * its other fields written.
+ */
+typedef struct {
+    _Atomic(const char *) name; /**< Static span name, NULL while unused */
+    uint64_t id;                /**< Correlation id */
+    uint64_t start_ns;          /**< Start time */
+    uint64_t end_ns;            /**< End time */
+    uint32_t tid;               /**< Small per-thread number */
+} trace_slot_t;
+
+/** @brief Span ring shared by every thread. */
+static trace_slot_t g_spans[KB_TRACE_SPANS];
+/** @brief Spans recorded so far; the next slot is g_head % KB_TRACE_SPANS. */
+static atomic_uint_fast64_t g_head;
+/** @brief Last correlation id handed out. */
+static atomic_uint_fast64_t g_last_id;
+/** @brief Last thread number handed out. */
+static atomic_uint g_last_tid;
+/** @brief Correlation id of the toggle running on this thread. */
+static _Thread_local uint64_t t_current;
+/** @brief Thread number of this thread, 0 until its first span. */
+static _Thread_local uint32_t t_tid;
+
+/**
+ * @brief Returns the trace clock in nanoseconds.
+ */
+uint64_t trace_now_ns(void) {
+#ifdef __APPLE__
+    return clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Returns a new correlation id.
+ */
+uint64_t trace_new_id(void) {
+    return atomic_fetch_add_explicit(&g_last_id, 1, memory_order_relaxed) + 1;
+}
+
+/**
+ * @brief Returns the correlation id of the toggle running on this thread.
+ */
+uint64_t trace_current(void) {
+    return t_current;
+}
+
+/**
+ * @brief Sets the correlation id of the toggle running on this thread.
+ */
+void trace_set_current(uint64_t id) {
+    t_current = id;
+}
+
+/**
+ * @brief Records a finished span on the calling thread.
+ */
+void trace_record(const char *name, uint64_t id, uint64_t start_ns, uint64_t end_ns) {
+    if (!t_tid) t_tid = atomic_fetch_add_explicit(&g_last_tid, 1, memory_order_relaxed) + 1;
+    uint64_t index = atomic_fetch_add_explicit(&g_head, 1, memory_order_relaxed);
+    trace_slot_t *slot = &g_spans[index & (KB_TRACE_SPANS - 1)];
+    slot->id = id;
+    slot->start_ns = start_ns;
+    slot->end_ns = end_ns > start_ns ? end_ns : start_ns;
+    slot->tid = t_tid;
+    atomic_store_explicit(&slot->name, name, memory_order_release);
+}
+
+/**
+ * @brief Returns the flow phase of a span: "s" for the first span of its
+ * correlation id, "f" for the last, "t" in between, or NULL when the id
+ * has a single span.
+ */
+static const char *flow_phase(const trace_span_t *spans, size_t count, size_t index) {
+    const trace_span_t *span = &spans[index];
+    bool earlier = false, later = false;
+    for (size_t i = 0; i < count; i++) {
+        if (i == index || spans[i].id != span->id) continue;
+        if (spans[i].start_ns < span->start_ns || (spans[i].start_ns == span->start_ns && i < index)) {
+            earlier = true;
+        } else {
+            later = true;
+        }
+    }
+    if (!earlier && !later) return NULL;
+    return !earlier ? "s" : (!later ? "f" : "t");
+}
+
+/**
+ * @brief Writes the recorded spans as a Chrome trace JSON document.
+ */
+void trace_export(FILE *out) {
+    trace_span_t spans[KB_TRACE_SPANS];
+    uint64_t head = atomic_load_explicit(&g_head, memory_order_acquire);
+    uint64_t first = head > KB_TRACE_SPANS ? head - KB_TRACE_SPANS : 0;
+    size_t count = 0;
+    for (uint64_t i = first; i < head; i++) {
+        trace_slot_t *slot = &g_spans[i & (KB_TRACE_SPANS - 1)];
+        const char *name = atomic_load_explicit(&slot->name, memory_order_acquire);
+        if (!name) continue;
+        spans[count++] = (trace_span_t){name, slot->id, slot->start_ns, slot->end_ns, slot->tid};
+    }
+
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    const char *sep = "\n";
+    for (size_t i = 0; i < count; i++) {
+        const trace_span_t *s = &spans[i];
+        double ts = (double)s->start_ns / 1000.0;
+        fprintf(out, "%s{\"name\":\"%s\",\"cat\":\"toggle\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                     "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"id\":%llu}}",
+                sep, s->name, s->tid, ts, (double)(s->end_ns - s->start_ns) / 1000.0, (unsigned long long)s->id);
+        sep = ",\n";
+        const char *phase = s->id ? flow_phase(spans, count, i) : NULL;
+        if (phase) {
+            fprintf(out, ",\n{\"name\":\"toggle\",\"cat\":\"toggle\",\"ph\":\"%s\",%s\"id\":%llu,\"pid\":1,"
+                         "\"tid\":%u,\"ts\":%.3f}",
+                    phase, phase[0] == 's' ? "" : "\"bp\":\"e\",", (unsigned long long)s->id, s->tid, ts);
+        }
+    }
+    fprintf(out, "\n]}\n");
+}
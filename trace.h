@@ -0,0 +1,99 @@
+/**
+ * @file trace.h
+ * @brief Cross-thread trace spans for blocking state changes.
+ *
+ * A toggle starts on one thread (the tap thread for the emergency shortcut,
+ * the main thread for the tray switch, the worker for timers) and finishes
+ * on others (settings write, owner callback, UI update). Every span of one
+ * toggle carries the same correlation id, so the whole path shows up as one
+ * flow when exported in Chrome trace format (chrome://tracing, Perfetto).
+ *
+ * Spans go into a fixed process-wide ring; recording never allocates or
+ * locks. Only state changes are traced, never individual keystrokes.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** @brief Number of spans kept (power of two). */
+#define KB_TRACE_SPANS 1024
+
+/** @brief Trace export file name inside Application Support. */
+#define KB_TRACE_FILE "trace.json"
+
+/**
+ * @brief A span being measured.
+ */
+typedef struct {
+    const char *name;       /**< Static span name */
+    uint64_t id;            /**< Correlation id, 0 for none */
+    uint64_t start_ns;      /**< Start time from trace_now_ns */
+} kb_trace_span_t;
+
+/**
+ * @brief Returns the trace clock in nanoseconds.
+ *
+ * On macOS this is the clock of CGEvent timestamps, so an event's own
+ * timestamp can start a span.
+ */
+uint64_t trace_now_ns(void);
+
+/**
+ * @brief Returns a new correlation id (never 0).
+ */
+uint64_t trace_new_id(void);
+
+/**
+ * @brief Returns the correlation id of the toggle running on this thread,
+ * or 0 if none.
+ */
+uint64_t trace_current(void);
+
+/**
+ * @brief Sets the correlation id of the toggle running on this thread.
+ *
+ * @param id Correlation id, or 0 once the thread is done with the toggle.
+ */
+void trace_set_current(uint64_t id);
+
+/**
+ * @brief Records a finished span on the calling thread.
+ *
+ * @param name Static span name.
+ * @param id Correlation id.
+ * @param start_ns Start time.
+ * @param end_ns End time.
+ */
+void trace_record(const char *name, uint64_t id, uint64_t start_ns, uint64_t end_ns);
+
+/**
+ * @brief Starts a span under the current correlation id.
+ */
+static inline void trace_begin(kb_trace_span_t *span, const char *name) {
+    span->name = name;
+    span->id = trace_current();
+    span->start_ns = trace_now_ns();
+}
+
+/**
+ * @brief Ends a span started with trace_begin and records it.
+ */
+static inline void trace_end(const kb_trace_span_t *span) {
+    trace_record(span->name, span->id, span->start_ns, trace_now_ns());
+}
+
+/**
+ * @brief Writes the recorded spans as a Chrome trace JSON document.
+ *
+ * Spans sharing a correlation id are linked by flow events. Spans recorded
+ * while exporting may be missed or torn.
+ *
+ * @param out Output stream.
+ */
+void trace_export(FILE *out);
+
+#endif
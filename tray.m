@@ -13,6 +13,7 @@
 #include "tray.h"
 #include "keyboard.h"
 #include "logger.h"
+#include "trace.h"
 #include "version.h"
 
 /**
@@ -31,6 +32,13 @@
  */
 - (void)switchAction:(id)sender;
 
+/**
+ * @brief Action invoked when a "Block For" duration is selected.
+ *
+ * @param sender The NSMenuItem whose tag holds the duration in minutes.
+ */
+- (void)blockForAction:(id)sender;
+
 /**
  * @brief Action invoked when the shortcut-enable switch is toggled.
  *
@@ -47,6 +55,34 @@
  */
 - (void)recordShortcutAction:(id)sender;
 
+/**
+ * @brief Action invoked when "Re-enable Disabled Keys" is selected.
+ *
+ * Releases every key quarantined as stuck or chattering.
+ *
+ * @param sender The menu item that triggered the action.
+ */
+- (void)clearQuarantineAction:(id)sender;
+
+/**
+ * @brief Action invoked when "Reload Settings" is selected.
+ *
+ * Restarts keyboard capture with the settings currently in settings.conf.
+ *
+ * @param sender The menu item that triggered the action.
+ */
+- (void)reloadSettingsAction:(id)sender;
+
+/**
+ * @brief Action invoked when "Save Diagnostics" is selected.
+ *
+ * Writes the flight recorder (recent events, verdicts and blocking changes)
+ * and the blocking toggle traces to Application Support.
+ *
+ * @param sender The menu item that triggered the action.
+ */
+- (void)saveDiagnosticsAction:(id)sender;
+
 /**
  * @brief Action invoked when the Quit menu item is selected.
  *
@@ -64,10 +100,29 @@
 - (void)updateShortcutButton;
 
 /**
- * @brief Performs an asynchronous update check and updates the UI.
+ * @brief Handles NSWorkspace application activation notifications.
+ *
+ * Forwards the bundle identifier of the newly frontmost application to the
+ * keyboard subsystem so the per-application policy is resolved off the
+ * event tap.
+ *
+ * @param notification The activation notification.
+ */
+- (void)applicationActivated:(NSNotification *)notification;
+
+/**
+ * @brief Starts an asynchronous update check on the worker.
  */
 - (void)checkForUpdates;
 
+/**
+ * @brief Shows the outcome of an update check. Main thread only.
+ *
+ * @param status Outcome of the check.
+ * @param remote Remote version, or nil if it could not be read.
+ */
+- (void)showUpdateStatus:(enum UPDATE_STATUS)status remote:(NSString *)remote;
+
 /**
  * @brief Opens the GitHub repository URL in the default browser.
  */
@@ -126,6 +181,25 @@ void recorded_shortcut_callback(unsigned long long flags, unsigned short keyCode
     }
 }
 
+/**
+ * @brief Callback invoked by the keyboard subsystem when a key is found
+ * stuck or chattering and has been blocked.
+ *
+ * This runs on the background worker thread, so the alert is shown
+ * asynchronously on the main thread.
+ *
+ * @param keyCode The hardware key code of the quarantined key.
+ */
+void quarantined_key_callback(unsigned short keyCode) {
+    dispatch_async(dispatch_get_main_queue(), ^{
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer),
+                 "Key code %hu keeps repeating or chattering and has been blocked.\n\n"
+                 "Use \"Re-enable Disabled Keys\" in the menu once the keyboard is fixed.", keyCode);
+        show_error_alert("Key Disabled", buffer);
+    });
+}
+
 /**
  * @brief Switch UI element that reflects/controls the keyboard blocking state.
  *
@@ -150,6 +224,32 @@ static NSButton *recordButton;
  */
 static NSMenuItem *versionMenuItem;
 
+/**
+ * @brief Dispatch source that saves diagnostics on SIGUSR1.
+ */
+static dispatch_source_t diagnosticsSignal;
+
+/**
+ * @brief State of the update check started at launch.
+ */
+static kb_update_check_t updateCheck;
+
+/**
+ * @brief Hands the outcome of the update check to the main thread. Runs on
+ * the worker thread.
+ *
+ * @param status Outcome of the check.
+ * @param remote_version Remote version, empty if it could not be read.
+ * @param arg The StatusBarDelegate that started the check.
+ */
+static void update_check_done(enum UPDATE_STATUS status, const char *remote_version, void *arg) {
+    StatusBarDelegate *delegate = (__bridge StatusBarDelegate *)arg;
+    NSString *remote = remote_version[0] ? [NSString stringWithUTF8String:remote_version] : nil;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        [delegate showUpdateStatus:status remote:remote];
+    });
+}
+
 /**
  * @brief Implementation of StatusBarDelegate.
  */
@@ -159,8 +259,25 @@ static NSMenuItem *versionMenuItem;
     if ([sender isKindOfClass:[NSSwitch class]]) {
         NSSwitch *sw = (NSSwitch *)sender;
         bool newState = (sw.state == NSControlStateValueOn);
+        kb_trace_span_t span;
+        trace_set_current(trace_new_id());
+        trace_begin(&span, "switchAction");
         enableKeyboardBlock(newState);
         update_tray_state(newState);
+        trace_end(&span);
+        trace_set_current(0);
+    }
+}
+
+- (void)blockForAction:(id)sender {
+    if ([sender isKindOfClass:[NSMenuItem class]]) {
+        kb_trace_span_t span;
+        trace_set_current(trace_new_id());
+        trace_begin(&span, "blockForAction");
+        enableKeyboardBlockFor((unsigned int)[(NSMenuItem *)sender tag]);
+        update_tray_state(true);
+        trace_end(&span);
+        trace_set_current(0);
     }
 }
 
@@ -247,37 +364,64 @@ static NSMenuItem *versionMenuItem;
     startRecording();
 }
 
+- (void)applicationActivated:(NSNotification *)notification {
+    NSRunningApplication *app = notification.userInfo[NSWorkspaceApplicationKey];
+    setFrontmostApplication([app.bundleIdentifier UTF8String]);
+}
+
+- (void)clearQuarantineAction:(id)sender {
+    clearQuarantinedKeys();
+}
+
+- (void)reloadSettingsAction:(id)sender {
+    kb_result_t result = restartKeyboardEventTap();
+    if (result != KB_SUCCESS) {
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer), "Failed to restart keyboard capture (Error code: %d).", result);
+        show_error_alert("Reload Failed", buffer);
+        return;
+    }
+    setFrontmostApplication([[[NSWorkspace sharedWorkspace] frontmostApplication].bundleIdentifier UTF8String]);
+    [blockingSwitch setState:isKeyboardBlockEnabled() ? NSControlStateValueOn : NSControlStateValueOff];
+    [shortcutSwitch setState:isShortcutEnabled() ? NSControlStateValueOn : NSControlStateValueOff];
+    [self updateShortcutButton];
+}
+
+- (void)saveDiagnosticsAction:(id)sender {
+    bool recorderSaved = dumpFlightRecorder();
+    bool traceSaved = dumpTrace();
+    if (!recorderSaved || !traceSaved) {
+        show_error_alert("Save Failed", "Could not write the diagnostics. See the log for details.");
+    }
+}
+
 - (void)quitAction:(id)sender {
     [NSApp terminate:nil];
 }
 
 - (void)checkForUpdates {
     log_message(KB_LOG_LEVEL_INFO, "Checking for updates...");
-    
-    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-        enum UPDATE_STATUS status = is_update_available();
-        
-        dispatch_async(dispatch_get_main_queue(), ^{
-            if (!versionMenuItem) return;
-            
-            if (status == UPDATE_STATUS_OUTDATED) {
-                const char *remote = get_remote_version();
-                NSString *title = [NSString stringWithFormat:@"Update Available (%s)", remote ? remote : "New Version"];
-                [versionMenuItem setTitle:title];
-                [versionMenuItem setAction:@selector(openVersionLink:)];
-                [versionMenuItem setTarget:self];
-                
-                log_message(KB_LOG_LEVEL_INFO, "Update found: %s", remote);
-                show_error_alert("Update Available", [[NSString stringWithFormat:@"A new version (%s) of KeyBlocker is available at GitHub.", remote ? remote : "New Version"] UTF8String]);
-            } else if (status == UPDATE_STATUS_ERROR) {
-                [versionMenuItem setTitle:[NSString stringWithFormat:@"(Check Fail) Version %s", KB_VERSION]];
-                log_message(KB_LOG_LEVEL_ERROR, "Update check failed.");
-                show_error_alert("Update Check Failed", "Unable to contact the update server. Please check your internet connection.");
-            } else {
-                [versionMenuItem setTitle:[NSString stringWithFormat:@"Version %s (Latest)", KB_VERSION]];
-            }
-        });
-    });
+    update_check_start(&updateCheck, update_check_done, (__bridge void *)self);
+}
+
+- (void)showUpdateStatus:(enum UPDATE_STATUS)status remote:(NSString *)remote {
+    if (!versionMenuItem) return;
+
+    if (status == UPDATE_STATUS_OUTDATED) {
+        NSString *version = remote ? remote : @"New Version";
+        [versionMenuItem setTitle:[NSString stringWithFormat:@"Update Available (%@)", version]];
+        [versionMenuItem setAction:@selector(openVersionLink:)];
+        [versionMenuItem setTarget:self];
+
+        log_message(KB_LOG_LEVEL_INFO, "Update found: %s", [version UTF8String]);
+        show_error_alert("Update Available", [[NSString stringWithFormat:@"A new version (%@) of KeyBlocker is available at GitHub.", version] UTF8String]);
+    } else if (status == UPDATE_STATUS_ERROR) {
+        [versionMenuItem setTitle:[NSString stringWithFormat:@"(Check Fail) Version %s", KB_VERSION]];
+        log_message(KB_LOG_LEVEL_ERROR, "Update check failed.");
+        show_error_alert("Update Check Failed", "Unable to contact the update server. Please check your internet connection.");
+    } else {
+        [versionMenuItem setTitle:[NSString stringWithFormat:@"Version %s (Latest)", KB_VERSION]];
+    }
 }
 
 - (void)openVersionLink:(id)sender {
@@ -293,6 +437,7 @@ static NSMenuItem *versionMenuItem;
 
     /* Register the callback that will be invoked when a shortcut is recorded. */
     setRecordingCallback(recorded_shortcut_callback);
+    setKeyQuarantineCallback(quarantined_key_callback);
 
     /* Initialize the keyboard event tap used to block or monitor keys. */
     kb_result_t result = setupKeyboardEventTap();
@@ -309,6 +454,23 @@ static NSMenuItem *versionMenuItem;
         return;
     }
 
+    /* Track the frontmost application for the per-application policy. */
+    NSWorkspace *workspace = [NSWorkspace sharedWorkspace];
+    setFrontmostApplication([[workspace frontmostApplication].bundleIdentifier UTF8String]);
+    [[workspace notificationCenter] addObserver:trayDelegate
+                                       selector:@selector(applicationActivated:)
+                                           name:NSWorkspaceDidActivateApplicationNotification
+                                         object:nil];
+
+    /* "kill -USR1 <pid>" saves diagnostics without opening the menu. */
+    signal(SIGUSR1, SIG_IGN);
+    diagnosticsSignal = dispatch_source_create(DISPATCH_SOURCE_TYPE_SIGNAL, SIGUSR1, 0, dispatch_get_main_queue());
+    dispatch_source_set_event_handler(diagnosticsSignal, ^{
+        dumpFlightRecorder();
+        dumpTrace();
+    });
+    dispatch_resume(diagnosticsSignal);
+
     /* Create and configure the status bar item and its icon. */
     statusItem = [[NSStatusBar systemStatusBar] statusItemWithLength:NSVariableStatusItemLength];    
     NSImage *image = [NSImage imageNamed:@"tray"];
@@ -349,6 +511,19 @@ static NSMenuItem *versionMenuItem;
     
     [switchItem setView:customView];
     [menu addItem:switchItem];
+
+    NSMenuItem *timedItem = [[NSMenuItem alloc] initWithTitle:@"Block For" action:nil keyEquivalent:@""];
+    NSMenu *timedMenu = [[NSMenu alloc] init];
+    for (NSNumber *minutes in @[@5, @15, @30, @60]) {
+        NSMenuItem *item = [[NSMenuItem alloc] initWithTitle:[NSString stringWithFormat:@"%@ Minutes", minutes]
+                                                      action:@selector(blockForAction:)
+                                               keyEquivalent:@""];
+        [item setTag:minutes.integerValue];
+        [item setTarget:trayDelegate];
+        [timedMenu addItem:item];
+    }
+    [timedItem setSubmenu:timedMenu];
+    [menu addItem:timedItem];
     
     [menu addItem:[NSMenuItem separatorItem]];
     
@@ -388,6 +563,24 @@ static NSMenuItem *versionMenuItem;
     [recordItem setView:recordView];
     [recordItem setEnabled:YES];
     [menu addItem:recordItem];
+
+    NSMenuItem *clearQuarantineItem = [[NSMenuItem alloc] initWithTitle:@"Re-enable Disabled Keys"
+                                                                 action:@selector(clearQuarantineAction:)
+                                                          keyEquivalent:@""];
+    [clearQuarantineItem setTarget:trayDelegate];
+    [menu addItem:clearQuarantineItem];
+
+    NSMenuItem *reloadItem = [[NSMenuItem alloc] initWithTitle:@"Reload Settings"
+                                                        action:@selector(reloadSettingsAction:)
+                                                 keyEquivalent:@""];
+    [reloadItem setTarget:trayDelegate];
+    [menu addItem:reloadItem];
+
+    NSMenuItem *diagnosticsItem = [[NSMenuItem alloc] initWithTitle:@"Save Diagnostics"
+                                                             action:@selector(saveDiagnosticsAction:)
+                                                      keyEquivalent:@""];
+    [diagnosticsItem setTarget:trayDelegate];
+    [menu addItem:diagnosticsItem];
     
     [menu addItem:[NSMenuItem separatorItem]];
 
@@ -439,7 +632,8 @@ void setup_tray_icon() {
  * @brief Updates the menu item UI to reflect the current blocking state.
  *
  * This function schedules a main-queue update so it can be safely called
- * from any thread.
+ * from any thread. The time spent queued and the update itself are traced
+ * under the caller's correlation id.
  *
  * @param active true if keyboard blocking is currently enabled; false
  * otherwise.
@@ -447,10 +641,18 @@ void setup_tray_icon() {
 void update_tray_state(bool active) {
     if (!statusItem) return;
 
+    uint64_t traceId = trace_current();
+    uint64_t queued = trace_now_ns();
     dispatch_async(dispatch_get_main_queue(), ^{
+        kb_trace_span_t span;
+        trace_record("ui_queued", traceId, queued, trace_now_ns());
+        trace_set_current(traceId);
+        trace_begin(&span, "update_tray_state");
         if (blockingSwitch) {
             blockingSwitch.state = active ? NSControlStateValueOn : NSControlStateValueOff;
         }
+        trace_end(&span);
+        trace_set_current(0);
     });
 }
 
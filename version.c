@@ -3,9 +3,14 @@
  * @brief Handles software versioning and update checks for KeyBlocker.
  */
 #include "version.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 /**
  * @brief Current software version.
@@ -17,6 +22,16 @@ const char *KB_VERSION = "1.2";
  */
 #define REMOTE_VERSION_URL "https://raw.githubusercontent.com/malvads/KeyBlocker/main/version.c"
 
+/**
+ * @brief Command that fetches the remote version line.
+ */
+#define REMOTE_VERSION_COMMAND "curl -s --max-time 20 " REMOTE_VERSION_URL " | grep KB_VERSION"
+
+/**
+ * @brief How long an asynchronous check waits for output before giving up.
+ */
+#define KB_UPDATE_CHECK_TIMEOUT_NS 30000000000ULL
+
 /**
  * @brief Get the current software version.
  *
@@ -35,8 +50,8 @@ const char *get_version() {
  * @return A string containing the remote version, or NULL if an error occurs.
  */
 const char *get_remote_version() {
-    static char version[64];
-    FILE *fp = popen("curl -s " REMOTE_VERSION_URL " | grep KB_VERSION", "r");
+    static char version[KB_UPDATE_VERSION_MAX];
+    FILE *fp = popen(REMOTE_VERSION_COMMAND, "r");
     if (!fp) return NULL;
 
     if (fgets(version, sizeof(version), fp)) {
@@ -102,3 +117,129 @@ enum UPDATE_STATUS is_update_available() {
     int cmp = compare_versions(remote_version, KB_VERSION);
     return (cmp > 0) ? UPDATE_STATUS_OUTDATED : UPDATE_STATUS_CORRECT;
 }
+
+/**
+ * @brief Extracts the quoted version from the first line of fetched output.
+ *
+ * @return true if a version was found.
+ */
+static bool parse_remote_version(const char *output, char *version, size_t size) {
+    const char *start = strchr(output, '"');
+    const char *newline = strchr(output, '\n');
+    if (!start || (newline && newline < start)) return false;
+    const char *end = strchr(start + 1, '"');
+    if (!end || (size_t)(end - start - 1) >= size) return false;
+    memcpy(version, start + 1, (size_t)(end - start - 1));
+    version[end - start - 1] = '\0';
+    return true;
+}
+
+/**
+ * @brief Starts the fetch in a shell leading its own process group, so the
+ * whole pipeline can be killed at once.
+ *
+ * @return true if the shell was started; check->pid and check->fd are set.
+ */
+static bool start_fetch(kb_update_check_t *check) {
+    int fds[2];
+    if (pipe(fds) != 0) return false;
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        setpgid(0, 0);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        execl("/bin/sh", "sh", "-c", REMOTE_VERSION_COMMAND, (char *)NULL);
+        _exit(127);
+    }
+    /* Also set here so the group exists before anyone may signal it */
+    setpgid(pid, pid);
+    close(fds[1]);
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    check->pid = pid;
+    check->fd = fds[0];
+    return true;
+}
+
+/**
+ * @brief Closes the fetch's output and reaps its shell.
+ *
+ * @param check Check whose fetch to end.
+ * @param kill_group Kill the whole pipeline first, for a fetch that has not
+ * finished.
+ */
+static void end_fetch(kb_update_check_t *check, bool kill_group) {
+    if (check->pid <= 0) return;
+    if (kill_group) kill(-check->pid, SIGKILL);
+    close(check->fd);
+    while (waitpid(check->pid, NULL, 0) < 0 && errno == EINTR) {
+    }
+    check->pid = 0;
+    check->fd = -1;
+}
+
+/**
+ * @brief Cancel function of the check task: kills the fetch and reports
+ * the check as failed.
+ */
+static void cancel_update_check(kb_task_t *task) {
+    kb_update_check_t *check = (kb_update_check_t *)task->arg;
+    end_fetch(check, true);
+    check->remote_version[0] = '\0';
+    check->done(UPDATE_STATUS_ERROR, check->remote_version, check->arg);
+}
+
+/**
+ * @brief Task running an update check: starts the fetch, reads its output
+ * whenever the pipe is readable, then reports.
+ */
+static void run_update_check(kb_task_t *task) {
+    kb_update_check_t *check = (kb_update_check_t *)task->arg;
+    enum UPDATE_STATUS status = UPDATE_STATUS_ERROR;
+
+    KB_TASK_BEGIN(task);
+    check->length = 0;
+    check->remote_version[0] = '\0';
+    check->finished = false;
+    if (start_fetch(check)) {
+        while (check->length < sizeof(check->output) - 1) {
+            KB_TASK_WAIT_FD(task, check->fd, KB_TASK_READ, KB_UPDATE_CHECK_TIMEOUT_NS);
+            if (!task->ready) break;
+            ssize_t n = read(check->fd, check->output + check->length, sizeof(check->output) - 1 - check->length);
+            if (n > 0) {
+                check->length += (size_t)n;
+            } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+                check->finished = n == 0;
+                break;
+            }
+        }
+        check->output[check->length] = '\0';
+        /* A fetch that timed out or filled the buffer would otherwise keep the worker waiting */
+        end_fetch(check, !check->finished);
+        if (parse_remote_version(check->output, check->remote_version, sizeof(check->remote_version))) {
+            status = compare_versions(check->remote_version, KB_VERSION) > 0 ? UPDATE_STATUS_OUTDATED
+                                                                            : UPDATE_STATUS_CORRECT;
+        }
+    }
+    check->done(status, check->remote_version, check->arg);
+    KB_TASK_END(task);
+}
+
+/**
+ * @brief Checks for an update without blocking the caller.
+ */
+void update_check_start(kb_update_check_t *check, kb_update_done_fn done, void *arg) {
+    check->pid = 0;
+    check->fd = -1;
+    check->done = done;
+    check->arg = arg;
+    worker_task_init(&check->task, run_update_check, check);
+    worker_task_on_cancel(&check->task, cancel_update_check);
+    worker_spawn(&check->task);
+}
@@ -6,6 +6,10 @@
  * @brief Defines software versioning and update checking functionality.
  */
 
+#include <stdio.h>
+#include <sys/types.h>
+#include "worker.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -20,6 +24,34 @@ enum UPDATE_STATUS {
     UPDATE_STATUS_ERROR = 2     /**< Error occurred while checking for updates */
 };
 
+/** @brief Longest remote version string kept, including the terminator. */
+#define KB_UPDATE_VERSION_MAX 64
+
+/**
+ * @brief Receives the outcome of an asynchronous update check. Runs on the
+ * worker thread.
+ *
+ * @param status Outcome of the check.
+ * @param remote_version Remote version, empty if it could not be read.
+ * @param arg Argument given to update_check_start().
+ */
+typedef void (*kb_update_done_fn)(enum UPDATE_STATUS status, const char *remote_version, void *arg);
+
+/**
+ * @brief An update check running as a task on the worker.
+ */
+typedef struct {
+    kb_task_t task;                             /**< Runs the check */
+    pid_t pid;                                  /**< Shell running the fetch, leading its own process group; 0 when not running */
+    int fd;                                     /**< Read end of the fetch's output, -1 when not running */
+    char output[256];                           /**< Output read so far */
+    size_t length;                              /**< Bytes of output read */
+    bool finished;                              /**< The fetch closed its output before the check ended it */
+    char remote_version[KB_UPDATE_VERSION_MAX]; /**< Parsed remote version */
+    kb_update_done_fn done;                     /**< Receives the outcome */
+    void *arg;                                  /**< Argument for done */
+} kb_update_check_t;
+
 /**
  * @brief Current version of the software.
  *
@@ -52,6 +84,22 @@ const char *get_remote_version();
  */
 enum UPDATE_STATUS is_update_available();
 
+/**
+ * @brief Checks for an update without blocking the caller.
+ *
+ * The fetch runs as a task on the worker, which reads its output as it
+ * arrives; done is called on the worker thread. If the worker is not
+ * running yet, the check starts when it does. If the task is cancelled or
+ * the worker stops first, the fetch is killed and done reports
+ * UPDATE_STATUS_ERROR on the thread that stopped it.
+ *
+ * @param check Check state; must stay valid until done is called, and may
+ *              not be reused before then.
+ * @param done Receives the outcome.
+ * @param arg Argument for done.
+ */
+void update_check_start(kb_update_check_t *check, kb_update_done_fn done, void *arg);
+
 #ifdef __cplusplus
 }
 #endif
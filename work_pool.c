@@ -0,0 +1,178 @@
+/**
+ * @file work_pool.c
+ * @brief Implementation of the work-stealing thread pool.
+ */
+
+#include "work_pool.h"
+#include "logger.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief A worker's deque: the owner pushes and pops at the bottom,
+ * thieves take from the top.
+ *
+ * Tasks are only pushed before the workers start, so the buffer never
+ * grows.
+ */
+typedef struct {
+    _Alignas(64) atomic_llong top;  /**< Next index to steal */
+    atomic_llong bottom;            /**< One past the owner's next index */
+    size_t capacity;                /**< Buffer size */
+    atomic_size_t *tasks;           /**< Task buffer, indexed modulo capacity */
+} kb_deque_t;
+
+/**
+ * @brief State of one run.
+ */
+typedef struct {
+    kb_deque_t *deques;             /**< One deque per worker */
+    unsigned int threads;           /**< Number of workers */
+    kb_pool_task_t run;             /**< Task function */
+    void *arg;                      /**< Task argument */
+    atomic_size_t remaining;        /**< Tasks not yet finished */
+    atomic_ullong steals;           /**< Successful steals */
+    uint64_t *tasks_run;            /**< Tasks run per worker */
+} kb_pool_t;
+
+/**
+ * @brief Worker argument.
+ */
+typedef struct {
+    kb_pool_t *pool;
+    unsigned int index;
+} kb_pool_worker_t;
+
+static void deque_push(kb_deque_t *d, size_t task) {
+    long long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    atomic_store_explicit(&d->tasks[(size_t)b % d->capacity], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Takes the newest task of the owner's deque.
+ */
+static bool deque_pop(kb_deque_t *d, size_t *task) {
+    long long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    if (t > b) {
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return false;
+    }
+    *task = atomic_load_explicit(&d->tasks[(size_t)b % d->capacity], memory_order_relaxed);
+    if (t < b) return true;
+
+    /* Last task: race the thieves for it */
+    bool won = atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, memory_order_seq_cst,
+                                                       memory_order_relaxed);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    return won;
+}
+
+/**
+ * @brief Takes the oldest task of another worker's deque.
+ */
+static bool deque_steal(kb_deque_t *d, size_t *task) {
+    long long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t >= b) return false;
+
+    *task = atomic_load_explicit(&d->tasks[(size_t)t % d->capacity], memory_order_relaxed);
+    return atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed);
+}
+
+/**
+ * @brief Runs the worker's own tasks, then steals until every task is done.
+ */
+static void *worker_main(void *arg) {
+    kb_pool_worker_t *worker = arg;
+    kb_pool_t *pool = worker->pool;
+    unsigned int self = worker->index;
+    size_t task;
+
+    while (atomic_load_explicit(&pool->remaining, memory_order_acquire) > 0) {
+        bool found = deque_pop(&pool->deques[self], &task);
+        for (unsigned int i = 1; !found && i < pool->threads; i++) {
+            if (deque_steal(&pool->deques[(self + i) % pool->threads], &task)) {
+                atomic_fetch_add_explicit(&pool->steals, 1, memory_order_relaxed);
+                found = true;
+            }
+        }
+        if (!found) {
+            sched_yield();
+            continue;
+        }
+        pool->run(pool->arg, task, self);
+        pool->tasks_run[self]++;
+        atomic_fetch_sub_explicit(&pool->remaining, 1, memory_order_release);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Runs every task across the workers.
+ */
+bool work_pool_run(unsigned int threads, size_t task_count, kb_pool_task_t run, void *arg, kb_pool_stats_t *stats) {
+    if (threads < 1) threads = 1;
+    if (threads > KB_POOL_MAX_THREADS) threads = KB_POOL_MAX_THREADS;
+
+    kb_pool_t pool = {.threads = threads, .run = run, .arg = arg};
+    size_t per_worker = (task_count + threads - 1) / threads;
+    uint64_t tasks_run[KB_POOL_MAX_THREADS] = {0};
+    kb_pool_worker_t workers[KB_POOL_MAX_THREADS];
+    pthread_t handles[KB_POOL_MAX_THREADS];
+    unsigned int started = 1;
+    bool ok = true;
+
+    pool.tasks_run = tasks_run;
+    atomic_init(&pool.remaining, task_count);
+    atomic_init(&pool.steals, 0);
+    pool.deques = aligned_alloc(64, sizeof(kb_deque_t) * threads);
+    if (!pool.deques) return false;
+    memset(pool.deques, 0, sizeof(kb_deque_t) * threads);
+
+    /* Contiguous blocks keep neighbouring tasks (chunks of one file) together */
+    for (unsigned int w = 0; w < threads; w++) {
+        kb_deque_t *d = &pool.deques[w];
+        atomic_init(&d->top, 0);
+        atomic_init(&d->bottom, 0);
+        d->capacity = per_worker ? per_worker : 1;
+        d->tasks = calloc(d->capacity, sizeof(d->tasks[0]));
+        if (!d->tasks) ok = false;
+    }
+    if (ok) {
+        /* Pushed in reverse so each owner pops its block in order */
+        for (unsigned int w = 0; w < threads; w++) {
+            size_t first = (size_t)w * per_worker;
+            size_t last = first + per_worker < task_count ? first + per_worker : task_count;
+            for (size_t t = last; t-- > first;) deque_push(&pool.deques[w], t);
+        }
+        for (unsigned int w = 0; w < threads; w++) workers[w] = (kb_pool_worker_t){&pool, w};
+        for (; started < threads; started++) {
+            if (pthread_create(&handles[started], NULL, worker_main, &workers[started]) != 0) {
+                log_message(KB_LOG_LEVEL_ERROR, "Failed to start worker %u; continuing with %u.", started, started);
+                break;
+            }
+        }
+        /* Workers that failed to start leave their tasks to be stolen */
+        worker_main(&workers[0]);
+        for (unsigned int w = 1; w < started; w++) pthread_join(handles[w], NULL);
+    }
+
+    if (stats) {
+        memset(stats, 0, sizeof(*stats));
+        stats->steals = atomic_load(&pool.steals);
+        memcpy(stats->tasks, tasks_run, sizeof(tasks_run[0]) * threads);
+    }
+    for (unsigned int w = 0; w < threads; w++) free(pool.deques[w].tasks);
+    free(pool.deques);
+    return ok;
+}
@@ -0,0 +1,55 @@
+/**
+ * @file work_pool.h
+ * @brief Work-stealing thread pool for offline batch jobs.
+ *
+ * A run splits a fixed set of tasks, identified by index, across worker
+ * threads. Each worker owns a deque seeded with a contiguous block of tasks
+ * and takes work from its bottom; a worker whose deque is empty steals from
+ * the top of another's, so uneven tasks (short last chunks, small files)
+ * keep every core busy. Deques follow Chase and Lev's algorithm and take no
+ * locks.
+ */
+
+#ifndef WORK_POOL_H
+#define WORK_POOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/** @brief Maximum number of worker threads in a run. */
+#define KB_POOL_MAX_THREADS 256
+
+/**
+ * @brief Runs one task.
+ *
+ * @param arg Argument given to work_pool_run.
+ * @param task Task index.
+ * @param worker Index of the worker running the task, below the thread
+ * count, for per-worker accumulators.
+ */
+typedef void (*kb_pool_task_t)(void *arg, size_t task, unsigned int worker);
+
+/**
+ * @brief Scheduling statistics of a run.
+ */
+typedef struct {
+    uint64_t steals;            /**< Tasks taken from another worker's deque */
+    uint64_t tasks[KB_POOL_MAX_THREADS]; /**< Tasks run by each worker */
+} kb_pool_stats_t;
+
+/**
+ * @brief Runs tasks 0 to task_count - 1 and returns when all have finished.
+ *
+ * The calling thread acts as worker 0.
+ *
+ * @param threads Number of workers (clamped to 1..KB_POOL_MAX_THREADS).
+ * @param task_count Number of tasks.
+ * @param run Task function.
+ * @param arg Argument passed to every call.
+ * @param stats Receives scheduling statistics, may be NULL.
+ * @return false if the deques or threads could not be created.
+ */
+bool work_pool_run(unsigned int threads, size_t task_count, kb_pool_task_t run, void *arg, kb_pool_stats_t *stats);
+
+#endif
@@ -0,0 +1,662 @@
+/**
+ * @file worker.c
+ * @brief Implementation of the worker thread and its event loop.
+ *
+ * Timer callbacks run on the worker thread with the worker lock held. The
+ * lock is recursive so callbacks can arm and cancel timers themselves.
+ * Task steps run on the same thread with the lock released.
+ *
+ * The thread sleeps in epoll_wait or kevent until the earliest deadline, a
+ * descriptor a task waits on, or a byte on the wake pipe, which other
+ * threads write when they change the wheel, queue a task or post one.
+ * Posted tasks sit on a lock-free stack until the worker takes them.
+ *
+ * Under the virtual clock there is no thread: worker_advance() runs the
+ * same loop on the caller's thread, stepping time from one deadline to the
+ * next and polling descriptors without waiting.
+ */
+
+#include "worker.h"
+#include "logger.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#define WORKER_EPOLL 1
+#else
+#include <sys/event.h>
+#endif
+
+/** @brief Resolution of the worker's timer wheel (10 ms). */
+#define WORKER_TICK_NS 10000000ULL
+
+/** @brief Descriptor events handled per wait. */
+#define WORKER_MAX_EVENTS 16
+
+/** @brief Worker lock, protecting the wheel, the task lists and the run flag. */
+static pthread_mutex_t g_lock;
+/** @brief Signaled when a task step returns. */
+static pthread_cond_t g_step_done = PTHREAD_COND_INITIALIZER;
+/** @brief Guards one-time initialization of the lock, the wheel and the poller. */
+static pthread_once_t g_lock_once = PTHREAD_ONCE_INIT;
+/** @brief Worker timer wheel. */
+static kb_timer_wheel_t g_wheel;
+/** @brief epoll or kqueue descriptor. */
+static int g_poll_fd = -1;
+/** @brief Pipe that wakes the worker; read end at 0. */
+static int g_wake_fd[2] = {-1, -1};
+/** @brief A wake byte is in the pipe. */
+static atomic_bool g_wake_pending;
+/** @brief Tasks posted since the worker last looked, newest first. */
+static _Atomic(kb_task_t *) g_posted;
+/** @brief Tasks ready to run, oldest first. */
+static kb_task_t *g_ready_head;
+static kb_task_t *g_ready_tail;
+/** @brief Tasks waiting on a descriptor. */
+static kb_task_t *g_waiting;
+/** @brief Tasks spawned and not yet finished or cancelled. */
+static kb_task_t *g_active;
+/** @brief Task whose step is running, or NULL. */
+static kb_task_t *g_current;
+/** @brief Worker thread handle. */
+static pthread_t g_thread;
+/** @brief Whether the worker thread is running. */
+static bool g_running = false;
+/** @brief Number of worker_start calls not yet matched by worker_stop. */
+static unsigned int g_users = 0;
+/** @brief Whether time is the virtual clock rather than CLOCK_MONOTONIC. */
+static bool g_virtual;
+/** @brief Virtual monotonic time, advanced by worker_advance(). */
+static _Atomic uint64_t g_virtual_now;
+/** @brief Wall-clock time at virtual time 0. */
+static time_t g_virtual_wall;
+
+/**
+ * @brief Returns the monotonic time used for worker deadlines.
+ */
+uint64_t worker_now_ns(void) {
+    if (g_virtual) return atomic_load_explicit(&g_virtual_now, memory_order_relaxed);
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Returns the wall-clock time that goes with worker_now_ns().
+ */
+void worker_wall_time(struct timespec *ts) {
+    if (!g_virtual) {
+        clock_gettime(CLOCK_REALTIME, ts);
+        return;
+    }
+    uint64_t now = worker_now_ns();
+    ts->tv_sec = g_virtual_wall + (time_t)(now / 1000000000ULL);
+    ts->tv_nsec = (long)(now % 1000000000ULL);
+}
+
+/**
+ * @brief Switches the worker to a virtual clock that starts at 0.
+ */
+void worker_use_virtual_clock(time_t wall_start) {
+    g_virtual = true;
+    g_virtual_wall = wall_start;
+    atomic_store_explicit(&g_virtual_now, 0, memory_order_relaxed);
+}
+
+/**
+ * @brief Creates the recursive worker lock, the empty wheel, the poller and
+ * the wake pipe.
+ *
+ * Timers may be armed and tasks spawned before the thread starts; they run
+ * once it does.
+ */
+static void init_lock(void) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&g_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    timer_wheel_init(&g_wheel, WORKER_TICK_NS, worker_now_ns());
+
+#ifdef WORKER_EPOLL
+    g_poll_fd = epoll_create1(EPOLL_CLOEXEC);
+#else
+    g_poll_fd = kqueue();
+#endif
+    if (g_poll_fd < 0 || pipe(g_wake_fd) != 0) {
+        log_message(KB_LOG_LEVEL_ERROR, "Failed to create the worker event loop.");
+        return;
+    }
+    for (int i = 0; i < 2; i++) {
+        fcntl(g_wake_fd[i], F_SETFL, fcntl(g_wake_fd[i], F_GETFL) | O_NONBLOCK);
+        fcntl(g_wake_fd[i], F_SETFD, FD_CLOEXEC);
+    }
+#ifdef WORKER_EPOLL
+    struct epoll_event ev = {.events = EPOLLIN, .data.fd = g_wake_fd[0]};
+    epoll_ctl(g_poll_fd, EPOLL_CTL_ADD, g_wake_fd[0], &ev);
+#else
+    struct kevent ev;
+    EV_SET(&ev, g_wake_fd[0], EVFILT_READ, EV_ADD, 0, 0, NULL);
+    kevent(g_poll_fd, &ev, 1, NULL, 0, NULL);
+#endif
+}
+
+/**
+ * @brief Writes a wake byte unless one is already in the pipe. Needs no lock.
+ */
+static void write_wake(void) {
+    if (atomic_exchange_explicit(&g_wake_pending, true, memory_order_seq_cst)) return;
+    char wake = 0;
+    (void)write(g_wake_fd[1], &wake, 1);
+}
+
+/**
+ * @brief Wakes the worker from its wait. Called with the lock held; a
+ * no-op on the worker thread, which re-checks everything before waiting.
+ */
+static void wake_worker(void) {
+    if (!g_running || pthread_equal(pthread_self(), g_thread)) return;
+    write_wake();
+}
+
+/**
+ * @brief Appends a task to the run queue. Called with the lock held.
+ */
+static void queue_task(kb_task_t *task) {
+    if (task->queued) return;
+    task->queued = true;
+    task->next = NULL;
+    if (g_ready_tail) {
+        g_ready_tail->next = task;
+    } else {
+        g_ready_head = task;
+    }
+    g_ready_tail = task;
+    wake_worker();
+}
+
+/**
+ * @brief Removes a task from the run queue. Called with the lock held.
+ */
+static void unqueue_task(kb_task_t *task) {
+    if (!task->queued) return;
+    kb_task_t *prev = NULL;
+    for (kb_task_t *t = g_ready_head; t; prev = t, t = t->next) {
+        if (t != task) continue;
+        if (prev) {
+            prev->next = t->next;
+        } else {
+            g_ready_head = t->next;
+        }
+        if (g_ready_tail == t) g_ready_tail = prev;
+        break;
+    }
+    task->queued = false;
+}
+
+/**
+ * @brief Marks a task active and adds it to g_active. Called with the lock
+ * held.
+ */
+static void activate_task(kb_task_t *task) {
+    task->active = true;
+    task->next_active = g_active;
+    g_active = task;
+}
+
+/**
+ * @brief Marks a task inactive and removes it from g_active. Called with
+ * the lock held.
+ */
+static void deactivate_task(kb_task_t *task) {
+    if (!task->active) return;
+    for (kb_task_t **link = &g_active; *link; link = &(*link)->next_active) {
+        if (*link == task) {
+            *link = task->next_active;
+            break;
+        }
+    }
+    task->next_active = NULL;
+    task->active = false;
+}
+
+/**
+ * @brief Starts a task, or flags it to start over once it finishes. Called
+ * with the lock held.
+ */
+static void spawn_task(kb_task_t *task) {
+    if (task->active) {
+        task->restart = true;
+    } else {
+        activate_task(task);
+        task->resume = 0;
+        queue_task(task);
+    }
+}
+
+/**
+ * @brief Spawns every posted task. Called with the lock held.
+ *
+ * The posted flag is cleared before spawning, so a task posted again
+ * meanwhile runs once more.
+ */
+static void take_posted(void) {
+    kb_task_t *task = atomic_exchange_explicit(&g_posted, NULL, memory_order_seq_cst);
+    while (task) {
+        kb_task_t *next = task->next_post;
+        task->next_post = NULL;
+        atomic_store_explicit(&task->posted, false, memory_order_release);
+        spawn_task(task);
+        task = next;
+    }
+}
+
+/**
+ * @brief Stops watching a task's descriptor. Called with the lock held.
+ */
+static void unwatch_fd(kb_task_t *task) {
+    if (task->fd < 0) return;
+#ifdef WORKER_EPOLL
+    epoll_ctl(g_poll_fd, EPOLL_CTL_DEL, task->fd, NULL);
+#else
+    /* One-shot filters that fired are already gone; ENOENT is expected */
+    struct kevent ev[2];
+    int n = 0;
+    if (task->events & KB_TASK_READ) EV_SET(&ev[n++], task->fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    if (task->events & KB_TASK_WRITE) EV_SET(&ev[n++], task->fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+    for (int i = 0; i < n; i++) kevent(g_poll_fd, &ev[i], 1, NULL, 0, NULL);
+#endif
+    for (kb_task_t **link = &g_waiting; *link; link = &(*link)->next_wait) {
+        if (*link == task) {
+            *link = task->next_wait;
+            break;
+        }
+    }
+    task->fd = -1;
+    task->events = 0;
+}
+
+/**
+ * @brief Timer callback ending a task's sleep or wait. Runs with the lock held.
+ */
+static void task_timer_expired(kb_timer_t *timer, void *arg) {
+    (void)timer;
+    kb_task_t *task = (kb_task_t *)arg;
+    unwatch_fd(task);
+    task->ready = 0;
+    queue_task(task);
+}
+
+/**
+ * @brief Resumes the task waiting on a descriptor. Called with the lock held.
+ *
+ * Readiness for a descriptor nobody waits on any more (the task was
+ * cancelled while the worker waited) is dropped.
+ */
+static void fd_ready(int fd, unsigned int ready) {
+    for (kb_task_t *task = g_waiting; task; task = task->next_wait) {
+        if (task->fd != fd) continue;
+        task->ready = ready & task->events ? ready & task->events : task->events;
+        timer_wheel_cancel(&g_wheel, &task->timer);
+        unwatch_fd(task);
+        queue_task(task);
+        return;
+    }
+}
+
+/**
+ * @brief Runs every queued task step. Called with the lock held, which is
+ * released around each step.
+ */
+static void run_tasks(void) {
+    while (g_ready_head && g_running) {
+        kb_task_t *task = g_ready_head;
+        g_ready_head = task->next;
+        if (!g_ready_head) g_ready_tail = NULL;
+        task->queued = false;
+
+        g_current = task;
+        pthread_mutex_unlock(&g_lock);
+        task->step(task);
+        pthread_mutex_lock(&g_lock);
+        g_current = NULL;
+
+        if (task->resume == -1) {
+            if (task->restart) {
+                task->restart = false;
+                task->resume = 0;
+                queue_task(task);
+            } else {
+                deactivate_task(task);
+            }
+        }
+        pthread_cond_broadcast(&g_step_done);
+    }
+}
+
+/**
+ * @brief Waits for descriptors, the wake pipe or a deadline. Called with
+ * the lock held, which is released while waiting.
+ */
+static void wait_events(void) {
+    int64_t timeout_ns = -1;
+    uint64_t deadline;
+    if (g_virtual || g_ready_head || atomic_load_explicit(&g_posted, memory_order_seq_cst)) {
+        timeout_ns = 0;
+    } else if (timer_wheel_next_deadline(&g_wheel, &deadline)) {
+        uint64_t now = worker_now_ns();
+        timeout_ns = deadline > now ? (int64_t)(deadline - now) : 0;
+    }
+    pthread_mutex_unlock(&g_lock);
+
+    int fds[WORKER_MAX_EVENTS];
+    unsigned int ready[WORKER_MAX_EVENTS];
+    int n;
+#ifdef WORKER_EPOLL
+    struct epoll_event events[WORKER_MAX_EVENTS];
+    /* Deadlines weeks away overflow an int of milliseconds; waking early is harmless */
+    int64_t timeout_ms = timeout_ns < 0 ? -1 : (timeout_ns + 999999) / 1000000;
+    if (timeout_ms > INT_MAX) timeout_ms = INT_MAX;
+    n = epoll_wait(g_poll_fd, events, WORKER_MAX_EVENTS, (int)timeout_ms);
+    for (int i = 0; i < n; i++) {
+        fds[i] = events[i].data.fd;
+        ready[i] = 0;
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) ready[i] |= KB_TASK_READ;
+        if (events[i].events & (EPOLLOUT | EPOLLERR)) ready[i] |= KB_TASK_WRITE;
+    }
+#else
+    struct kevent events[WORKER_MAX_EVENTS];
+    struct timespec ts = {(time_t)(timeout_ns / 1000000000LL), (long)(timeout_ns % 1000000000LL)};
+    n = kevent(g_poll_fd, NULL, 0, events, WORKER_MAX_EVENTS, timeout_ns < 0 ? NULL : &ts);
+    for (int i = 0; i < n; i++) {
+        fds[i] = (int)events[i].ident;
+        ready[i] = events[i].filter == EVFILT_WRITE ? KB_TASK_WRITE : KB_TASK_READ;
+    }
+#endif
+
+    bool woken = false;
+    for (int i = 0; i < n; i++) woken |= fds[i] == g_wake_fd[0];
+    if (woken) {
+        /* Drain first: a wake written after the drain then finds the flag set and is seen by the next pass */
+        char drain[64];
+        while (read(g_wake_fd[0], drain, sizeof(drain)) > 0) {
+        }
+        atomic_store_explicit(&g_wake_pending, false, memory_order_seq_cst);
+    }
+
+    pthread_mutex_lock(&g_lock);
+    for (int i = 0; i < n; i++) {
+        if (fds[i] != g_wake_fd[0]) fd_ready(fds[i], ready[i]);
+    }
+}
+
+/**
+ * @brief Takes a task off the worker wherever it is and resets it. Called
+ * with the lock held, never for the running task.
+ *
+ * @return Whether the task was active, so its cancel function is due.
+ */
+static bool stop_task(kb_task_t *task) {
+    bool was_active = task->active;
+    unqueue_task(task);
+    unwatch_fd(task);
+    timer_wheel_cancel(&g_wheel, &task->timer);
+    deactivate_task(task);
+    task->restart = false;
+    task->resume = -1;
+    return was_active;
+}
+
+/**
+ * @brief Worker thread: fires expired timers, runs ready tasks and sleeps
+ * until there is more to do.
+ */
+static void *worker_thread_func(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&g_lock);
+    while (g_running) {
+        timer_wheel_advance(&g_wheel, worker_now_ns());
+        take_posted();
+        run_tasks();
+        if (g_running) wait_events();
+    }
+    pthread_mutex_unlock(&g_lock);
+    return NULL;
+}
+
+/**
+ * @brief Acquires the worker, starting its thread for the first user.
+ */
+bool worker_start(void) {
+    pthread_once(&g_lock_once, init_lock);
+    if (g_poll_fd < 0 || g_wake_fd[0] < 0) return false;
+    pthread_mutex_lock(&g_lock);
+    if (g_running) {
+        g_users++;
+        pthread_mutex_unlock(&g_lock);
+        return true;
+    }
+    g_running = true;
+    if (g_virtual) {
+        g_thread = pthread_self();
+    } else if (pthread_create(&g_thread, NULL, worker_thread_func, NULL) != 0) {
+        g_running = false;
+        pthread_mutex_unlock(&g_lock);
+        log_message(KB_LOG_LEVEL_ERROR, "Failed to create worker thread.");
+        return false;
+    }
+    g_users = 1;
+    pthread_mutex_unlock(&g_lock);
+    return true;
+}
+
+/**
+ * @brief Releases the worker, stopping and joining it for the last user.
+ */
+void worker_stop(void) {
+    pthread_once(&g_lock_once, init_lock);
+    pthread_mutex_lock(&g_lock);
+    if (!g_running || --g_users > 0) {
+        pthread_mutex_unlock(&g_lock);
+        return;
+    }
+    g_running = false;
+    write_wake();
+    pthread_mutex_unlock(&g_lock);
+    if (!g_virtual) pthread_join(g_thread, NULL);
+
+    /*
+     * Cancel unfinished tasks so their owners get their descriptors back and
+     * can respawn them after a restart, then drop the remaining timers.
+     */
+    pthread_mutex_lock(&g_lock);
+    take_posted();
+    kb_task_t *cancelled = NULL;
+    while (g_active) {
+        kb_task_t *task = g_active;
+        stop_task(task);
+        task->next_active = cancelled;
+        cancelled = task;
+    }
+    timer_wheel_clear(&g_wheel);
+    pthread_mutex_unlock(&g_lock);
+
+    while (cancelled) {
+        kb_task_t *task = cancelled;
+        cancelled = task->next_active;
+        task->next_active = NULL;
+        if (task->cancel) task->cancel(task);
+    }
+}
+
+/**
+ * @brief Advances the virtual clock, running everything that falls due.
+ */
+void worker_advance(uint64_t delta_ns) {
+    pthread_mutex_lock(&g_lock);
+    uint64_t end = worker_now_ns() + delta_ns;
+    for (;;) {
+        timer_wheel_advance(&g_wheel, worker_now_ns());
+        take_posted();
+        run_tasks();
+        wait_events();
+        if (g_ready_head || atomic_load_explicit(&g_posted, memory_order_seq_cst)) continue;
+
+        if (worker_now_ns() == end) break;
+        /* Deadlines always lie past the wheel's current tick, so time moves on */
+        uint64_t deadline;
+        if (!timer_wheel_next_deadline(&g_wheel, &deadline) || deadline > end) deadline = end;
+        atomic_store_explicit(&g_virtual_now, deadline, memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&g_lock);
+}
+
+/**
+ * @brief Arms a timer on the worker's wheel.
+ */
+void worker_arm(kb_timer_t *timer, uint64_t deadline_ns) {
+    pthread_once(&g_lock_once, init_lock);
+    pthread_mutex_lock(&g_lock);
+    timer_wheel_arm(&g_wheel, timer, deadline_ns);
+    wake_worker();
+    pthread_mutex_unlock(&g_lock);
+}
+
+/**
+ * @brief Disarms a timer on the worker's wheel.
+ */
+void worker_cancel(kb_timer_t *timer) {
+    pthread_once(&g_lock_once, init_lock);
+    pthread_mutex_lock(&g_lock);
+    timer_wheel_cancel(&g_wheel, timer);
+    pthread_mutex_unlock(&g_lock);
+}
+
+/**
+ * @brief Initializes a task.
+ */
+void worker_task_init(kb_task_t *task, kb_task_fn step, void *arg) {
+    task->step = step;
+    task->arg = arg;
+    task->resume = -1;
+    task->fd = -1;
+    task->events = 0;
+    task->ready = 0;
+    timer_init(&task->timer, task_timer_expired, task);
+    task->next = NULL;
+    task->next_wait = NULL;
+    task->next_post = NULL;
+    task->next_active = NULL;
+    task->cancel = NULL;
+    atomic_init(&task->posted, false);
+    task->active = false;
+    task->queued = false;
+    task->restart = false;
+}
+
+/**
+ * @brief Sets the function that releases what a task holds.
+ */
+void worker_task_on_cancel(kb_task_t *task, kb_task_fn cancel) {
+    task->cancel = cancel;
+}
+
+/**
+ * @brief Starts a task from the top, or once more after it finishes.
+ */
+void worker_spawn(kb_task_t *task) {
+    pthread_once(&g_lock_once, init_lock);
+    pthread_mutex_lock(&g_lock);
+    spawn_task(task);
+    pthread_mutex_unlock(&g_lock);
+}
+
+/**
+ * @brief Starts a task from the worker, without taking the lock.
+ *
+ * Pushes the task onto the posted stack; the flag keeps it from being
+ * pushed twice, so the stack needs no protection against reuse.
+ */
+void worker_post(kb_task_t *task) {
+    pthread_once(&g_lock_once, init_lock);
+    if (atomic_exchange_explicit(&task->posted, true, memory_order_acq_rel)) return;
+    kb_task_t *head = atomic_load_explicit(&g_posted, memory_order_relaxed);
+    do {
+        task->next_post = head;
+    } while (!atomic_compare_exchange_weak_explicit(&g_posted, &head, task, memory_order_seq_cst,
+                                                    memory_order_relaxed));
+    write_wake();
+}
+
+/**
+ * @brief Stops a task wherever it is waiting.
+ */
+void worker_task_cancel(kb_task_t *task) {
+    pthread_once(&g_lock_once, init_lock);
+    pthread_mutex_lock(&g_lock);
+    take_posted();
+    while (g_current == task) pthread_cond_wait(&g_step_done, &g_lock);
+    bool was_active = stop_task(task);
+    pthread_mutex_unlock(&g_lock);
+    if (was_active && task->cancel) task->cancel(task);
+}
+
+/**
+ * @brief Queues the running task again.
+ */
+void worker_task_yield(kb_task_t *task) {
+    pthread_mutex_lock(&g_lock);
+    queue_task(task);
+    pthread_mutex_unlock(&g_lock);
+}
+
+/**
+ * @brief Wakes the running task after a delay.
+ */
+void worker_task_sleep(kb_task_t *task, uint64_t delay_ns) {
+    pthread_mutex_lock(&g_lock);
+    timer_wheel_arm(&g_wheel, &task->timer, worker_now_ns() + delay_ns);
+    pthread_mutex_unlock(&g_lock);
+}
+
+/**
+ * @brief Wakes the running task when a descriptor is ready.
+ *
+ * If the descriptor cannot be watched the task resumes at once as if it
+ * were ready, and finds out from its next read or write.
+ */
+void worker_task_wait_fd(kb_task_t *task, int fd, unsigned int events, uint64_t timeout_ns) {
+    pthread_mutex_lock(&g_lock);
+    task->fd = fd;
+    task->events = events;
+    task->next_wait = g_waiting;
+    g_waiting = task;
+
+    bool watched;
+#ifdef WORKER_EPOLL
+    struct epoll_event ev = {.events = EPOLLONESHOT, .data.fd = fd};
+    if (events & KB_TASK_READ) ev.events |= EPOLLIN;
+    if (events & KB_TASK_WRITE) ev.events |= EPOLLOUT;
+    watched = epoll_ctl(g_poll_fd, EPOLL_CTL_ADD, fd, &ev) == 0;
+#else
+    struct kevent ev[2];
+    int n = 0;
+    if (events & KB_TASK_READ) EV_SET(&ev[n++], fd, EVFILT_READ, EV_ADD | EV_ONESHOT, 0, 0, NULL);
+    if (events & KB_TASK_WRITE) EV_SET(&ev[n++], fd, EVFILT_WRITE, EV_ADD | EV_ONESHOT, 0, 0, NULL);
+    watched = kevent(g_poll_fd, ev, n, NULL, 0, NULL) == 0;
+#endif
+    if (!watched) {
+        unwatch_fd(task);
+        task->ready = events;
+        queue_task(task);
+    } else if (timeout_ns) {
+        timer_wheel_arm(&g_wheel, &task->timer, worker_now_ns() + timeout_ns);
+    }
+    pthread_mutex_unlock(&g_lock);
+}
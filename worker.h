@@ -0,0 +1,241 @@
+/**
+ * @file worker.h
+ * @brief Background worker thread: the application's timer wheel and event loop.
+ *
+ * All time-based behavior (timed blocking, the safety watchdog) is expressed
+ * as timers on a single wheel. The worker sleeps until the earliest deadline,
+ * so the event tap never checks timers per event.
+ *
+ * The same thread runs background tasks (settings persistence, update
+ * checks, the metrics socket) as stackless coroutines. A task is a step
+ * function that runs until it has to wait for a descriptor or a delay,
+ * records where to resume and returns; the loop (epoll on Linux, kqueue
+ * elsewhere) calls it again once the wait is over. Tasks keep their state
+ * in their own structures, never in locals across a wait, and run without
+ * the worker lock held, so a slow step never delays worker_arm.
+ *
+ * The event tap never takes the worker lock: it hands work over with
+ * worker_post(), which only sets flags and writes to the wake pipe.
+ */
+
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include "timer_wheel.h"
+
+/** @brief Task waits for the descriptor to become readable. */
+#define KB_TASK_READ 1
+/** @brief Task waits for the descriptor to become writable. */
+#define KB_TASK_WRITE 2
+
+struct kb_task;
+
+/**
+ * @brief Runs a task up to its next wait or its end.
+ *
+ * @param task The task; its arg is the argument given to worker_task_init().
+ */
+typedef void (*kb_task_fn)(struct kb_task *task);
+
+/**
+ * @brief A stackless coroutine on the worker. Owned by the caller, never
+ * allocated by the worker.
+ */
+typedef struct kb_task {
+    kb_task_fn step;            /**< Step function */
+    void *arg;                  /**< Step argument */
+    int resume;                 /**< Line to resume at, 0 to start, -1 once finished */
+    int fd;                     /**< Descriptor waited on, -1 if none */
+    unsigned int events;        /**< KB_TASK_READ/KB_TASK_WRITE waited for */
+    unsigned int ready;         /**< Events that ended the last wait, 0 if it timed out */
+    kb_timer_t timer;           /**< Sleep and wait deadline */
+    struct kb_task *next;       /**< Next task in the run queue */
+    struct kb_task *next_wait;  /**< Next task waiting on a descriptor */
+    struct kb_task *next_post;  /**< Next task posted since the worker last looked */
+    struct kb_task *next_active; /**< Next active task */
+    kb_task_fn cancel;          /**< Releases what the task holds if stopped early, NULL if nothing */
+    atomic_bool posted;         /**< Posted and not yet spawned by the worker */
+    bool active;                /**< Spawned and not yet finished */
+    bool queued;                /**< In the run queue */
+    bool restart;               /**< Spawned again while active */
+} kb_task_t;
+
+/**
+ * @brief Starts a task body. Use once, at the top of the step function.
+ */
+#define KB_TASK_BEGIN(task) switch ((task)->resume) { case 0:
+
+/**
+ * @brief Returns from the step and resumes here on the next one. Only
+ * after arranging to be woken; use at most one task macro per line.
+ */
+#define KB_TASK_SUSPEND(task) do { (task)->resume = __LINE__; return; case __LINE__:; } while (0)
+
+/**
+ * @brief Lets other tasks and timers run, then continues.
+ */
+#define KB_TASK_YIELD(task) do { worker_task_yield(task); KB_TASK_SUSPEND(task); } while (0)
+
+/**
+ * @brief Continues after a delay, at the wheel's 10 ms resolution.
+ */
+#define KB_TASK_SLEEP(task, delay_ns) do { worker_task_sleep(task, delay_ns); KB_TASK_SUSPEND(task); } while (0)
+
+/**
+ * @brief Continues once a descriptor is ready or the timeout passes; check
+ * (task)->ready to tell which.
+ */
+#define KB_TASK_WAIT_FD(task, fd, events, timeout_ns) \
+    do { worker_task_wait_fd(task, fd, events, timeout_ns); KB_TASK_SUSPEND(task); } while (0)
+
+/**
+ * @brief Ends a task body. The task finishes when it gets here.
+ */
+#define KB_TASK_END(task) } (task)->resume = -1
+
+/**
+ * @brief Acquires the worker, starting its thread for the first user.
+ *
+ * @return True on success.
+ */
+bool worker_start(void);
+
+/**
+ * @brief Releases the worker. The last user stops and joins the thread;
+ * armed timers are then discarded and unfinished tasks cancelled as by
+ * worker_task_cancel(), so they can be spawned again after a restart.
+ */
+void worker_stop(void);
+
+/**
+ * @brief Returns the monotonic time used for worker deadlines.
+ *
+ * @return Current time in nanoseconds.
+ */
+uint64_t worker_now_ns(void);
+
+/**
+ * @brief Returns the wall-clock time that goes with worker_now_ns(), for
+ * code that works on local time (the schedule).
+ *
+ * @param ts Receives the time.
+ */
+void worker_wall_time(struct timespec *ts);
+
+/**
+ * @brief Switches the worker to a virtual clock, for tests. Call before
+ * the first worker_start().
+ *
+ * The worker then runs no thread: time stands still and nothing runs
+ * until worker_advance() is called, which runs timers, tasks and ready
+ * descriptors on the caller's thread.
+ *
+ * @param wall_start Wall-clock time at which the virtual clock starts.
+ */
+void worker_use_virtual_clock(time_t wall_start);
+
+/**
+ * @brief Advances the virtual clock, stopping at every deadline on the way
+ * to fire its timers and run the tasks they wake. Descriptors are polled
+ * without waiting.
+ *
+ * @param delta_ns Time to advance by.
+ */
+void worker_advance(uint64_t delta_ns);
+
+/**
+ * @brief Arms a timer on the worker's wheel. Safe to call from any thread,
+ * including from timer callbacks.
+ *
+ * @param timer Timer to arm.
+ * @param deadline_ns Absolute expiry time, in worker_now_ns() time.
+ */
+void worker_arm(kb_timer_t *timer, uint64_t deadline_ns);
+
+/**
+ * @brief Disarms a timer on the worker's wheel. Safe to call from any thread.
+ *
+ * @param timer Timer to disarm.
+ */
+void worker_cancel(kb_timer_t *timer);
+
+/**
+ * @brief Initializes a task.
+ *
+ * @param task Task to initialize.
+ * @param step Step function.
+ * @param arg Step argument.
+ */
+void worker_task_init(kb_task_t *task, kb_task_fn step, void *arg);
+
+/**
+ * @brief Sets the function that releases what a task holds (descriptors,
+ * child processes) and reports its outcome when it is stopped before it
+ * finishes. Set it after worker_task_init().
+ *
+ * The function runs on the thread that cancels, after the task has left
+ * the worker, and only for a task that was active.
+ *
+ * @param task Initialized task.
+ * @param cancel Cancel function, or NULL for none.
+ */
+void worker_task_on_cancel(kb_task_t *task, kb_task_fn cancel);
+
+/**
+ * @brief Starts a task from the top. Safe to call from any thread; does
+ * not allocate.
+ *
+ * A task that is already active is not interrupted: it starts over once
+ * it finishes, however many times it was spawned meanwhile.
+ *
+ * @param task Initialized task.
+ */
+void worker_spawn(kb_task_t *task);
+
+/**
+ * @brief Starts a task like worker_spawn() without taking the worker lock.
+ * Safe to call from any thread, including the event tap: it never blocks
+ * or allocates.
+ *
+ * The task goes on a lock-free list and the worker is woken through its
+ * pipe; the worker spawns it when it next looks. Posting a task that is
+ * already posted does nothing. Stop posting a task before cancelling it.
+ *
+ * @param task Initialized task.
+ */
+void worker_post(kb_task_t *task);
+
+/**
+ * @brief Stops a task wherever it is waiting, or before it runs if it was
+ * posted. Safe to call from any thread but the task's own step; waits for
+ * a step in progress to return.
+ *
+ * The task's descriptors stay open; closing them is up to its cancel
+ * function (worker_task_on_cancel()) or the owner.
+ *
+ * @param task Task to stop.
+ */
+void worker_task_cancel(kb_task_t *task);
+
+/** @brief Queues the running task again. Used by KB_TASK_YIELD. */
+void worker_task_yield(kb_task_t *task);
+
+/** @brief Wakes the running task after a delay. Used by KB_TASK_SLEEP. */
+void worker_task_sleep(kb_task_t *task, uint64_t delay_ns);
+
+/**
+ * @brief Wakes the running task when a descriptor is ready. Used by
+ * KB_TASK_WAIT_FD.
+ *
+ * @param task Running task.
+ * @param fd Descriptor to watch.
+ * @param events KB_TASK_READ and/or KB_TASK_WRITE.
+ * @param timeout_ns Longest wait, 0 for none.
+ */
+void worker_task_wait_fd(kb_task_t *task, int fd, unsigned int events, uint64_t timeout_ns);
+
+#endif
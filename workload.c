@@ -0,0 +1,461 @@
+/**
+ * @file workload.c
+ * @brief Implementation of the synthetic keyboard event streams.
+ *
+ * Every model is a gesture function: it schedules the events of one gesture
+ * (a keystroke, a chord, a burst of paws) at or after the generator clock
+ * and advances the clock to the start of the next gesture. Gestures may
+ * overlap, as rolled-over keystrokes do, so events are returned from the
+ * pending set in timestamp order.
+ */
+
+#include "workload.h"
+#include "media_keys.h"
+#include <string.h>
+
+#define FLAG_SHIFT   0x00020000ULL
+#define FLAG_CONTROL 0x00040000ULL
+#define FLAG_OPTION  0x00080000ULL
+#define FLAG_COMMAND 0x00100000ULL
+
+#define KEY_RETURN 36
+#define KEY_TAB 48
+#define KEY_SPACE 49
+#define KEY_DELETE 51
+#define KEY_COMMAND 55
+#define KEY_SHIFT 56
+#define KEY_OPTION 58
+#define KEY_CONTROL 59
+
+#define MS(x) ((uint64_t)(x) * 1000000ULL)
+#define US(x) ((uint64_t)(x) * 1000ULL)
+
+/** @brief Delay before a held key starts repeating. */
+#define REPEAT_DELAY MS(500)
+
+/** @brief Interval between auto-repeated key downs. */
+#define REPEAT_INTERVAL MS(33)
+
+/**
+ * @brief A letter key with the finger that types it and its English
+ * frequency (per mille).
+ *
+ * Fingers 0-3 are the left pinky to index, 4-7 the right index to pinky.
+ */
+typedef struct {
+    unsigned short key;
+    unsigned char finger;
+    unsigned short weight;
+} letter_t;
+
+static const letter_t letters[] = {
+    {14, 2, 127}, {17, 3, 91}, {0, 0, 82},  {31, 6, 75}, {34, 5, 70}, {45, 4, 67}, {1, 1, 63},
+    {4, 4, 61},   {15, 3, 60}, {2, 2, 43},  {37, 6, 40}, {8, 2, 28},  {32, 4, 28}, {46, 4, 24},
+    {13, 1, 24},  {3, 3, 22},  {5, 3, 20},  {16, 4, 20}, {35, 7, 19}, {11, 3, 15}, {9, 3, 10},
+    {40, 5, 8},   {7, 1, 2},   {38, 4, 2},  {12, 0, 1},  {6, 0, 1},
+};
+
+#define LETTER_COUNT (sizeof(letters) / sizeof(letters[0]))
+
+/** @brief Finger recorded for keys outside the letter table (thumbs, Delete). */
+#define FINGER_OTHER 8
+
+/** @brief Letter rows of the keyboard, for bursts of neighbouring keys. */
+static const unsigned short keyboard_rows[3][10] = {
+    {12, 13, 14, 15, 17, 16, 32, 34, 31, 35},
+    {0, 1, 2, 3, 5, 4, 38, 40, 37, 41},
+    {6, 7, 8, 9, 11, 45, 46, 43, 47, 44},
+};
+
+static const struct {
+    unsigned short key;
+    unsigned long long flag;
+} modifier_keys[] = {
+    {KEY_COMMAND, FLAG_COMMAND}, {KEY_SHIFT, FLAG_SHIFT}, {KEY_OPTION, FLAG_OPTION}, {KEY_CONTROL, FLAG_CONTROL},
+};
+
+static const char *const model_names[KB_WORKLOAD_MODEL_COUNT] = {
+    [KB_WORKLOAD_UNIFORM] = "uniform", [KB_WORKLOAD_TYPING] = "typing", [KB_WORKLOAD_REPEAT] = "repeat",
+    [KB_WORKLOAD_CHORDS] = "chords",   [KB_WORKLOAD_MASH] = "mash",     [KB_WORKLOAD_FLOOD] = "flood",
+    [KB_WORKLOAD_MIX] = "mix",
+};
+
+/**
+ * @brief Returns a uniformly distributed value in [low, high].
+ */
+static uint64_t between(kb_workload_t *w, uint64_t low, uint64_t high) {
+    return low + workload_random(&w->random) % (high - low + 1);
+}
+
+/**
+ * @brief Returns true with the given probability in percent.
+ */
+static bool chance(kb_workload_t *w, unsigned int percent) {
+    return workload_random(&w->random) % 100 < percent;
+}
+
+/**
+ * @brief Returns a duration around mean, spread by +/-40% with a bell-shaped
+ * distribution (sum of three uniforms).
+ */
+static uint64_t around(kb_workload_t *w, uint64_t mean) {
+    uint64_t spread = mean * 4 / 10;
+    uint64_t sum = between(w, 0, 2 * spread) + between(w, 0, 2 * spread) + between(w, 0, 2 * spread);
+    return mean - spread + sum / 3;
+}
+
+/**
+ * @brief Adds an event to the pending set. Events beyond the capacity are
+ * dropped; gestures are sized so this does not happen.
+ */
+static void schedule(kb_workload_t *w, kb_event_type_t type, unsigned short key, unsigned long long flags,
+                     uint64_t timestamp, bool autorepeat) {
+    if (w->pending_count >= KB_WORKLOAD_PENDING) return;
+    kb_event_t *event = &w->pending[w->pending_count++];
+    event->type = type;
+    event->key_code = key;
+    event->flags = flags;
+    event->device = w->device;
+    event->timestamp = timestamp;
+    event->autorepeat = autorepeat;
+}
+
+/**
+ * @brief Schedules a key held from down to up, with auto-repeat if held
+ * past the repeat delay.
+ *
+ * A key that is still held at the requested time is pressed shortly after
+ * its release instead.
+ *
+ * @return Time of the key down.
+ */
+static uint64_t keystroke(kb_workload_t *w, unsigned short key, unsigned long long flags, uint64_t down,
+                          uint64_t hold) {
+    if (key < KB_KEY_COUNT && down <= w->released[key]) down = w->released[key] + around(w, MS(30));
+    schedule(w, KB_EVENT_KEY_DOWN, key, flags, down, false);
+    for (uint64_t t = REPEAT_DELAY; t < hold; t += REPEAT_INTERVAL) {
+        schedule(w, KB_EVENT_KEY_DOWN, key, flags, down + t, true);
+    }
+    schedule(w, KB_EVENT_KEY_UP, key, flags, down + hold, false);
+    if (key < KB_KEY_COUNT) w->released[key] = down + hold;
+    return down;
+}
+
+/**
+ * @brief One independent random event, drawn to reach every engine decision
+ * path rather than to look like real input.
+ */
+static void gesture_uniform(kb_workload_t *w) {
+    static const unsigned int devices[] = {40, 41, 58, 59, 300};
+    uint64_t r = workload_random(&w->random);
+    unsigned int pick = r % 100;
+    kb_event_t *event;
+
+    if (w->pending_count >= KB_WORKLOAD_PENDING) return;
+    w->clock += (r >> 8) % MS(50);
+    event = &w->pending[w->pending_count++];
+    event->timestamp = w->clock;
+    event->device = devices[(r >> 32) % (sizeof(devices) / sizeof(devices[0]))];
+    event->flags = 0;
+    uint64_t modifiers = workload_random(&w->random);
+    for (int m = 0; m < 4; m++) {
+        if (((modifiers >> (3 * m)) & 7) == 0) event->flags |= modifier_keys[m].flag;
+    }
+    event->autorepeat = false;
+
+    if (pick < 45) {
+        event->type = KB_EVENT_KEY_DOWN;
+        event->key_code = (unsigned short)((r >> 48) % KB_KEY_MEDIA_BASE);
+        event->autorepeat = ((r >> 56) & 7) == 0;
+    } else if (pick < 85) {
+        event->type = KB_EVENT_KEY_UP;
+        event->key_code = (unsigned short)((r >> 48) % KB_KEY_MEDIA_BASE);
+    } else if (pick < 92) {
+        event->type = KB_EVENT_FLAGS_CHANGED;
+        event->key_code = (unsigned short)(54 + (r >> 48) % 8);
+    } else if (pick < 98) {
+        event->type = KB_EVENT_SYSTEM_DEFINED;
+        event->key_code = (unsigned short)(KB_KEY_MEDIA_BASE + (r >> 48) % KB_MEDIA_KEY_COUNT);
+    } else {
+        event->type = KB_EVENT_OTHER;
+        event->key_code = KB_KEY_NONE;
+    }
+}
+
+/**
+ * @brief Picks a letter by English frequency.
+ */
+static const letter_t *pick_letter(kb_workload_t *w) {
+    unsigned int total = 0;
+    for (size_t i = 0; i < LETTER_COUNT; i++) total += letters[i].weight;
+    unsigned int target = (unsigned int)between(w, 0, total - 1);
+    for (size_t i = 0; i < LETTER_COUNT; i++) {
+        if (target < letters[i].weight) return &letters[i];
+        target -= letters[i].weight;
+    }
+    return &letters[0];
+}
+
+/**
+ * @brief Returns the finger that types a key.
+ */
+static unsigned int finger_of(unsigned short key) {
+    for (size_t i = 0; i < LETTER_COUNT; i++) {
+        if (letters[i].key == key) return letters[i].finger;
+    }
+    return FINGER_OTHER;
+}
+
+/**
+ * @brief Mean interval between two keystrokes: slowest on the same finger,
+ * fastest when the hands alternate.
+ */
+static uint64_t bigram_interval(unsigned short previous, unsigned short next) {
+    unsigned int a = finger_of(previous), b = finger_of(next);
+    if (previous == next) return MS(150);
+    if (a == FINGER_OTHER || b == FINGER_OTHER) return MS(130);
+    if (a == b) return MS(175);
+    if ((a < 4) == (b < 4)) return MS(135);
+    return MS(100);
+}
+
+/**
+ * @brief One keystroke of running text: a letter, a space between words,
+ * a typo and its correction, a capital or an occasional volume key.
+ */
+static void gesture_typing(kb_workload_t *w) {
+    uint64_t start = w->clock;
+    unsigned short key;
+    unsigned long long flags = 0;
+
+    /* Volume up or down, about once every 300 keystrokes */
+    if (between(w, 0, 999) < 3) {
+        keystroke(w, (unsigned short)(KB_KEY_MEDIA_BASE + between(w, 0, 1)), 0, start, around(w, MS(90)));
+        w->clock = start + around(w, MS(600));
+        return;
+    }
+
+    if (w->correcting) {
+        key = KEY_DELETE;
+        w->correcting = false;
+    } else if (w->word_left == 0) {
+        key = chance(w, 5) ? KEY_RETURN : KEY_SPACE;
+        w->word_left = (unsigned int)between(w, 1, 9);
+    } else {
+        const letter_t *letter = pick_letter(w);
+        key = letter->key;
+        w->correcting = chance(w, 2);
+        w->word_left--;
+        if (w->previous_key == KEY_SPACE || w->previous_key == KEY_RETURN) flags = chance(w, 8) ? FLAG_SHIFT : 0;
+    }
+
+    uint64_t hold = around(w, MS(95));
+    if (flags) {
+        uint64_t lead = around(w, MS(45));
+        schedule(w, KB_EVENT_FLAGS_CHANGED, KEY_SHIFT, FLAG_SHIFT, start, false);
+        start = keystroke(w, key, flags, start + lead, hold);
+        schedule(w, KB_EVENT_FLAGS_CHANGED, KEY_SHIFT, 0, start + hold + around(w, MS(30)), false);
+    } else {
+        start = keystroke(w, key, 0, start, hold);
+    }
+
+    uint64_t next = around(w, bigram_interval(w->previous_key, key));
+    if (key == KEY_SPACE && chance(w, 3)) next += between(w, MS(400), MS(2500));
+    if (key == KEY_RETURN) next += between(w, MS(300), MS(1500));
+    w->previous_key = key;
+    w->clock = start + next;
+}
+
+/**
+ * @brief A key held long enough to auto-repeat: arrows, Delete, Space or a
+ * letter.
+ */
+static void gesture_repeat(kb_workload_t *w) {
+    static const unsigned short held[] = {123, 124, 125, 126, KEY_DELETE, KEY_SPACE};
+    unsigned short key = chance(w, 70) ? held[between(w, 0, sizeof(held) / sizeof(held[0]) - 1)]
+                                       : pick_letter(w)->key;
+    uint64_t hold = between(w, MS(400), MS(2400));
+
+    keystroke(w, key, 0, w->clock, hold);
+    w->clock += hold + between(w, MS(150), MS(900));
+}
+
+/**
+ * @brief A modifier chord: modifiers pressed one by one (FlagsChanged), one
+ * to three keys tapped, modifiers released in reverse order.
+ */
+static void gesture_chords(kb_workload_t *w) {
+    static const unsigned short chord_keys[] = {8, 9, 7, 6, 1, 17, 13, 12, 45, 3, KEY_TAB};
+    size_t order[4];
+    size_t count = 0;
+    unsigned long long flags = 0;
+    uint64_t t = w->clock;
+
+    unsigned int first = (unsigned int)between(w, 0, 9);
+    order[count++] = first < 6 ? 0 : first < 8 ? 3 : 2;
+    if (chance(w, 30)) order[count++] = 1;
+    if (order[0] != 2 && chance(w, 10)) order[count++] = 2;
+
+    for (size_t i = 0; i < count; i++) {
+        flags |= modifier_keys[order[i]].flag;
+        schedule(w, KB_EVENT_FLAGS_CHANGED, modifier_keys[order[i]].key, flags, t, false);
+        t += between(w, MS(20), MS(60));
+    }
+    unsigned int taps = (unsigned int)between(w, 1, 3);
+    for (unsigned int i = 0; i < taps; i++) {
+        uint64_t hold = around(w, MS(80));
+        unsigned short key = chord_keys[between(w, 0, sizeof(chord_keys) / sizeof(chord_keys[0]) - 1)];
+        t = keystroke(w, key, flags, t, hold) + hold + between(w, MS(40), MS(200));
+    }
+    for (size_t i = count; i-- > 0;) {
+        flags &= ~modifier_keys[order[i]].flag;
+        schedule(w, KB_EVENT_FLAGS_CHANGED, modifier_keys[order[i]].key, flags, t, false);
+        t += between(w, MS(10), MS(40));
+    }
+    w->clock = t + between(w, MS(300), MS(1500));
+}
+
+/**
+ * @brief A burst of neighbouring keys pressed almost at once, as under a
+ * paw, sometimes held long enough to repeat.
+ */
+static void gesture_mash(kb_workload_t *w) {
+    uint64_t used[2] = {0, 0};
+    unsigned int row = (unsigned int)between(w, 0, 2), column = (unsigned int)between(w, 0, 9);
+    unsigned int keys = (unsigned int)between(w, 4, 16), long_holds = 0;
+    uint64_t t = w->clock, end = t;
+
+    for (unsigned int i = 0; i < keys; i++) {
+        int r = (int)row + (int)between(w, 0, 2) - 1;
+        int c = (int)column + (int)between(w, 0, 4) - 2;
+        if (r < 0 || r > 2 || c < 0 || c > 9) continue;
+        unsigned short key = keyboard_rows[r][c];
+        if (i == 0 && chance(w, 10)) key = KEY_SPACE;
+        if ((used[key >> 6] >> (key & 63)) & 1) continue;
+        used[key >> 6] |= 1ULL << (key & 63);
+
+        uint64_t hold = between(w, MS(15), MS(250));
+        if (long_holds < 2 && chance(w, 10)) {
+            hold = between(w, MS(600), MS(1500));
+            long_holds++;
+        }
+        uint64_t down = keystroke(w, key, 0, t, hold);
+        if (down + hold > end) end = down + hold;
+        t += between(w, 1, MS(25));
+    }
+    if (end == w->clock) end++;
+    w->clock = end + between(w, MS(80), MS(600));
+}
+
+/**
+ * @brief One press and release at 10 kHz, with the occasional media key or
+ * undecodable system-defined event.
+ */
+static void gesture_flood(kb_workload_t *w) {
+    unsigned int pick = (unsigned int)between(w, 0, 99);
+    uint64_t t = w->clock;
+
+    if (pick < 2) {
+        schedule(w, KB_EVENT_SYSTEM_DEFINED, KB_KEY_NONE, 0, t, false);
+    } else {
+        unsigned short key = pick < 5 ? (unsigned short)(KB_KEY_MEDIA_BASE + between(w, 0, KB_MEDIA_KEY_COUNT - 1))
+                                      : (unsigned short)between(w, 0, KB_KEY_MEDIA_BASE - 1);
+        schedule(w, KB_EVENT_KEY_DOWN, key, 0, t, chance(w, 20));
+        schedule(w, KB_EVENT_KEY_UP, key, 0, t + US(100), false);
+    }
+    w->clock = t + US(200);
+}
+
+/**
+ * @brief Chooses the model of the next mix segment and its length.
+ */
+static void next_segment(kb_workload_t *w) {
+    unsigned int pick = (unsigned int)between(w, 0, 99);
+    if (pick < 50) {
+        w->current = KB_WORKLOAD_TYPING;
+    } else if (pick < 65) {
+        w->current = KB_WORKLOAD_CHORDS;
+    } else if (pick < 80) {
+        w->current = KB_WORKLOAD_REPEAT;
+    } else if (pick < 95) {
+        w->current = KB_WORKLOAD_MASH;
+    } else {
+        w->current = KB_WORKLOAD_FLOOD;
+    }
+    w->segment_end = w->clock + (w->current == KB_WORKLOAD_FLOOD ? between(w, MS(100), MS(500))
+                                                                 : between(w, MS(5000), MS(30000)));
+}
+
+/**
+ * @brief Schedules the next gesture of the stream.
+ */
+static void gesture(kb_workload_t *w) {
+    if (w->model == KB_WORKLOAD_MIX && w->clock >= w->segment_end) next_segment(w);
+    switch (w->current) {
+        case KB_WORKLOAD_TYPING: gesture_typing(w); break;
+        case KB_WORKLOAD_REPEAT: gesture_repeat(w); break;
+        case KB_WORKLOAD_CHORDS: gesture_chords(w); break;
+        case KB_WORKLOAD_MASH: gesture_mash(w); break;
+        case KB_WORKLOAD_FLOOD: gesture_flood(w); break;
+        default: gesture_uniform(w); break;
+    }
+}
+
+/**
+ * @brief Starts a stream.
+ */
+void workload_init(kb_workload_t *workload, kb_workload_model_t model, uint64_t seed, unsigned int device) {
+    memset(workload, 0, sizeof(*workload));
+    workload->model = model;
+    workload->current = model;
+    workload->random = seed ? seed : 1;
+    workload->device = device;
+    workload->word_left = 4;
+    workload->previous_key = KEY_SPACE;
+}
+
+/**
+ * @brief Produces the next events of a stream.
+ *
+ * A gesture is scheduled whenever the earliest pending event lies beyond
+ * the clock: no later gesture can then produce an earlier event, so the
+ * earliest pending event is safe to return.
+ */
+void workload_generate(kb_workload_t *workload, kb_event_t *events, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        size_t earliest = 0;
+        for (;;) {
+            for (size_t j = 1; j < workload->pending_count; j++) {
+                if (workload->pending[j].timestamp < workload->pending[earliest].timestamp) earliest = j;
+            }
+            if (workload->pending_count && workload->pending[earliest].timestamp <= workload->clock) break;
+            gesture(workload);
+            earliest = 0;
+        }
+        events[i] = workload->pending[earliest];
+        /* Shift rather than swap so events with equal timestamps keep their order */
+        memmove(&workload->pending[earliest], &workload->pending[earliest + 1],
+                (workload->pending_count - earliest - 1) * sizeof(workload->pending[0]));
+        workload->pending_count--;
+    }
+}
+
+/**
+ * @brief Returns the name of a model.
+ */
+const char *workload_model_name(kb_workload_model_t model) {
+    return (unsigned int)model < KB_WORKLOAD_MODEL_COUNT ? model_names[model] : "unknown";
+}
+
+/**
+ * @brief Parses a model name.
+ */
+bool workload_parse_model(const char *name, kb_workload_model_t *model) {
+    for (int i = 0; i < KB_WORKLOAD_MODEL_COUNT; i++) {
+        if (strcmp(name, model_names[i]) == 0) {
+            *model = (kb_workload_model_t)i;
+            return true;
+        }
+    }
+    return false;
+}
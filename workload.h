@@ -0,0 +1,103 @@
+/**
+ * @file workload.h
+ * @brief Synthetic keyboard event streams for benchmarks and soak tests.
+ *
+ * Each model produces the decoded events the event tap would see for a
+ * kind of input: key downs and ups, FlagsChanged events for modifiers,
+ * media keys decoded from system-defined events, and auto-repeat. Streams
+ * are in timestamp order and fully determined by the model and the seed.
+ */
+
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "engine.h"
+
+/** @brief Maximum number of scheduled events not yet returned. */
+#define KB_WORKLOAD_PENDING 512
+
+/**
+ * @brief Kinds of generated input.
+ */
+typedef enum {
+    KB_WORKLOAD_UNIFORM = 0,    /**< Independent random events covering every decision path */
+    KB_WORKLOAD_TYPING,         /**< Human typing with bigram timing, capitals and typos */
+    KB_WORKLOAD_REPEAT,         /**< Held keys producing auto-repeat */
+    KB_WORKLOAD_CHORDS,         /**< Modifier chords such as Command-Shift-Z */
+    KB_WORKLOAD_MASH,           /**< A pet walking on the keyboard: bursts of neighbouring keys */
+    KB_WORKLOAD_FLOOD,          /**< Pathological 10 kHz stream from a broken or malicious device */
+    KB_WORKLOAD_MIX,            /**< Segments of every model above except uniform */
+    KB_WORKLOAD_MODEL_COUNT
+} kb_workload_model_t;
+
+/**
+ * @brief Generator state.
+ */
+typedef struct {
+    kb_workload_model_t model;              /**< Configured model */
+    kb_workload_model_t current;            /**< Model of the current segment (differs from model for mix) */
+    uint64_t random;                        /**< Random state */
+    uint64_t clock;                         /**< Start of the next gesture, in nanoseconds */
+    uint64_t segment_end;                   /**< End of the current mix segment */
+    unsigned int device;                    /**< Keyboard type of generated events */
+    unsigned short previous_key;            /**< Last typed key, for bigram timing */
+    unsigned int word_left;                 /**< Letters left in the current word */
+    bool correcting;                        /**< A typo was typed; the next key is Delete */
+    uint64_t released[KB_KEY_COUNT];        /**< Time each key is released, so it is not pressed while held */
+    size_t pending_count;                   /**< Number of scheduled events */
+    kb_event_t pending[KB_WORKLOAD_PENDING]; /**< Scheduled events, unordered */
+} kb_workload_t;
+
+/**
+ * @brief Returns the next value of a xorshift64* generator.
+ *
+ * @param state Generator state, never 0.
+ */
+static inline uint64_t workload_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * @brief Starts a stream.
+ *
+ * @param workload Generator to initialize.
+ * @param model Kind of input.
+ * @param seed Seed; the same model, seed and device give the same stream.
+ * @param device Keyboard type of generated events (the uniform model picks
+ * its own).
+ */
+void workload_init(kb_workload_t *workload, kb_workload_model_t model, uint64_t seed, unsigned int device);
+
+/**
+ * @brief Produces the next events of a stream.
+ *
+ * @param workload Generator.
+ * @param events Receives the events, in timestamp order.
+ * @param count Number of events to produce.
+ */
+void workload_generate(kb_workload_t *workload, kb_event_t *events, size_t count);
+
+/**
+ * @brief Returns the name of a model, as accepted by workload_parse_model.
+ */
+const char *workload_model_name(kb_workload_model_t model);
+
+/**
+ * @brief Parses a model name.
+ *
+ * @param name Model name ("uniform", "typing", "repeat", "chords", "mash",
+ * "flood" or "mix").
+ * @param model Output for the parsed model.
+ * @return True if the name was recognized.
+ */
+bool workload_parse_model(const char *name, kb_workload_model_t *model);
+
+#endif